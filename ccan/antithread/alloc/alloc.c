@@ -844,6 +844,266 @@ unsigned long alloc_size(void *pool, unsigned long poolsize, void *p)
 	return bucket_to_size(ph->bucket);
 }
 
+/* Every cached block starts with this, so it can find its way home. */
+struct cache_block {
+	/* Offset of the owner's remote free list within the pool. */
+	unsigned long owner;
+	/* Bucket it was sized for, or NO_CACHE_BUCKET. */
+	unsigned long bucket;
+};
+
+/* While a block is free, its first word links it into a list. */
+union cache_link {
+	/* Cache-local lists use pointers... */
+	void *next;
+	/* ...remote lists are shared, so use offsets. */
+	unsigned long next_off;
+};
+
+#define CACHE_BUCKETS 48
+#define NO_CACHE_BUCKET -1UL
+/* Remote free list value once the owner has gone. */
+#define CACHE_OWNER_DEAD 1UL
+/* Move at most this many bytes to or from the pool at once. */
+#define CACHE_BATCH_BYTES 16384
+#define CACHE_BATCH_MAX 32
+
+struct alloc_cache {
+	void *pool;
+	unsigned long poolsize;
+	void (*lock)(void *arg);
+	void (*unlock)(void *arg);
+	void *arg;
+	/* In the pool: others push our blocks here when they free them. */
+	unsigned long *remote;
+	struct {
+		void *head;
+		unsigned long num;
+	} free[CACHE_BUCKETS];
+	struct alloc_cache_stats stats;
+};
+
+static unsigned long cache_batch(unsigned int bucket)
+{
+	unsigned long num = CACHE_BATCH_BYTES / bucket_to_size(bucket);
+
+	if (num > CACHE_BATCH_MAX)
+		return CACHE_BATCH_MAX;
+	return num ? num : 1;
+}
+
+static struct cache_block *to_block(void *p)
+{
+	return (struct cache_block *)p - 1;
+}
+
+static unsigned long pool_off(const struct alloc_cache *cache, const void *p)
+{
+	return (char *)p - (char *)cache->pool;
+}
+
+static void cache_push(struct alloc_cache *cache, struct cache_block *b)
+{
+	union cache_link *l = (union cache_link *)(b + 1);
+
+	l->next = cache->free[b->bucket].head;
+	cache->free[b->bucket].head = b;
+	cache->free[b->bucket].num++;
+	cache->stats.cached_bytes += bucket_to_size(b->bucket);
+}
+
+static struct cache_block *cache_pop(struct alloc_cache *cache,
+				     unsigned int bucket)
+{
+	struct cache_block *b = cache->free[bucket].head;
+
+	if (b) {
+		cache->free[bucket].head = ((union cache_link *)(b + 1))->next;
+		cache->free[bucket].num--;
+		cache->stats.cached_bytes -= bucket_to_size(bucket);
+	}
+	return b;
+}
+
+/* Hand back a batch of this bucket to the pool.  Lock must be held. */
+static void cache_flush(struct alloc_cache *cache, unsigned int bucket,
+			unsigned long num)
+{
+	struct cache_block *b;
+
+	while (num-- && (b = cache_pop(cache, bucket)) != NULL)
+		alloc_free(cache->pool, cache->poolsize, b);
+}
+
+/* Take back everything others freed for us.  Returns number reclaimed. */
+static unsigned long cache_reclaim(struct alloc_cache *cache,
+				   unsigned long newval)
+{
+	unsigned long off, num = 0;
+
+	if (!__atomic_load_n(cache->remote, __ATOMIC_RELAXED)
+	    && newval != CACHE_OWNER_DEAD)
+		return 0;
+
+	off = __atomic_exchange_n(cache->remote, newval, __ATOMIC_ACQUIRE);
+	while (off) {
+		struct cache_block *b = (void *)((char *)cache->pool + off);
+
+		off = ((union cache_link *)(b + 1))->next_off;
+		cache_push(cache, b);
+		num++;
+	}
+	cache->stats.remote_reclaimed += num;
+	return num;
+}
+
+struct alloc_cache *alloc_cache_new(void *pool, unsigned long poolsize,
+				    void (*lock)(void *arg),
+				    void (*unlock)(void *arg),
+				    void *arg)
+{
+	struct alloc_cache *cache = calloc(1, sizeof(*cache));
+
+	if (!cache)
+		return NULL;
+
+	assert(size_to_bucket(ALLOC_CACHE_MAX + sizeof(struct cache_block))
+	       < CACHE_BUCKETS);
+	cache->pool = pool;
+	cache->poolsize = poolsize;
+	cache->lock = lock;
+	cache->unlock = unlock;
+	cache->arg = arg;
+
+	lock(arg);
+	cache->remote = alloc_get(pool, poolsize, sizeof(*cache->remote),
+				  ALIGNOF(unsigned long));
+	unlock(arg);
+	if (!cache->remote) {
+		free(cache);
+		return NULL;
+	}
+	*cache->remote = 0;
+	return cache;
+}
+
+void *alloc_cache_get(struct alloc_cache *cache, unsigned long size)
+{
+	struct cache_block *b;
+	unsigned long bucket, i, num;
+
+	cache->stats.gets++;
+	if (unlikely(size > ALLOC_CACHE_MAX)) {
+		cache->lock(cache->arg);
+		b = alloc_get(cache->pool, cache->poolsize,
+			      sizeof(*b) + size, sizeof(*b));
+		cache->unlock(cache->arg);
+		if (!b)
+			return NULL;
+		b->owner = pool_off(cache, cache->remote);
+		b->bucket = NO_CACHE_BUCKET;
+		return b + 1;
+	}
+
+	/* Free blocks need room for the link. */
+	if (size < sizeof(union cache_link))
+		size = sizeof(union cache_link);
+	bucket = size_to_bucket(sizeof(*b) + size);
+	b = cache_pop(cache, bucket);
+	if (!b && cache_reclaim(cache, 0))
+		b = cache_pop(cache, bucket);
+	if (b) {
+		cache->stats.hits++;
+		return b + 1;
+	}
+
+	/* Refill a batch: we keep all but the one we return. */
+	num = cache_batch(bucket);
+	cache->lock(cache->arg);
+	for (i = 0; i < num; i++) {
+		b = alloc_get(cache->pool, cache->poolsize,
+			      bucket_to_size(bucket), sizeof(*b));
+		if (!b)
+			break;
+		b->owner = pool_off(cache, cache->remote);
+		b->bucket = bucket;
+		if (i != num - 1)
+			cache_push(cache, b);
+	}
+	cache->unlock(cache->arg);
+	cache->stats.refills++;
+
+	/* Pool ran dry?  Give them one we cached, if any. */
+	if (!b) {
+		b = cache_pop(cache, bucket);
+		if (!b)
+			return NULL;
+	}
+	return b + 1;
+}
+
+void alloc_cache_free(struct alloc_cache *cache, void *p)
+{
+	struct cache_block *b = to_block(p);
+	unsigned long *remote, head, off;
+
+	if (unlikely(b->bucket == NO_CACHE_BUCKET))
+		goto to_pool;
+
+	if (b->owner != pool_off(cache, cache->remote)) {
+		/* Someone else's: push onto their remote list. */
+		cache->stats.remote_frees++;
+		remote = (void *)((char *)cache->pool + b->owner);
+		off = pool_off(cache, b);
+		head = __atomic_load_n(remote, __ATOMIC_RELAXED);
+		do {
+			if (head == CACHE_OWNER_DEAD)
+				goto to_pool;
+			((union cache_link *)p)->next_off = head;
+		} while (!__atomic_compare_exchange_n(remote, &head, off, true,
+						      __ATOMIC_RELEASE,
+						      __ATOMIC_RELAXED));
+		return;
+	}
+
+	cache_push(cache, b);
+	/* Don't hoard: return a batch once we have two spare. */
+	if (cache->free[b->bucket].num > 2 * cache_batch(b->bucket)) {
+		cache->lock(cache->arg);
+		cache_flush(cache, b->bucket, cache_batch(b->bucket));
+		cache->unlock(cache->arg);
+		cache->stats.flushes++;
+	}
+	return;
+
+to_pool:
+	cache->lock(cache->arg);
+	alloc_free(cache->pool, cache->poolsize, b);
+	cache->unlock(cache->arg);
+}
+
+void alloc_cache_stats(const struct alloc_cache *cache,
+		       struct alloc_cache_stats *stats)
+{
+	*stats = cache->stats;
+}
+
+void alloc_cache_destroy(struct alloc_cache *cache)
+{
+	unsigned int i;
+
+	/* After this, others free our blocks straight to the pool. */
+	cache_reclaim(cache, CACHE_OWNER_DEAD);
+
+	cache->lock(cache->arg);
+	for (i = 0; i < CACHE_BUCKETS; i++)
+		cache_flush(cache, i, -1UL);
+	cache->unlock(cache->arg);
+
+	/* The remote word has to stay: a free may still be racing with us. */
+	free(cache);
+}
+
 /* Useful for gdb breakpoints. */
 static bool check_fail(void)
 {
@@ -1235,3 +1495,67 @@ void alloc_visualize(FILE *out, void *pool, unsigned long poolsize)
 
 	print_overhead(out, "total", overhead, poolsize);
 }
+
+static void stats_list(struct header *head, u16 pgnum, unsigned int sp_bits,
+		       unsigned long page_size, unsigned long esize,
+		       unsigned long per_page, struct alloc_stats *stats)
+{
+	struct page_header *p;
+
+	while (pgnum) {
+		p = from_pgnum(head, pgnum, sp_bits);
+		stats->allocs += p->elements_used;
+		stats->allocated += p->elements_used * esize;
+		stats->fragmented += (per_page - p->elements_used) * esize;
+		stats->overhead += page_size - per_page * esize;
+		pgnum = p->next;
+	}
+}
+
+bool alloc_stats(void *pool, unsigned long poolsize, struct alloc_stats *stats)
+{
+	struct header *head = pool;
+	struct huge_alloc *ha;
+	unsigned long i, lp_bits, sp_bits, num_buckets, header_size;
+
+	memset(stats, 0, sizeof(*stats));
+	if (poolsize < MIN_USEFUL_SIZE)
+		return false;
+
+	sp_bits = small_page_bits(poolsize);
+	lp_bits = sp_bits + BITS_FROM_SMALL_TO_LARGE_PAGE;
+	num_buckets = max_bucket(lp_bits);
+	header_size = sizeof(*head) + sizeof(head->bs) * (num_buckets-1);
+
+	stats->overhead = align_up(header_size, 1UL << sp_bits)
+		+ poolsize % (1UL << lp_bits);
+	stats->free = (count_list(head, head->small_free_list, sp_bits, NULL)
+		       << sp_bits)
+		+ (count_list(head, head->large_free_list, sp_bits, NULL)
+		   << lp_bits);
+
+	for (i = 0; i < num_buckets; i++) {
+		struct bucket_state *bs = &head->bs[i];
+		unsigned long page_size = 1UL << sp_bits, esize;
+
+		if (large_page_bucket(i, sp_bits))
+			page_size <<= BITS_FROM_SMALL_TO_LARGE_PAGE;
+		esize = bucket_to_size(i);
+
+		stats_list(head, bs->full_list, sp_bits, page_size,
+			   esize, bs->elements_per_page, stats);
+		stats_list(head, bs->page_list, sp_bits, page_size,
+			   esize, bs->elements_per_page, stats);
+	}
+
+	/* Each huge alloc has a tracking record: that's overhead, not use. */
+	for (i = head->huge; i; i = ha->next) {
+		unsigned long hsize = bucket_to_size(size_to_bucket(
+				align_up(sizeof(*ha), ALIGNOF(*ha))));
+		ha = (void *)((char *)head + i);
+		stats->huge += ha->len;
+		stats->allocated -= hsize;
+		stats->overhead += hsize;
+	}
+	return true;
+}
@@ -127,4 +127,159 @@ bool alloc_check(void *pool, unsigned long poolsize);
  *	}
  */
 void alloc_visualize(FILE *out, void *pool, unsigned long poolsize);
+
+/**
+ * struct alloc_stats - how the allocation pool is being used
+ * @allocs: number of live allocations.
+ * @allocated: bytes handed out (as rounded up by the allocator).
+ * @huge: bytes in allocations too large for a page (included in @allocs).
+ * @fragmented: bytes unused in pages which hold some allocations.
+ * @free: bytes in unused pages.
+ * @overhead: bytes lost to headers, page tails and the pool tail.
+ *
+ * @fragmented is the interesting one: that memory can only be used by
+ * allocations of the same size as their neighbours.
+ */
+struct alloc_stats {
+	unsigned long allocs;
+	unsigned long allocated;
+	unsigned long huge;
+	unsigned long fragmented;
+	unsigned long free;
+	unsigned long overhead;
+};
+
+/**
+ * alloc_stats - gather statistics about the allocation pool
+ * @pool: the contiguous bytes for the allocator to use
+ * @poolsize: the size of the pool
+ * @stats: the structure to fill in.
+ *
+ * Like alloc_visualize(), but for programs rather than people.  Returns
+ * false (and zeroes @stats) if the pool is too small to keep pages.
+ *
+ * Example:
+ *	struct alloc_stats stats;
+ *
+ *	if (alloc_stats(pool, 32*1024*1024, &stats))
+ *		printf("%lu bytes in use, %lu lost to fragmentation\n",
+ *		       stats.allocated + stats.huge, stats.fragmented);
+ */
+bool alloc_stats(void *pool, unsigned long poolsize, struct alloc_stats *stats);
+
+/* Largest size alloc_cache_get() keeps cached (larger goes to the pool). */
+#define ALLOC_CACHE_MAX 1024
+
+/**
+ * struct alloc_cache_stats - how an allocation cache is doing
+ * @gets: calls to alloc_cache_get().
+ * @hits: gets satisfied without taking the pool lock.
+ * @refills: batches taken from the pool.
+ * @flushes: batches handed back to the pool.
+ * @remote_frees: frees of blocks belonging to another cache.
+ * @remote_reclaimed: our blocks freed by another cache, which we took back.
+ * @cached_bytes: bytes currently sitting in this cache.
+ */
+struct alloc_cache_stats {
+	unsigned long gets;
+	unsigned long hits;
+	unsigned long refills;
+	unsigned long flushes;
+	unsigned long remote_frees;
+	unsigned long remote_reclaimed;
+	unsigned long cached_bytes;
+};
+
+/**
+ * alloc_cache_new - create a private cache in front of a shared pool
+ * @pool: the contiguous bytes for the allocator to use
+ * @poolsize: the size of the pool
+ * @lock: function to serialize access to the pool
+ * @unlock: function to release @lock
+ * @arg: argument to hand to @lock and @unlock.
+ *
+ * The alloc_ functions don't lock: when several processes share a pool
+ * they must serialize every call.  An alloc_cache belongs to one process
+ * (or thread), and keeps free blocks of each size up to ALLOC_CACHE_MAX,
+ * so most allocations and frees don't touch the pool (or @lock) at all.
+ * It refills and drains a batch at a time.
+ *
+ * Blocks can be freed through any cache on the same pool: a block which
+ * belongs to another cache is handed back to its owner without locking.
+ *
+ * The cache itself is allocated with malloc(), and one word is allocated
+ * from @pool.  Returns NULL on allocation failure.
+ *
+ * Example:
+ *	static void no_lock(void *unused)
+ *	{
+ *	}
+ *	...
+ *		struct alloc_cache *cache;
+ *
+ *		cache = alloc_cache_new(pool, 32*1024*1024,
+ *					no_lock, no_lock, NULL);
+ *		if (!cache)
+ *			errx(1, "Could not create cache");
+ */
+struct alloc_cache *alloc_cache_new(void *pool, unsigned long poolsize,
+				    void (*lock)(void *arg),
+				    void (*unlock)(void *arg),
+				    void *arg);
+
+/**
+ * alloc_cache_get - allocate some memory through a cache
+ * @cache: the cache from alloc_cache_new()
+ * @size: the size of the desired allocation
+ *
+ * The result is 16-byte aligned (relative to the pool), and must be freed
+ * with alloc_cache_free(), not alloc_free().  Returns NULL if there is no
+ * room.
+ *
+ * Example:
+ *	double *dp = alloc_cache_get(cache, sizeof(*dp));
+ *	if (!dp)
+ *		errx(1, "Failed to allocate a double");
+ */
+void *alloc_cache_get(struct alloc_cache *cache, unsigned long size);
+
+/**
+ * alloc_cache_free - free memory from alloc_cache_get()
+ * @cache: any cache on the same pool
+ * @p: the non-NULL pointer returned from alloc_cache_get().
+ *
+ * @p goes back into @cache if it came from @cache, otherwise it is
+ * queued for the cache it came from.
+ *
+ * Example:
+ *	alloc_cache_free(cache, dp);
+ */
+void alloc_cache_free(struct alloc_cache *cache, void *p);
+
+/**
+ * alloc_cache_stats - get statistics for an allocation cache
+ * @cache: the cache from alloc_cache_new()
+ * @stats: the structure to fill in.
+ *
+ * Example:
+ *	struct alloc_cache_stats cstats;
+ *
+ *	alloc_cache_stats(cache, &cstats);
+ *	printf("%lu of %lu allocations avoided the lock\n",
+ *	       cstats.hits, cstats.gets);
+ */
+void alloc_cache_stats(const struct alloc_cache *cache,
+		       struct alloc_cache_stats *stats);
+
+/**
+ * alloc_cache_destroy - return everything in a cache to the pool
+ * @cache: the cache from alloc_cache_new()
+ *
+ * Blocks it handed out which are still in use remain valid; when they
+ * are freed (through another cache) they go straight back to the pool.
+ *
+ * Example:
+ *	alloc_cache_destroy(cache);
+ */
+void alloc_cache_destroy(struct alloc_cache *cache);
 #endif /* ALLOC_H */
@@ -0,0 +1,128 @@
+#include <ccan/antithread/alloc/alloc.h>
+#include <ccan/tap/tap.h>
+#include <ccan/antithread/alloc/alloc.c>
+#include <ccan/antithread/alloc/bitops.c>
+#include <ccan/antithread/alloc/tiny.c>
+#include <stdlib.h>
+#include <err.h>
+
+#define POOL_SIZE (1024*1024*4)
+#define NUM 1000
+
+static void count_lock(int *depth)
+{
+	assert(*depth == 0);
+	(*depth)++;
+}
+
+static void count_unlock(int *depth)
+{
+	assert(*depth == 1);
+	(*depth)--;
+}
+
+static struct alloc_cache *new_cache(void *mem, int *depth)
+{
+	return alloc_cache_new(mem, POOL_SIZE,
+			       (void (*)(void *))count_lock,
+			       (void (*)(void *))count_unlock, depth);
+}
+
+static bool unique(void *p[], unsigned int num)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < num; i++)
+		for (j = i + 1; j < num; j++)
+			if (p[i] == p[j])
+				return false;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	void *mem = malloc(POOL_SIZE), *p[NUM];
+	struct alloc_cache *c1, *c2;
+	struct alloc_cache_stats s1, s2;
+	struct alloc_stats stats;
+	int depth = 0;
+	unsigned int i;
+	bool aligned, filled;
+
+	plan_tests(24);
+
+	alloc_init(mem, POOL_SIZE);
+	c1 = new_cache(mem, &depth);
+	c2 = new_cache(mem, &depth);
+	ok1(c1 && c2);
+
+	/* Every size, up to and past the cache limit. */
+	aligned = true;
+	for (i = 0; i < NUM; i++) {
+		p[i] = alloc_cache_get(c1, i * 2);
+		if ((unsigned long)((char *)p[i] - (char *)mem) % 16)
+			aligned = false;
+		memset(p[i], i, i * 2);
+	}
+	ok1(aligned);
+	ok1(unique(p, NUM));
+	ok1(alloc_check(mem, POOL_SIZE));
+	filled = true;
+	for (i = 0; i < NUM; i++) {
+		unsigned int j;
+		for (j = 0; j < i * 2; j++)
+			if (((unsigned char *)p[i])[j] != (unsigned char)i)
+				filled = false;
+	}
+	ok1(filled);
+	alloc_cache_stats(c1, &s1);
+	ok1(s1.gets == NUM);
+	ok1(s1.refills > 0 && s1.refills < NUM);
+	ok1(s1.hits + s1.refills + (NUM - ALLOC_CACHE_MAX/2 - 1) == NUM);
+
+	/* Freeing to ourselves then reallocating hits the cache. */
+	for (i = 0; i < NUM; i++)
+		alloc_cache_free(c1, p[i]);
+	ok1(alloc_check(mem, POOL_SIZE));
+	for (i = 0; i < 20; i++)
+		p[i] = alloc_cache_get(c1, 100);
+	alloc_cache_stats(c1, &s2);
+	ok1(s2.refills == s1.refills);
+	ok1(s2.hits == s1.hits + 20);
+	/* It doesn't hang onto everything we freed. */
+	ok1(s2.flushes > 0);
+	for (; i < 100; i++)
+		p[i] = alloc_cache_get(c1, 100);
+
+	/* Free them through the other cache: they go home. */
+	for (i = 0; i < 100; i++)
+		alloc_cache_free(c2, p[i]);
+	alloc_cache_stats(c2, &s2);
+	ok1(s2.remote_frees == 100);
+	ok1(s2.cached_bytes == 0);
+	for (i = 0; i < 100; i++)
+		p[i] = alloc_cache_get(c1, 100);
+	alloc_cache_stats(c1, &s1);
+	ok1(s1.remote_reclaimed == 100);
+	ok1(unique(p, 100));
+	ok1(alloc_check(mem, POOL_SIZE));
+
+	/* Owner goes away: remote frees go straight to the pool. */
+	alloc_cache_destroy(c1);
+	ok1(depth == 0);
+	for (i = 0; i < 100; i++)
+		alloc_cache_free(c2, p[i]);
+	alloc_cache_stats(c2, &s2);
+	ok1(s2.remote_frees == 200);
+	ok1(s2.cached_bytes == 0);
+	ok1(alloc_check(mem, POOL_SIZE));
+
+	/* Only the two remote-free words are left. */
+	alloc_cache_destroy(c2);
+	ok1(depth == 0);
+	ok1(alloc_stats(mem, POOL_SIZE, &stats));
+	ok1(stats.allocs == 2);
+
+	free(mem);
+	return exit_status();
+}
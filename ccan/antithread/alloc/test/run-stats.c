@@ -0,0 +1,63 @@
+#include <ccan/antithread/alloc/alloc.h>
+#include <ccan/tap/tap.h>
+#include <ccan/antithread/alloc/alloc.c>
+#include <ccan/antithread/alloc/bitops.c>
+#include <ccan/antithread/alloc/tiny.c>
+#include <stdlib.h>
+#include <err.h>
+
+#define POOL_SIZE (1024*1024*4)
+#define NUM 1000
+
+static unsigned long total(const struct alloc_stats *stats)
+{
+	return stats->allocated + stats->huge + stats->fragmented
+		+ stats->free + stats->overhead;
+}
+
+int main(int argc, char *argv[])
+{
+	void *mem = malloc(POOL_SIZE), *p[NUM], *huge;
+	struct alloc_stats stats, before;
+	unsigned int i;
+
+	plan_tests(16);
+
+	/* Tiny pools don't have pages. */
+	alloc_init(mem, 1024);
+	ok1(!alloc_stats(mem, 1024, &stats));
+
+	alloc_init(mem, POOL_SIZE);
+	ok1(alloc_stats(mem, POOL_SIZE, &before));
+	ok1(before.allocs == 0);
+	ok1(before.allocated == 0);
+	ok1(before.fragmented == 0);
+	ok1(total(&before) == POOL_SIZE);
+
+	for (i = 0; i < NUM; i++)
+		p[i] = alloc_get(mem, POOL_SIZE, 100, 1);
+	huge = alloc_get(mem, POOL_SIZE, POOL_SIZE / 8, 1);
+	ok1(huge);
+	ok1(alloc_stats(mem, POOL_SIZE, &stats));
+	ok1(stats.allocs == NUM + 1);
+	ok1(stats.allocated >= NUM * 100);
+	ok1(stats.huge >= POOL_SIZE / 8);
+	ok1(total(&stats) == POOL_SIZE);
+
+	/* Free every second one: now it's fragmented. */
+	for (i = 0; i < NUM; i += 2)
+		alloc_free(mem, POOL_SIZE, p[i]);
+	before = stats;
+	ok1(alloc_stats(mem, POOL_SIZE, &stats));
+	ok1(stats.fragmented > before.fragmented + (NUM / 2) * 90);
+	ok1(total(&stats) == POOL_SIZE);
+
+	for (i = 1; i < NUM; i += 2)
+		alloc_free(mem, POOL_SIZE, p[i]);
+	alloc_free(mem, POOL_SIZE, huge);
+	alloc_stats(mem, POOL_SIZE, &stats);
+	ok1(stats.allocs == 0);
+
+	free(mem);
+	return exit_status();
+}
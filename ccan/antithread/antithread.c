@@ -34,6 +34,8 @@ struct at_pool_contents {
 	int fd;
 	int parent_rfd, parent_wfd;
 	struct at_pool *atp;
+	/* For at_alloc: ours alone, created on first use. */
+	struct alloc_cache *cache;
 };
 
 struct at_pool {
@@ -93,8 +95,17 @@ static struct at_pool_contents *find_pool(const void *ptr)
 	abort();
 }
 
+static void drop_cache(struct at_pool_contents *p)
+{
+	if (p->cache) {
+		alloc_cache_destroy(p->cache);
+		p->cache = NULL;
+	}
+}
+
 static int destroy_pool(struct at_pool_contents *p)
 {
+	drop_cache(p);
 	list_del(&p->list);
 	munmap(p->pool, p->poolsize);
 	close(p->fd);
@@ -204,6 +215,7 @@ struct at_pool *at_pool(unsigned long size)
 	p->poolsize = size;
 	p->parent_rfd = p->parent_wfd = -1;
 	p->atp = atp;
+	p->cache = NULL;
 	alloc_init(p->pool, p->poolsize);
 	list_add(&pools, &p->list);
 	talloc_set_destructor(p, destroy_pool);
@@ -280,6 +292,8 @@ static struct athread *fork_thread(struct at_pool *atp)
 		close(p2c[1]);
 		pool->parent_rfd = p2c[0];
 		pool->parent_wfd = c2p[1];
+		/* That's the parent's cache: we need our own. */
+		pool->cache = NULL;
 		talloc_set_destructor(at, cant_destroy_self);
 	} else {
 		/* Parent */
@@ -315,7 +329,11 @@ struct athread *_at_run(struct at_pool *atp,
 
 	if (at->pid == 0) {
 		/* Child */
-		at_tell_parent(atp, fn(atp, obj));
+		void *ret = fn(atp, obj);
+		/* Don't strand our cached memory in the pool: once we've
+		 * told our parent, it may kill us. */
+		drop_cache(atp->p);
+		at_tell_parent(atp, ret);
 		exit(0);
 	}
 	/* Parent */
@@ -421,6 +439,7 @@ struct at_pool *at_get_pool(int *argc, char *argv[], void **arg)
 		arg = &map;
 
 	p = atp->p = talloc(atp, struct at_pool_contents);
+	p->cache = NULL;
 
 	if (sscanf(argv[1], "AT:%p/%lu/%i/%i/%i/%p",
 		   &p->pool, &p->poolsize, &p->fd,
@@ -550,3 +569,54 @@ void at_unlock_all(struct at_pool *atp)
 {
 	unlock(atp->p->fd, 0);
 }
+
+static void cache_lock(void *p)
+{
+	lock(((struct at_pool_contents *)p)->fd, 0);
+}
+
+static void cache_unlock(void *p)
+{
+	unlock(((struct at_pool_contents *)p)->fd, 0);
+}
+
+static struct alloc_cache *get_cache(struct at_pool_contents *p)
+{
+	if (!p->cache)
+		p->cache = alloc_cache_new(p->pool, p->poolsize,
+					   cache_lock, cache_unlock, p);
+	return p->cache;
+}
+
+void *at_alloc(struct at_pool *atp, unsigned long size)
+{
+	struct alloc_cache *cache = get_cache(atp->p);
+
+	if (!cache)
+		return NULL;
+	return alloc_cache_get(cache, size);
+}
+
+void at_free(struct at_pool *atp, void *ptr)
+{
+	struct alloc_cache *cache = get_cache(atp->p);
+
+	if (!cache)
+		errx(1, "Could not create cache to free %p", ptr);
+	alloc_cache_free(cache, ptr);
+}
+
+void at_alloc_stats(struct at_pool *atp, struct alloc_cache_stats *stats)
+{
+	if (atp->p->cache)
+		alloc_cache_stats(atp->p->cache, stats);
+	else
+		memset(stats, 0, sizeof(*stats));
+}
+
+void at_pool_stats(struct at_pool *atp, struct alloc_stats *stats)
+{
+	lock(atp->p->fd, 0);
+	alloc_stats(atp->p->pool, atp->p->poolsize, stats);
+	unlock(atp->p->fd, 0);
+}
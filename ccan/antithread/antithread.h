@@ -2,6 +2,7 @@
 #ifndef ANTITHREAD_H
 #define ANTITHREAD_H
 #include <ccan/typesafe_cb/typesafe_cb.h>
+#include <ccan/antithread/alloc/alloc.h>
 
 struct at_pool;
 struct athread;
@@ -53,6 +54,18 @@ void at_unlock(void *obj);
 void at_lock_all(struct at_pool *pool);
 void at_unlock_all(struct at_pool *pool);
 
+/* Raw allocation within the pool, without talloc: small sizes are cached
+ * per-process, so usually don't need the pool lock.  Any process can
+ * at_free() what another process at_alloc()ed. */
+void *at_alloc(struct at_pool *pool, unsigned long size);
+void at_free(struct at_pool *pool, void *ptr);
+
+/* How this process's at_alloc cache is doing. */
+void at_alloc_stats(struct at_pool *pool, struct alloc_cache_stats *stats);
+
+/* How the whole pool is being used (takes the pool lock). */
+void at_pool_stats(struct at_pool *pool, struct alloc_stats *stats);
+
 /* Internal function */
 struct athread *_at_run(struct at_pool *pool,
 			void *(*fn)(struct at_pool *, void *arg),
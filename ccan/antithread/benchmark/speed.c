@@ -0,0 +1,151 @@
+/* Times NUM_RUNS small allocations and frees in each of 1 to 8 antithreads
+ * sharing a pool, through at_alloc's per-process caches, through talloc
+ * (which takes the pool lock for every call), and through alloc_get under
+ * at_lock_all.  "local" frees its own blocks; "shared" swaps blocks through
+ * a common array, so most frees are of another process's block. */
+#include <ccan/antithread/antithread.c>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#define NUM_RUNS 200000
+#define WINDOW 64
+#define NUM_SLOTS 256
+#define MAX_CHILDREN 8
+
+enum method { CACHE, TALLOC, LOCKED };
+static const char *method_name[] = { "at_alloc", "talloc", "locked" };
+
+struct bench {
+	enum method method;
+	bool shared;
+	void *slots[NUM_SLOTS];
+};
+
+static void *get(struct at_pool *atp, struct bench *b, unsigned long len)
+{
+	void *p;
+
+	switch (b->method) {
+	case CACHE:
+		return at_alloc(atp, len);
+	case TALLOC:
+		return talloc_size(at_pool_ctx(atp), len);
+	case LOCKED:
+		at_lock_all(atp);
+		p = alloc_get(atp->p->pool, atp->p->poolsize, len, 16);
+		at_unlock_all(atp);
+		return p;
+	}
+	abort();
+}
+
+static void put(struct at_pool *atp, struct bench *b, void *p)
+{
+	switch (b->method) {
+	case CACHE:
+		at_free(atp, p);
+		break;
+	case TALLOC:
+		talloc_free(p);
+		break;
+	case LOCKED:
+		at_lock_all(atp);
+		alloc_free(atp->p->pool, atp->p->poolsize, p);
+		at_unlock_all(atp);
+		break;
+	}
+}
+
+static void *worker(struct at_pool *atp, struct bench *b)
+{
+	void *window[WINDOW] = { NULL };
+	unsigned int i, seed = getpid();
+
+	/* Wait for the starting gun. */
+	at_read_parent(atp);
+	for (i = 0; i < NUM_RUNS; i++) {
+		unsigned long len = 16 + rand_r(&seed) % 240;
+		void *p = get(atp, b, len), **slot;
+
+		if (!p)
+			errx(1, "Allocation failed");
+		memset(p, 0, 16);
+		if (b->shared)
+			slot = &b->slots[rand_r(&seed) % NUM_SLOTS];
+		else
+			slot = &window[i % WINDOW];
+		p = __atomic_exchange_n(slot, p, __ATOMIC_ACQ_REL);
+		if (p)
+			put(atp, b, p);
+	}
+	for (i = 0; i < WINDOW; i++)
+		if (window[i])
+			put(atp, b, window[i]);
+	return b;
+}
+
+static void run(struct at_pool *atp, struct bench *b, unsigned int num)
+{
+	struct athread *at[MAX_CHILDREN];
+	struct timemono start;
+	struct timerel diff;
+	unsigned int i;
+
+	memset(b->slots, 0, sizeof(b->slots));
+	for (i = 0; i < num; i++) {
+		at[i] = at_run(atp, worker, b);
+		if (!at[i])
+			err(1, "Creating antithread");
+	}
+	start = time_mono();
+	for (i = 0; i < num; i++)
+		at_tell(at[i], b);
+	for (i = 0; i < num; i++) {
+		if (at_read(at[i]) != b)
+			errx(1, "Antithread failed");
+		talloc_free(at[i]);
+	}
+	diff = timemono_since(start);
+
+	for (i = 0; i < NUM_SLOTS; i++)
+		if (b->slots[i])
+			put(atp, b, b->slots[i]);
+
+	printf("%-8s %-6s %u procs: %6llu nsec per alloc+free\n",
+	       method_name[b->method], b->shared ? "shared" : "local", num,
+	       (unsigned long long)time_to_nsec(diff) / (NUM_RUNS * num));
+	/* Or the next children will print it again when they exit. */
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	struct at_pool *atp;
+	struct bench *b;
+	struct alloc_stats stats;
+	unsigned int num, method, shared;
+
+	atp = at_pool(64 * 1024 * 1024);
+	if (!atp)
+		err(1, "Creating pool");
+	b = talloc(at_pool_ctx(atp), struct bench);
+	for (shared = 0; shared < 2; shared++) {
+		for (method = CACHE; method <= LOCKED; method++) {
+			b->method = method;
+			b->shared = shared;
+			for (num = 1; num <= MAX_CHILDREN; num *= 2)
+				run(atp, b, num);
+		}
+	}
+
+	at_pool_stats(atp, &stats);
+	printf("Pool: %lu allocs, %lu bytes allocated, %lu fragmented,"
+	       " %lu free, %lu overhead\n",
+	       stats.allocs, stats.allocated, stats.fragmented,
+	       stats.free, stats.overhead);
+	talloc_free(atp);
+	return 0;
+}
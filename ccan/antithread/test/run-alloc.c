@@ -0,0 +1,142 @@
+#include <ccan/antithread/antithread.c>
+#include <assert.h>
+#include <unistd.h>
+#include <ccan/tap/tap.h>
+
+#define NUM 1000
+#define NUM_CHILDREN 4
+#define NUM_SLOTS 64
+#define NUM_RUNS 20000
+
+static unsigned long size(unsigned int i)
+{
+	return i % 200 + 1;
+}
+
+static bool filled(const unsigned char *p, unsigned long len, int c)
+{
+	unsigned long i;
+
+	for (i = 0; i < len; i++)
+		if (p[i] != (unsigned char)c)
+			return false;
+	return true;
+}
+
+/* Free all the parent's blocks, replace them with ours. */
+static void *swap(struct at_pool *atp, void *unused)
+{
+	unsigned char **p = at_read_parent(atp);
+	unsigned int i;
+
+	for (i = 0; i < NUM; i++) {
+		if (!filled(p[i], size(i), i))
+			return NULL;
+		at_free(atp, p[i]);
+		p[i] = at_alloc(atp, size(i));
+		memset(p[i], 0xAA, size(i));
+	}
+	return p;
+}
+
+/* Everyone swaps blocks in and out of shared slots, and frees what
+ * they got, which mostly came from someone else. */
+static void *stress(struct at_pool *atp, unsigned char **slots)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_RUNS; i++) {
+		unsigned int len = size(random());
+		unsigned char *p = at_alloc(atp, len), *old;
+
+		if (!p)
+			return NULL;
+		p[0] = len;
+		memset(p + 1, 0x55, len - 1);
+		old = __atomic_exchange_n(&slots[random() % NUM_SLOTS], p,
+					  __ATOMIC_ACQ_REL);
+		if (old) {
+			if (!filled(old + 1, old[0] - 1, 0x55))
+				return NULL;
+			at_free(atp, old);
+		}
+	}
+	return slots;
+}
+
+int main(int argc, char *argv[])
+{
+	struct at_pool *atp;
+	struct athread *at[NUM_CHILDREN];
+	struct alloc_cache_stats cstats;
+	struct alloc_stats stats;
+	unsigned char **p, **slots;
+	unsigned int i;
+	bool ok;
+
+	plan_tests(14);
+
+	atp = at_pool(4*1024*1024);
+	assert(atp);
+
+	p = at_alloc(atp, NUM * sizeof(*p));
+	for (i = 0; i < NUM; i++) {
+		p[i] = at_alloc(atp, size(i));
+		memset(p[i], i, size(i));
+	}
+	at_alloc_stats(atp, &cstats);
+	ok1(cstats.gets == NUM + 1);
+	ok1(cstats.refills < NUM / 10);
+
+	at[0] = at_run(atp, swap, NULL);
+	at_tell(at[0], p);
+	ok1(at_read(at[0]) == p);
+	talloc_free(at[0]);
+
+	ok = true;
+	for (i = 0; i < NUM; i++) {
+		if (!filled(p[i], size(i), 0xAA))
+			ok = false;
+		at_free(atp, p[i]);
+	}
+	ok1(ok);
+
+	/* We get back what the child freed for us. */
+	for (i = 0; i < NUM; i++)
+		p[i] = at_alloc(atp, size(i));
+	at_alloc_stats(atp, &cstats);
+	ok1(cstats.remote_frees == NUM);
+	ok1(cstats.remote_reclaimed == NUM);
+	for (i = 0; i < NUM; i++)
+		at_free(atp, p[i]);
+	at_free(atp, p);
+
+	at_pool_stats(atp, &stats);
+	ok1(stats.allocs > 0);
+	ok1(stats.allocated + stats.huge + stats.fragmented + stats.free
+	    + stats.overhead == atp->p->poolsize);
+
+	/* Now everyone at once. */
+	slots = at_alloc(atp, NUM_SLOTS * sizeof(*slots));
+	memset(slots, 0, NUM_SLOTS * sizeof(*slots));
+	for (i = 0; i < NUM_CHILDREN; i++) {
+		at[i] = at_run(atp, stress, slots);
+		ok1(at[i]);
+	}
+	ok = true;
+	for (i = 0; i < NUM_CHILDREN; i++) {
+		if (at_read(at[i]) != slots)
+			ok = false;
+		talloc_free(at[i]);
+	}
+	ok1(ok);
+
+	for (i = 0; i < NUM_SLOTS; i++)
+		if (slots[i])
+			at_free(atp, slots[i]);
+	at_free(atp, slots);
+	ok1(alloc_check(atp->p->pool, atp->p->poolsize));
+
+	talloc_free(atp);
+	return exit_status();
+}
@@ -1,5 +1,6 @@
 #include <ccan/asort/asort.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if !HAVE_QSORT_R_PRIVATE_LAST
 
@@ -257,3 +258,214 @@ _asort (void *const pbase, size_t total_elems, size_t size,
 }
 
 #endif /* !HAVE_QSORT_R_PRIVATE_LAST */
+
+/* Below this many elements per thread, threads cost more than they save. */
+#define PARALLEL_MIN 4096
+
+/* Merge sorted a[0..na) and b[0..nb) into out.  Ties go to a. */
+static void merge(char *out, const char *a, size_t na,
+		  const char *b, size_t nb, size_t size,
+		  _total_order_cb cmp, void *ctx)
+{
+	while (na && nb) {
+		if (cmp(b, a, ctx) < 0) {
+			memcpy(out, b, size);
+			b += size;
+			nb--;
+		} else {
+			memcpy(out, a, size);
+			a += size;
+			na--;
+		}
+		out += size;
+	}
+	memcpy(out, a, na * size);
+	memcpy(out + na * size, b, nb * size);
+}
+
+/*
+ * How many elements of a are in the first k elements of merge(a, b)?
+ * This lets us start merging in the middle, so threads can share a merge.
+ */
+static size_t merge_split(const char *a, size_t na, const char *b, size_t nb,
+			  size_t k, size_t size, _total_order_cb cmp, void *ctx)
+{
+	size_t lo = k > nb ? k - nb : 0, hi = k < na ? k : na;
+
+	while (lo < hi) {
+		size_t i = lo + (hi - lo) / 2;
+		/* If b[k-i-1] isn't less than a[i], a[i] goes first. */
+		if (cmp(b + (k - i - 1) * size, a + i * size, ctx) >= 0)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+/* Start of the r'th of nruns runs. */
+static size_t run_start(size_t nmemb, size_t nruns, size_t r)
+{
+	if (r >= nruns)
+		return nmemb;
+	return (size_t)((unsigned long long)nmemb * r / nruns);
+}
+
+void _asort_parallel(void *base, size_t nmemb, size_t size,
+		     _total_order_cb cmp, void *ctx, unsigned int nthreads)
+{
+	char *src = base, *dst, *tmp, *swap;
+	size_t width, ntasks;
+	long t;
+
+#ifndef _OPENMP
+	nthreads = 1;
+#endif
+	if (nthreads > nmemb / PARALLEL_MIN)
+		nthreads = nmemb / PARALLEL_MIN;
+	if (nthreads < 2 || !(tmp = malloc(nmemb * size))) {
+		_asort(base, nmemb, size, cmp, ctx);
+		return;
+	}
+
+	/* Each thread sorts one run. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nthreads)
+#endif
+	for (t = 0; t < (long)nthreads; t++) {
+		size_t start = run_start(nmemb, nthreads, t);
+		_asort(src + start * size,
+		       run_start(nmemb, nthreads, t + 1) - start,
+		       size, cmp, ctx);
+	}
+
+	/*
+	 * Merge pairs of runs, each twice as wide as the last.  Each merge
+	 * is cut into as many pieces as it has runs, so every thread has
+	 * a piece of the output to produce.
+	 */
+	dst = tmp;
+	for (width = 1; width < nthreads; width *= 2) {
+		ntasks = (nthreads + 2 * width - 1) / (2 * width) * (2 * width);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nthreads)
+#endif
+		for (t = 0; t < (long)ntasks; t++) {
+			size_t r = t / (2 * width) * (2 * width);
+			size_t piece = t % (2 * width);
+			size_t start = run_start(nmemb, nthreads, r);
+			size_t mid = run_start(nmemb, nthreads, r + width);
+			size_t end = run_start(nmemb, nthreads, r + 2 * width);
+			const char *a = src + start * size;
+			const char *b = src + mid * size;
+			size_t na = mid - start, nb = end - mid;
+			size_t k0, k1, i0, i1;
+
+			k0 = (unsigned long long)(end - start) * piece
+				/ (2 * width);
+			k1 = (unsigned long long)(end - start) * (piece + 1)
+				/ (2 * width);
+			i0 = merge_split(a, na, b, nb, k0, size, cmp, ctx);
+			i1 = merge_split(a, na, b, nb, k1, size, cmp, ctx);
+			merge(dst + (start + k0) * size,
+			      a + i0 * size, i1 - i0,
+			      b + (k0 - i0) * size, (k1 - i1) - (k0 - i0),
+			      size, cmp, ctx);
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != (char *)base)
+		memcpy(base, src, nmemb * size);
+	free(tmp);
+}
+
+/* Offset in the element of the pass'th least significant byte of the key. */
+static size_t radix_byte(size_t keyoff, size_t keysize,
+			 enum asort_radix_key kind, size_t pass)
+{
+#if HAVE_LITTLE_ENDIAN
+	if (kind != ASORT_RADIX_BYTES)
+		return keyoff + pass;
+#endif
+	return keyoff + keysize - 1 - pass;
+}
+
+/* Copy each element into its bucket; constant size lets memcpy inline. */
+#define RADIX_SCATTER(size)						\
+	for (i = 0; i < nmemb; i++) {					\
+		const unsigned char *e = src + i * (size);		\
+		memcpy(dst + pos[e[off]]++ * (size), e, (size));	\
+	}
+
+bool _asort_radix(void *base, size_t nmemb, size_t size,
+		  size_t keyoff, size_t keysize, enum asort_radix_key kind)
+{
+	unsigned char *src = base, *dst, *tmp, *swap;
+	size_t (*count)[256], pos[256], i, pass, b, off, sum;
+	unsigned char flip;
+
+	if (nmemb < 2)
+		return true;
+
+	tmp = malloc(nmemb * size);
+	count = calloc(keysize, sizeof(*count));
+	if (!tmp || !count) {
+		free(tmp);
+		free(count);
+		return false;
+	}
+
+	/* Count every byte of the key in one pass over the array. */
+	for (i = 0; i < nmemb; i++) {
+		for (pass = 0; pass < keysize; pass++) {
+			off = radix_byte(keyoff, keysize, kind, pass);
+			count[pass][src[i * size + off]]++;
+		}
+	}
+
+	dst = tmp;
+	for (pass = 0; pass < keysize; pass++) {
+		off = radix_byte(keyoff, keysize, kind, pass);
+		/* Flipping the sign bit makes negative numbers sort first. */
+		flip = (kind == ASORT_RADIX_SIGNED && pass == keysize - 1)
+			? 0x80 : 0;
+
+		/* If every element has the same byte here, skip it. */
+		if (count[pass][src[off]] == nmemb)
+			continue;
+
+		/* Bucket offsets, in order of (flipped) byte value. */
+		for (sum = 0, b = 0; b < 256; b++) {
+			pos[b ^ flip] = sum;
+			sum += count[pass][b ^ flip];
+		}
+
+		switch (size) {
+		case 4:
+			RADIX_SCATTER(4);
+			break;
+		case 8:
+			RADIX_SCATTER(8);
+			break;
+		case 16:
+			RADIX_SCATTER(16);
+			break;
+		default:
+			RADIX_SCATTER(size);
+			break;
+		}
+
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != base)
+		memcpy(base, src, nmemb * size);
+	free(tmp);
+	free(count);
+	return true;
+}
@@ -3,6 +3,9 @@
 #define CCAN_ASORT_H
 #include "config.h"
 #include <ccan/order/order.h>
+#include <ccan/build_assert/build_assert.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 /**
@@ -29,4 +32,135 @@ void _asort(void *base, size_t nmemb, size_t size,
 	    _total_order_cb compar, void *ctx);
 #endif
 
+/**
+ * asort_parallel - sort an array of elements using several threads
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @cmp: pointer to comparison function
+ * @ctx: a context pointer for the cmp function
+ * @nthreads: the number of threads to use
+ *
+ * This is a parallel merge sort: each thread sorts a piece of the array
+ * with asort(), then the pieces are merged pairwise, with every merge
+ * divided between all the threads.  @cmp is called from several threads
+ * at once, so it (and @ctx) must be safe for that.
+ *
+ * It needs a temporary copy of the array; if that can't be allocated, or
+ * the array is too small to be worth it, this is simply asort().
+ *
+ * Example:
+ *	static int cmp_int(const int *a, const int *b, void *unused)
+ *	{
+ *		return (*a > *b) - (*a < *b);
+ *	}
+ *
+ *	static void sort_ints(int *arr, size_t num)
+ *	{
+ *		asort_parallel(arr, num, cmp_int, NULL, 4);
+ *	}
+ */
+#define asort_parallel(base, num, cmp, ctx, nthreads)			\
+_asort_parallel((base), (num), sizeof(*(base)),				\
+		total_order_cast((cmp), *(base), (ctx)), (ctx), (nthreads))
+
+void _asort_parallel(void *base, size_t nmemb, size_t size,
+		     _total_order_cb compar, void *ctx, unsigned int nthreads);
+
+enum asort_radix_key {
+	ASORT_RADIX_UNSIGNED,
+	ASORT_RADIX_SIGNED,
+	/* An array of bytes, sorted as memcmp() would. */
+	ASORT_RADIX_BYTES
+};
+
+#if HAVE_TYPEOF
+/**
+ * asort_radix - sort an array of integers without comparisons
+ * @base: pointer to the integers to sort
+ * @num: number of elements
+ *
+ * This is a least-significant-digit radix sort: it makes one pass over
+ * the array per byte of the integer type (skipping bytes which are the
+ * same in every element), so it takes O(n) time, and is much faster than
+ * asort() on large arrays.  Signed and unsigned integer types of 1, 2, 4
+ * or 8 bytes are supported; anything else fails to compile.
+ *
+ * It needs a temporary copy of the array: returns false if that can't be
+ * allocated (leaving the array untouched).
+ *
+ * Example:
+ *	static bool sort_offsets(long *offsets, size_t num)
+ *	{
+ *		return asort_radix(offsets, num);
+ *	}
+ */
+#define asort_radix(base, num)						\
+	_asort_radix((base), (num), sizeof(*(base)), 0, sizeof(*(base)),	\
+		     asort_radix_kind_(*(base)))
+
+/**
+ * asort_radix_by - sort an array of structures by an integer member
+ * @base: pointer to the structures to sort
+ * @num: number of elements
+ * @member: the integer member of the structure to sort by
+ *
+ * Like asort_radix(), but moves whole structures.  Structures with equal
+ * keys stay in the order they were in (ie. it's a stable sort).
+ *
+ * Example:
+ *	struct record {
+ *		unsigned int id;
+ *		char payload[28];
+ *	};
+ *
+ *	static bool sort_records(struct record *recs, size_t num)
+ *	{
+ *		return asort_radix_by(recs, num, id);
+ *	}
+ */
+#define asort_radix_by(base, num, member)				\
+	_asort_radix((base), (num), sizeof(*(base)),			\
+		     offsetof(__typeof__(*(base)), member),		\
+		     sizeof((base)->member),				\
+		     asort_radix_kind_((base)->member))
+
+/**
+ * asort_radix_bytes - sort an array of structures by a fixed-width key
+ * @base: pointer to the structures to sort
+ * @num: number of elements
+ * @member: an array of (unsigned) chars in the structure to sort by
+ *
+ * Like asort_radix_by(), but the key is compared byte by byte, as
+ * memcmp() would.  Useful for big-endian integers, hashes and the like.
+ *
+ * Example:
+ *	struct object {
+ *		unsigned char sha[20];
+ *		const char *name;
+ *	};
+ *
+ *	static bool sort_objects(struct object *objs, size_t num)
+ *	{
+ *		return asort_radix_bytes(objs, num, sha);
+ *	}
+ */
+#define asort_radix_bytes(base, num, member)				\
+	_asort_radix((base), (num), sizeof(*(base)),			\
+		     offsetof(__typeof__(*(base)), member),		\
+		     sizeof((base)->member)				\
+		     + BUILD_ASSERT_OR_ZERO(sizeof((base)->member[0]) == 1), \
+		     ASORT_RADIX_BYTES)
+
+/* Integer types only: floating point keys fail to build. */
+#define asort_radix_kind_(key)						\
+	(BUILD_ASSERT_OR_ZERO(sizeof(key) == 1 || sizeof(key) == 2	\
+			      || sizeof(key) == 4 || sizeof(key) == 8)	\
+	 + BUILD_ASSERT_OR_ZERO((__typeof__(key))0.5 == 0)		\
+	 + ((__typeof__(key))-1 < (__typeof__(key))0			\
+	    ? ASORT_RADIX_SIGNED : ASORT_RADIX_UNSIGNED))
+#endif /* HAVE_TYPEOF */
+
+bool _asort_radix(void *base, size_t nmemb, size_t size,
+		  size_t keyoff, size_t keysize, enum asort_radix_key kind);
+
 #endif /* CCAN_ASORT_H */
@@ -0,0 +1,112 @@
+/* Compares asort, asort_parallel and asort_radix on integers and records. */
+#include <ccan/asort/asort.h>
+#include <ccan/time/time.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A typical fixed-size record with an integer key. */
+struct rec {
+	uint64_t key;
+	char payload[24];
+};
+
+static int cmp_u64(const uint64_t *a, const uint64_t *b, void *unused)
+{
+	return (*a > *b) - (*a < *b);
+}
+
+static int cmp_rec(const struct rec *a, const struct rec *b, void *unused)
+{
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+static uint64_t rand64(void)
+{
+	return ((uint64_t)random() << 42) ^ ((uint64_t)random() << 21) ^ random();
+}
+
+static struct timemono start;
+
+static void report(const char *what, size_t num, unsigned int nthreads)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-18s %10zu elements, %2u threads: %8llu usec (%llu nsec each)\n",
+	       what, num, nthreads,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / num));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t sizes[] = { 100000, 1000000, 10000000 };
+	unsigned int threads[] = { 2, 4, 8 };
+	size_t s, t, i, num, max = 0;
+	uint64_t *orig, *ints;
+	struct rec *recs;
+
+	/* Optionally, a single size to test. */
+	if (argc > 1) {
+		sizes[0] = atol(argv[1]);
+		sizes[1] = sizes[2] = 0;
+	}
+	for (s = 0; s < 3; s++)
+		if (sizes[s] > max)
+			max = sizes[s];
+
+	orig = malloc(sizeof(*orig) * max);
+	ints = malloc(sizeof(*ints) * max);
+	recs = malloc(sizeof(*recs) * max);
+	for (i = 0; i < max; i++)
+		orig[i] = rand64();
+
+	for (s = 0; s < 3 && sizes[s]; s++) {
+		num = sizes[s];
+
+		memcpy(ints, orig, sizeof(*ints) * num);
+		start = time_mono();
+		asort(ints, num, cmp_u64, NULL);
+		report("asort u64", num, 1);
+
+		for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+			memcpy(ints, orig, sizeof(*ints) * num);
+			start = time_mono();
+			asort_parallel(ints, num, cmp_u64, NULL, threads[t]);
+			report("asort_parallel u64", num, threads[t]);
+		}
+
+		memcpy(ints, orig, sizeof(*ints) * num);
+		start = time_mono();
+		if (!asort_radix(ints, num))
+			abort();
+		report("asort_radix u64", num, 1);
+
+		for (i = 0; i < num; i++)
+			recs[i].key = orig[i];
+		start = time_mono();
+		asort(recs, num, cmp_rec, NULL);
+		report("asort rec", num, 1);
+
+		for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+			for (i = 0; i < num; i++)
+				recs[i].key = orig[i];
+			start = time_mono();
+			asort_parallel(recs, num, cmp_rec, NULL, threads[t]);
+			report("asort_parallel rec", num, threads[t]);
+		}
+
+		for (i = 0; i < num; i++)
+			recs[i].key = orig[i];
+		start = time_mono();
+		if (!asort_radix_by(recs, num, key))
+			abort();
+		report("asort_radix_by rec", num, 1);
+	}
+
+	free(orig);
+	free(ints);
+	free(recs);
+	return 0;
+}
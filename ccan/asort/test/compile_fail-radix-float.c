@@ -0,0 +1,20 @@
+#include <ccan/asort/asort.h>
+#include <ccan/asort/asort.c>
+
+int main(void)
+{
+#ifdef FAIL
+#if HAVE_TYPEOF
+	double arr[2] = { 2, 1 };
+#else
+#error "Unfortunately we don't fail if no typeof support."
+#endif
+#else
+	long arr[2] = { 2, 1 };
+#endif
+#if HAVE_TYPEOF
+	return asort_radix(arr, 2) ? 0 : 1;
+#else
+	return arr[0] == 2 ? 0 : 1;
+#endif
+}
@@ -0,0 +1,70 @@
+#include <ccan/asort/asort.h>
+#include <ccan/asort/asort.c>
+#include <ccan/tap/tap.h>
+#include <stdbool.h>
+
+struct rec {
+	unsigned int key;
+	unsigned int idx;
+};
+
+static int cmp_rec(const struct rec *a, const struct rec *b, void *unused)
+{
+	if (a->key < b->key)
+		return -1;
+	return a->key > b->key;
+}
+
+/* Sorted, and still a permutation of the original. */
+static bool sorted_perm(const struct rec *arr, size_t num)
+{
+	bool *seen = calloc(num, sizeof(*seen));
+	size_t i;
+	bool ret = true;
+
+	for (i = 0; i < num; i++) {
+		if (i > 0 && arr[i].key < arr[i-1].key)
+			ret = false;
+		if (arr[i].idx >= num || seen[arr[i].idx])
+			ret = false;
+		else
+			seen[arr[i].idx] = true;
+	}
+	free(seen);
+	return ret;
+}
+
+static bool test_sort(size_t num, unsigned int nthreads, unsigned int range)
+{
+	struct rec *arr = malloc(sizeof(*arr) * num);
+	size_t i;
+	bool ret;
+
+	for (i = 0; i < num; i++) {
+		arr[i].key = random() % range;
+		arr[i].idx = i;
+	}
+	asort_parallel(arr, num, cmp_rec, NULL, nthreads);
+	ret = sorted_perm(arr, num);
+	free(arr);
+	return ret;
+}
+
+int main(void)
+{
+	plan_tests(9);
+
+	ok1(test_sort(0, 4, 100));
+	ok1(test_sort(1, 4, 100));
+	ok1(test_sort(1000, 4, 100));
+	ok1(test_sort(100000, 1, 1000000));
+	ok1(test_sort(100000, 2, 1000000));
+	ok1(test_sort(100000, 3, 1000000));
+	ok1(test_sort(100000, 8, 1000000));
+	/* Lots of equal keys. */
+	ok1(test_sort(100000, 5, 3));
+	/* More threads than is sensible. */
+	ok1(test_sort(50000, 64, 1000000));
+
+	return exit_status();
+}
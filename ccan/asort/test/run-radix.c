@@ -0,0 +1,130 @@
+#include <ccan/asort/asort.h>
+#include <ccan/asort/asort.c>
+#include <ccan/tap/tap.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+struct rec {
+	uint16_t pad;
+	int64_t key;
+	uint32_t idx;
+};
+
+struct hashed {
+	const char *name;
+	unsigned char hash[5];
+	unsigned int idx;
+};
+
+#define NUM 20000
+
+static uint64_t rand64(void)
+{
+	return ((uint64_t)random() << 42) ^ ((uint64_t)random() << 21) ^ random();
+}
+
+#define LT(a, b) ((a) < (b))
+#define REC_LT(a, b) ((a).key < (b).key)
+/* Equal keys must keep their original order. */
+#define REC_STABLE(a, b) ((a).key == (b).key && (a).idx < (b).idx)
+#define HASH_LT(a, b) (memcmp((a).hash, (b).hash, 5) < 0)
+#define HASH_STABLE(a, b) (memcmp((a).hash, (b).hash, 5) == 0 && (a).idx < (b).idx)
+
+/* Is nothing in arr lt the element before it? */
+#define DEFINE_SORTED(name, type, lt)					\
+	static bool name(const type *arr, size_t num)			\
+	{								\
+		size_t i;						\
+		for (i = 1; i < num; i++)				\
+			if (lt(arr[i], arr[i-1]))			\
+				return false;				\
+		return true;						\
+	}
+
+DEFINE_SORTED(sorted_u8, uint8_t, LT)
+DEFINE_SORTED(sorted_s16, int16_t, LT)
+DEFINE_SORTED(sorted_u32, uint32_t, LT)
+DEFINE_SORTED(sorted_s32, int32_t, LT)
+DEFINE_SORTED(sorted_s64, int64_t, LT)
+DEFINE_SORTED(sorted_u64, uint64_t, LT)
+DEFINE_SORTED(sorted_rec, struct rec, REC_LT)
+DEFINE_SORTED(stable_rec, struct rec, REC_STABLE)
+DEFINE_SORTED(sorted_hash, struct hashed, HASH_LT)
+DEFINE_SORTED(stable_hash, struct hashed, HASH_STABLE)
+
+int main(void)
+{
+	static uint8_t u8[NUM];
+	static int16_t s16[NUM];
+	static uint32_t u32[NUM];
+	static int32_t s32[NUM];
+	static int64_t s64[NUM];
+	static uint64_t same[NUM];
+	static struct rec recs[NUM];
+	static struct hashed hashes[NUM];
+	size_t i;
+
+	plan_tests(11);
+
+	for (i = 0; i < NUM; i++) {
+		u8[i] = random();
+		s16[i] = random();
+		u32[i] = random() * 2;
+		s32[i] = random() - RAND_MAX / 2;
+		s64[i] = rand64();
+		same[i] = 0x1234000000005678ULL | ((uint64_t)(random() % 16) << 24);
+		recs[i].key = (int64_t)(rand64() % 1000) - 500;
+		recs[i].idx = i;
+		hashes[i].idx = i;
+		hashes[i].hash[0] = random() % 3;
+		hashes[i].hash[1] = 7;
+		hashes[i].hash[2] = random();
+		hashes[i].hash[3] = random() % 2;
+		hashes[i].hash[4] = random();
+	}
+	s64[0] = INT64_MIN;
+	s64[1] = INT64_MAX;
+
+#if HAVE_TYPEOF
+	ok1(asort_radix(u8, NUM) && sorted_u8(u8, NUM));
+	ok1(asort_radix(s16, NUM) && sorted_s16(s16, NUM));
+	ok1(asort_radix(u32, NUM) && sorted_u32(u32, NUM));
+	ok1(asort_radix(s32, NUM) && sorted_s32(s32, NUM));
+	ok1(asort_radix(s64, NUM) && sorted_s64(s64, NUM));
+	ok1(s64[0] == INT64_MIN && s64[NUM-1] == INT64_MAX);
+	/* Most bytes are identical, so get skipped. */
+	ok1(asort_radix(same, NUM) && sorted_u64(same, NUM));
+
+	ok1(asort_radix_by(recs, NUM, key) && sorted_rec(recs, NUM));
+	ok1(stable_rec(recs, NUM));
+	ok1(asort_radix_bytes(hashes, NUM, hash) && sorted_hash(hashes, NUM));
+	ok1(stable_hash(hashes, NUM));
+#else
+	/* Without typeof, call the underlying function directly. */
+	ok1(_asort_radix(u8, NUM, 1, 0, 1, ASORT_RADIX_UNSIGNED)
+	    && sorted_u8(u8, NUM));
+	ok1(_asort_radix(s16, NUM, 2, 0, 2, ASORT_RADIX_SIGNED)
+	    && sorted_s16(s16, NUM));
+	ok1(_asort_radix(u32, NUM, 4, 0, 4, ASORT_RADIX_UNSIGNED)
+	    && sorted_u32(u32, NUM));
+	ok1(_asort_radix(s32, NUM, 4, 0, 4, ASORT_RADIX_SIGNED)
+	    && sorted_s32(s32, NUM));
+	ok1(_asort_radix(s64, NUM, 8, 0, 8, ASORT_RADIX_SIGNED)
+	    && sorted_s64(s64, NUM));
+	ok1(s64[0] == INT64_MIN && s64[NUM-1] == INT64_MAX);
+	ok1(_asort_radix(same, NUM, 8, 0, 8, ASORT_RADIX_UNSIGNED)
+	    && sorted_u64(same, NUM));
+
+	ok1(_asort_radix(recs, NUM, sizeof(recs[0]),
+			 offsetof(struct rec, key), 8, ASORT_RADIX_SIGNED)
+	    && sorted_rec(recs, NUM));
+	ok1(stable_rec(recs, NUM));
+	ok1(_asort_radix(hashes, NUM, sizeof(hashes[0]),
+			 offsetof(struct hashed, hash), 5, ASORT_RADIX_BYTES)
+	    && sorted_hash(hashes, NUM));
+	ok1(stable_hash(hashes, NUM));
+#endif
+
+	return exit_status();
+}
@@ -623,6 +623,357 @@ oom1:
 	return BDELTA_MEMORY;
 }
 
+/*
+ * Output for the hash-chain differ.  Patch bytes are buffered and handed to
+ * @write in large pieces, so the whole patch never needs to be in memory.
+ */
+typedef struct
+{
+	bdelta_write_fn write;
+	void *arg;
+	size_t used;
+	unsigned char buf[65536];
+} Sink;
+
+static int sink_flush(Sink *sink)
+{
+	if (sink->used > 0 && sink->write(sink->arg, sink->buf, sink->used) != 0)
+		return -1;
+	sink->used = 0;
+	return 0;
+}
+
+static int sink_write(Sink *sink, const void *data, size_t size)
+{
+	if (size > sizeof(sink->buf) - sink->used) {
+		if (sink_flush(sink) != 0)
+			return -1;
+		/* Large writes (ie. inserted text) go straight through. */
+		if (size >= sizeof(sink->buf))
+			return sink->write(sink->arg, data, size);
+	}
+	memcpy(sink->buf + sink->used, data, size);
+	sink->used += size;
+	return 0;
+}
+
+/*
+ * Like csi32_emit_op, but the size may exceed 32 bits, in which case
+ * we emit several operations.  @data is the text for OP_INSERT.
+ */
+static int sink_op(Sink *sink, int op, size_t size, const unsigned char *data)
+{
+	while (size > 0) {
+		unsigned char header[5];
+		uint32_t chunk, tmp;
+		unsigned int i, size_param_length;
+		
+		chunk = size > UINT32_MAX ? UINT32_MAX : size;
+		size_param_length = bytes_needed_for_size(chunk);
+		header[0] = (unsigned int)op | size_param_length << 2;
+		for (i = size_param_length, tmp = chunk; i > 0; i--, tmp >>= 8)
+			header[i] = tmp & 0xFF;
+		if (sink_write(sink, header, 1 + size_param_length) != 0)
+			return -1;
+		
+		if (op == OP_INSERT) {
+			if (sink_write(sink, data, chunk) != 0)
+				return -1;
+			data += chunk;
+		}
+		size -= chunk;
+	}
+	return 0;
+}
+
+static int sb_write_cb(void *sb, const void *data, size_t size)
+{
+	return sb_write(sb, data, size);
+}
+
+/*
+ * Myers' algorithm is hopeless when the strings differ by a lot, or when
+ * they are huge.  For those, we find matches by indexing the old string
+ * with hash chains, zlib-style: the chains only cover a window of old
+ * starting at the old cursor, so memory use is bounded by the window size
+ * rather than the input size.
+ *
+ * PT_CSI32 can only move forward through old, so matches behind the
+ * cursor are useless; matches ahead of it are reached with a skip.
+ *
+ * Only every HC_STEP'th position of old is indexed, but every position
+ * of new is looked up, so any common run of HC_MIN_MATCH + HC_STEP - 1
+ * bytes will be found (and extended in both directions).
+ */
+#define HC_MIN_MATCH   16
+#define HC_STEP        8
+#define HC_MAX_CHAIN   32
+#define HC_NONE        SIZE_MAX
+
+typedef struct
+{
+	const unsigned char *old;
+	size_t old_size;
+	
+	size_t *head;       /* Most recent position for each hash */
+	size_t *prev;       /* Previous position with same hash, by sample */
+	unsigned int bits;  /* log2 of number of heads and samples */
+	size_t indexed_to;  /* Next old position to index */
+} HashChains;
+
+static size_t hc_hash(const unsigned char *s, unsigned int bits)
+{
+	uint64_t a, b;
+	
+	memcpy(&a, s, sizeof(a));
+	memcpy(&b, s + sizeof(a), sizeof(b));
+	return ((a * 0x9E3779B97F4A7C15ULL + b) * 0xC2B2AE3D27D4EB4FULL)
+		>> (64 - bits);
+}
+
+static int hc_init(HashChains *hc, const unsigned char *old, size_t old_size,
+                   size_t window)
+{
+	size_t i, samples;
+	
+	if (window > old_size)
+		window = old_size;
+	samples = window / HC_STEP + 1;
+	for (hc->bits = 8; ((size_t)1 << hc->bits) < samples; hc->bits++)
+		;
+	
+	hc->old = old;
+	hc->old_size = old_size;
+	hc->indexed_to = 0;
+	hc->head = malloc(sizeof(*hc->head) << hc->bits);
+	hc->prev = malloc(sizeof(*hc->prev) << hc->bits);
+	if (hc->head == NULL || hc->prev == NULL) {
+		free(hc->head);
+		free(hc->prev);
+		return -1;
+	}
+	for (i = 0; i < ((size_t)1 << hc->bits); i++)
+		hc->head[i] = HC_NONE;
+	return 0;
+}
+
+static void hc_free(HashChains *hc)
+{
+	free(hc->head);
+	free(hc->prev);
+}
+
+/* Index old up to @end, starting no earlier than @start. */
+static void hc_index(HashChains *hc, size_t start, size_t end)
+{
+	size_t mask = ((size_t)1 << hc->bits) - 1;
+	
+	if (hc->indexed_to < start)
+		hc->indexed_to = (start + HC_STEP - 1) / HC_STEP * HC_STEP;
+	if (end > hc->old_size - HC_MIN_MATCH + 1)
+		end = hc->old_size - HC_MIN_MATCH + 1;
+	
+	for (; hc->indexed_to < end; hc->indexed_to += HC_STEP) {
+		size_t h = hc_hash(hc->old + hc->indexed_to, hc->bits);
+		
+		hc->prev[(hc->indexed_to / HC_STEP) & mask] = hc->head[h];
+		hc->head[h] = hc->indexed_to;
+	}
+}
+
+/*
+ * Length of the match between old[o_pos] and new_[n_pos], extended
+ * backwards no further than @o_min and @n_min.  Sets *back_out to the
+ * number of bytes it was extended backwards.
+ */
+static size_t match_length(
+	const unsigned char *old, size_t old_size, size_t o_pos, size_t o_min,
+	const unsigned char *new_, size_t new_size, size_t n_pos, size_t n_min,
+	size_t *back_out)
+{
+	size_t fwd = 0, back = 0;
+	
+	while (o_pos + fwd < old_size && n_pos + fwd < new_size &&
+	       old[o_pos + fwd] == new_[n_pos + fwd])
+		fwd++;
+	if (fwd == 0)
+		return 0;
+	while (o_pos - back > o_min && n_pos - back > n_min &&
+	       old[o_pos - back - 1] == new_[n_pos - back - 1])
+		back++;
+	
+	*back_out = back;
+	return back + fwd;
+}
+
+/*
+ * Generate a PT_CSI32 patch using hash chains over a sliding window of old.
+ *
+ * Return values:
+ *
+ *  BDELTA_OK:            Success
+ *  BDELTA_MEMORY:        Memory allocation failed
+ *  BDELTA_WRITE_FAILED:  sink->write returned an error
+ */
+static BDELTAcode diff_hash_chains(
+	const unsigned char *old,  size_t old_size,
+	const unsigned char *new_, size_t new_size,
+	size_t window, Sink *sink)
+{
+	HashChains hc;
+	size_t o = 0;    /* Old cursor: we have copied or skipped up to here. */
+	size_t n = 0;    /* Position in new we're trying to match. */
+	size_t lit = 0;  /* Start of pending insert in new. */
+	size_t mask;
+	unsigned char pt = PT_CSI32;
+	
+	if (sink_write(sink, &pt, 1) != 0)
+		return BDELTA_WRITE_FAILED;
+	
+	if (window > old_size)
+		window = old_size;
+	if (old_size < HC_MIN_MATCH || new_size < HC_MIN_MATCH)
+		goto finish;
+	
+	if (hc_init(&hc, old, old_size, window) != 0)
+		return BDELTA_MEMORY;
+	mask = ((size_t)1 << hc.bits) - 1;
+	
+	while (n + HC_MIN_MATCH <= new_size) {
+		size_t best_len = 0, best_back = 0, best_pos = 0;
+		size_t len, back, lowest, p;
+		unsigned int steps;
+		
+		/*
+		 * The cheapest match is one which keeps us in step with old,
+		 * as if the pending insert replaced the same number of bytes
+		 * (or was a pure insertion).  Try those first.
+		 */
+		p = o + (n - lit);
+		if (p < old_size) {
+			len = match_length(old, old_size, p, o, new_, new_size,
+			                   n, lit, &back);
+			if (len >= HC_MIN_MATCH) {
+				best_len = len;
+				best_back = back;
+				best_pos = p;
+				goto found;
+			}
+		}
+		if (o < old_size && o != p) {
+			len = match_length(old, old_size, o, o, new_, new_size,
+			                   n, lit, &back);
+			if (len >= HC_MIN_MATCH) {
+				best_len = len;
+				best_back = back;
+				best_pos = o;
+				goto found;
+			}
+		}
+		
+		/* Look for the longest match ahead of us in the window. */
+		hc_index(&hc, o, o + window);
+		lowest = o;
+		if (hc.indexed_to > (mask + 1) * HC_STEP &&
+		    hc.indexed_to - (mask + 1) * HC_STEP > lowest)
+			lowest = hc.indexed_to - (mask + 1) * HC_STEP;
+		
+		for (p = hc.head[hc_hash(new_ + n, hc.bits)], steps = 0;
+		     p != HC_NONE && p >= lowest && steps < HC_MAX_CHAIN;
+		     p = hc.prev[(p / HC_STEP) & mask], steps++) {
+			if (memcmp(old + p, new_ + n, HC_MIN_MATCH) != 0)
+				continue;
+			len = match_length(old, old_size, p, o, new_, new_size,
+			                   n, lit, &back);
+			/* Chains run backwards: on a tie, prefer skipping less. */
+			if (len >= best_len) {
+				best_len = len;
+				best_back = back;
+				best_pos = p;
+			}
+		}
+		
+		if (best_len < HC_MIN_MATCH) {
+			n++;
+			continue;
+		}
+		
+	found:
+		n -= best_back;
+		best_pos -= best_back;
+		if (sink_op(sink, OP_INSERT, n - lit, new_ + lit) != 0 ||
+		    sink_op(sink, OP_SKIP, best_pos - o, NULL) != 0 ||
+		    sink_op(sink, OP_COPY, best_len, NULL) != 0) {
+			hc_free(&hc);
+			return BDELTA_WRITE_FAILED;
+		}
+		o = best_pos + best_len;
+		n += best_len;
+		lit = n;
+	}
+	hc_free(&hc);
+	
+finish:
+	/* Whatever's left is inserted; there's no need to skip the rest of old. */
+	if (sink_op(sink, OP_INSERT, new_size - lit, new_ + lit) != 0 ||
+	    sink_flush(sink) != 0)
+		return BDELTA_WRITE_FAILED;
+	return BDELTA_OK;
+}
+
+/*
+ * Generate a patch using hash chains, appending it to @patch_out.
+ */
+static BDELTAcode diff_hash(
+	const char *old,  size_t old_size,
+	const char *new_, size_t new_size,
+	SB *patch_out)
+{
+	Sink *sink;
+	BDELTAcode rc;
+	
+	sink = malloc(sizeof(*sink));
+	if (sink == NULL)
+		return BDELTA_MEMORY;
+	sink->write = sb_write_cb;
+	sink->arg = patch_out;
+	sink->used = 0;
+	
+	rc = diff_hash_chains((const unsigned char *)old, old_size,
+	                      (const unsigned char *)new_, new_size,
+	                      BDELTA_DEFAULT_WINDOW, sink);
+	free(sink);
+	
+	/* The only way sb_write fails is running out of memory. */
+	if (rc == BDELTA_WRITE_FAILED)
+		rc = BDELTA_MEMORY;
+	return rc;
+}
+
+BDELTAcode bdelta_diff_stream(
+	const void *old,  size_t old_size,
+	const void *new_, size_t new_size,
+	size_t window,
+	bdelta_write_fn write, void *arg)
+{
+	Sink *sink;
+	BDELTAcode rc;
+	
+	if (window == 0)
+		window = BDELTA_DEFAULT_WINDOW;
+	
+	sink = malloc(sizeof(*sink));
+	if (sink == NULL)
+		return BDELTA_MEMORY;
+	sink->write = write;
+	sink->arg = arg;
+	sink->used = 0;
+	
+	rc = diff_hash_chains(old, old_size, new_, new_size, window, sink);
+	free(sink);
+	return rc;
+}
+
 BDELTAcode bdelta_diff(
 	const void  *old,       size_t  old_size,
 	const void  *new_,      size_t  new_size,
@@ -636,8 +987,21 @@ BDELTAcode bdelta_diff(
 	if (new_size == 0)
 		goto emit_new_literally;
 	
-	if (diff_myers(old, old_size, new_, new_size, &patch) != BDELTA_OK)
-		goto emit_new_literally;
+	switch (diff_myers(old, old_size, new_, new_size, &patch)) {
+		case BDELTA_OK:
+			break;
+		
+		case BDELTA_INTERNAL_DMAX_EXCEEDED:
+		case BDELTA_INTERNAL_INPUTS_TOO_LARGE:
+			/* Too different (or too big) for Myers: use hash chains. */
+			patch.cur = patch.start;
+			if (diff_hash(old, old_size, new_, new_size, &patch) != BDELTA_OK)
+				goto emit_new_literally;
+			break;
+		
+		default:
+			goto emit_new_literally;
+	}
 	
 	if (sb_size(&patch) > new_size) {
 		/*
@@ -818,6 +1182,8 @@ const char *bdelta_strerror(BDELTAcode code)
 			return "Patch is invalid";
 		case BDELTA_PATCH_MISMATCH:
 			return "Patch applied to wrong data";
+		case BDELTA_WRITE_FAILED:
+			return "Writing patch failed";
 		
 		case BDELTA_INTERNAL_DMAX_EXCEEDED:
 			return "Difference threshold exceeded (internal error)";
@@ -31,6 +31,7 @@ typedef enum {
 	BDELTA_MEMORY           = 1,  /* Memory allocation failed. */
 	BDELTA_PATCH_INVALID    = 2,  /* Patch is malformed. */
 	BDELTA_PATCH_MISMATCH   = 3,  /* Patch applied to wrong original string. */
+	BDELTA_WRITE_FAILED     = 4,  /* Write callback returned an error. */
 	
 	/* Internal error codes.  These will never be returned by API functions. */
 	BDELTA_INTERNAL_DMAX_EXCEEDED    = -10,
@@ -67,6 +68,53 @@ BDELTAcode bdelta_diff(
 	void       **patch_out, size_t *patch_size_out
 );
 
+/*
+ * bdelta_write_fn - Callback which receives patch output from
+ * bdelta_diff_stream.  Returns 0 on success, nonzero on failure.
+ */
+typedef int (*bdelta_write_fn)(void *arg, const void *data, size_t size);
+
+/* Default window for bdelta_diff_stream, in bytes of the old string. */
+#define BDELTA_DEFAULT_WINDOW (16 * 1024 * 1024)
+
+/*
+ * bdelta_diff_stream - Like bdelta_diff, but for very large strings.
+ *
+ * Instead of Myers' algorithm, this finds matches using hash chains over a
+ * sliding @window of the old string (0 means BDELTA_DEFAULT_WINDOW), so
+ * memory use depends on @window, not on the size of the inputs.  There
+ * are two tables of size_t, each with one entry per 8 bytes of @window
+ * plus one, rounded up to a power of two.  For BDELTA_DEFAULT_WINDOW that
+ * is 16MB / 8 + 1 entries, rounded up to 4M: with a 64-bit size_t, 32MB
+ * per table and 64MB in all.  This makes it suitable for mmap'ed files
+ * larger than memory.
+ *
+ * The patch is handed to @write as it is generated, in pieces, and is in
+ * the same format as that produced by bdelta_diff.  Unlike bdelta_diff,
+ * the patch is not verified, and is not replaced with a literal copy of
+ * the new string if that turns out to be smaller.
+ *
+ * Returns BDELTA_OK on success, BDELTA_MEMORY if allocation fails, or
+ * BDELTA_WRITE_FAILED if @write returns nonzero.
+ *
+ * Example:
+ *	static int write_stdout(void *arg, const void *data, size_t size)
+ *	{
+ *		return fwrite(data, 1, size, stdout) == size ? 0 : -1;
+ *	}
+ *	...
+ *	rc = bdelta_diff_stream(old, old_size, new_, new_size, 0,
+ *	                        write_stdout, NULL);
+ *	if (rc != BDELTA_OK)
+ *		bdelta_perror("bdelta_diff_stream", rc);
+ */
+BDELTAcode bdelta_diff_stream(
+	const void *old,  size_t old_size,
+	const void *new_, size_t new_size,
+	size_t window,
+	bdelta_write_fn write, void *arg
+);
+
 /*
  * bdelta_patch - Apply a patch produced by bdelta_diff to the
  * old string to recover the new string.
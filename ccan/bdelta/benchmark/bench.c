@@ -0,0 +1,111 @@
+/* Delta size and throughput of bdelta on large, mostly-similar inputs.
+ * New is old with a random edit (insert, delete or change of up to 1k)
+ * every <spacing> bytes on average. */
+#include <ccan/bdelta/bdelta.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int count_write(void *arg, const void *data, size_t size)
+{
+	*(size_t *)arg += size;
+	return 0;
+}
+
+static void report(const char *name, size_t old_size, size_t new_size,
+		   size_t patch_size, struct timerel t)
+{
+	printf("%s: %zu byte patch (%.2f%% of new), %.1f MB/s\n",
+	       name, patch_size, 100.0 * patch_size / new_size,
+	       (double)(old_size + new_size) / (time_to_usec(t) + 1));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t old_size, new_size = 0, spacing, o = 0, patch_size, i;
+	unsigned char *old, *new_;
+	struct timemono start;
+	void *patch, *result;
+	size_t result_size;
+	BDELTAcode rc;
+
+	if (argc > 3 || (argc > 1 && atol(argv[1]) == 0)) {
+		fprintf(stderr, "Usage: bench [<megabytes> [<edit-spacing>]]\n");
+		exit(1);
+	}
+	old_size = (argc > 1 ? atol(argv[1]) : 256) * 1024 * 1024;
+	spacing = argc > 2 ? atol(argv[2]) : 65536;
+
+	old = malloc(old_size);
+	new_ = malloc(old_size * 2);
+	for (i = 0; i < old_size; i++)
+		old[i] = random();
+
+	while (o < old_size) {
+		size_t run = random() % (spacing * 2), edit = random() % 1024;
+
+		if (run > old_size - o)
+			run = old_size - o;
+		memcpy(new_ + new_size, old + o, run);
+		new_size += run;
+		o += run;
+		switch (random() % 3) {
+		case 0: /* Insert. */
+			for (i = 0; i < edit; i++)
+				new_[new_size++] = random();
+			break;
+		case 1: /* Delete. */
+			o += edit;
+			break;
+		case 2: /* Change. */
+			for (i = 0; i < edit; i++)
+				new_[new_size++] = random();
+			o += edit;
+			break;
+		}
+	}
+
+	printf("old %zu bytes, new %zu bytes:\n", old_size, new_size);
+
+	patch_size = 0;
+	start = time_mono();
+	rc = bdelta_diff_stream(old, old_size, new_, new_size, 0,
+				count_write, &patch_size);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_diff_stream", rc);
+		exit(1);
+	}
+	report("bdelta_diff_stream", old_size, new_size, patch_size,
+	       timemono_since(start));
+
+	/* bdelta_diff also applies the patch to check it. */
+	start = time_mono();
+	rc = bdelta_diff(old, old_size, new_, new_size, &patch, &patch_size);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_diff", rc);
+		exit(1);
+	}
+	report("bdelta_diff", old_size, new_size, patch_size,
+	       timemono_since(start));
+
+	start = time_mono();
+	rc = bdelta_patch(old, old_size, patch, patch_size,
+			  &result, &result_size);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_patch", rc);
+		exit(1);
+	}
+	printf("bdelta_patch: %.1f MB/s\n",
+	       (double)result_size / (time_to_usec(timemono_since(start)) + 1));
+	if (result_size != new_size || memcmp(result, new_, new_size) != 0) {
+		fprintf(stderr, "Patch didn't reproduce new!\n");
+		exit(1);
+	}
+
+	free(result);
+	free(patch);
+	free(old);
+	free(new_);
+	return 0;
+}
@@ -0,0 +1,165 @@
+#include "common.h"
+
+struct collect {
+	SB sb;
+	size_t writes;
+	size_t fail_after;
+};
+
+static int collect_write(void *arg, const void *data, size_t size)
+{
+	struct collect *c = arg;
+
+	if (c->writes++ == c->fail_after)
+		return -1;
+	return sb_write(&c->sb, data, size);
+}
+
+/*
+ * Check that bdelta_diff_stream produces a patch that works,
+ * and that it reports write failures.
+ */
+static int test_stream(const uint8_t *old, uint32_t old_size,
+                       const uint8_t *new_, uint32_t new_size,
+                       size_t window)
+{
+	struct collect c;
+	void *result;
+	size_t result_size;
+	BDELTAcode rc;
+	int ret = 1;
+
+	sb_init(&c.sb);
+	c.writes = 0;
+	c.fail_after = (size_t)-1;
+	rc = bdelta_diff_stream(old, old_size, new_, new_size, window,
+	                        collect_write, &c);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_diff_stream", rc);
+		return 0;
+	}
+	rc = bdelta_patch(old, old_size, c.sb.start, sb_size(&c.sb),
+	                  &result, &result_size);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_patch", rc);
+		return 0;
+	}
+	if (result_size != new_size || memcmp(result, new_, new_size) != 0) {
+		fprintf(stderr, "patch(old, diff_stream(old, new)) != new\n");
+		ret = 0;
+	}
+	free(result);
+	free(c.sb.start);
+
+	sb_init(&c.sb);
+	c.writes = 0;
+	c.fail_after = 0;
+	rc = bdelta_diff_stream(old, old_size, new_, new_size, window,
+	                        collect_write, &c);
+	if (rc != BDELTA_WRITE_FAILED) {
+		fprintf(stderr, "Write failure not reported\n");
+		ret = 0;
+	}
+	free(c.sb.start);
+
+	return ret;
+}
+
+/*
+ * Old is random; new is built from runs of old (in order, with gaps),
+ * with random bytes in between.  Myers gives up on these, so bdelta_diff
+ * has to use hash chains to produce a useful patch.
+ */
+static int test_runs(uint32_t old_size, uint32_t run, size_t window)
+{
+	uint8_t *old, *new_;
+	uint32_t new_size = 0, o = 0;
+	size_t patch_size;
+	void *patch;
+	BDELTAcode rc;
+	int ret = 1;
+
+	old = random_string(old_size, NULL);
+	new_ = malloc(old_size);
+	while (o < old_size) {
+		uint32_t len = rand32() % run + 1;
+
+		if (len > old_size - o)
+			len = old_size - o;
+		if (rand32() % 4 == 0)
+			random_string_into(new_ + new_size, len, NULL);
+		else
+			memcpy(new_ + new_size, old + o, len);
+		new_size += len;
+		o += len;
+		/* Occasionally drop some of old. */
+		if (rand32() % 4 == 0)
+			o += rand32() % run;
+	}
+
+	rc = bdelta_diff(old, old_size, new_, new_size, &patch, &patch_size);
+	if (rc != BDELTA_OK) {
+		bdelta_perror("bdelta_diff", rc);
+		return 0;
+	}
+	/* Three quarters of new is copied, so the patch should show that. */
+	if (patch_size > new_size / 2) {
+		fprintf(stderr, "bdelta_diff patch too large: %zu for %u\n",
+		        patch_size, new_size);
+		ret = 0;
+	}
+	free(patch);
+
+	ret &= test_stream(old, old_size, new_, new_size, window);
+	free(new_);
+	free(old);
+	return ret;
+}
+
+/* Many scattered edits: too many for Myers, but the runs between remain. */
+static int test_edits(uint32_t old_size, uint32_t diff_size)
+{
+	uint8_t *old, *new_;
+	uint32_t new_size;
+	int ret;
+
+	if (random_string_pair(old_size, diff_size, NULL,
+	                       &old, &new_, &new_size) != RSTRING_OK) {
+		fprintf(stderr, "Error generating random string pair\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* bdelta_diff checks its own result. */
+	ret = (bdelta_diff(old, old_size, new_, new_size, NULL, NULL) == BDELTA_OK);
+	ret &= test_stream(old, old_size, new_, new_size, 0);
+	free(new_);
+	free(old);
+	return ret;
+}
+
+int main(void)
+{
+	int i;
+	int count = 10;
+
+	plan_tests(count * 6 + 1);
+
+	for (i = 0; i < count; i++)
+		ok1(test_runs(10000, 200, 0));
+	for (i = 0; i < count; i++)
+		ok1(test_runs(100000, 2000, 0));
+	/* Tiny window: old runs are still found as long as we don't skip far. */
+	for (i = 0; i < count; i++)
+		ok1(test_runs(100000, 1000, 4096));
+	/* Large inserts go straight through to the write callback. */
+	for (i = 0; i < count; i++)
+		ok1(test_runs(1000000, 100000, 0));
+	for (i = 0; i < count; i++)
+		ok1(test_edits(10000, 2000));
+	for (i = 0; i < count; i++)
+		ok1(test_edits(rand32() % 100000, rand32() % 10000));
+
+	ok1(strcmp(bdelta_strerror(BDELTA_WRITE_FAILED), "Writing patch failed") == 0);
+
+	return exit_status();
+}
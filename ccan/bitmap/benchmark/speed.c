@@ -0,0 +1,127 @@
+/* Times the bulk bitmap operations on a free-space sized map against the
+ * word-at-a-time loops callers used to write over bitmap_word arrays.
+ * Run with a bit count to change the size (default 256M bits). */
+#include <ccan/bitmap/bitmap.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void report(const char *what, struct timemono start,
+		   unsigned long nbits, unsigned long result)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-28s %8llu usec (%6.2f Gbit/s) [%lu]\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       (double)nbits / time_to_nsec(diff), result);
+}
+
+static void random_bitmap(bitmap *b, unsigned long nbits, int density)
+{
+	unsigned long i;
+
+	bitmap_zero(b, nbits);
+	for (i = 0; i < nbits; i++)
+		if (random() % 1024 < density)
+			bitmap_set_bit(b, i);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long nbits = argc > 1 ? strtoul(argv[1], NULL, 0) : 1UL << 28;
+	unsigned long nwords = BITMAP_NWORDS(nbits), i, result, len;
+	bitmap *b1 = bitmap_alloc(nbits), *b2 = bitmap_alloc(nbits);
+	bitmap *dst = bitmap_alloc(nbits);
+	struct bitmap_iter it;
+	struct timemono start;
+
+	random_bitmap(b1, nbits, 512);
+	random_bitmap(b2, nbits, 512);
+	bitmap_zero(dst, nbits);
+
+	start = time_mono();
+	for (i = 0; i < nwords; i++)
+		dst[i].w = b1[i].w & b2[i].w;
+	report("and, by word", start, nbits, dst[0].w != 0);
+
+	start = time_mono();
+	bitmap_and(dst, b1, b2, nbits);
+	report("bitmap_and", start, nbits, dst[0].w != 0);
+
+	start = time_mono();
+	for (result = 0, i = 0; i < nwords; i++)
+		result += __builtin_popcountl(b1[i].w);
+	report("popcount, by word", start, nbits, result);
+
+	start = time_mono();
+	result = bitmap_popcount(b1, nbits);
+	report("bitmap_popcount", start, nbits, result);
+
+	/* One bit in 16k set: mostly skipping empty words. */
+	random_bitmap(b1, nbits, 0);
+	for (i = 0; i < nbits; i += 16384 + random() % 1024)
+		bitmap_set_bit(b1, i);
+
+	start = time_mono();
+	for (result = 0, i = 0; i < nwords; i++) {
+		bitmap_word w = b1[i].w;
+		while (w) {
+			w &= w - 1;
+			result++;
+		}
+	}
+	report("sparse, by word", start, nbits, result);
+
+	start = time_mono();
+	for (result = 0, i = bitmap_ffs(b1, 0, nbits); i < nbits;
+	     i = bitmap_ffs(b1, i + 1, nbits))
+		result++;
+	report("sparse, bitmap_ffs loop", start, nbits, result);
+
+	start = time_mono();
+	result = 0;
+	bitmap_for_each_set(&it, i, b1, 0, nbits)
+		result++;
+	report("sparse, bitmap_for_each_set", start, nbits, result);
+
+	/* Half the bits set: mostly within words. */
+	random_bitmap(b2, nbits / 16, 512);
+
+	start = time_mono();
+	for (result = 0, i = bitmap_ffs(b2, 0, nbits / 16); i < nbits / 16;
+	     i = bitmap_ffs(b2, i + 1, nbits / 16))
+		result++;
+	report("dense, bitmap_ffs loop", start, nbits / 16, result);
+
+	start = time_mono();
+	result = 0;
+	bitmap_for_each_set(&it, i, b2, 0, nbits / 16)
+		result++;
+	report("dense, bitmap_for_each_set", start, nbits / 16, result);
+
+	/* A nearly full free-space map, with one hole big enough at the
+	 * end; the rest are smaller. */
+	bitmap_fill(b1, nbits);
+	for (i = 0; i + 64 < nbits; i += 4096 + random() % 4096)
+		bitmap_zero_range(b1, i, i + 1 + random() % 63);
+	len = 64;
+	bitmap_zero_range(b1, nbits - len, nbits);
+
+	start = time_mono();
+	for (result = 0, i = 0; i < nbits; i++) {
+		if (bitmap_test_bit(b1, i))
+			result = 0;
+		else if (++result == len)
+			break;
+	}
+	report("find 64 zeroes, by bit", start, nbits, i + 1 - len);
+
+	start = time_mono();
+	result = bitmap_ffz_run(b1, 0, nbits, len);
+	report("bitmap_ffz_run", start, nbits, result);
+
+	free(b1);
+	free(b2);
+	free(dst);
+	return 0;
+}
@@ -3,9 +3,21 @@
 #include "config.h"
 
 #include <ccan/bitmap/bitmap.h>
+#include <ccan/compiler/compiler.h>
 
 #include <assert.h>
 
+/*
+ * The bulk loops have AVX2 and AVX-512 versions, chosen at runtime.  The
+ * rest of the file is plain C, so callers needn't be built for either.
+ */
+#if defined(__x86_64__) && HAVE_BUILTIN_CPU_SUPPORTS
+#define BITMAP_X86_64 1
+#include <immintrin.h>
+#else
+#define BITMAP_X86_64 0
+#endif
+
 #define BIT_ALIGN_DOWN(n)	((n) & ~(BITMAP_WORD_BITS - 1))
 #define BIT_ALIGN_UP(n)		BIT_ALIGN_DOWN((n) + BITMAP_WORD_BITS - 1)
 
@@ -59,25 +71,127 @@ void bitmap_fill_range(bitmap *b, unsigned long n, unsigned long m)
 		BITMAP_WORD(b, m) |= bitmap_bswap(tailmask);
 }
 
-static int bitmap_clz(bitmap_word w)
-{
-#if HAVE_BUILTIN_CLZL
-	return __builtin_clzl(w);
+/*
+ * Bulk binary operations
+ *
+ * Each vector version does as many whole vectors as fit, and returns how
+ * many words it did; the scalar loop finishes off the rest.
+ */
+#if BITMAP_X86_64
+#define BITMAP_DEF_BULK(_name, _op, _v256, _v512)			\
+	__attribute__((target("avx512f")))				\
+	static unsigned long _name##_avx512(bitmap *dst,		\
+					    const bitmap *src1,		\
+					    const bitmap *src2,		\
+					    unsigned long nwords)	\
+	{								\
+		unsigned long i;					\
+		for (i = 0; i + 8 <= nwords; i += 8) {			\
+			__m512i a = _mm512_loadu_si512(&src1[i]);	\
+			__m512i b = _mm512_loadu_si512(&src2[i]);	\
+			_mm512_storeu_si512(&dst[i], _v512);		\
+		}							\
+		return i;						\
+	}								\
+	__attribute__((target("avx2")))					\
+	static unsigned long _name##_avx2(bitmap *dst,			\
+					  const bitmap *src1,		\
+					  const bitmap *src2,		\
+					  unsigned long nwords)		\
+	{								\
+		unsigned long i;					\
+		for (i = 0; i + 4 <= nwords; i += 4) {			\
+			__m256i a = _mm256_loadu_si256((const void *)&src1[i]); \
+			__m256i b = _mm256_loadu_si256((const void *)&src2[i]); \
+			_mm256_storeu_si256((void *)&dst[i], _v256);	\
+		}							\
+		return i;						\
+	}								\
+	void bitmap_##_name##_(bitmap *dst, const bitmap *src1,	\
+			       const bitmap *src2, unsigned long nwords) \
+	{								\
+		unsigned long i = 0;					\
+		if (cpu_supports("avx512f"))				\
+			i = _name##_avx512(dst, src1, src2, nwords);	\
+		else if (cpu_supports("avx2"))				\
+			i = _name##_avx2(dst, src1, src2, nwords);	\
+		for (; i < nwords; i++)					\
+			dst[i].w = src1[i].w _op src2[i].w;		\
+	}
 #else
-	int lz = 0;
-	bitmap_word mask = (bitmap_word)1 << (BITMAP_WORD_BITS - 1);
+#define BITMAP_DEF_BULK(_name, _op, _v256, _v512)			\
+	void bitmap_##_name##_(bitmap *dst, const bitmap *src1,	\
+			       const bitmap *src2, unsigned long nwords) \
+	{								\
+		unsigned long i;					\
+		for (i = 0; i < nwords; i++)				\
+			dst[i].w = src1[i].w _op src2[i].w;		\
+	}
+#endif
 
-	while (!(w & mask)) {
-		lz++;
-		mask >>= 1;
+BITMAP_DEF_BULK(and, &, _mm256_and_si256(a, b), _mm512_and_si512(a, b))
+BITMAP_DEF_BULK(or, |, _mm256_or_si256(a, b), _mm512_or_si512(a, b))
+BITMAP_DEF_BULK(xor, ^, _mm256_xor_si256(a, b), _mm512_xor_si512(a, b))
+BITMAP_DEF_BULK(andnot, & ~, _mm256_andnot_si256(b, a),
+		_mm512_andnot_si512(b, a))
+
+#undef BITMAP_DEF_BULK
+
+/*
+ * Skip whole words equal to skip (all zeroes or all ones), returning the
+ * index of the first word from i that isn't, or end.
+ */
+#if BITMAP_X86_64
+__attribute__((target("avx512f")))
+static unsigned long skip_words_avx512(const bitmap *b, unsigned long i,
+				       unsigned long end, bitmap_word skip)
+{
+	__m512i s = _mm512_set1_epi64(skip);
+
+	while (i + 8 <= end) {
+		if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(&b[i]), s))
+			break;
+		i += 8;
 	}
+	return i;
+}
 
-	return lz;
+__attribute__((target("avx2")))
+static unsigned long skip_words_avx2(const bitmap *b, unsigned long i,
+				     unsigned long end, bitmap_word skip)
+{
+	__m256i s = _mm256_set1_epi64x(skip);
+
+	while (i + 4 <= end) {
+		__m256i w = _mm256_loadu_si256((const void *)&b[i]);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(w, s)) != -1)
+			break;
+		i += 4;
+	}
+	return i;
+}
+#endif
+
+static unsigned long skip_words(const bitmap *b, unsigned long i,
+				unsigned long end, bitmap_word skip)
+{
+#if BITMAP_X86_64
+	if (end - i >= BITMAP_BULK_WORDS) {
+		if (cpu_supports("avx512f"))
+			i = skip_words_avx512(b, i, end, skip);
+		else if (cpu_supports("avx2"))
+			i = skip_words_avx2(b, i, end, skip);
+	}
 #endif
+	while (i < end && b[i].w == skip)
+		i++;
+	return i;
 }
 
-unsigned long bitmap_ffs(const bitmap *b,
-			 unsigned long n, unsigned long m)
+/* Find the first bit which differs from flip's bits (0 or all ones). */
+static unsigned long bitmap_scan(const bitmap *b,
+				 unsigned long n, unsigned long m,
+				 bitmap_word flip)
 {
 	unsigned long an = BIT_ALIGN_UP(n);
 	unsigned long am = BIT_ALIGN_DOWN(m);
@@ -87,7 +201,7 @@ unsigned long bitmap_ffs(const bitmap *b,
 	assert(m >= n);
 
 	if (am < an) {
-		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, n));
+		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, n) ^ flip);
 
 		w &= (headmask & tailmask);
 
@@ -95,7 +209,7 @@ unsigned long bitmap_ffs(const bitmap *b,
 	}
 
 	if (an > n) {
-		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, n));
+		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, n) ^ flip);
 
 		w &= headmask;
 
@@ -103,17 +217,17 @@ unsigned long bitmap_ffs(const bitmap *b,
 			return BIT_ALIGN_DOWN(n) + bitmap_clz(w);
 	}
 
-	while (an < am) {
-		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, an));
-
-		if (w)
-			return an + bitmap_clz(w);
+	if (an < am) {
+		unsigned long i = skip_words(b, an / BITMAP_WORD_BITS,
+					     am / BITMAP_WORD_BITS, flip);
 
-		an += BITMAP_WORD_BITS;
+		if (i < am / BITMAP_WORD_BITS)
+			return i * BITMAP_WORD_BITS
+				+ bitmap_clz(bitmap_bswap(b[i].w ^ flip));
 	}
 
 	if (m > am) {
-		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, m));
+		bitmap_word w = bitmap_bswap(BITMAP_WORD(b, m) ^ flip);
 
 		w &= tailmask;
 
@@ -123,3 +237,212 @@ unsigned long bitmap_ffs(const bitmap *b,
 
 	return m;
 }
+
+unsigned long bitmap_ffs(const bitmap *b,
+			 unsigned long n, unsigned long m)
+{
+	return bitmap_scan(b, n, m, BITMAP_WORD_0);
+}
+
+unsigned long bitmap_ffz(const bitmap *b,
+			 unsigned long n, unsigned long m)
+{
+	return bitmap_scan(b, n, m, BITMAP_WORD_1);
+}
+
+/*
+ * Population count
+ *
+ * Without -mpopcnt, __builtin_popcountl is a libgcc call, so even the
+ * scalar loop has a version built for the popcnt instruction.
+ */
+static unsigned long popcount_word(bitmap_word w)
+{
+#if HAVE_BUILTIN_POPCOUNTL
+	return __builtin_popcountl(w);
+#else
+	unsigned long count = 0;
+
+	while (w) {
+		w &= w - 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+#if BITMAP_X86_64
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static unsigned long popcount_avx512(const bitmap *b, unsigned long *i,
+				     unsigned long end)
+{
+	__m512i sum = _mm512_setzero_si512();
+
+	for (; *i + 8 <= end; *i += 8)
+		sum = _mm512_add_epi64(sum,
+			_mm512_popcnt_epi64(_mm512_loadu_si512(&b[*i])));
+	return _mm512_reduce_add_epi64(sum);
+}
+
+/* Counts each nibble with a shuffle lookup, then sums the bytes. */
+__attribute__((target("avx2")))
+static unsigned long popcount_avx2(const bitmap *b, unsigned long *i,
+				   unsigned long end)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+					       1, 2, 2, 3, 2, 3, 3, 4,
+					       0, 1, 1, 2, 1, 2, 2, 3,
+					       1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i sum = _mm256_setzero_si256();
+	unsigned long total;
+
+	while (*i + 4 <= end) {
+		__m256i bytes = _mm256_setzero_si256();
+		int j;
+
+		/* Each byte counts up to 8 per round: 31 rounds fit. */
+		for (j = 0; j < 31 && *i + 4 <= end; j++, *i += 4) {
+			__m256i w = _mm256_loadu_si256((const void *)&b[*i]);
+			__m256i lo = _mm256_and_si256(w, low);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(w, 4),
+						      low);
+			bytes = _mm256_add_epi8(bytes,
+					_mm256_shuffle_epi8(table, lo));
+			bytes = _mm256_add_epi8(bytes,
+					_mm256_shuffle_epi8(table, hi));
+		}
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(bytes,
+					_mm256_setzero_si256()));
+	}
+	total = _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1)
+		+ _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+	return total;
+}
+
+__attribute__((target("popcnt")))
+static unsigned long popcount_popcnt(const bitmap *b, unsigned long *i,
+				     unsigned long end)
+{
+	unsigned long count = 0;
+
+	for (; *i < end; (*i)++)
+		count += __builtin_popcountl(b[*i].w);
+	return count;
+}
+#endif
+
+static unsigned long popcount_words(const bitmap *b, unsigned long i,
+				    unsigned long end)
+{
+	unsigned long count = 0;
+
+#if BITMAP_X86_64
+	if (end - i >= BITMAP_BULK_WORDS) {
+		if (cpu_supports("avx512vpopcntdq"))
+			count += popcount_avx512(b, &i, end);
+		else if (cpu_supports("avx2"))
+			count += popcount_avx2(b, &i, end);
+	}
+	if (cpu_supports("popcnt"))
+		return count + popcount_popcnt(b, &i, end);
+#endif
+	for (; i < end; i++)
+		count += popcount_word(b[i].w);
+	return count;
+}
+
+unsigned long bitmap_popcount_range(const bitmap *b,
+				    unsigned long n, unsigned long m)
+{
+	unsigned long an = BIT_ALIGN_UP(n);
+	unsigned long am = BIT_ALIGN_DOWN(m);
+	bitmap_word headmask = BITMAP_WORD_1 >> (n % BITMAP_WORD_BITS);
+	bitmap_word tailmask = ~(BITMAP_WORD_1 >> (m % BITMAP_WORD_BITS));
+	unsigned long count = 0;
+
+	assert(m >= n);
+
+	if (am < an)
+		return popcount_word(BITMAP_WORD(b, n)
+				     & bitmap_bswap(headmask & tailmask));
+
+	if (an > n)
+		count += popcount_word(BITMAP_WORD(b, n)
+				       & bitmap_bswap(headmask));
+
+	if (am > an)
+		count += popcount_words(b, an / BITMAP_WORD_BITS,
+					am / BITMAP_WORD_BITS);
+
+	if (m > am)
+		count += popcount_word(BITMAP_WORD(b, m)
+				       & bitmap_bswap(tailmask));
+
+	return count;
+}
+
+unsigned long bitmap_ffz_run(const bitmap *b, unsigned long n,
+			     unsigned long m, unsigned long len)
+{
+	assert(m >= n);
+
+	if (!len)
+		return n;
+
+	while (m - n >= len) {
+		unsigned long start = bitmap_ffz(b, n, m), end;
+
+		if (m - start < len)
+			break;
+		/* Does the run reach len?  If not, start again past the
+		 * set bit which cut it short. */
+		end = bitmap_ffs(b, start, start + len);
+		if (end == start + len)
+			return start;
+		n = end + 1;
+	}
+	return m;
+}
+
+void bitmap_iter_init(struct bitmap_iter *it, const bitmap *b,
+		      unsigned long n, unsigned long m)
+{
+	assert(m >= n);
+
+	it->b = b;
+	it->m = m;
+	if (n == m) {
+		it->base = m;
+		it->w = 0;
+		return;
+	}
+	it->base = BIT_ALIGN_DOWN(n);
+	it->w = bitmap_bswap(BITMAP_WORD(b, n))
+		& (BITMAP_WORD_1 >> (n % BITMAP_WORD_BITS));
+	if (BIT_ALIGN_DOWN(m) == it->base)
+		it->w &= ~(BITMAP_WORD_1 >> (m % BITMAP_WORD_BITS));
+}
+
+unsigned long bitmap_iter_refill_(struct bitmap_iter *it)
+{
+	unsigned long next;
+
+	if (it->m - it->base <= BITMAP_WORD_BITS) {
+		it->base = it->m;
+		return it->m;
+	}
+
+	next = bitmap_ffs(it->b, it->base + BITMAP_WORD_BITS, it->m);
+	if (next == it->m) {
+		it->base = it->m;
+		return it->m;
+	}
+
+	/* Nothing is set before next in its word: bitmap_ffs checked. */
+	it->base = BIT_ALIGN_DOWN(next);
+	it->w = bitmap_bswap(BITMAP_WORD(it->b, next));
+	if (BIT_ALIGN_DOWN(it->m) == it->base)
+		it->w &= ~(BITMAP_WORD_1 >> (it->m % BITMAP_WORD_BITS));
+	return bitmap_iter_next(it);
+}
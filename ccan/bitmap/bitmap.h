@@ -2,6 +2,7 @@
 #ifndef CCAN_BITMAP_H_
 #define CCAN_BITMAP_H_
 
+#include "config.h"
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -97,11 +98,25 @@ static inline void bitmap_copy(bitmap *dst, const bitmap *src,
 	memcpy(dst, src, bitmap_sizeof(nbits));
 }
 
+/*
+ * Bitmaps of at least this many words are handed to the out-of-line
+ * versions, which use AVX2 or AVX-512 where the CPU has them.
+ */
+#define BITMAP_BULK_WORDS	16
+
 #define BITMAP_DEF_BINOP(_name, _op) \
-	static inline void bitmap_##_name(bitmap *dst, bitmap *src1, bitmap *src2, \
+	void bitmap_##_name##_(bitmap *dst, const bitmap *src1, \
+			       const bitmap *src2, unsigned long nwords); \
+	static inline void bitmap_##_name(bitmap *dst, const bitmap *src1, \
+					  const bitmap *src2, \
 					  unsigned long nbits)		\
 	{ \
 		unsigned long i = 0; \
+		if (BITMAP_NWORDS(nbits) >= BITMAP_BULK_WORDS) { \
+			bitmap_##_name##_(dst, src1, src2, \
+					  BITMAP_NWORDS(nbits)); \
+			return; \
+		} \
 		for (i = 0; i < BITMAP_NWORDS(nbits); i++) { \
 			dst[i].w = src1[i].w _op src2[i].w; \
 		} \
@@ -190,7 +205,88 @@ static inline bool bitmap_empty(const bitmap *b, unsigned long nbits)
 	return true;
 }
 
+/*
+ * Searching and counting
+ *
+ * These all work on the bits from n up to, but not including, m.
+ */
 unsigned long bitmap_ffs(const bitmap *b, unsigned long n, unsigned long m);
+unsigned long bitmap_ffz(const bitmap *b, unsigned long n, unsigned long m);
+
+unsigned long bitmap_popcount_range(const bitmap *b,
+				    unsigned long n, unsigned long m);
+
+static inline unsigned long bitmap_popcount(const bitmap *b,
+					    unsigned long nbits)
+{
+	return bitmap_popcount_range(b, 0, nbits);
+}
+
+/*
+ * Returns the first bit of the first run of len clear bits, or m if there
+ * isn't one.  To allocate from a free-space map, follow this with
+ * bitmap_fill_range(b, first, first + len).
+ */
+unsigned long bitmap_ffz_run(const bitmap *b, unsigned long n,
+			     unsigned long m, unsigned long len);
+
+/*
+ * Iterating over set bits
+ *
+ * The iterator keeps the current word, so each set bit costs only a
+ * count-leading-zeros; runs of empty words are skipped with bitmap_ffs.
+ *
+ *	struct bitmap_iter it;
+ *	unsigned long i;
+ *
+ *	bitmap_for_each_set(&it, i, b, 0, nbits)
+ *		printf("bit %lu is set\n", i);
+ */
+struct bitmap_iter {
+	const bitmap *b;
+	unsigned long base, m;
+	/* What's left of the word at base, byteswapped: bit base is the MSB */
+	bitmap_word w;
+};
+
+static inline int bitmap_clz(bitmap_word w)
+{
+#if HAVE_BUILTIN_CLZL
+	return __builtin_clzl(w);
+#else
+	int lz = 0;
+	bitmap_word mask = (bitmap_word)1 << (BITMAP_WORD_BITS - 1);
+
+	while (!(w & mask)) {
+		lz++;
+		mask >>= 1;
+	}
+
+	return lz;
+#endif
+}
+
+void bitmap_iter_init(struct bitmap_iter *it, const bitmap *b,
+		      unsigned long n, unsigned long m);
+unsigned long bitmap_iter_refill_(struct bitmap_iter *it);
+
+/* Returns the next set bit, or m once there are no more. */
+static inline unsigned long bitmap_iter_next(struct bitmap_iter *it)
+{
+	if (it->w) {
+		int lz = bitmap_clz(it->w);
+
+		it->w &= ~((bitmap_word)1 << (BITMAP_WORD_BITS - 1 - lz));
+		return it->base + lz;
+	}
+	return bitmap_iter_refill_(it);
+}
+
+#define bitmap_for_each_set(_it, _i, _b, _n, _m)			\
+	for (bitmap_iter_init((_it), (_b), (_n), (_m)),		\
+		     (_i) = bitmap_iter_next(_it);			\
+	     (_i) < (_it)->m;						\
+	     (_i) = bitmap_iter_next(_it))
 
 /*
  * Allocation functions
@@ -0,0 +1,184 @@
+#include <ccan/bitmap/bitmap.h>
+#include <ccan/tap/tap.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/foreach/foreach.h>
+
+#include <ccan/bitmap/bitmap.c>
+
+/* Big enough to go through the vector paths, with ragged ends. */
+int bitmap_sizes[] = {
+	1, 7, 63, 64, 65, 129,
+	1023, 1024, 1025, 4099, 65536 + 17,
+};
+#define NSIZES ARRAY_SIZE(bitmap_sizes)
+#define NTESTS 9
+
+/* Sparse, dense and half full, so every search has work to do. */
+static void random_bitmap(bitmap *b, int nbits, int density)
+{
+	int i;
+
+	bitmap_zero(b, nbits);
+	for (i = 0; i < nbits; i++)
+		if (random() % 64 < density)
+			bitmap_set_bit(b, i);
+}
+
+static bool check_binops(bitmap *b1, bitmap *b2, int nbits)
+{
+	bitmap *dst = bitmap_alloc(nbits);
+	int i;
+	bool ok = true;
+
+	bitmap_and(dst, b1, b2, nbits);
+	for (i = 0; i < nbits; i++)
+		if (bitmap_test_bit(dst, i)
+		    != (bitmap_test_bit(b1, i) && bitmap_test_bit(b2, i)))
+			ok = false;
+	bitmap_or(dst, b1, b2, nbits);
+	for (i = 0; i < nbits; i++)
+		if (bitmap_test_bit(dst, i)
+		    != (bitmap_test_bit(b1, i) || bitmap_test_bit(b2, i)))
+			ok = false;
+	bitmap_xor(dst, b1, b2, nbits);
+	for (i = 0; i < nbits; i++)
+		if (bitmap_test_bit(dst, i)
+		    != (bitmap_test_bit(b1, i) != bitmap_test_bit(b2, i)))
+			ok = false;
+	/* In place, as callers often do. */
+	bitmap_copy(dst, b1, nbits);
+	bitmap_andnot(dst, dst, b2, nbits);
+	for (i = 0; i < nbits; i++)
+		if (bitmap_test_bit(dst, i)
+		    != (bitmap_test_bit(b1, i) && !bitmap_test_bit(b2, i)))
+			ok = false;
+	free(dst);
+	return ok;
+}
+
+static unsigned long slow_popcount(bitmap *b, int n, int m)
+{
+	unsigned long count = 0;
+	int i;
+
+	for (i = n; i < m; i++)
+		count += bitmap_test_bit(b, i);
+	return count;
+}
+
+static bool check_popcount(bitmap *b, int nbits)
+{
+	int n, m;
+
+	if (bitmap_popcount(b, nbits) != slow_popcount(b, 0, nbits))
+		return false;
+	for (n = 0; n < nbits; n += 1 + n / 3)
+		for (m = n; m <= nbits; m += 1 + m / 5)
+			if (bitmap_popcount_range(b, n, m)
+			    != slow_popcount(b, n, m))
+				return false;
+	return true;
+}
+
+static bool check_ffz(bitmap *b, int nbits)
+{
+	int n, i;
+
+	for (n = 0; n < nbits; n += 1 + n / 7) {
+		for (i = n; i < nbits && bitmap_test_bit(b, i); i++);
+		if (bitmap_ffz(b, n, nbits) != i)
+			return false;
+	}
+	return true;
+}
+
+static bool check_iter(bitmap *b, int nbits)
+{
+	struct bitmap_iter it;
+	unsigned long i;
+	int n, expect;
+
+	for (n = 0; n < nbits; n += 1 + n / 2) {
+		expect = n;
+		bitmap_for_each_set(&it, i, b, n, nbits) {
+			while (expect < nbits && !bitmap_test_bit(b, expect))
+				expect++;
+			if (i != expect)
+				return false;
+			expect++;
+		}
+		while (expect < nbits && !bitmap_test_bit(b, expect))
+			expect++;
+		if (expect != nbits)
+			return false;
+	}
+	return true;
+}
+
+static unsigned long slow_ffz_run(bitmap *b, int n, int m, int len)
+{
+	int i, run = 0;
+
+	if (!len)
+		return n;
+	for (i = n; i < m; i++) {
+		run = bitmap_test_bit(b, i) ? 0 : run + 1;
+		if (run == len)
+			return i + 1 - len;
+	}
+	return m;
+}
+
+static bool check_ffz_run(bitmap *b, int nbits)
+{
+	int n, len;
+
+	for (n = 0; n < nbits; n += 1 + n / 2)
+		for (len = 0; len <= nbits - n; len += 1 + len / 2)
+			if (bitmap_ffz_run(b, n, nbits, len)
+			    != slow_ffz_run(b, n, nbits, len))
+				return false;
+	return true;
+}
+
+static void test_size(int nbits)
+{
+	bitmap *b1 = bitmap_alloc(nbits), *b2 = bitmap_alloc(nbits);
+
+	random_bitmap(b1, nbits, 32);
+	random_bitmap(b2, nbits, 32);
+	ok1(check_binops(b1, b2, nbits));
+	ok1(check_popcount(b1, nbits));
+	ok1(check_iter(b1, nbits));
+
+	/* Sparse: long runs of zero words. */
+	random_bitmap(b1, nbits, 1);
+	ok1(check_iter(b1, nbits));
+	ok1(check_ffz_run(b1, nbits));
+	ok1(bitmap_ffz_run(b1, 0, nbits, nbits + 1) == nbits);
+
+	/* Dense: long runs of full words. */
+	random_bitmap(b2, nbits, 62);
+	ok1(check_ffz(b2, nbits));
+	ok1(check_ffz_run(b2, nbits));
+	bitmap_fill(b2, nbits);
+	ok1(bitmap_ffz(b2, 0, nbits) == nbits
+	    && bitmap_popcount(b2, nbits) == nbits);
+
+	free(b1);
+	free(b2);
+}
+
+int main(void)
+{
+	int i;
+
+	plan_tests(NSIZES * NTESTS);
+
+	for (i = 0; i < NSIZES; i++) {
+		diag("Testing %d-bit bitmap", bitmap_sizes[i]);
+		test_size(bitmap_sizes[i]);
+	}
+
+	exit(exit_status());
+}
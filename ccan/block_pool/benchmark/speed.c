@@ -0,0 +1,178 @@
+/* Request-scoped allocation: each request makes a few hundred small objects,
+ * drops a quarter of them along the way, and then everything goes at once.
+ * Compares malloc, tal, talloc, a fresh block_pool per request, and one
+ * block_pool reset between requests. */
+#include <ccan/block_pool/block_pool.h>
+#include <ccan/tal/tal.h>
+#include <ccan/talloc/talloc.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REQUESTS 20000
+#define OBJS 300
+
+static size_t sizes[OBJS];
+
+static void random_sizes(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < OBJS; i++)
+		sizes[i] = 8 + (random() % 4 ? random() % 64 : random() % 256);
+}
+
+/* Every fourth object is dropped once the next one exists. */
+#define DROP(i) ((i) % 4 == 1)
+
+static void report(const char *what, struct timemono start)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-24s %6llu usec (%llu nsec per request)\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / REQUESTS));
+}
+
+static void run_malloc(void)
+{
+	void *p[OBJS];
+	unsigned int r, i;
+	struct timemono start = time_mono();
+
+	for (r = 0; r < REQUESTS; r++) {
+		for (i = 0; i < OBJS; i++) {
+			p[i] = malloc(sizes[i]);
+			memset(p[i], i, sizes[i]);
+			if (i && DROP(i-1)) {
+				free(p[i-1]);
+				p[i-1] = NULL;
+			}
+		}
+		for (i = 0; i < OBJS; i++)
+			free(p[i]);
+	}
+	report("malloc", start);
+}
+
+static void run_tal(void)
+{
+	void *p[OBJS];
+	unsigned int r, i;
+	struct timemono start = time_mono();
+
+	for (r = 0; r < REQUESTS; r++) {
+		char *ctx = tal(NULL, char);
+		for (i = 0; i < OBJS; i++) {
+			p[i] = tal_arr(ctx, char, sizes[i]);
+			memset(p[i], i, sizes[i]);
+			if (i && DROP(i-1))
+				tal_free(p[i-1]);
+		}
+		tal_free(ctx);
+	}
+	report("tal", start);
+}
+
+static void run_talloc(void)
+{
+	void *p[OBJS];
+	unsigned int r, i;
+	struct timemono start = time_mono();
+
+	for (r = 0; r < REQUESTS; r++) {
+		void *ctx = talloc_new(NULL);
+		for (i = 0; i < OBJS; i++) {
+			p[i] = talloc_size(ctx, sizes[i]);
+			memset(p[i], i, sizes[i]);
+			if (i && DROP(i-1))
+				talloc_free(p[i-1]);
+		}
+		talloc_free(ctx);
+	}
+	report("talloc", start);
+}
+
+static void run_block_pool(void)
+{
+	void *p[OBJS];
+	unsigned int r, i;
+	struct timemono start = time_mono();
+
+	for (r = 0; r < REQUESTS; r++) {
+		struct block_pool *bp = block_pool_new(NULL);
+		for (i = 0; i < OBJS; i++) {
+			p[i] = block_pool_alloc(bp, sizes[i]);
+			memset(p[i], i, sizes[i]);
+			if (i && DROP(i-1))
+				block_pool_release(bp, p[i-1], sizes[i-1]);
+		}
+		block_pool_free(bp);
+	}
+	report("block_pool new/free", start);
+}
+
+static void run_block_pool_reset(bool release)
+{
+	struct block_pool *bp = block_pool_new(NULL);
+	struct block_pool_stats stats;
+	void *p[OBJS];
+	unsigned int r, i;
+	struct timemono start = time_mono();
+
+	for (r = 0; r < REQUESTS; r++) {
+		for (i = 0; i < OBJS; i++) {
+			p[i] = block_pool_alloc(bp, sizes[i]);
+			memset(p[i], i, sizes[i]);
+			if (release && i && DROP(i-1))
+				block_pool_release(bp, p[i-1], sizes[i-1]);
+		}
+		if (r == REQUESTS - 1)
+			block_pool_stats(bp, &stats);
+		block_pool_reset(bp);
+	}
+	report(release ? "block_pool reset+release" : "block_pool reset", start);
+	printf("    %zu blocks, %zu bytes: %zu allocated, %zu released, "
+	       "%zu unused, %zu wasted, %zu reused\n",
+	       stats.blocks, stats.capacity, stats.allocated, stats.released,
+	       stats.unused, stats.wasted, stats.reused);
+	block_pool_free(bp);
+}
+
+/* A pool that is never reset: with release, churn stops growing it. */
+static void run_long_lived(bool release)
+{
+	struct block_pool *bp = block_pool_new(NULL);
+	struct block_pool_stats stats;
+	void *p[OBJS];
+	unsigned int r, i;
+
+	for (i = 0; i < OBJS; i++)
+		p[i] = block_pool_alloc(bp, sizes[i]);
+	for (r = 0; r < 1000; r++) {
+		i = random() % OBJS;
+		if (release)
+			block_pool_release(bp, p[i], sizes[i]);
+		p[i] = block_pool_alloc(bp, sizes[i]);
+	}
+	block_pool_stats(bp, &stats);
+	printf("long-lived%-14s %zu blocks, %zu bytes: %zu allocated, "
+	       "%zu released, %zu wasted\n", release ? ", release" : "",
+	       stats.blocks, stats.capacity, stats.allocated,
+	       stats.released, stats.wasted);
+	block_pool_free(bp);
+}
+
+int main(void)
+{
+	random_sizes();
+	run_malloc();
+	run_tal();
+	run_talloc();
+	run_block_pool();
+	run_block_pool_reset(false);
+	run_block_pool_reset(true);
+	run_long_lived(false);
+	run_long_lived(true);
+	return 0;
+}
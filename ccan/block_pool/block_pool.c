@@ -23,11 +23,15 @@
 #include "block_pool.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
 //must be a power of 2
 #define BLOCK_SIZE 4096
 
+#define CLASS_SHIFT 3
+#define CLASSES ((BLOCK_POOL_MAX_RELEASE >> CLASS_SHIFT) + 1)
+
 struct block {
 	size_t remaining;
 	size_t size;
@@ -41,6 +45,14 @@ struct block_pool {
 	
 	//blocks are arranged in a max-heap by the .remaining field
 	// (except the root block does not percolate down until it is filled)
+	
+	//released blocks, by size/8.  Each links to the next through its
+	// first pointer-sized bytes.
+	void *free_list[CLASSES];
+	
+	size_t allocated; //bytes handed out, less bytes released
+	size_t released;  //bytes sitting in free_list
+	size_t reused;
 };
 
 static int destructor(struct block_pool *bp) {
@@ -62,6 +74,11 @@ struct block_pool *block_pool_new(void *ctx) {
 	bp->alloc = 7;
 	bp->block = malloc(bp->alloc * sizeof(struct block));
 	
+	memset(bp->free_list, 0, sizeof(bp->free_list));
+	bp->allocated = 0;
+	bp->released = 0;
+	bp->reused = 0;
+	
 	return bp;
 }
 
@@ -139,12 +156,38 @@ static void percolate_up(struct block_pool *bp, size_t node) {
 	percolate_up(bp, parent);
 }
 
+//pop a released block of this size, if there is one suitably aligned
+static void *try_free_list(struct block_pool *bp, size_t size, size_t align) {
+	size_t class = (size + ((1<<CLASS_SHIFT)-1)) >> CLASS_SHIFT;
+	void *ret = bp->free_list[class];
+	
+	//only look at the head; mixed alignments within a size are rare
+	if (!ret || ((uintptr_t)ret & align))
+		return NULL;
+	
+	bp->free_list[class] = *(void**)ret;
+	bp->released -= class << CLASS_SHIFT;
+	bp->reused++;
+	return ret;
+}
+
 void *block_pool_alloc_align(struct block_pool *bp, size_t size, size_t align) {
 	void *ret;
 	
 	if (align)
 		align--;
 	
+	bp->allocated += size;
+	
+	//small blocks take up whole granules, so a released one can be reused
+	// by any request that rounds to the same size
+	if (size && size <= BLOCK_POOL_MAX_RELEASE) {
+		ret = try_free_list(bp, size, align);
+		if (ret)
+			return ret;
+		size = (size + ((1<<CLASS_SHIFT)-1)) & ~((1<<CLASS_SHIFT)-1);
+	}
+	
 	//if there aren't any blocks, make a new one
 	if (!bp->count) {
 		bp->count = 1;
@@ -177,11 +220,59 @@ void *block_pool_alloc_align(struct block_pool *bp, size_t size, size_t align) {
 	return ret;
 }
 
+void block_pool_reset(struct block_pool *bp) {
+	size_t i;
+	
+	for (i=0; i<bp->count; i++)
+		bp->block[i].remaining = bp->block[i].size;
+	
+	//every block changed, so rebuild the heap from scratch
+	for (i=bp->count/2; i--;)
+		percolate_down(bp, i);
+	
+	memset(bp->free_list, 0, sizeof(bp->free_list));
+	bp->allocated = 0;
+	bp->released = 0;
+	bp->reused = 0;
+}
+
 #undef L
 #undef R
 #undef P
 #undef V
 
+void block_pool_release(struct block_pool *bp, void *ptr, size_t size) {
+	size_t class = (size + ((1<<CLASS_SHIFT)-1)) >> CLASS_SHIFT;
+	
+	bp->allocated -= size;
+	
+	//too big, or can't hold the link aligned
+	if (!size || size > BLOCK_POOL_MAX_RELEASE
+	    || ((uintptr_t)ptr & (sizeof(void*)-1)))
+		return;
+	
+	*(void**)ptr = bp->free_list[class];
+	bp->free_list[class] = ptr;
+	bp->released += class << CLASS_SHIFT;
+}
+
+void block_pool_stats(const struct block_pool *bp, struct block_pool_stats *stats) {
+	size_t i;
+	
+	stats->blocks = bp->count;
+	stats->capacity = 0;
+	stats->unused = 0;
+	for (i=0; i<bp->count; i++) {
+		stats->capacity += bp->block[i].size;
+		stats->unused += bp->block[i].remaining;
+	}
+	stats->allocated = bp->allocated;
+	stats->released = bp->released;
+	stats->wasted = stats->capacity - stats->unused
+		- stats->allocated - stats->released;
+	stats->reused = bp->reused;
+}
+
 char *block_pool_strdup(struct block_pool *bp, const char *str) {
 	size_t size = strlen(str)+1;
 	char *ret = block_pool_alloc_align(bp, size, 1);
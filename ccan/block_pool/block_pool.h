@@ -28,6 +28,21 @@
 
 struct block_pool;
 
+/* Largest size block_pool_release will keep for reuse.  Blocks up to this
+   size are rounded up to a multiple of 8 bytes, with a free list for each. */
+#define BLOCK_POOL_MAX_RELEASE 256
+
+struct block_pool_stats {
+	size_t blocks;    //number of buffers the pool has malloc'd
+	size_t capacity;  //total bytes in those buffers
+	size_t allocated; //bytes handed out and not released
+	size_t released;  //bytes on the free lists, waiting to be reused
+	size_t unused;    //bytes at the ends of buffers, not yet handed out
+	size_t wasted;    //everything else: alignment padding, leftovers
+	                  // from reuse, and releases too odd to keep
+	size_t reused;    //allocations served from the free lists
+};
+
 /* Construct a new block pool.
    ctx is a talloc context (or NULL if you don't know what talloc is ;) ) */
 struct block_pool *block_pool_new(void *ctx);
@@ -38,8 +53,8 @@ struct block_pool *block_pool_new(void *ctx);
 void *block_pool_alloc_align(struct block_pool *bp, size_t size, size_t align);
 
 /* Allocate a block of a given size.  The returned pointer will remain valid
-   for the life of the block_pool.  The block cannot be resized or
-   freed individually. */
+   for the life of the block_pool (or until block_pool_reset).  The block
+   cannot be resized, but see block_pool_release. */
 static inline void *block_pool_alloc(struct block_pool *bp, size_t size) {
 	size_t align = size & -size; //greatest power of two by which size is divisible
 	if (align > 16)
@@ -51,6 +66,21 @@ static inline void block_pool_free(struct block_pool *bp) {
 	talloc_free(bp);
 }
 
+/* Give a block back to the pool so a later allocation of the same size can
+   reuse it.  size must be the size it was allocated with.  Blocks larger than
+   BLOCK_POOL_MAX_RELEASE or not pointer-aligned (such as strings) are not
+   reused; they are only counted as wasted. */
+void block_pool_release(struct block_pool *bp, void *ptr, size_t size);
+
+/* Forget every allocation, but keep the buffers for the next round.  This is
+   meant for pools that serve one request at a time: after the first few
+   requests, allocation never has to go to malloc.  All pointers handed out
+   before the reset become invalid. */
+void block_pool_reset(struct block_pool *bp);
+
+/* Fill in stats with the pool's current memory usage. */
+void block_pool_stats(const struct block_pool *bp, struct block_pool_stats *stats);
+
 
 char *block_pool_strdup(struct block_pool *bp, const char *str);
 
@@ -0,0 +1,106 @@
+#include <ccan/block_pool/block_pool.h>
+#include <ccan/block_pool/block_pool.c>
+#include <ccan/tap/tap.h>
+
+#define NUM 1000
+
+//everything the pool has malloc'd is accounted for exactly once
+static int stats_add_up(struct block_pool *bp, struct block_pool_stats *s) {
+	block_pool_stats(bp, s);
+	return s->allocated + s->released + s->unused + s->wasted
+		== s->capacity;
+}
+
+int main(void)
+{
+	struct block_pool *bp = block_pool_new(NULL);
+	struct block_pool_stats s;
+	void *p[NUM], *q[NUM];
+	char *big, *str;
+	size_t i, blocks, capacity;
+	int same, aligned;
+	
+	plan_tests(24);
+	
+	ok1(stats_add_up(bp, &s));
+	ok1(s.blocks == 0 && s.capacity == 0);
+	
+	for (i=0; i<NUM; i++)
+		p[i] = block_pool_alloc(bp, 24);
+	ok1(stats_add_up(bp, &s));
+	ok1(s.allocated == NUM*24);
+	ok1(s.reused == 0);
+	blocks = s.blocks;
+	
+	//release them all: the same sizes come back, without new blocks
+	for (i=0; i<NUM; i++)
+		block_pool_release(bp, p[i], 24);
+	ok1(stats_add_up(bp, &s));
+	ok1(s.allocated == 0 && s.released == NUM*24);
+	
+	for (i=0; i<NUM; i++)
+		q[i] = block_pool_alloc(bp, 24);
+	ok1(stats_add_up(bp, &s));
+	ok1(s.blocks == blocks);
+	ok1(s.reused == NUM && s.released == 0);
+	//it's a stack, so they come back in reverse
+	same = 1;
+	for (i=0; i<NUM; i++)
+		if (q[i] != p[NUM-1-i])
+			same = 0;
+	ok1(same);
+	
+	//24-byte blocks are only 8-byte aligned; a request for 16-byte
+	// alignment must not get one that isn't
+	for (i=0; i<NUM; i++)
+		block_pool_release(bp, q[i], 24);
+	aligned = 1;
+	for (i=0; i<NUM; i++) {
+		p[i] = block_pool_alloc_align(bp, 24, 16);
+		if ((uintptr_t)p[i] & 15)
+			aligned = 0;
+	}
+	ok1(aligned);
+	ok1(stats_add_up(bp, &s));
+	
+	//small sizes are rounded to 8, so odd sizes reuse each other
+	str = block_pool_alloc(bp, 20);
+	block_pool_release(bp, str, 20);
+	ok1(block_pool_alloc(bp, 17) == str);
+	
+	//oversized releases are just waste
+	big = block_pool_alloc(bp, BLOCK_POOL_MAX_RELEASE*2);
+	block_pool_release(bp, big, BLOCK_POOL_MAX_RELEASE*2);
+	ok1(stats_add_up(bp, &s));
+	ok1(s.wasted >= BLOCK_POOL_MAX_RELEASE*2);
+	
+	//a reset keeps every block, and hands them out again
+	blocks = s.blocks;
+	capacity = s.capacity;
+	block_pool_reset(bp);
+	ok1(stats_add_up(bp, &s));
+	ok1(s.blocks == blocks && s.capacity == capacity);
+	ok1(s.allocated == 0 && s.released == 0 && s.wasted == 0);
+	ok1(s.reused == 0);
+	ok1(s.unused == capacity);
+	
+	for (i=0; i<NUM; i++) {
+		p[i] = block_pool_alloc(bp, 24);
+		memset(p[i], 0xaa, 24);
+	}
+	for (i=0; i<NUM; i++)
+		p[i] = block_pool_alloc(bp, 24);
+	block_pool_stats(bp, &s);
+	ok1(s.blocks == blocks);
+	
+	//grow past what we had, and reset again
+	for (i=0; i<NUM; i++)
+		p[i] = block_pool_alloc(bp, 100);
+	block_pool_stats(bp, &s);
+	ok1(s.blocks > blocks);
+	block_pool_reset(bp);
+	ok1(stats_add_up(bp, &s));
+	
+	block_pool_free(bp);
+	return exit_status();
+}
@@ -0,0 +1,112 @@
+/* Times bulk loading, lookups, order statistics and range removal. */
+#include <ccan/btree/btree.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static btree_search_implement(order_by_ptr, size_t*, , a == b, a < b)
+
+static struct timemono start;
+
+static void start_timer(const char *what, size_t n)
+{
+	printf("%s %zu: ", what, n);
+	fflush(stdout);
+	start = time_mono();
+}
+
+static void stop_timer(size_t n)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%llu usec (%llu nsec each)\n",
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / (n ? n : 1)));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i, n = 5000000, ops = 1000000, removed, sum = 0;
+	size_t *array, **items;
+	struct btree *btree;
+	btree_iterator iter, to;
+
+	if (argc > 1)
+		n = atol(argv[1]);
+	if (argc > 2)
+		ops = atol(argv[2]);
+
+	array = calloc(n, sizeof(*array));
+	items = malloc(sizeof(*items) * n);
+	for (i = 0; i < n; i++)
+		items[i] = &array[i];
+	srandom(1);
+
+	printf("%zu items per node\n", (size_t)BTREE_ITEM_MAX);
+
+	btree = btree_new(order_by_ptr);
+	start_timer("btree_insert (sorted)", n);
+	for (i = 0; i < n; i++)
+		btree_insert(btree, items[i]);
+	stop_timer(n);
+	btree_delete(btree);
+
+	btree = btree_new(order_by_ptr);
+	start_timer("btree_load_sorted", n);
+	btree_load_sorted(btree, (const void * const *)items, n);
+	stop_timer(n);
+
+	start_timer("btree_lookup", ops);
+	for (i = 0; i < ops; i++)
+		sum += (btree_lookup(btree, &array[random() % n]) != NULL);
+	stop_timer(ops);
+
+	start_timer("btree_select", ops);
+	for (i = 0; i < ops; i++)
+		sum += btree_select(btree, random() % n, iter);
+	stop_timer(ops);
+
+	start_timer("btree_find+btree_rank", ops);
+	for (i = 0; i < ops; i++) {
+		btree_find(btree, &array[random() % n], iter);
+		sum += btree_rank(iter);
+	}
+	stop_timer(ops);
+
+	start_timer("btree_count_range", ops);
+	for (i = 0; i < ops; i++) {
+		size_t a = random() % n;
+		btree_find(btree, &array[a], iter);
+		btree_find(btree, &array[a + random() % (n - a)], to);
+		sum += btree_count_range(iter, to);
+	}
+	stop_timer(ops);
+
+	/* Remove a tenth of the items, in 1000 ranges. */
+	removed = 0;
+	start_timer("btree_remove_range (1000 ranges)", n / 10);
+	for (i = 0; i < 1000; i++) {
+		size_t a = random() % (btree->count - n / 10000);
+		btree_select(btree, a, iter);
+		btree_select(btree, a + n / 10000, to);
+		removed += btree_remove_range(iter, to);
+	}
+	stop_timer(removed);
+
+	removed = 0;
+	start_timer("btree_remove_at (1000 ranges)", n / 10);
+	for (i = 0; i < 1000; i++) {
+		size_t j, a = random() % (btree->count - n / 10000);
+		for (j = 0; j < n / 10000; j++) {
+			btree_select(btree, a, iter);
+			removed += btree_remove_at(iter);
+		}
+	}
+	stop_timer(removed);
+
+	btree_delete(btree);
+	free(items);
+	free(array);
+	/* Stop the compiler optimizing everything away. */
+	return sum == 0;
+}
@@ -23,6 +23,7 @@
 #include "btree.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -31,6 +32,10 @@
 
 static struct btree_node *node_alloc(int internal);
 static void node_delete(struct btree_node *node, struct btree *btree);
+static void node_free(struct btree_node *node);
+static size_t node_total(const struct btree_node *node);
+static struct btree_node *node_add_total(struct btree_node *node,
+				ptrdiff_t delta);
 
 static void branch_begin(btree_iterator iter);
 static void branch_end(btree_iterator iter);
@@ -51,10 +56,21 @@ static void node_insert(const void *x, struct btree_node *xr,
 				struct btree_node *p, unsigned int k);
 static void node_split(const void **x, struct btree_node **xr,
 				struct btree_node *p, unsigned int k);
+static struct btree_node *node_insert_up(const void *x, struct btree_node *xr,
+				struct btree_node *p, unsigned int k, size_t total);
 
 static void node_remove_leaf_item(struct btree_node *node, unsigned int k);
 void node_restore(struct btree_node *node, unsigned int k);
 
+static struct btree_node *node_build(const void * const **items,
+				size_t count, unsigned int depth);
+static struct btree_node *node_select(struct btree_node *node,
+				size_t index, unsigned int *k);
+static struct btree_node *node_join(struct btree_node *l, const void *x,
+				struct btree_node *r);
+static const void *split_at(struct btree_node *node, unsigned int k,
+				struct btree_node **l, struct btree_node **r);
+
 static int node_walk_backward(const struct btree_node *node,
 				btree_action_t action, void *ctx);
 static int node_walk_forward(const struct btree_node *node,
@@ -70,6 +86,7 @@ struct btree *btree_new(btree_search_t search)
 		node->parent = NULL;
 		node->count = 0;
 		node->depth = 0;
+		node->total = 0;
 	btree->root = node;
 	btree->search = search;
 	btree->multi = false;
@@ -95,18 +112,19 @@ bool btree_insert(struct btree *btree, const void *item)
 
 bool btree_remove(struct btree *btree, const void *key)
 {
-	btree_iterator iter;
-	bool success = false;
-	bool multi = btree->multi;
+	btree_iterator iter, last;
 	
-	do {
-		if (btree_find_first(btree, key, iter)) {
-			btree_remove_at(iter);
-			success = true;
-		}
-	} while (multi);
+	if (!btree_find_first(btree, key, iter))
+		return false;
+	
+	if (btree->multi) {
+		btree_find_last(btree, key, last);
+		btree_remove_range(iter, last);
+	} else {
+		btree_remove_at(iter);
+	}
 	
-	return success;
+	return true;
 }
 
 void *btree_lookup(struct btree *btree, const void *key)
@@ -119,6 +137,41 @@ void *btree_lookup(struct btree *btree, const void *key)
 	return NULL;
 }
 
+/*
+ * Returns the number of items a subtree of the given depth can hold,
+ * or SIZE_MAX if that doesn't fit in a size_t.
+ */
+static size_t depth_capacity(unsigned int depth)
+{
+	size_t cap = MAX;
+	
+	while (depth--) {
+		if (cap > (SIZE_MAX - MAX) / (MAX + 1))
+			return SIZE_MAX;
+		cap = cap * (MAX + 1) + MAX;
+	}
+	return cap;
+}
+
+bool btree_load_sorted(struct btree *btree,
+			const void * const *items, size_t count)
+{
+	unsigned int depth = 0;
+	
+	if (btree->count)
+		return false;
+	if (!count)
+		return true;
+	
+	while (depth_capacity(depth) < count)
+		depth++;
+	
+	free(btree->root);
+	btree->root = node_build(&items, count, depth);
+	btree->count = count;
+	return true;
+}
+
 int btree_begin_end_lr(const struct btree *btree, btree_iterator iter, int lr)
 {
 	struct btree_node *node;
@@ -227,9 +280,6 @@ int btree_walk_forward(const struct btree *btree,
 
 void btree_insert_at(btree_iterator iter, const void *item)
 {
-	const void *x = item;
-	struct btree_node *xr = NULL;
-	struct btree_node *p;
 	struct btree *btree = iter->btree;
 	
 	/* btree_insert_at always sets iter->item to item. */
@@ -243,48 +293,7 @@ void btree_insert_at(btree_iterator iter, const void *item)
 	if (iter->node->depth)
 		branch_end(iter);
 	
-	/*
-	 * First try inserting item into this node.
-	 * If it's too big, split it, and repeat by
-	 * trying to insert the median and right subtree into parent.
-	 */
-	if (iter->node->count < MAX) {
-		node_insert(x, xr, iter->node, iter->k);
-		goto finished;
-	} else {
-		for (;;) {
-			node_split(&x, &xr, iter->node, iter->k);
-			
-			if (!ascend(iter))
-				break;
-			
-			if (iter->node->count < MAX) {
-				node_insert(x, xr, iter->node, iter->k);
-				goto finished;
-			}
-		}
-		
-		/*
-		 * If splitting came all the way up to the root, create a new root whose
-		 * left branch is the current root, median is x, and right branch is the
-		 * half split off from the root.
-		 */
-		assert(iter->node == btree->root);
-		p = node_alloc(1);
-		p->parent = NULL;
-		p->count = 1;
-		p->depth = btree->root->depth + 1;
-		p->item[0] = x;
-		p->branch[0] = btree->root;
-			btree->root->parent = p;
-			btree->root->k = 0;
-		p->branch[1] = xr;
-			xr->parent = p;
-			xr->k = 1;
-		btree->root = p;
-	}
-	
-finished:
+	btree->root = node_insert_up(item, NULL, iter->node, iter->k, 1);
 	btree->count++;
 	iter->node = NULL;
 }
@@ -299,6 +308,7 @@ int btree_remove_at(btree_iterator iter)
 	
 	if (!iter->node->depth) {
 		node_remove_leaf_item(iter->node, iter->k);
+		node_add_total(iter->node, -1);
 		if (iter->node->count >= MIN || !iter->node->parent)
 			goto finished;
 	} else {
@@ -320,6 +330,7 @@ int btree_remove_at(btree_iterator iter)
 		
 		/* Remove successor. */
 		node_remove_leaf_item(iter->node, 0);
+		node_add_total(iter->node, -1);
 	}
 	
 	/*
@@ -353,6 +364,81 @@ finished:
 	return 1;
 }
 
+size_t btree_remove_range(btree_iterator iter_from, btree_iterator iter_to)
+{
+	struct btree *btree = iter_from->btree;
+	size_t from = btree_rank(iter_from), to = btree_rank(iter_to);
+	struct btree_node *node, *head, *l, *mid, *r = NULL;
+	const void *y = NULL;
+	unsigned int k;
+	
+	if (from >= to)
+		return 0;
+	
+	/* Split off the item at iter_to and everything after it. */
+	head = btree->root;
+	if (to < btree->count) {
+		node = node_select(head, to, &k);
+		y = split_at(node, k, &head, &r);
+	}
+	
+	/* Split off the range itself, and throw it away. */
+	node = node_select(head, from, &k);
+	split_at(node, k, &l, &mid);
+	node_free(mid);
+	
+	/* Glue the ends back together, using the item at iter_to. */
+	btree->root = r ? node_join(l, y, r) : l;
+	btree->count -= to - from;
+	return to - from;
+}
+
+size_t btree_rank(const btree_iterator iter)
+{
+	const struct btree_node *node = iter->node;
+	unsigned int i, k = iter->k;
+	size_t rank = k;
+	
+	/* Count the items before k, and the branches to the left of item[k]. */
+	if (node->depth) {
+		for (i = 0; i <= k; i++)
+			rank += node->branch[i]->total;
+	}
+	
+	/* Then everything to our left in each ancestor. */
+	while (node->parent) {
+		k = node->k;
+		node = node->parent;
+		rank += k;
+		for (i = 0; i < k; i++)
+			rank += node->branch[i]->total;
+	}
+	
+	return rank;
+}
+
+int btree_select(const struct btree *btree, size_t index, btree_iterator iter)
+{
+	iter->btree = (struct btree *)btree;
+	
+	if (index >= btree->count) {
+		begin_end_lr(iter, btree->root, 1);
+		return 0;
+	}
+	
+	iter->node = node_select(btree->root, index, &iter->k);
+	iter->item = (void*)iter->node->item[iter->k];
+	return 1;
+}
+
+size_t btree_count_range(const btree_iterator iter_from,
+			const btree_iterator iter_to)
+{
+	size_t from = btree_rank(iter_from), to = btree_rank(iter_to);
+	
+	return to > from ? to - from : 0;
+}
+
 /*
  * ascends iterator a until it matches iterator b's depth.
  *
@@ -431,6 +517,43 @@ static struct btree_node *node_alloc(int internal)
 	return node;
 }
 
+/* Frees node and its descendents, but not the items. */
+static void node_free(struct btree_node *node)
+{
+	unsigned int i;
+	
+	if (node->depth) {
+		for (i=0; i<=node->count; i++)
+			node_free(node->branch[i]);
+	}
+	free(node);
+}
+
+/* Counts the items in node's subtree, using its branches' totals. */
+static size_t node_total(const struct btree_node *node)
+{
+	size_t total = node->count;
+	unsigned int i;
+	
+	if (node->depth) {
+		for (i=0; i<=node->count; i++)
+			total += node->branch[i]->total;
+	}
+	return total;
+}
+
+/* Adds delta to the totals of node and its ancestors, and returns the root. */
+static struct btree_node *node_add_total(struct btree_node *node,
+				ptrdiff_t delta)
+{
+	for (;;) {
+		node->total += delta;
+		if (!node->parent)
+			return node;
+		node = node->parent;
+	}
+}
+
 static void node_delete(struct btree_node *node, struct btree *btree)
 {
 	unsigned int i, count = node->count;
@@ -593,6 +716,58 @@ static void node_split(const void **x, struct btree_node **xr,
 	 */
 	*x = l->item[--l->count];
 	*xr = r;
+	
+	l->total = node_total(l);
+	r->total = node_total(r);
+}
+
+/*
+ * Inserts item x and right branch xr into node p at position k, splitting
+ * p and its ancestors as needed.  total is the number of items this adds
+ * to p's subtree (1 plus the number under xr).
+ *
+ * Returns the root, which is new if splitting came all the way up.
+ */
+static struct btree_node *node_insert_up(const void *x, struct btree_node *xr,
+				struct btree_node *p, unsigned int k, size_t total)
+{
+	struct btree_node *root;
+	
+	/*
+	 * First try inserting item into this node.
+	 * If it's too big, split it, and repeat by
+	 * trying to insert the median and right subtree into parent.
+	 */
+	while (p->count == MAX) {
+		node_split(&x, &xr, p, k);
+		
+		if (!p->parent) {
+			/*
+			 * If splitting came all the way up to the root, create a new
+			 * root whose left branch is the current root, median is x,
+			 * and right branch is the half split off from the root.
+			 */
+			root = node_alloc(1);
+			root->parent = NULL;
+			root->count = 1;
+			root->depth = p->depth + 1;
+			root->item[0] = x;
+			root->branch[0] = p;
+				p->parent = root;
+				p->k = 0;
+			root->branch[1] = xr;
+				xr->parent = root;
+				xr->k = 1;
+			root->total = p->total + 1 + xr->total;
+			return root;
+		}
+		
+		k = p->k;
+		p = p->parent;
+	}
+	
+	node_insert(x, xr, p, k);
+	return node_add_total(p, total);
 }
 
 /*
@@ -609,8 +784,12 @@ static void node_remove_leaf_item(struct btree_node *node, unsigned int k)
 	node->count--;
 }
 
-static void move_left(struct btree_node *node, unsigned int k);
-static void move_right(struct btree_node *node, unsigned int k);
+static void move_left(struct btree_node *l, const void **sep,
+				struct btree_node *r);
+static void move_right(struct btree_node *l, const void **sep,
+				struct btree_node *r);
+static void concat(struct btree_node *l, const void *sep,
+				struct btree_node *r);
 static void combine(struct btree_node *node, unsigned int k);
 
 /*
@@ -620,37 +799,48 @@ static void combine(struct btree_node *node, unsigned int k);
  */
 void node_restore(struct btree_node *node, unsigned int k)
 {
+	struct btree_node **b = node->branch;
+	
 	if (k == 0) {
-		if (node->branch[1]->count > MIN)
-			move_left(node, 0);
+		if (b[1]->count > MIN)
+			move_left(b[0], &node->item[0], b[1]);
 		else
 			combine(node, 0);
 	} else if (k == node->count) {
-		if (node->branch[k-1]->count > MIN)
-			move_right(node, k-1);
+		if (b[k-1]->count > MIN)
+			move_right(b[k-1], &node->item[k-1], b[k]);
 		else
 			combine(node, k-1);
-	} else if (node->branch[k-1]->count > MIN) {
-		move_right(node, k-1);
-	} else if (node->branch[k+1]->count > MIN) {
-		move_left(node, k);
+	} else if (b[k-1]->count > MIN) {
+		move_right(b[k-1], &node->item[k-1], b[k]);
+	} else if (b[k+1]->count > MIN) {
+		move_left(b[k], &node->item[k], b[k+1]);
 	} else {
 		combine(node, k-1);
 	}
 }
 
-static void move_left(struct btree_node *node, unsigned int k)
+/*
+ * Moves the separator *sep to the end of l, and the first item of r
+ * (with its left branch) up to take its place.
+ */
+static void move_left(struct btree_node *l, const void **sep,
+				struct btree_node *r)
 {
-	struct btree_node *l = node->branch[k], *r = node->branch[k+1], *mv;
+	struct btree_node *mv;
 	unsigned int i;
 	
-	l->item[l->count] = node->item[k];
-	node->item[k] = r->item[0];
+	l->item[l->count] = *sep;
+	*sep = r->item[0];
 	for (i = 1; i < r->count; i++)
 		r->item[i-1] = r->item[i];
+	l->total++;
+	r->total--;
 	
 	if (r->depth) {
 		mv = r->branch[0];
+		l->total += mv->total;
+		r->total -= mv->total;
 		l->branch[l->count+1] = mv;
 		mv->parent = l;
 		mv->k = l->count+1;
@@ -665,15 +855,21 @@ static void move_left(struct btree_node *node, unsigned int k)
 	r->count--;
 }
 
-static void move_right(struct btree_node *node, unsigned int k)
+/*
+ * Moves the separator *sep to the start of r, and the last item of l
+ * (with its right branch) up to take its place.
+ */
+static void move_right(struct btree_node *l, const void **sep,
+				struct btree_node *r)
 {
-	struct btree_node *l = node->branch[k], *r = node->branch[k+1];
 	unsigned int i;
 	
 	for (i = r->count; i--;)
 		r->item[i+1] = r->item[i];
-	r->item[0] = node->item[k];
-	node->item[k] = l->item[l->count-1];
+	r->item[0] = *sep;
+	*sep = l->item[l->count-1];
+	l->total--;
+	r->total++;
 	
 	if (r->depth) {
 		for (i = r->count+1; i--;) {
@@ -683,21 +879,24 @@ static void move_right(struct btree_node *node, unsigned int k)
 		r->branch[0] = l->branch[l->count];
 		r->branch[0]->parent = r;
 		r->branch[0]->k = 0;
+		l->total -= r->branch[0]->total;
+		r->total += r->branch[0]->total;
 	}
 	
 	l->count--;
 	r->count++;
 }
 
-/* Combine node->branch[k] and node->branch[k+1]. */
-static void combine(struct btree_node *node, unsigned int k)
+/* Append sep followed by r's items (and branches) to l, and free r. */
+static void concat(struct btree_node *l, const void *sep,
+				struct btree_node *r)
 {
-	struct btree_node *l = node->branch[k], *r = node->branch[k+1], *mv;
 	const void **o = &l->item[l->count];
+	struct btree_node *mv;
 	unsigned int i;
 	
-	//append node->item[k] followed by right node's items to left node
-	*o++ = node->item[k];
+	//append sep followed by right node's items to left node
+	*o++ = sep;
 	for (i=0; i<r->count; i++)
 		*o++ = r->item[i];
 	
@@ -711,17 +910,253 @@ static void combine(struct btree_node *node, unsigned int k)
 		}
 	}
 	
+	//don't forget to update the left node's counts and to free the right node
+	l->count += r->count + 1;
+	l->total += r->total + 1;
+	free(r);
+}
+
+/* Combine node->branch[k] and node->branch[k+1]. */
+static void combine(struct btree_node *node, unsigned int k)
+{
+	unsigned int i;
+	
+	concat(node->branch[k], node->item[k], node->branch[k+1]);
+	
 	//remove k and its right branch from parent node
 	for (i = k+1; i < node->count; i++) {
 		node->item[i-1] = node->item[i];
 		node->branch[i] = node->branch[i+1];
 		node->branch[i]->k = i;
 	}
-	
-	//don't forget to update the left and parent node's counts and to free the right node
-	l->count += r->count + 1;
 	node->count--;
-	free(r);
+}
+
+/*
+ * Builds a subtree of the given depth from the next count items.  It uses
+ * as few branches as can hold them, and divides the items evenly between
+ * those, which keeps every node at least half full.
+ */
+static struct btree_node *node_build(const void * const **items,
+				size_t count, unsigned int depth)
+{
+	struct btree_node *node = node_alloc(depth), *child;
+	size_t cap, each, extra;
+	unsigned int i, branches;
+	
+	node->parent = NULL;
+	node->depth = depth;
+	node->k = 0;
+	node->total = count;
+	
+	if (!depth) {
+		node->count = count;
+		for (i = 0; i < count; i++)
+			node->item[i] = *(*items)++;
+		return node;
+	}
+	
+	cap = depth_capacity(depth - 1);
+	branches = cap < SIZE_MAX ? count / (cap + 1) + 1 : 2;
+	if (branches < 2)
+		branches = 2;
+	
+	/* One item between each pair of branches; the rest go below. */
+	node->count = branches - 1;
+	each = (count - node->count) / branches;
+	extra = (count - node->count) % branches;
+	for (i = 0; i < branches; i++) {
+		child = node_build(items, each + (i < extra), depth - 1);
+		child->parent = node;
+		child->k = i;
+		node->branch[i] = child;
+		if (i < node->count)
+			node->item[i] = *(*items)++;
+	}
+	
+	return node;
+}
+
+/*
+ * Finds the item with the given rank in node's subtree, which must have
+ * that many items.  Returns the node it's in, and sets *k to its index.
+ */
+static struct btree_node *node_select(struct btree_node *node,
+				size_t index, unsigned int *k)
+{
+	unsigned int i;
+	
+	while (node->depth) {
+		for (i = 0; index >= node->branch[i]->total; i++) {
+			index -= node->branch[i]->total;
+			if (index == 0) {
+				*k = i;
+				return node;
+			}
+			index--;
+		}
+		node = node->branch[i];
+	}
+	
+	*k = index;
+	return node;
+}
+
+/*
+ * Makes a tree out of node's items [from, to) and the branches around
+ * them.  If that's just one branch, it is detached and returned.
+ */
+static struct btree_node *node_slice(struct btree_node *node,
+				unsigned int from, unsigned int to)
+{
+	struct btree_node *ret;
+	unsigned int i;
+	
+	if (node->depth && from == to) {
+		ret = node->branch[from];
+		ret->parent = NULL;
+		ret->k = 0;
+		return ret;
+	}
+	
+	ret = node_alloc(node->depth);
+	ret->parent = NULL;
+	ret->count = to - from;
+	ret->depth = node->depth;
+	ret->k = 0;
+	for (i = from; i < to; i++)
+		ret->item[i-from] = node->item[i];
+	if (ret->depth) {
+		for (i = from; i <= to; i++) {
+			ret->branch[i-from] = node->branch[i];
+			ret->branch[i-from]->parent = ret;
+			ret->branch[i-from]->k = i-from;
+		}
+	}
+	ret->total = node_total(ret);
+	return ret;
+}
+
+/*
+ * Moves items between siblings l and r (through their separator *sep)
+ * until neither has fewer than MIN.  They must have 2*MIN between them.
+ */
+static void balance(struct btree_node *l, const void **sep,
+				struct btree_node *r)
+{
+	while (l->count < MIN)
+		move_left(l, sep, r);
+	while (r->count < MIN)
+		move_right(l, sep, r);
+}
+
+/*
+ * Joins the trees rooted at l and r, with item x between them, and returns
+ * the new root.  Either tree may be empty.  This takes time proportional
+ * to the difference in their depths.
+ */
+static struct btree_node *node_join(struct btree_node *l, const void *x,
+				struct btree_node *r)
+{
+	struct btree_node *node, *sib;
+	size_t total;
+	
+	if (l->depth == r->depth) {
+		if (l->count + 1 + r->count <= MAX) {
+			concat(l, x, r);
+			return l;
+		}
+		balance(l, &x, r);
+		
+		node = node_alloc(1);
+		node->parent = NULL;
+		node->count = 1;
+		node->depth = l->depth + 1;
+		node->k = 0;
+		node->item[0] = x;
+		node->branch[0] = l;
+			l->parent = node;
+			l->k = 0;
+		node->branch[1] = r;
+			r->parent = node;
+			r->k = 1;
+		node->total = l->total + 1 + r->total;
+		return node;
+	}
+	
+	if (l->depth > r->depth) {
+		/* Hang r off l's right edge, beside sib. */
+		total = 1 + r->total;
+		for (node = l; node->depth > r->depth + 1;)
+			node = node->branch[node->count];
+		sib = node->branch[node->count];
+		
+		if (r->count < MIN) {
+			if (sib->count + 1 + r->count <= MAX) {
+				concat(sib, x, r);
+				return node_add_total(node, total);
+			}
+			balance(sib, &x, r);
+		}
+		return node_insert_up(x, r, node, node->count, total);
+	}
+	
+	/* Hang l off r's left edge, beside sib. */
+	total = 1 + l->total;
+	for (node = r; node->depth > l->depth + 1;)
+		node = node->branch[0];
+	sib = node->branch[0];
+	
+	if (l->count < MIN) {
+		if (l->count + 1 + sib->count <= MAX) {
+			concat(l, x, sib);
+			node->branch[0] = l;
+			l->parent = node;
+			l->k = 0;
+			return node_add_total(node, total);
+		}
+		balance(l, &x, sib);
+	}
+	
+	/* l takes sib's place, and sib goes back in to the right of x. */
+	node->branch[0] = l;
+	l->parent = node;
+	l->k = 0;
+	return node_insert_up(x, sib, node, 0, total);
+}
+
+/*
+ * Splits the tree around node->item[k], into a tree of the items before it
+ * (*l) and a tree of the items after it (*r), and returns the item itself.
+ * node and its ancestors are freed.  Each step up joins at most one level
+ * higher than the last, so this takes O(log n) time.
+ */
+static const void *split_at(struct btree_node *node, unsigned int k,
+				struct btree_node **l, struct btree_node **r)
+{
+	const void *x = node->item[k];
+	struct btree_node *parent;
+	
+	*l = node_slice(node, 0, k);
+	*r = node_slice(node, k+1, node->count);
+	
+	for (;;) {
+		parent = node->parent;
+		k = node->k;
+		free(node);
+		if (!parent)
+			break;
+		
+		if (k > 0)
+			*l = node_join(node_slice(parent, 0, k-1),
+					parent->item[k-1], *l);
+		if (k < parent->count)
+			*r = node_join(*r, parent->item[k],
+					node_slice(parent, k+1, parent->count));
+		node = parent;
+	}
+	
+	return x;
 }
 
 static int node_walk_backward(const struct btree_node *node,
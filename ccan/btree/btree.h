@@ -37,15 +37,36 @@ btree_lookup
 #include <stdint.h>
 #include <string.h>
 
+/*
+ * Size of a leaf node in bytes.  Internal nodes have an array of
+ * BTREE_ITEM_MAX + 1 branch pointers on top of this.  The default of four
+ * cache lines gives 29 items per node on 64-bit machines.  Define this (or
+ * BTREE_ITEM_MAX itself) when compiling btree.c to tune it; every user of
+ * the tree must agree on the value.
+ */
+#ifndef BTREE_NODE_SIZE
+#define BTREE_NODE_SIZE 256
+#endif
+
 /*
  * Maximum number of items per node.
  * The maximum number of branches is BTREE_ITEM_MAX + 1.
+ *
+ * The node header (parent, total, and the three unsigned chars) takes
+ * three pointers' worth of space.  Since count is an unsigned char, this
+ * can be at most 254.
  */
-#define BTREE_ITEM_MAX 20
+#ifndef BTREE_ITEM_MAX
+#define BTREE_ITEM_MAX \
+	((BTREE_NODE_SIZE - 3 * sizeof(void *)) / sizeof(void *))
+#endif
 
 struct btree_node {
 	struct btree_node *parent;
 	
+	/* Number of items in this node and all its descendents. */
+	size_t total;
+	
 	/* Number of items (rather than branches). */
 	unsigned char count;
 	
@@ -149,6 +170,15 @@ bool btree_remove(struct btree *btree, const void *key);
  * NULLs in a btree, use btree_find instead. */
 void *btree_lookup(struct btree *btree, const void *key);
 
+/* Fills an empty btree with count items, which must already be sorted
+ * (as determined by the search function), and must not contain duplicates
+ * unless btree->multi is set.  This builds the tree bottom-up with full
+ * nodes, so it is much faster than inserting the items one at a time.
+ *
+ * Returns false (and does nothing) if the btree is not empty. */
+bool btree_load_sorted(struct btree *btree,
+			const void * const *items, size_t count);
+
 
 /* lr must be 0 or 1, nothing else. */
 int btree_begin_end_lr(const struct btree *btree, btree_iterator iter, int lr);
@@ -220,6 +250,48 @@ void btree_insert_at(btree_iterator iter, const void *item);
  */
 int btree_remove_at(btree_iterator iter);
 
+/*
+ * Removes the items from iter_from up to (but not including) iter_to,
+ * and returns the number of items removed.
+ *
+ * This takes O(log n) time, plus the time to free the nodes holding
+ * the removed items.  Like btree_remove_at, it does not call
+ * btree->destroy on the removed items, and it invalidates all iterators
+ * to the btree.
+ */
+size_t btree_remove_range(btree_iterator iter_from, btree_iterator iter_to);
+
+/*
+ * Returns the number of items before the position of iter (so the
+ * first item has rank 0, and the end of the btree has rank btree->count).
+ *
+ * Takes O(log n) time.
+ */
+size_t btree_rank(const btree_iterator iter);
+
+/*
+ * Points iter at the item with the given rank (0 being the first item).
+ *
+ * If index < btree->count, btree_select returns 1 and sets iter->item.
+ * Otherwise, it returns 0 and points iter to the end of the btree.
+ *
+ * Takes O(log n) time.
+ */
+int btree_select(const struct btree *btree, size_t index, btree_iterator iter);
+
+/*
+ * Returns the number of items between iter_from and iter_to (including
+ * the item at iter_from but not the one at iter_to), or 0 if iter_to is
+ * before iter_from.
+ *
+ * For example, the number of items in the range [lo, hi) is:
+ *	btree_find_first(btree, lo, from);
+ *	btree_find_first(btree, hi, to);
+ *	n = btree_count_range(from, to);
+ */
+size_t btree_count_range(const btree_iterator iter_from,
+			const btree_iterator iter_to);
+
 /*
  * Compares positions of two iterators.
  *
@@ -0,0 +1,225 @@
+/* Include the main header first, to test it works */
+#include <ccan/btree/btree.h>
+/* Include the C files directly. */
+#include <ccan/btree/btree.c>
+#include <ccan/tap/tap.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint32_t rand32_state = 0;
+
+/*
+ * Finds a pseudorandom 32-bit number from 0 to 2^32-1 .
+ * Uses the BCPL linear congruential generator method.
+ */
+static uint32_t rand32(void)
+{
+	rand32_state *= (uint32_t)0x7FF8A3ED;
+	rand32_state += (uint32_t)0x2AA01D31;
+	return rand32_state;
+}
+
+static btree_search_implement(order_by_ptr, size_t*, , a == b, a < b)
+
+/* Check structure, totals, and that no non-root node is under MIN. */
+static int node_ok(const struct btree_node *node,
+		   const struct btree_node *parent, size_t *count)
+{
+	size_t before = *count;
+	unsigned int i;
+	
+	if (node->parent != parent)
+		return 0;
+	if (parent) {
+		if (node->depth != parent->depth - 1)
+			return 0;
+		if (node != parent->branch[node->k])
+			return 0;
+		if (node->count < MIN)
+			return 0;
+	}
+	if (node->count > MAX)
+		return 0;
+	if (node->depth) {
+		if (node->count == 0)
+			return 0;
+		for (i = 0; i <= node->count; i++)
+			if (!node_ok(node->branch[i], node, count))
+				return 0;
+	}
+	*count += node->count;
+	return node->total == *count - before;
+}
+
+static int tree_ok(const struct btree *btree)
+{
+	size_t count = 0;
+	
+	return node_ok(btree->root, NULL, &count) && count == btree->count;
+}
+
+/* Check the btree holds exactly items[0..n), in order. */
+static int same_items(const struct btree *btree, size_t *items[], size_t n)
+{
+	btree_iterator iter;
+	size_t i = 0;
+	
+	if (!tree_ok(btree) || btree->count != n)
+		return 0;
+	for (btree_begin(btree, iter); btree_next(iter); i++) {
+		if (i >= n || iter->item != items[i])
+			return 0;
+	}
+	return i == n;
+}
+
+static int test_load(size_t *array, size_t *items[], size_t n)
+{
+	struct btree *btree = btree_new(order_by_ptr);
+	btree_iterator iter, end;
+	size_t i;
+	int ret;
+	
+	ret = btree_load_sorted(btree, (const void * const *)items, n)
+		&& same_items(btree, items, n);
+	
+	/* Can only load into an empty tree. */
+	if (n && btree_load_sorted(btree, (const void * const *)items, n))
+		ret = 0;
+	
+	/* Rank and select are inverses. */
+	for (i = 0; ret && i < n; i += rand32() % 7 + 1) {
+		if (!btree_select(btree, i, iter) || iter->item != items[i])
+			ret = 0;
+		else if (btree_rank(iter) != i)
+			ret = 0;
+		else if (!btree_find(btree, &array[i], iter)
+			 || btree_rank(iter) != i)
+			ret = 0;
+	}
+	if (btree_select(btree, n, iter) || btree_rank(iter) != n)
+		ret = 0;
+	btree_begin(btree, iter);
+	btree_end(btree, end);
+	if (btree_count_range(iter, end) != n || btree_count_range(end, iter))
+		ret = 0;
+	
+	/* Still works after normal insertions and removals. */
+	for (i = 0; ret && i < n; i += 3) {
+		btree_find(btree, &array[i], iter);
+		btree_remove_at(iter);
+		btree_find(btree, &array[i], iter);
+		btree_insert_at(iter, &array[i]);
+	}
+	if (!same_items(btree, items, n))
+		ret = 0;
+	
+	btree_delete(btree);
+	return ret;
+}
+
+static int test_remove_range(size_t *items[], size_t n, size_t trials)
+{
+	struct btree *btree = btree_new(order_by_ptr);
+	size_t **ref = malloc(sizeof(*ref) * n);
+	btree_iterator from, to;
+	size_t i, a, b, len = n;
+	int ret = 1;
+	
+	memcpy(ref, items, sizeof(*ref) * n);
+	btree_load_sorted(btree, (const void * const *)items, n);
+	
+	for (i = 0; ret && i < trials && len; i++) {
+		a = rand32() % (len + 1);
+		/* Mostly small ranges, so the tree lasts a while. */
+		if (rand32() % 4)
+			b = a + rand32() % 50;
+		else
+			b = a + rand32() % (len + 1);
+		if (b > len)
+			b = len;
+		
+		btree_select(btree, a, from);
+		btree_select(btree, b, to);
+		if (btree_count_range(from, to) != b - a)
+			ret = 0;
+		if (btree_remove_range(from, to) != b - a)
+			ret = 0;
+		memmove(ref + a, ref + b, sizeof(*ref) * (len - b));
+		len -= b - a;
+		if (!same_items(btree, ref, len))
+			ret = 0;
+	}
+	
+	/* Backwards ranges are empty. */
+	if (ret && len > 1) {
+		btree_select(btree, 1, from);
+		btree_select(btree, 0, to);
+		if (btree_remove_range(from, to) != 0 || btree->count != len)
+			ret = 0;
+	}
+	
+	/* Remove everything. */
+	btree_begin(btree, from);
+	btree_end(btree, to);
+	if (btree_remove_range(from, to) != len || !same_items(btree, ref, 0))
+		ret = 0;
+	
+	free(ref);
+	btree_delete(btree);
+	return ret;
+}
+
+/* With multi set, btree_remove removes all duplicates, using ranges. */
+static int test_remove_multi(size_t *array, size_t n)
+{
+	struct btree *btree = btree_new(order_by_ptr);
+	size_t i, j;
+	int ret = 1;
+	
+	btree->multi = true;
+	for (i = 0; i < n; i++)
+		for (j = 0; j < i % 5; j++)
+			btree_insert(btree, &array[i]);
+	for (i = 0; ret && i < n; i += 2) {
+		size_t before = btree->count;
+		if (btree_remove(btree, &array[i]) != (i % 5 != 0))
+			ret = 0;
+		if (btree->count != before - i % 5 || btree_lookup(btree, &array[i]))
+			ret = 0;
+	}
+	ret &= tree_ok(btree);
+	btree_delete(btree);
+	return ret;
+}
+
+int main(void)
+{
+	size_t n = 100000, i;
+	size_t *array = calloc(n, sizeof(*array));
+	size_t **items = malloc(sizeof(*items) * n);
+	
+	plan_tests(10);
+	
+	for (i = 0; i < n; i++)
+		items[i] = &array[i];
+	
+	ok1(test_load(array, items, 0));
+	ok1(test_load(array, items, 1));
+	ok1(test_load(array, items, MAX));
+	ok1(test_load(array, items, MAX + 1));
+	ok1(test_load(array, items, 1000));
+	ok1(test_load(array, items, n));
+	
+	ok1(test_remove_range(items, 1000, 1000));
+	ok1(test_remove_range(items, n, 2000));
+	ok1(test_remove_range(items, MAX * 3, 100));
+	
+	ok1(test_remove_multi(array, 10000));
+	
+	free(items);
+	free(array);
+	return exit_status();
+}
@@ -68,6 +68,7 @@ static void clear_stats(void)
 static int test_node_consistency(struct btree_node *node, struct btree_node *parent, size_t *count)
 {
 	unsigned int i, j, e = node->count;
+	size_t before = *count;
 	
 	/* Verify parent, depth, and k */
 	if (node->parent != parent)
@@ -101,6 +102,10 @@ static int test_node_consistency(struct btree_node *node, struct btree_node *par
 	}
 	
 	*count += node->count;
+	
+	/* Verify the subtree total. */
+	if (node->total != *count - before)
+		return 0;
 	return 1;
 }
 
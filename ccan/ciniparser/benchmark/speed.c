@@ -0,0 +1,115 @@
+/* Writes an ini file of 1000 sections of 100 keys each, then times loading
+ * it with stdio and from a mapping, looking every key up, and listing the
+ * keys of every section; the lookups and listing are also done by scanning
+ * every slot, as dictionary_get() and ciniparser_dump_ini() used to. */
+#include <ccan/ciniparser/ciniparser.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTIONS 1000
+#define KEYS 100
+/* The old linear lookup is too slow to do them all. */
+#define SCANS 1000
+
+static void report(const char *what, struct timemono start, unsigned int n)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-28s %8llu usec (%llu nsec each)\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / n));
+}
+
+static char *scan_get(dictionary *d, const char *key)
+{
+	unsigned hash = dictionary_hash(key);
+	int i;
+
+	for (i = 0; i < d->size; i++) {
+		if (d->key[i] && d->hash[i] == hash && !strcmp(d->key[i], key))
+			return d->val[i];
+	}
+	return NULL;
+}
+
+static int scan_section(dictionary *d, const char *sec)
+{
+	int i, n = 0, len = strlen(sec);
+
+	for (i = 0; i < d->size; i++) {
+		if (d->key[i] && !strncmp(d->key[i], sec, len)
+		    && d->key[i][len] == ':')
+			n++;
+	}
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = argc > 1 ? argv[1] : "/tmp/ciniparser-speed.ini";
+	struct timemono start;
+	dictionary *d;
+	char key[64];
+	unsigned int s, k, found;
+	FILE *f;
+
+	f = fopen(file, "w");
+	if (!f) {
+		perror(file);
+		return 1;
+	}
+	for (s = 0; s < SECTIONS; s++) {
+		fprintf(f, "[Section%u]\n", s);
+		for (k = 0; k < KEYS; k++)
+			fprintf(f, "Key%u = value %u ; comment\n", k, s * k);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+
+	start = time_mono();
+	d = ciniparser_load(file);
+	report("ciniparser_load", start, SECTIONS * KEYS);
+	ciniparser_freedict(d);
+
+	start = time_mono();
+	d = ciniparser_load_mmap(file);
+	report("ciniparser_load_mmap", start, SECTIONS * KEYS);
+
+	found = 0;
+	start = time_mono();
+	for (s = 0; s < SECTIONS; s++) {
+		for (k = 0; k < KEYS; k++) {
+			sprintf(key, "section%u:key%u", s, k);
+			found += (dictionary_get(d, key, NULL) != NULL);
+		}
+	}
+	report("dictionary_get", start, SECTIONS * KEYS);
+
+	start = time_mono();
+	for (s = 0; s < SCANS; s++) {
+		sprintf(key, "section%u:key%u", s, s % KEYS);
+		found += (scan_get(d, key) != NULL);
+	}
+	report("linear lookup", start, SCANS);
+
+	start = time_mono();
+	for (s = 0; s < SECTIONS; s++) {
+		sprintf(key, "section%u", s);
+		found += ciniparser_getsecnkeys(d, key);
+	}
+	report("ciniparser_getsecnkeys", start, SECTIONS);
+
+	start = time_mono();
+	for (s = 0; s < SCANS / 10; s++) {
+		sprintf(key, "section%u", s);
+		found += scan_section(d, key);
+	}
+	report("linear section scan", start, SCANS / 10);
+
+	printf("(%u found)\n", found);
+	ciniparser_freedict(d);
+	unlink(file);
+	return 0;
+}
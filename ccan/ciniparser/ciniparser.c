@@ -33,6 +33,9 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ccan/ciniparser/ciniparser.h>
 
 #define ASCIILINESZ      (1024)
@@ -178,22 +181,10 @@ line_status ciniparser_line(char *input_line, char *section,
 
 int ciniparser_getnsec(dictionary *d)
 {
-	int i;
-	int nsec;
-
 	if (d == NULL)
 		return -1;
 
-	nsec = 0;
-	for (i = 0; i < d->size; i++) {
-		if (d->key[i] == NULL)
-			continue;
-		if (strchr(d->key[i], ':') == NULL) {
-			nsec ++;
-		}
-	}
-
-	return nsec;
+	return d->nsec;
 }
 
 char *ciniparser_getsecname(dictionary *d, int n)
@@ -246,21 +237,46 @@ void ciniparser_dump(dictionary *d, FILE *f)
 	return;
 }
 
+int ciniparser_getsecnkeys(dictionary *d, const char *s)
+{
+	int i, nkeys;
+
+	if (d == NULL || s == NULL)
+		return 0;
+
+	nkeys = 0;
+	for (i = dictionary_section_first(d, strlwc(s)); i >= 0;
+	     i = dictionary_section_next(d, i))
+		nkeys++;
+
+	return nkeys;
+}
+
+const char **ciniparser_getseckeys(dictionary *d, const char *s,
+				   const char **keys)
+{
+	int i, n;
+
+	if (d == NULL || s == NULL || keys == NULL)
+		return NULL;
+
+	n = 0;
+	for (i = dictionary_section_first(d, strlwc(s)); i >= 0;
+	     i = dictionary_section_next(d, i))
+		keys[n++] = d->key[i];
+
+	return keys;
+}
+
 void ciniparser_dump_ini(dictionary *d, FILE *f)
 {
 	int i, j;
-	char keym[ASCIILINESZ+1];
-	int nsec;
-	char *secname;
 	int seclen;
 
 	if (d == NULL || f == NULL)
 		return;
 
-	memset(keym, 0, ASCIILINESZ + 1);
-
-	nsec = ciniparser_getnsec(d);
-	if (nsec < 1) {
+	if (d->nsec < 1) {
 		/* No section in file: dump all keys as they are */
 		for (i = 0; i < d->size; i++) {
 			if (d->key[i] == NULL)
@@ -270,19 +286,16 @@ void ciniparser_dump_ini(dictionary *d, FILE *f)
 		return;
 	}
 
-	for (i = 0; i < nsec; i++) {
-		secname = ciniparser_getsecname(d, i);
-		seclen  = (int)strlen(secname);
-		fprintf(f, "\n[%s]\n", secname);
-		snprintf(keym, ASCIILINESZ + 1, "%s:", secname);
-		for (j = 0; j < d->size; j++) {
-			if (d->key[j] == NULL)
-				continue;
-			if (!strncmp(d->key[j], keym, seclen+1)) {
-				fprintf(f, "%-30s = %s\n",
-					d->key[j]+seclen+1,
-					d->val[j] ? d->val[j] : "");
-			}
+	for (i = 0; i < d->size; i++) {
+		if (d->key[i] == NULL || strchr(d->key[i], ':'))
+			continue;
+		seclen = (int)strlen(d->key[i]);
+		fprintf(f, "\n[%s]\n", d->key[i]);
+		for (j = d->link[i].first; j >= 0;
+		     j = dictionary_section_next(d, j)) {
+			fprintf(f, "%-30s = %s\n",
+				d->key[j]+seclen+1,
+				d->val[j] ? d->val[j] : "");
 		}
 	}
 	fprintf(f, "\n");
@@ -471,6 +484,279 @@ dictionary *ciniparser_load(const char *ininame)
 	return dict;
 }
 
+/**
+ * @brief Trim blanks from both ends of a span of characters
+ * @param s Pointer to the start of the span, updated
+ * @param e Pointer to the end of the span, updated
+ */
+static void span_strip(char **s, char **e)
+{
+	while (*s < *e && isspace((unsigned char)**s))
+		(*s)++;
+	while (*e > *s && isspace((unsigned char)(*e)[-1]))
+		(*e)--;
+}
+
+/**
+ * @brief Parse a single line in place, like ciniparser_line()
+ * @param line Start of the line, which need not be NUL terminated
+ * @param end End of the line
+ * @param a Set to the section name, or the key
+ * @param ae Set to the end of a
+ * @param v Set to the value
+ * @param ve Set to the end of v
+ * @return line_status value
+ *
+ * Nothing is copied or lowercased: the results point into the line. For
+ * "[]", a is set to NULL, as ciniparser_line() leaves the section alone.
+ */
+static line_status ciniparser_span(char *line, char *end,
+				   char **a, char **ae, char **v, char **ve)
+{
+	char *eq, *q;
+
+	span_strip(&line, &end);
+
+	if (line == end)
+		return LINE_EMPTY;
+	if (line[0] == '#')
+		return LINE_COMMENT;
+	if (line[0] == '[' && end[-1] == ']') {
+		*a = line + 1;
+		*ae = memchr(*a, ']', end - *a);
+		if (*ae == *a)
+			*a = NULL;
+		else
+			span_strip(a, ae);
+		return LINE_SECTION;
+	}
+
+	eq = memchr(line, '=', end - line);
+	if (eq == NULL || eq == line)
+		return LINE_ERROR;
+	*a = line;
+	*ae = eq;
+	span_strip(a, ae);
+
+	*v = eq + 1;
+	while (*v < end && isspace((unsigned char)**v))
+		(*v)++;
+	*ve = *v;
+	if (*v < end && (**v == '"' || **v == '\'')) {
+		/* Quoted, up to the closing quote (if any). */
+		q = memchr(*v + 1, **v, end - (*v + 1));
+		if (q == NULL)
+			q = end;
+		if (q > *v + 1) {
+			(*v)++;
+			*ve = q;
+		}
+	}
+	if (*ve == *v) {
+		/* Unquoted, up to any comment. */
+		while (*ve < end && **ve != ';' && **ve != '#')
+			(*ve)++;
+	}
+	span_strip(v, ve);
+	/* "" and '' are empty values */
+	if (*ve - *v == 2 && (*v)[0] == (*v)[1]
+	    && ((*v)[0] == '"' || (*v)[0] == '\''))
+		*ve = *v;
+
+	return LINE_VALUE;
+}
+
+/**
+ * @brief Make room in a growable buffer
+ * @param buf The buffer, updated
+ * @param size Its allocated size, updated
+ * @param need The number of bytes needed
+ * @return 0 on success, -1 on allocation failure
+ */
+static int buf_need(char **buf, size_t *size, size_t need)
+{
+	char *p;
+
+	if (need <= *size)
+		return 0;
+	p = realloc(*buf, need * 2);
+	if (p == NULL)
+		return -1;
+	*buf = p;
+	*size = need * 2;
+	return 0;
+}
+
+/**
+ * @brief Parse a whole ini file held in memory
+ * @param dict Dictionary to fill in, with the buffer as dict->map
+ * @param p Start of the file
+ * @param end End of the file
+ * @param ininame Name of the file, for error messages
+ * @return 0 if Ok, the number of syntax errors, or -1 on allocation failure
+ *
+ * Values are NUL terminated where they lie and stored without copying,
+ * except those which had to be joined from several lines, and one that
+ * runs right to the end of the buffer.
+ */
+static int ciniparser_parse(dictionary *dict, char *p, char *end,
+			    const char *ininame)
+{
+	char *line, *lend, *eol, *a, *ae, *v, *ve;
+	char *section = NULL, *key = NULL, *join = NULL;
+	size_t seclen = 0, secsize = 0, keysize = 0, joinlen = 0, joinsize = 0;
+	int lineno = 0, errs = 0, ret, i;
+
+	if (buf_need(&section, &secsize, 1) != 0)
+		return -1;
+	section[0] = '\0';
+
+	while (p < end && errs >= 0) {
+		line = p;
+		eol = memchr(p, '\n', end - p);
+		lend = eol ? eol : end;
+		p = eol ? eol + 1 : end;
+		lineno++;
+
+		/* Get rid of spaces at end of line */
+		while (lend > line && isspace((unsigned char)lend[-1]))
+			lend--;
+
+		/* Detect multi-line: the backslash is replaced by the next line */
+		if (lend > line && lend[-1] == '\\') {
+			if (buf_need(&join, &joinsize, joinlen + (lend - line))) {
+				errs = -1;
+				break;
+			}
+			memcpy(join + joinlen, line, lend - 1 - line);
+			joinlen += lend - 1 - line;
+			continue;
+		}
+		if (joinlen) {
+			size_t len = lend - line;
+			if (buf_need(&join, &joinsize, joinlen + len + 1)) {
+				errs = -1;
+				break;
+			}
+			memcpy(join + joinlen, line, len);
+			line = join;
+			lend = join + joinlen + len;
+			joinlen = 0;
+		}
+
+		switch (ciniparser_span(line, lend, &a, &ae, &v, &ve)) {
+		case LINE_EMPTY:
+		case LINE_COMMENT:
+			break;
+
+		case LINE_SECTION:
+			if (a != NULL) {
+				seclen = ae - a;
+				if (buf_need(&section, &secsize, seclen + 1)) {
+					errs = -1;
+					break;
+				}
+				for (i = 0; i < (int)seclen; i++)
+					section[i] = tolower((unsigned char)a[i]);
+				section[seclen] = '\0';
+			}
+			if (dictionary_set(dict, section, NULL) != 0)
+				errs = -1;
+			break;
+
+		case LINE_VALUE:
+			if (buf_need(&key, &keysize, seclen + 1 + (ae - a) + 1)) {
+				errs = -1;
+				break;
+			}
+			memcpy(key, section, seclen);
+			key[seclen] = ':';
+			for (i = 0; i < ae - a; i++)
+				key[seclen + 1 + i] = tolower((unsigned char)a[i]);
+			key[seclen + 1 + i] = '\0';
+
+			if (line == join) {
+				/* Joined lines: copy it out of the buffer. */
+				*ve = '\0';
+				ret = dictionary_set(dict, key, v);
+			} else if (ve < end) {
+				/* Terminate it in place: ve is at most eol. */
+				*ve = '\0';
+				ret = dictionary_set_mapped(dict, key, v);
+			} else {
+				/* Last line, with no room for the NUL. */
+				char *copy = strndup(v, ve - v);
+				ret = copy ? dictionary_set(dict, key, copy) : -1;
+				free(copy);
+			}
+			if (ret != 0)
+				errs = -1;
+			break;
+
+		case LINE_ERROR:
+			fprintf(stderr, "ciniparser: syntax error in %s (%d):\n",
+					ininame, lineno);
+			fprintf(stderr, "-> %.*s\n", (int)(lend - line), line);
+			errs++;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (errs < 0)
+		fprintf(stderr, "ciniparser: memory allocation failure\n");
+	free(section);
+	free(key);
+	free(join);
+	return errs;
+}
+
+dictionary *ciniparser_load_mmap(const char *ininame)
+{
+	struct stat st;
+	dictionary *dict;
+	char *map = NULL;
+	int fd;
+
+	fd = open(ininame, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "ciniparser: cannot open %s\n", ininame);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	if (st.st_size > 0) {
+		/* Private and writable, so values can be terminated in place. */
+		map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+			   fd, 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "ciniparser: cannot map %s\n", ininame);
+			close(fd);
+			return NULL;
+		}
+	}
+	close(fd);
+
+	dict = dictionary_new(0);
+	if (!dict) {
+		if (map)
+			munmap(map, st.st_size);
+		return NULL;
+	}
+	dict->map = map;
+	dict->map_len = st.st_size;
+
+	if (ciniparser_parse(dict, map, map + st.st_size, ininame) != 0) {
+		dictionary_del(dict);
+		dict = NULL;
+	}
+
+	return dict;
+}
+
 void ciniparser_freedict(dictionary *d)
 {
 	dictionary_del(d);
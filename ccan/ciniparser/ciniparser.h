@@ -74,6 +74,35 @@ int ciniparser_getnsec(dictionary *d);
  */
 char *ciniparser_getsecname(dictionary *d, int n);
 
+/**
+ * @brief    Get the number of keys in a section of a dictionary
+ * @param    d   Dictionary to examine
+ * @param    s   Section name
+ * @return   Number of keys in the section, 0 if there is no such section
+ *
+ * This walks the keys of the section only, not the whole dictionary.
+ */
+int ciniparser_getsecnkeys(dictionary *d, const char *s);
+
+/**
+ * @brief    Get the keys of a section of a dictionary
+ * @param    d    Dictionary to examine
+ * @param    s    Section name
+ * @param    keys Array of ciniparser_getsecnkeys(d, s) pointers to fill
+ * @return   keys, or NULL on error
+ *
+ * This fills keys with the full "section:key" names of the keys in the
+ * section, in the order they appear in the dictionary. They point to
+ * strings allocated inside the dictionary: do not free or modify them.
+ *
+ * @code
+ * const char **keys = malloc(ciniparser_getsecnkeys(d, "wine")
+ *                            * sizeof(*keys));
+ * @endcode
+ */
+const char **ciniparser_getseckeys(dictionary *d, const char *s,
+				   const char **keys);
+
 /**
  * @brief    Save a dictionary to a loadable ini file
  * @param    d   Dictionary to dump
@@ -234,6 +263,25 @@ int ciniparser_find_entry(dictionary *ini, char *entry) ;
  */
 dictionary *ciniparser_load(const char *ininame);
 
+/**
+ * @brief    Parse an ini file in place and return an allocated dictionary
+ * @param    ininame Name of the ini file to read.
+ * @return   Pointer to newly allocated dictionary
+ *
+ * This gives the same dictionary as ciniparser_load(), but maps the file
+ * privately and parses it in one pass instead of reading it line by line.
+ * Values are terminated where they lie in the mapping and used without
+ * copying; only keys (which are lowercased and prefixed with their
+ * section) are allocated. The mapping is released with the dictionary,
+ * and the file must not be truncated before then.
+ *
+ * Unlike ciniparser_load(), lines may be of any length, and every
+ * syntax error in the file makes it fail.
+ *
+ * The returned dictionary must be freed using ciniparser_freedict().
+ */
+dictionary *ciniparser_load_mmap(const char *ininame);
+
 /**
  * @brief    Free all memory associated to an ini dictionary
  * @param    d Dictionary to free
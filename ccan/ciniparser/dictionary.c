@@ -41,7 +41,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 /** Maximum value size for integers and doubles. */
 #define MAXVALSZ	1024
@@ -70,15 +72,17 @@ static void *mem_double(void *ptr, int size)
 	return newptr;
 }
 
-/* The remaining exposed functions are documented in dictionary.h */
-
-unsigned dictionary_hash(const char *key)
+/**
+ * @brief Compute the hash of the first len bytes of a string
+ * @param key the string
+ * @param len the number of bytes to hash
+ * @return the same value as dictionary_hash() of those bytes alone
+ */
+static unsigned hash_len(const char *key, size_t len)
 {
-	int len;
 	unsigned hash;
-	int i;
+	size_t i;
 
-	len = strlen(key);
 	for (hash = 0, i = 0; i < len; i++) {
 		hash += (unsigned) key[i];
 		hash += (hash << 10);
@@ -90,6 +94,238 @@ unsigned dictionary_hash(const char *key)
 	return hash;
 }
 
+/**
+ * @brief Size the hash index for a number of slots, and fill it in
+ * @param d the dictionary, with d->size already set
+ * @return 0 on success, -1 on allocation failure
+ *
+ * The index is at least twice the number of slots, so probe sequences
+ * stay short even when the dictionary is full.
+ */
+static int index_rebuild(dictionary *d)
+{
+	unsigned cap = 1, pos;
+	int i, *index;
+
+	while (cap < 2 * (unsigned)d->size)
+		cap <<= 1;
+	index = (int *) calloc(cap, sizeof(int));
+	if (index == NULL)
+		return -1;
+	free(d->index);
+	d->index = index;
+	d->index_mask = cap - 1;
+	for (i = 0; i < d->size; i++) {
+		if (d->key[i] == NULL)
+			continue;
+		for (pos = d->hash[i] & d->index_mask;
+		     d->index[pos];
+		     pos = (pos + 1) & d->index_mask);
+		d->index[pos] = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Find the index position of a key
+ * @param d the dictionary
+ * @param key the key, which need not be NUL terminated
+ * @param len the length of the key
+ * @param hash hash_len(key, len)
+ * @return position in d->index, or -1 if not found
+ */
+static int index_find(const dictionary *d, const char *key, size_t len,
+		      unsigned hash)
+{
+	unsigned pos;
+	int i;
+
+	for (pos = hash & d->index_mask;
+	     d->index[pos];
+	     pos = (pos + 1) & d->index_mask) {
+		i = d->index[pos] - 1;
+		if (d->hash[i] == hash
+		    && !strncmp(d->key[i], key, len)
+		    && d->key[i][len] == '\0')
+			return pos;
+	}
+	return -1;
+}
+
+/**
+ * @brief Remove an index position, shifting later entries back
+ * @param d the dictionary
+ * @param pos the position to empty
+ *
+ * Entries further along the probe sequence are moved into the gap when
+ * their home position allows, so lookups never need tombstones.
+ */
+static void index_remove(dictionary *d, unsigned pos)
+{
+	unsigned next, home;
+
+	for (;;) {
+		d->index[pos] = 0;
+		next = pos;
+		for (;;) {
+			next = (next + 1) & d->index_mask;
+			if (!d->index[next])
+				return;
+			home = d->hash[d->index[next] - 1] & d->index_mask;
+			/* Can't move it if its home is in (pos, next]. */
+			if (pos <= next ? (pos < home && home <= next)
+					: (pos < home || home <= next))
+				continue;
+			break;
+		}
+		d->index[pos] = d->index[next];
+		pos = next;
+	}
+}
+
+/**
+ * @brief Add a key slot to a section's list, keeping it in slot order
+ * @param d the dictionary
+ * @param s the section slot
+ * @param i the key slot
+ */
+static void section_add(dictionary *d, int s, int i)
+{
+	struct dictionary_link *l = d->link;
+	int p;
+
+	/* Usually i is a brand new slot, and goes at the end. */
+	for (p = l[s].last; p > i; p = l[p].prev);
+
+	l[i].section = s;
+	l[i].prev = p;
+	l[i].next = p >= 0 ? l[p].next : l[s].first;
+	if (p >= 0)
+		l[p].next = i;
+	else
+		l[s].first = i;
+	if (l[i].next >= 0)
+		l[l[i].next].prev = i;
+	else
+		l[s].last = i;
+}
+
+/**
+ * @brief Remove a key slot from its section's list
+ * @param d the dictionary
+ * @param i the key slot
+ */
+static void section_del(dictionary *d, int i)
+{
+	struct dictionary_link *l = d->link;
+	int s = l[i].section;
+
+	if (l[i].prev >= 0)
+		l[l[i].prev].next = l[i].next;
+	else
+		l[s].first = l[i].next;
+	if (l[i].next >= 0)
+		l[l[i].next].prev = l[i].prev;
+	else
+		l[s].last = l[i].prev;
+	l[i].section = -1;
+}
+
+/**
+ * @brief Link a newly added slot to its section, or its keys to it
+ * @param d the dictionary
+ * @param i the new slot
+ */
+static void section_link(dictionary *d, int i)
+{
+	const char *colon = strchr(d->key[i], ':');
+	size_t len;
+	int j, pos;
+
+	d->link[i].section = d->link[i].prev = d->link[i].next = -1;
+	d->link[i].first = d->link[i].last = -1;
+
+	if (colon) {
+		len = colon - d->key[i];
+		pos = index_find(d, d->key[i], len, hash_len(d->key[i], len));
+		if (pos >= 0)
+			section_add(d, d->index[pos] - 1, i);
+		else
+			d->orphans++;
+		return;
+	}
+
+	/* A new section: ciniparser_load() never gets here with orphans. */
+	d->nsec++;
+	len = strlen(d->key[i]);
+	for (j = 0; j < d->size && d->orphans; j++) {
+		if (d->key[j] == NULL || d->link[j].section >= 0
+		    || strncmp(d->key[j], d->key[i], len)
+		    || d->key[j][len] != ':')
+			continue;
+		section_add(d, i, j);
+		d->orphans--;
+	}
+}
+
+/**
+ * @brief Unlink a slot which is about to be emptied
+ * @param d the dictionary
+ * @param i the slot
+ */
+static void section_unlink(dictionary *d, int i)
+{
+	int j, next;
+
+	if (strchr(d->key[i], ':')) {
+		if (d->link[i].section >= 0)
+			section_del(d, i);
+		else
+			d->orphans--;
+		return;
+	}
+
+	/* Its keys stay, but belong to no section now. */
+	d->nsec--;
+	for (j = d->link[i].first; j >= 0; j = next) {
+		next = d->link[j].next;
+		d->link[j].section = d->link[j].prev = d->link[j].next = -1;
+		d->orphans++;
+	}
+	d->link[i].first = d->link[i].last = -1;
+}
+
+/**
+ * @brief Is a value stored in the file mapping, rather than allocated?
+ * @param d the dictionary
+ * @param val the value
+ * @return non-zero if val must not be freed
+ */
+static int is_mapped(const dictionary *d, const char *val)
+{
+	return d->map != NULL
+		&& (uintptr_t)val >= (uintptr_t)d->map
+		&& (uintptr_t)val < (uintptr_t)d->map + d->map_len;
+}
+
+/**
+ * @brief Free a value, unless it is in the file mapping
+ * @param d the dictionary
+ * @param val the value (may be NULL)
+ */
+static void free_val(const dictionary *d, char *val)
+{
+	if (val != NULL && !is_mapped(d, val))
+		free(val);
+}
+
+/* The remaining exposed functions are documented in dictionary.h */
+
+unsigned dictionary_hash(const char *key)
+{
+	return hash_len(key, strlen(key));
+}
+
 dictionary *dictionary_new(int size)
 {
 	dictionary *d;
@@ -104,6 +340,13 @@ dictionary *dictionary_new(int size)
 	d->val  = (char **) calloc(size, sizeof(char *));
 	d->key  = (char **) calloc(size, sizeof(char *));
 	d->hash = (unsigned int *) calloc(size, sizeof(unsigned));
+	d->link = (struct dictionary_link *)
+		calloc(size, sizeof(struct dictionary_link));
+	if (d->val == NULL || d->key == NULL || d->hash == NULL
+	    || d->link == NULL || index_rebuild(d) != 0) {
+		dictionary_del(d);
+		return NULL;
+	}
 	return d;
 }
 
@@ -113,67 +356,74 @@ void dictionary_del(dictionary *d)
 
 	if (d == NULL)
 		return;
-	for (i = 0; i < d->size; i++) {
+	for (i = 0; i < d->size && d->key; i++) {
 		if (d->key[i] != NULL)
 			free(d->key[i]);
-		if (d->val[i] != NULL)
-			free(d->val[i]);
+		if (d->val != NULL)
+			free_val(d, d->val[i]);
 	}
+	if (d->map != NULL)
+		munmap(d->map, d->map_len);
 	free(d->val);
 	free(d->key);
 	free(d->hash);
+	free(d->index);
+	free(d->link);
 	free(d);
 	return;
 }
 
+int dictionary_find(dictionary *d, const char *key)
+{
+	size_t len;
+	int pos;
+
+	if (d == NULL || key == NULL)
+		return -1;
+
+	len = strlen(key);
+	pos = index_find(d, key, len, hash_len(key, len));
+	return pos < 0 ? -1 : d->index[pos] - 1;
+}
+
 char *dictionary_get(dictionary *d, const char *key, char *def)
 {
-	unsigned hash;
 	int i;
 
-	hash = dictionary_hash(key);
-	for (i=0; i < d->size; i++) {
-		if (d->key[i] == NULL)
-			continue;
-		/* Compare hash */
-		if (hash == d->hash[i]) {
-			/* Compare string, to avoid hash collisions */
-			if (!strcmp(key, d->key[i])) {
-				return d->val[i];
-			}
-		}
-	}
-	return def;
+	i = dictionary_find(d, key);
+	if (i < 0)
+		return def;
+	return d->val[i];
 }
 
-int dictionary_set(dictionary *d, const char *key, char *val)
+/**
+ * @brief Set a value, copying it or not
+ * @param d the dictionary
+ * @param key the key
+ * @param val the value (may be NULL)
+ * @param copy whether val must be duplicated
+ * @return 0 if Ok, -1 on allocation failure or bad arguments
+ */
+static int set_val(dictionary *d, const char *key, char *val, int copy)
 {
+	size_t len;
+	unsigned hash, pos;
 	int i;
-	unsigned hash;
 
 	if (d==NULL || key==NULL)
 		return -1;
 
 	/* Compute hash for this key */
-	hash = dictionary_hash(key);
+	len = strlen(key);
+	hash = hash_len(key, len);
 	/* Find if value is already in dictionary */
-	if (d->n > 0) {
-		for (i = 0; i < d->size; i++) {
-			if (d->key[i] == NULL)
-				continue;
-			/* Same hash value */
-			if (hash == d->hash[i]) {
-				/* Same key */
-				if (!strcmp(key, d->key[i])) {
-					/* Found a value: modify and return */
-					if (d->val[i] != NULL)
-						free(d->val[i]);
-					d->val[i] = val ? strdup(val) : NULL;
-					/* Value has been modified: return */
-					return 0;
-				}
-			}
-		}
+	i = index_find(d, key, len, hash);
+	if (i >= 0) {
+		/* Found a value: modify and return */
+		i = d->index[i] - 1;
+		free_val(d, d->val[i]);
+		d->val[i] = (val && copy) ? strdup(val) : val;
+		return 0;
 	}
 
 	/* Add a new value
@@ -184,64 +434,94 @@ int dictionary_set(dictionary *d, const char *key, char *val)
 		d->key  = (char **) mem_double(d->key, d->size * sizeof(char *));
 		d->hash = (unsigned int *)
 			mem_double(d->hash, d->size * sizeof(unsigned));
-		if ((d->val == NULL) || (d->key == NULL) || (d->hash == NULL))
+		d->link = (struct dictionary_link *)
+			mem_double(d->link,
+				   d->size * sizeof(struct dictionary_link));
+		if ((d->val == NULL) || (d->key == NULL) || (d->hash == NULL)
+		    || (d->link == NULL))
 			/* Cannot grow dictionary */
 			return -1;
 		/* Double size */
 		d->size *= 2;
+		if (index_rebuild(d) != 0)
+			return -1;
 	}
 
 	/* Insert key in the first empty slot */
-	for (i = 0; i < d->size; i++) {
-		if (d->key[i] == NULL) {
-			/* Add key here */
-			break;
-		}
-	}
+	for (i = d->free_hint; d->key[i] != NULL; i++);
+	d->free_hint = i + 1;
+
 	/* Copy key */
 	d->key[i] = strdup(key);
-	d->val[i] = val ? strdup(val) : NULL;
+	if (d->key[i] == NULL)
+		return -1;
+	d->val[i] = (val && copy) ? strdup(val) : val;
 	d->hash[i] = hash;
+	for (pos = hash & d->index_mask;
+	     d->index[pos];
+	     pos = (pos + 1) & d->index_mask);
+	d->index[pos] = i + 1;
+	section_link(d, i);
 	d->n ++;
 	return 0;
 }
 
+int dictionary_set(dictionary *d, const char *key, char *val)
+{
+	return set_val(d, key, val, 1);
+}
+
+int dictionary_set_mapped(dictionary *d, const char *key, char *val)
+{
+	if (d == NULL || (val != NULL && !is_mapped(d, val)))
+		return -1;
+	return set_val(d, key, val, 0);
+}
+
 void dictionary_unset(dictionary *d, const char *key)
 {
-	unsigned hash;
-	int i;
+	size_t len;
+	int i, pos;
 
 	if (key == NULL)
 		return;
 
-	hash = dictionary_hash(key);
-	for (i = 0; i < d->size; i++) {
-		if (d->key[i] == NULL)
-			continue;
-		/* Compare hash */
-		if (hash == d->hash[i]) {
-			/* Compare string, to avoid hash collisions */
-			if (!strcmp(key, d->key[i])) {
-				/* Found key */
-				break;
-			}
-		}
-	}
-	if (i >= d->size)
+	len = strlen(key);
+	pos = index_find(d, key, len, hash_len(key, len));
+	if (pos < 0)
 		/* Key not found */
 		return;
 
+	i = d->index[pos] - 1;
+	section_unlink(d, i);
+	index_remove(d, pos);
+
 	free(d->key[i]);
 	d->key[i] = NULL;
-	if (d->val[i]!=NULL) {
-		free(d->val[i]);
-		d->val[i] = NULL;
-	}
+	free_val(d, d->val[i]);
+	d->val[i] = NULL;
 	d->hash[i] = 0;
+	if (i < d->free_hint)
+		d->free_hint = i;
 	d->n --;
 	return;
 }
 
+int dictionary_section_first(dictionary *d, const char *section)
+{
+	int i;
+
+	i = dictionary_find(d, section);
+	if (i < 0 || strchr(section, ':'))
+		return -1;
+	return d->link[i].first;
+}
+
+int dictionary_section_next(dictionary *d, int i)
+{
+	return d->link[i].next;
+}
+
 void dictionary_dump(dictionary *d, FILE *out)
 {
 	int i;
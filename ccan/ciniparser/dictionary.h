@@ -45,6 +45,20 @@
  */
 
 
+/**
+ * @brief Section links for one dictionary slot (internal use only)
+ * @param section Slot of the section a "section:key" entry belongs to, or -1
+ * @param prev Previous key slot in the same section, or -1
+ * @param next Next key slot in the same section, or -1
+ * @param first First key slot of a section entry, or -1
+ * @param last Last key slot of a section entry, or -1
+ */
+struct dictionary_link {
+	int section;
+	int prev, next;
+	int first, last;
+};
+
 /**
  * @brief Dictionary object
  * @param n Number of entries in the dictionary
@@ -52,11 +66,20 @@
  * @param val List of string values
  * @param key List of string keys
  * @param hash List of hash values for keys
+ * @param index Open-addressed hash index: slot + 1 for each key, 0 if unused
+ * @param index_mask Size of index, minus one
+ * @param free_hint Every slot below this one is in use
+ * @param link Section links for each slot
+ * @param nsec Number of keys which contain no colon (sections)
+ * @param orphans Number of "section:key" entries whose section is missing
+ * @param map File mapping which values may point into, or NULL
+ * @param map_len Length of map
  *
  * This object contains a list of string/string associations. Each
- * association is identified by a unique string key. Looking up values
- * in the dictionary is speeded up by the use of a (hopefully collision-free)
- * hash function.
+ * association is identified by a unique string key. Entries stay in the
+ * slot they were added to, so walking key[] from 0 to size gives them in
+ * insertion order (with holes where entries were removed); lookups go
+ * through a linear-probing hash index over the slots instead.
  */
 typedef struct _dictionary_ {
 	int n;
@@ -64,6 +87,14 @@ typedef struct _dictionary_ {
 	char **val;
 	char **key;
 	unsigned *hash;
+	int *index;
+	unsigned index_mask;
+	int free_hint;
+	struct dictionary_link *link;
+	int nsec;
+	int orphans;
+	char *map;
+	size_t map_len;
 } dictionary;
 
 /**
@@ -94,7 +125,8 @@ dictionary *dictionary_new(int size);
  * @param d dictionary object to deallocate.
  * @return void
  *
- * Deallocate a dictionary object and all memory associated to it.
+ * Deallocate a dictionary object and all memory associated to it,
+ * including the file mapping, if any.
  */
 void dictionary_del(dictionary *vd);
 
@@ -149,6 +181,54 @@ int dictionary_set(dictionary *vd, const char *key, char *val);
  */
 void dictionary_unset(dictionary *d, const char *key);
 
+/**
+ * @brief Set a value in a dictionary without copying it.
+ * @param d dictionary object to modify.
+ * @param key Key to modify or add.
+ * @param val Value to add, which must point inside d->map.
+ * @return int 0 if Ok, anything else otherwise
+ *
+ * This is dictionary_set() for values which live in the file mapping
+ * attached to the dictionary (see ciniparser_load_mmap()): the pointer
+ * is stored as it is, and is never freed.
+ */
+int dictionary_set_mapped(dictionary *d, const char *key, char *val);
+
+/**
+ * @brief Find the slot holding a key.
+ * @param d dictionary object to search.
+ * @param key Key to look for in the dictionary.
+ * @return slot index in d->key and d->val, or -1 if not found.
+ */
+int dictionary_find(dictionary *d, const char *key);
+
+/**
+ * @brief Find the first key in a section.
+ * @param d dictionary object to search.
+ * @param section Section name (a key containing no colon).
+ * @return slot of the first "section:..." key, or -1 if there is none.
+ *
+ * Keys are returned in slot order, which is the order they were added in
+ * unless entries were removed. Use it with dictionary_section_next():
+ *
+ * @code
+ * for (i = dictionary_section_first(d, "sec"); i >= 0;
+ *      i = dictionary_section_next(d, i))
+ *	printf("%s = %s\n", d->key[i], d->val[i]);
+ * @endcode
+ *
+ * This costs one lookup, plus one step per key in the section.
+ */
+int dictionary_section_first(dictionary *d, const char *section);
+
+/**
+ * @brief Find the next key in the same section.
+ * @param d dictionary object to search.
+ * @param i slot returned by dictionary_section_first() or this function.
+ * @return slot of the next key in the section, or -1 if there are no more.
+ */
+int dictionary_section_next(dictionary *d, int i);
+
 /**
  * @brief Dump a dictionary to an opened file pointer.
  * @param d Dictionary to dump
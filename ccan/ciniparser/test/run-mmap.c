@@ -0,0 +1,193 @@
+#include <ccan/ciniparser/ciniparser.h>
+#include <ccan/ciniparser/ciniparser.c>
+#include <ccan/ciniparser/dictionary.h>
+#include <ccan/ciniparser/dictionary.c>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include <ccan/tap/tap.h>
+
+/* Every line form ciniparser_line() understands. */
+static const char tricky[] =
+	"# comment\n"
+	"nosection = before any section\n"
+	"[ Mixed Case ]   \n"
+	"Key1 = plain value ; comment\n"
+	"KEY2=\"quoted ; not a comment\" trailing\n"
+	"key3 = 'single # quoted'\n"
+	"key4 = \"\"\n"
+	"key5 = ''\n"
+	"key6 =\n"
+	"key7 = ;\n"
+	"key8 = # nothing\n"
+	"key9 = \"unterminated\n"
+	"key10 = two \\\n"
+	"   lines \\\n"
+	"and three\n"
+	"   key11   =   spaced   \n"
+	"\t\n"
+	"[]\n"
+	"key12 = after empty section\n"
+	"[second]\n"
+	"a = 1\n"
+	"key1 = overridden\n"
+	"[second]\n"
+	"b = 2\n"
+	"key1 = last wins\n";
+
+static char *write_file(const char *name, const char *contents)
+{
+	char *path = malloc(100);
+	FILE *f;
+
+	sprintf(path, "/tmp/ciniparser-%s.%u.ini", name, (unsigned)getpid());
+	f = fopen(path, "w");
+	fputs(contents, f);
+	fclose(f);
+	return path;
+}
+
+/* Same keys in the same slots, with the same values. */
+static bool same_dict(dictionary *a, dictionary *b)
+{
+	int i;
+
+	if (a->n != b->n || a->nsec != b->nsec)
+		return false;
+	for (i = 0; i < a->size && i < b->size; i++) {
+		if (!a->key[i] != !b->key[i])
+			return false;
+		if (!a->key[i])
+			continue;
+		if (strcmp(a->key[i], b->key[i]) != 0)
+			return false;
+		if (!a->val[i] != !b->val[i])
+			return false;
+		if (a->val[i] && strcmp(a->val[i], b->val[i]) != 0)
+			return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	dictionary *d1, *d2;
+	const char **keys;
+	char *path, *dump, *buf;
+	int i, n;
+	FILE *f;
+
+	plan_tests(31);
+
+	/* The sample file. */
+	d1 = ciniparser_load("test/test.ini");
+	d2 = ciniparser_load_mmap("test/test.ini");
+	ok1(d1 && d2);
+	ok1(same_dict(d1, d2));
+	ok1(d2->map != NULL);
+	ok1(!strcmp(ciniparser_getstring(d2, "Wine:Grape", NULL),
+		    "Cabernet Sauvignon"));
+	ok1(ciniparser_getint(d2, "pizza:capres", 0) == 3);
+
+	/* Section iteration. */
+	ok1(ciniparser_getnsec(d2) == 3);
+	ok1(ciniparser_getsecnkeys(d2, "WINE") == 4);
+	ok1(ciniparser_getsecnkeys(d2, "nonesuch") == 0);
+	keys = malloc(4 * sizeof(*keys));
+	ok1(ciniparser_getseckeys(d2, "wine", keys) == keys);
+	ok1(!strcmp(keys[0], "wine:grape"));
+	ok1(!strcmp(keys[3], "wine:alcohol"));
+	free(keys);
+	ciniparser_freedict(d1);
+	ciniparser_freedict(d2);
+
+	/* All the odd cases parse the same way. */
+	path = write_file("tricky", tricky);
+	d1 = ciniparser_load(path);
+	d2 = ciniparser_load_mmap(path);
+	ok1(d1 && d2);
+	ok1(same_dict(d1, d2));
+	ok1(!strcmp(ciniparser_getstring(d2, "mixed case:key2", NULL),
+		    "quoted ; not a comment"));
+	ok1(!strcmp(ciniparser_getstring(d2, "mixed case:key4", NULL), ""));
+	ok1(!strcmp(ciniparser_getstring(d2, "mixed case:key10", NULL),
+		    "two    lines and three"));
+	ok1(!strcmp(ciniparser_getstring(d2, ":nosection", NULL),
+		    "before any section"));
+	ok1(!strcmp(ciniparser_getstring(d2, "second:key1", NULL),
+		    "last wins"));
+	ok1(ciniparser_getsecnkeys(d2, "second") == 3);
+
+	/* Setting and unsetting mapped values must not free them. */
+	ok1(ciniparser_set(d2, "mixed case:key1", "new") == 0);
+	ciniparser_unset(d2, "mixed case:key3");
+	ok1(!ciniparser_find_entry(d2, "mixed case:key3"));
+	ok1(ciniparser_getsecnkeys(d2, "mixed case") == 11);
+	ciniparser_freedict(d1);
+	ciniparser_freedict(d2);
+	unlink(path);
+	free(path);
+
+	/* A last line without a newline, and a syntax error. */
+	path = write_file("nonl", "[s]\nk = v");
+	d2 = ciniparser_load_mmap(path);
+	ok1(d2 && !strcmp(ciniparser_getstring(d2, "s:k", NULL), "v"));
+	ciniparser_freedict(d2);
+	unlink(path);
+	free(path);
+	path = write_file("bad", "[s]\nnot a key\nk = v\n");
+	ok1(ciniparser_load_mmap(path) == NULL);
+	unlink(path);
+	free(path);
+	ok1(ciniparser_load_mmap("/nonexistent/file.ini") == NULL);
+
+	/* An empty file is an empty dictionary. */
+	path = write_file("empty", "");
+	d2 = ciniparser_load_mmap(path);
+	ok1(d2 && d2->n == 0);
+	ciniparser_freedict(d2);
+	unlink(path);
+	free(path);
+
+	/* Keys added before their section are found once it exists. */
+	d1 = dictionary_new(0);
+	dictionary_set(d1, "late:b", "2");
+	dictionary_set(d1, "late:a", "1");
+	ok1(dictionary_section_first(d1, "late") == -1);
+	dictionary_set(d1, "late", NULL);
+	i = dictionary_section_first(d1, "late");
+	ok1(i == 0 && dictionary_section_next(d1, i) == 1);
+	dictionary_unset(d1, "late");
+	ok1(dictionary_section_first(d1, "late") == -1 && d1->orphans == 2);
+	dictionary_del(d1);
+
+	/* dump_ini writes every section once, and reads back the same. */
+	buf = malloc(100000);
+	dump = write_file("dump", "");
+	strcpy(buf, "");
+	for (i = 0; i < 50; i++)
+		for (n = 0; n < 20; n++)
+			sprintf(buf + strlen(buf), "[sec%d]\nkey%d = %d\n",
+				i, n, i * n);
+	path = write_file("big", buf);
+	d1 = ciniparser_load_mmap(path);
+	f = fopen(dump, "w");
+	ciniparser_dump_ini(d1, f);
+	fclose(f);
+	d2 = ciniparser_load(dump);
+	ok1(d1 && d2 && same_dict(d1, d2));
+	ok1(ciniparser_getnsec(d2) == 50
+	    && ciniparser_getsecnkeys(d2, "sec49") == 20);
+	ciniparser_freedict(d1);
+	ciniparser_freedict(d2);
+	unlink(path);
+	free(path);
+	unlink(dump);
+	free(dump);
+	free(buf);
+
+	return exit_status();
+}
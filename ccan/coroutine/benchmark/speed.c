@@ -0,0 +1,116 @@
+/* Creates 100k coroutine stacks, each from coroutine_stack_alloc() and
+ * from pools with and without guard pages, runs a coroutine on each, and
+ * reports the time taken and the memory used. */
+#include <ccan/coroutine/coroutine.h>
+#include <ccan/time/time.h>
+#include <alloca.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM 100000
+#define STKSZ (64 * 1024)
+/* Deep enough to be worth trimming. */
+#define DEPTH 16000
+
+static struct coroutine_stack *stacks[NUM];
+static struct coroutine_state main_cs, co_cs;
+
+static void dig(void *unused)
+{
+	char *buf = alloca(DEPTH);
+
+	memset(buf, 1, DEPTH);
+	/* Don't let the compiler decide that's unused. */
+	__asm__ __volatile__("" : : "r"(buf) : "memory");
+	coroutine_jump(&main_cs);
+}
+
+/* Resident memory, in kbytes. */
+static unsigned long rss(void)
+{
+	unsigned long size, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (f) {
+		if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+	return resident * getpagesize() / 1024;
+}
+
+static unsigned long nsec_each(struct timemono start, size_t num)
+{
+	return num ? time_to_nsec(timemono_since(start)) / num : 0;
+}
+
+static void bench(const char *what, struct coroutine_stack_pool *pool)
+{
+	struct timemono start;
+	unsigned long base = rss(), get_ns, run_ns, release_ns, reget_ns;
+	size_t i, num;
+
+	start = time_mono();
+	for (num = 0; num < NUM; num++) {
+		if (pool)
+			stacks[num] = coroutine_stack_pool_get(pool);
+		else
+			stacks[num] = coroutine_stack_alloc(STKSZ, 0);
+		if (!stacks[num])
+			break;
+	}
+	get_ns = nsec_each(start, num);
+
+	start = time_mono();
+	for (i = 0; i < num; i++) {
+		coroutine_init(&co_cs, dig, NULL, stacks[i]);
+		coroutine_switch(&main_cs, &co_cs);
+	}
+	run_ns = nsec_each(start, num);
+
+	printf("%-20s %6zu stacks: %6lu ns get, %6lu ns first run, %7lu kB\n",
+	       what, num, get_ns, run_ns, rss() - base);
+
+	start = time_mono();
+	for (i = 0; i < num; i++)
+		coroutine_stack_release(stacks[i], 0);
+	release_ns = nsec_each(start, num);
+
+	if (!pool) {
+		printf("%-20s %6s         %6lu ns release\n", "", "", release_ns);
+		return;
+	}
+
+	start = time_mono();
+	for (i = 0; i < num; i++)
+		stacks[i] = coroutine_stack_pool_get(pool);
+	reget_ns = nsec_each(start, num);
+	for (i = 0; i < num; i++)
+		coroutine_stack_release(stacks[i], 0);
+	printf("%-20s %6s         %6lu ns release, %6lu ns reuse",
+	       "", "", release_ns, reget_ns);
+	if (coroutine_stack_pool_high_water(pool))
+		printf(", high water %zu bytes",
+		       coroutine_stack_pool_high_water(pool));
+	printf("\n");
+
+	coroutine_stack_pool_trim(pool);
+	printf("%-20s %6s         %7lu kB after trim\n", "", "", rss() - base);
+	coroutine_stack_pool_free(pool);
+}
+
+int main(void)
+{
+	bench("coroutine_stack_alloc", NULL);
+	bench("pool", coroutine_stack_pool_new(STKSZ, 0, 0));
+	bench("pool, no guard",
+	      coroutine_stack_pool_new(STKSZ, 0,
+				       COROUTINE_STACK_POOL_NO_GUARD));
+	bench("pool, high water",
+	      coroutine_stack_pool_new(STKSZ, 0,
+				       COROUTINE_STACK_POOL_NO_GUARD
+				       | COROUTINE_STACK_POOL_HIGH_WATER));
+	return 0;
+}
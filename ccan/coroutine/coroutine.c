@@ -75,6 +75,7 @@ struct coroutine_stack *coroutine_stack_init(void *buf, size_t bufsize,
 
 	stack->magic = COROUTINE_STACK_MAGIC_BUF;
 	stack->size = size;
+	stack->pool = NULL;
 	vg_register_stack(stack);
 	return stack;
 }
@@ -111,6 +112,7 @@ struct coroutine_stack *coroutine_stack_alloc(size_t totalsize, size_t metasize)
 
 	stack->magic = COROUTINE_STACK_MAGIC_ALLOC;
 	stack->size = totalsize - sizeof(*stack) - metasize;
+	stack->pool = NULL;
 
 	vg_register_stack(stack);
 
@@ -133,6 +135,291 @@ static void coroutine_stack_free(struct coroutine_stack *stack, size_t metasize)
 	munmap(map, mapsize);
 }
 
+/*
+ * Stack pools
+ */
+
+/* The most stacks mapped at once. */
+#define POOL_MAX_REGION		1024
+
+/* A single mapping, carved into stacks as they're first needed. */
+struct coroutine_stack_region {
+	struct coroutine_stack_region *next;
+	char *map;
+	unsigned int num;
+	/* Stacks carved from it so far (may overshoot num). */
+	unsigned int used;
+};
+
+struct coroutine_stack_pool {
+	size_t slotsize;
+	size_t metasize;
+	size_t pgsz;
+	unsigned int flags;
+	unsigned int next_num;
+	/* Released stacks, and carved ones still needing a guard page,
+	 * linked through next_free, under free_lock. */
+	struct coroutine_stack *free, *unguarded;
+	bool free_lock;
+	/* The first is the one we're carving from. */
+	struct coroutine_stack_region *regions;
+	size_t high_water;
+};
+
+static size_t guard_size(const struct coroutine_stack_pool *pool)
+{
+	return (pool->flags & COROUTINE_STACK_POOL_NO_GUARD) ? 0 : pool->pgsz;
+}
+
+struct coroutine_stack_pool *coroutine_stack_pool_new(size_t totalsize,
+						      size_t metasize,
+						      unsigned int flags)
+{
+	struct coroutine_stack_pool *pool;
+	size_t pgsz = getpagesize();
+
+	if (totalsize < COROUTINE_MIN_STKSZ + sizeof(struct coroutine_stack)
+	    + metasize)
+		return NULL;
+
+	pool = malloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pool->pgsz = pgsz;
+	pool->flags = flags;
+	pool->metasize = metasize;
+	pool->slotsize = ((totalsize + (pgsz - 1)) & ~(pgsz - 1))
+		+ guard_size(pool);
+	pool->next_num = 16;
+	pool->free = pool->unguarded = NULL;
+	pool->free_lock = false;
+	pool->regions = NULL;
+	pool->high_water = 0;
+	return pool;
+}
+
+/* Map a new region and make it the one we carve from.  If another thread
+ * beat us to it, use theirs. */
+static bool pool_grow(struct coroutine_stack_pool *pool,
+		      struct coroutine_stack_region *old)
+{
+	struct coroutine_stack_region *r;
+	unsigned int num = __atomic_load_n(&pool->next_num, __ATOMIC_RELAXED);
+
+	r = malloc(sizeof(*r));
+	if (!r)
+		return false;
+	/* Reserve, but don't commit, the memory. */
+	r->map = mmap(NULL, num * pool->slotsize, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (r->map == MAP_FAILED) {
+		free(r);
+		return false;
+	}
+	r->num = num;
+	r->used = 0;
+	r->next = old;
+	if (!__atomic_compare_exchange_n(&pool->regions, &r->next, r, false,
+					 __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+		munmap(r->map, num * pool->slotsize);
+		free(r);
+		return true;
+	}
+	if (num < POOL_MAX_REGION)
+		__atomic_store_n(&pool->next_num, num * 2, __ATOMIC_RELAXED);
+	return true;
+}
+
+/* The lock is only held to push or pop, so spinning is cheap, and a
+ * byte-wide test-and-set needs no libatomic. */
+static void free_lock(struct coroutine_stack_pool *pool)
+{
+	while (__atomic_test_and_set(&pool->free_lock, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&pool->free_lock, __ATOMIC_RELAXED));
+}
+
+static void free_unlock(struct coroutine_stack_pool *pool)
+{
+	__atomic_clear(&pool->free_lock, __ATOMIC_RELEASE);
+}
+
+static void free_push(struct coroutine_stack_pool *pool,
+		      struct coroutine_stack **list,
+		      struct coroutine_stack *stack)
+{
+	free_lock(pool);
+	stack->next_free = *list;
+	*list = stack;
+	free_unlock(pool);
+}
+
+static struct coroutine_stack *free_pop(struct coroutine_stack_pool *pool,
+					struct coroutine_stack **list)
+{
+	struct coroutine_stack *stack;
+
+	free_lock(pool);
+	stack = *list;
+	if (stack)
+		*list = stack->next_free;
+	free_unlock(pool);
+	return stack;
+}
+
+static bool pool_guard(const struct coroutine_stack_pool *pool,
+		       struct coroutine_stack *stack)
+{
+	char *slot;
+
+	if (!guard_size(pool))
+		return true;
+#if HAVE_STACK_GROWS_UPWARDS
+	slot = (char *)stack - pool->metasize;
+	return mprotect(slot + pool->slotsize - pool->pgsz, pool->pgsz,
+			PROT_NONE) == 0;
+#else
+	slot = (char *)(stack + 1) + pool->metasize - pool->slotsize;
+	/* This fails once we hit the limit on mappings. */
+	return mprotect(slot, pool->pgsz, PROT_NONE) == 0;
+#endif
+}
+
+/* Set up the stack in the next unused slot of a region. */
+static struct coroutine_stack *carve_slot(struct coroutine_stack_pool *pool)
+{
+	struct coroutine_stack_region *r;
+	struct coroutine_stack *stack;
+	unsigned int i;
+	char *slot;
+
+	for (;;) {
+		r = __atomic_load_n(&pool->regions, __ATOMIC_ACQUIRE);
+		if (r) {
+			i = __atomic_fetch_add(&r->used, 1, __ATOMIC_RELAXED);
+			if (i < r->num)
+				break;
+		}
+		if (!pool_grow(pool, r))
+			return NULL;
+	}
+
+	slot = r->map + (size_t)i * pool->slotsize;
+#if HAVE_STACK_GROWS_UPWARDS
+	stack = (struct coroutine_stack *)(slot + pool->metasize);
+#else
+	stack = (struct coroutine_stack *)(slot + pool->slotsize
+					   - pool->metasize) - 1;
+#endif
+	stack->magic = COROUTINE_STACK_MAGIC_POOL;
+	stack->size = pool->slotsize - guard_size(pool)
+		- sizeof(*stack) - pool->metasize;
+	stack->pool = pool;
+	return stack;
+}
+
+static struct coroutine_stack *pool_carve(struct coroutine_stack_pool *pool)
+{
+	struct coroutine_stack *stack;
+
+	/* Slots we couldn't guard last time come first. */
+	stack = free_pop(pool, &pool->unguarded);
+	if (!stack) {
+		stack = carve_slot(pool);
+		if (!stack)
+			return NULL;
+	}
+
+	if (!pool_guard(pool, stack)) {
+		free_push(pool, &pool->unguarded, stack);
+		return NULL;
+	}
+	return stack;
+}
+
+struct coroutine_stack *
+coroutine_stack_pool_get(struct coroutine_stack_pool *pool)
+{
+	struct coroutine_stack *stack;
+
+	stack = free_pop(pool, &pool->free);
+	if (!stack) {
+		stack = pool_carve(pool);
+		if (!stack)
+			return NULL;
+	}
+	vg_register_stack(stack);
+	return stack;
+}
+
+static void coroutine_stack_pool_put(struct coroutine_stack_pool *pool,
+				     struct coroutine_stack *stack,
+				     size_t metasize)
+{
+	assert(metasize == pool->metasize);
+
+	if (pool->flags & COROUTINE_STACK_POOL_HIGH_WATER) {
+		size_t used = coroutine_stack_used(stack);
+		size_t hw = __atomic_load_n(&pool->high_water,
+					    __ATOMIC_RELAXED);
+		char *base = coroutine_stack_base(stack);
+
+		while (used > hw
+		       && !__atomic_compare_exchange_n(&pool->high_water, &hw,
+						       used, false,
+						       __ATOMIC_RELAXED,
+						       __ATOMIC_RELAXED));
+		/* Back to zero, for next time. */
+#if HAVE_STACK_GROWS_UPWARDS
+		memset(base, 0, used);
+#else
+		memset(base + stack->size - used, 0, used);
+#endif
+	}
+	free_push(pool, &pool->free, stack);
+}
+
+void coroutine_stack_pool_trim(struct coroutine_stack_pool *pool)
+{
+	struct coroutine_stack *stack, *next;
+	size_t mask = pool->pgsz - 1;
+
+	/* Take them all, so we don't madvise() under the lock. */
+	free_lock(pool);
+	next = pool->free;
+	pool->free = NULL;
+	free_unlock(pool);
+
+	while ((stack = next) != NULL) {
+		uintptr_t start = (uintptr_t)coroutine_stack_base(stack);
+		uintptr_t end = start + stack->size;
+
+		next = stack->next_free;
+		/* Only whole pages: not the one holding the header. */
+		start = (start + mask) & ~mask;
+		end &= ~mask;
+		if (end > start)
+			madvise((void *)start, end - start, MADV_DONTNEED);
+		free_push(pool, &pool->free, stack);
+	}
+}
+
+size_t coroutine_stack_pool_high_water(const struct coroutine_stack_pool *pool)
+{
+	return __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+}
+
+void coroutine_stack_pool_free(struct coroutine_stack_pool *pool)
+{
+	struct coroutine_stack_region *r, *next;
+
+	for (r = pool->regions; r; r = next) {
+		next = r->next;
+		munmap(r->map, r->num * pool->slotsize);
+		free(r);
+	}
+	free(pool);
+}
+
 void coroutine_stack_release(struct coroutine_stack *stack, size_t metasize)
 {
 	vg_deregister_stack(stack);
@@ -146,6 +433,10 @@ void coroutine_stack_release(struct coroutine_stack *stack, size_t metasize)
 		coroutine_stack_free(stack, metasize);
 		break;
 
+	case COROUTINE_STACK_MAGIC_POOL:
+		coroutine_stack_pool_put(stack->pool, stack, metasize);
+		break;
+
 	default:
 		abort();
 	}
@@ -156,7 +447,8 @@ struct coroutine_stack *coroutine_stack_check(struct coroutine_stack *stack,
 {
 	if (stack && vg_addressable(stack, sizeof(*stack))
 	    && ((stack->magic == COROUTINE_STACK_MAGIC_BUF)
-		|| (stack->magic == COROUTINE_STACK_MAGIC_ALLOC))
+		|| (stack->magic == COROUTINE_STACK_MAGIC_ALLOC)
+		|| (stack->magic == COROUTINE_STACK_MAGIC_POOL))
 	    && (stack->size >= COROUTINE_MIN_STKSZ))
 		return stack;
 
@@ -177,7 +469,63 @@ size_t coroutine_stack_size(const struct coroutine_stack *stack)
 	return stack->size;
 }
 
-#if HAVE_UCONTEXT
+/* Find the resident page furthest from the start of the stack (ie.
+ * the lowest, on a downward-growing stack): untouched pages are zero,
+ * and we don't want to fault them in to find out. */
+static const char *first_resident(const char *base, size_t size)
+{
+	size_t pgsz = getpagesize();
+	uintptr_t start = (uintptr_t)base & ~(pgsz - 1);
+	size_t i, npages = ((uintptr_t)base + size - start + pgsz - 1) / pgsz;
+	unsigned char vec_small[256], *vec = vec_small;
+	const char *p = base;
+
+	if (npages > sizeof(vec_small)) {
+		vec = malloc(npages);
+		if (!vec)
+			return base;
+	}
+	if (mincore((void *)start, npages * pgsz, vec) == 0) {
+#if HAVE_STACK_GROWS_UPWARDS
+		for (i = npages; i > 0; i--)
+			if (vec[i - 1] & 1)
+				break;
+		p = (const char *)(start + i * pgsz);
+		if (p > base + size)
+			p = base + size;
+#else
+		for (i = 0; i < npages; i++)
+			if (vec[i] & 1)
+				break;
+		p = (const char *)(start + i * pgsz);
+		if (p < base)
+			p = base;
+#endif
+	}
+	if (vec != vec_small)
+		free(vec);
+	return p;
+}
+
+size_t coroutine_stack_used(const struct coroutine_stack *stack)
+{
+	const char *base = coroutine_stack_base((struct coroutine_stack *)stack);
+	const char *p = first_resident(base, stack->size);
+
+#if HAVE_STACK_GROWS_UPWARDS
+	while (p > base && p[-1] == 0)
+		p--;
+	return p - base;
+#else
+	const char *end = base + stack->size;
+
+	while (p < end && *p == 0)
+		p++;
+	return end - p;
+#endif
+}
+
+#if HAVE_UCONTEXT && !COROUTINE_X86_64
 static void coroutine_uc_stack(stack_t *uc_stack,
 			       const struct coroutine_stack *stack)
 {
@@ -190,7 +538,99 @@ static void coroutine_uc_stack(stack_t *uc_stack,
  * Coroutine switching
  */
 
-#if HAVE_UCONTEXT
+#if COROUTINE_X86_64
+/*
+ * A suspended coroutine's stack pointer points at its saved state:
+ *
+ *	sp[0]	MXCSR (low half) and x87 control word (high half)
+ *	sp[1-6]	r15, r14, r13, r12, rbx, rbp
+ *	sp[7]	return address
+ *
+ * Everything else is caller-saved, so the compiler has already dealt
+ * with it by the time we're called.
+ */
+void ccan_coroutine_swap(void **from_sp, void *to_sp);
+void NORETURN ccan_coroutine_restore(void *to_sp);
+void ccan_coroutine_start(void);
+
+__asm__(".text\n"
+	".globl ccan_coroutine_swap\n"
+	".hidden ccan_coroutine_swap\n"
+	".type ccan_coroutine_swap, @function\n"
+	"ccan_coroutine_swap:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rdi\n"
+	/* Fall through. */
+	".size ccan_coroutine_swap, .-ccan_coroutine_swap\n"
+	".globl ccan_coroutine_restore\n"
+	".hidden ccan_coroutine_restore\n"
+	".type ccan_coroutine_restore, @function\n"
+	"ccan_coroutine_restore:\n"
+	"	movq %rdi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size ccan_coroutine_restore, .-ccan_coroutine_restore\n"
+	/* A new coroutine "returns" here, with fn in r13 and arg in r12,
+	 * and the stack aligned as for a call. */
+	".globl ccan_coroutine_start\n"
+	".hidden ccan_coroutine_start\n"
+	".type ccan_coroutine_start, @function\n"
+	"ccan_coroutine_start:\n"
+	"	movq %r12, %rdi\n"
+	"	callq *%r13\n"
+	/* Coroutines must not return. */
+	"	ud2\n"
+	".size ccan_coroutine_start, .-ccan_coroutine_start\n");
+
+void coroutine_init_(struct coroutine_state *cs,
+		     void (*fn)(void *), void *arg,
+		     struct coroutine_stack *stack)
+{
+	char *base = coroutine_stack_base(stack);
+	uintptr_t top = ((uintptr_t)base + coroutine_stack_size(stack)) & ~15;
+	uint64_t *sp = (uint64_t *)top - 8;
+
+	/* Default MXCSR (all exceptions masked, round to nearest), and
+	 * x87 control word (likewise, 64-bit precision). */
+	sp[0] = 0x1f80 | ((uint64_t)0x037f << 32);
+	sp[1] = 0;			/* r15 */
+	sp[2] = 0;			/* r14 */
+	sp[3] = (uintptr_t)fn;		/* r13 */
+	sp[4] = (uintptr_t)arg;		/* r12 */
+	sp[5] = 0;			/* rbx */
+	sp[6] = 0;			/* rbp */
+	sp[7] = (uintptr_t)ccan_coroutine_start;
+	cs->sp = sp;
+}
+
+void coroutine_jump(const struct coroutine_state *to)
+{
+	ccan_coroutine_restore(to->sp);
+}
+
+void coroutine_switch(struct coroutine_state *from,
+		      const struct coroutine_state *to)
+{
+	ccan_coroutine_swap(&from->sp, to->sp);
+}
+#elif HAVE_UCONTEXT
 void coroutine_init_(struct coroutine_state *cs,
 		     void (*fn)(void *), void *arg,
 		     struct coroutine_stack *stack)
@@ -12,6 +12,8 @@
 #include <ccan/compiler/compiler.h>
 #include <ccan/typesafe_cb/typesafe_cb.h>
 
+struct coroutine_stack_pool;
+
 /**
  * struct coroutine_stack
  *
@@ -22,6 +24,9 @@ struct coroutine_stack {
 	uint64_t magic;
 	size_t size;
 	int valgrind_id;
+	/* For stacks from a coroutine_stack_pool. */
+	struct coroutine_stack_pool *pool;
+	struct coroutine_stack *next_free;
 };
 
 /**
@@ -49,8 +54,16 @@ struct coroutine_state;
  * Contains the minimum size for a coroutine stack (not including
  * overhead).  On systems with MINSTKSZ, guaranteed to be at least as
  * large as MINSTKSZ.
+ *
+ * On x86-64 the first call to a lazily bound library function runs the
+ * dynamic linker's resolver, which saves the extended register state on
+ * the stack: that alone is nearly 3k on a CPU with AVX-512.
  */
+#ifdef __x86_64__
+#define COROUTINE_MIN_STKSZ		4096
+#else
 #define COROUTINE_MIN_STKSZ		2048
+#endif
 
 /**
  * COROUTINE_STACK_MAGIC_BUF - Magic number for coroutine stacks in a user
@@ -64,6 +77,12 @@ struct coroutine_state;
  */
 #define COROUTINE_STACK_MAGIC_ALLOC	0xc040c040574ca110
 
+/**
+ * COROUTINE_STACK_MAGIC_POOL - Magic number for coroutine stacks
+ *                              from a coroutine_stack_pool
+ */
+#define COROUTINE_STACK_MAGIC_POOL	0xc040c040574c9001
+
 /**
  * coroutine_stack_init - Prepare a coroutine stack in an existing buffer
  * @buf: buffer to use for the coroutine stack
@@ -177,11 +196,128 @@ coroutine_stack_from_metadata(void *metadata, size_t metasize)
  */
 size_t coroutine_stack_size(const struct coroutine_stack *stack);
 
+/**
+ * coroutine_stack_used - Estimate how much of a stack has been used
+ * @stack: coroutine stack
+ *
+ * Returns the number of bytes between the start of @stack and the
+ * furthest non-zero byte from it, which is how deep the coroutines
+ * running on it have gone, as long as the stack was all zero to begin
+ * with.  Stacks from coroutine_stack_alloc() and from a
+ * coroutine_stack_pool are.  It may underestimate if the deepest frame
+ * only wrote zeroes.
+ *
+ * Pages which were never touched are skipped without being read, so
+ * this doesn't commit memory for them.
+ */
+size_t coroutine_stack_used(const struct coroutine_stack *stack);
+
+/*
+ * Stack pools
+ */
+
+/**
+ * COROUTINE_STACK_POOL_NO_GUARD - Don't put guard pages below pool stacks
+ *
+ * Each guard page splits the pool's mappings, and the kernel limits how
+ * many mappings a process may have (vm.max_map_count, 65530 by
+ * default on Linux): so without this, a process can't have much more
+ * than 32000 pool stacks.
+ */
+#define COROUTINE_STACK_POOL_NO_GUARD	1
+
+/**
+ * COROUTINE_STACK_POOL_HIGH_WATER - Track stack usage
+ *
+ * Measure each stack with coroutine_stack_used() when it's returned to
+ * the pool, for coroutine_stack_pool_high_water(), and zero what was
+ * used so the next measurement is good.  This costs time in proportion
+ * to the stack used.
+ */
+#define COROUTINE_STACK_POOL_HIGH_WATER	2
+
+/**
+ * coroutine_stack_pool_new - Create a pool of coroutine stacks
+ * @totalsize: total size of each stack, as for coroutine_stack_alloc()
+ * @metasize: size of metadata to add to each stack
+ * @flags: COROUTINE_STACK_POOL_NO_GUARD, COROUTINE_STACK_POOL_HIGH_WATER
+ *
+ * A pool maps stacks many at a time, in regions which grow as the pool
+ * does.  Memory is reserved but not committed: only the pages of a
+ * stack that a coroutine actually touches use memory.  Unless
+ * COROUTINE_STACK_POOL_NO_GUARD is given, each stack has a guard page,
+ * as from coroutine_stack_alloc().
+ *
+ * Stacks released go back to the pool's free list, which any thread
+ * can take from or return to (a spinlock covers only the list
+ * operations).  The pool only unmaps them when freed.
+ *
+ * Returns NULL if out of memory, or if @totalsize is too small.
+ */
+struct coroutine_stack_pool *coroutine_stack_pool_new(size_t totalsize,
+						      size_t metasize,
+						      unsigned int flags);
+
+/**
+ * coroutine_stack_pool_get - Take a stack from a pool
+ * @pool: the pool
+ *
+ * Returns a stack from the free list, or from a new region if there
+ * are none.  Returns NULL if we can't map a new region.  Release it
+ * with coroutine_stack_release(), using the pool's metasize.
+ */
+struct coroutine_stack *
+coroutine_stack_pool_get(struct coroutine_stack_pool *pool);
+
+/**
+ * coroutine_stack_pool_trim - Return the memory of free stacks
+ * @pool: the pool
+ *
+ * Tells the kernel it can have back the memory of every stack in the
+ * pool's free list, leaving them reserved.  They'll be committed again,
+ * zero, when next used.
+ */
+void coroutine_stack_pool_trim(struct coroutine_stack_pool *pool);
+
+/**
+ * coroutine_stack_pool_high_water - Most stack any coroutine has used
+ * @pool: the pool
+ *
+ * Returns the most coroutine_stack_used() for any stack returned to
+ * the pool, or 0 unless it was created with
+ * COROUTINE_STACK_POOL_HIGH_WATER.
+ */
+size_t coroutine_stack_pool_high_water(const struct coroutine_stack_pool *pool);
+
+/**
+ * coroutine_stack_pool_free - Free a pool
+ * @pool: the pool
+ *
+ * This unmaps every stack in the pool, including any not released.
+ */
+void coroutine_stack_pool_free(struct coroutine_stack_pool *pool);
+
 /*
  * Coroutine switching
  */
 
-#if HAVE_UCONTEXT
+/*
+ * On x86-64 ELF platforms we switch stacks ourselves, saving only the
+ * registers the ABI says a call preserves.  This is much faster than
+ * swapcontext(), which also saves and restores the signal mask with a
+ * system call on every switch: so coroutines don't each get their own
+ * signal mask.  Define COROUTINE_USE_UCONTEXT to use ucontext anyway.
+ */
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__) \
+	&& !defined(COROUTINE_USE_UCONTEXT)
+#define COROUTINE_X86_64		1
+#else
+#define COROUTINE_X86_64		0
+#endif
+
+#if COROUTINE_X86_64
+#define COROUTINE_AVAILABLE		1
+#elif HAVE_UCONTEXT
 #include <ucontext.h>
 #define COROUTINE_AVAILABLE		1
 #else
@@ -189,9 +325,12 @@ size_t coroutine_stack_size(const struct coroutine_stack *stack);
 #endif
 
 struct coroutine_state {
-#if HAVE_UCONTEXT
+#if COROUTINE_X86_64
+	/* Everything else is saved on the coroutine's own stack. */
+	void *sp;
+#elif HAVE_UCONTEXT
 	ucontext_t uc;
-#endif /* HAVE_UCONTEXT */
+#endif
 };
 
 #if COROUTINE_AVAILABLE
@@ -0,0 +1,132 @@
+#include <alloca.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccan/coroutine/coroutine.h>
+#include <ccan/tap/tap.h>
+
+#define STKSZ	(64 * 1024)
+#define NUM	100
+
+struct metadata {
+	uint64_t magic;
+};
+
+struct state {
+	struct coroutine_state ret;
+	size_t depth;
+};
+
+/* Use about s->depth bytes of stack. */
+static void dig(void *p)
+{
+	struct state *s = p;
+	char *buf = alloca(s->depth);
+
+	memset(buf, 0xff, s->depth);
+	/* Don't let the compiler drop the memset as a dead store. */
+	__asm__ volatile("" : : "r"(buf) : "memory");
+	coroutine_jump(&s->ret);
+}
+
+static void run_dig(struct coroutine_stack *stack, size_t depth)
+{
+	struct coroutine_state t;
+	struct state s;
+
+	s.depth = depth;
+	coroutine_init(&t, dig, &s, stack);
+	coroutine_switch(&s.ret, &t);
+}
+
+int main(void)
+{
+	struct coroutine_stack_pool *pool;
+	struct coroutine_stack *stacks[NUM], *stack;
+	struct metadata *meta;
+	int i;
+	bool ok;
+
+	/* This is how many tests you plan to run */
+	plan_tests(17);
+
+	ok1(coroutine_stack_pool_new(COROUTINE_MIN_STKSZ, 0, 0) == NULL);
+
+	pool = coroutine_stack_pool_new(STKSZ, sizeof(*meta),
+					COROUTINE_STACK_POOL_HIGH_WATER);
+	ok1(pool);
+
+	/* Enough to need several regions. */
+	ok = true;
+	for (i = 0; i < NUM; i++) {
+		stacks[i] = coroutine_stack_pool_get(pool);
+		if (coroutine_stack_check(stacks[i], NULL) != stacks[i]
+		    || coroutine_stack_size(stacks[i])
+		    != STKSZ - COROUTINE_STK_OVERHEAD - sizeof(*meta)
+		    || coroutine_stack_used(stacks[i]) != 0)
+			ok = false;
+		meta = coroutine_stack_to_metadata(stacks[i], sizeof(*meta));
+		meta->magic = i;
+	}
+	ok1(ok);
+	for (i = 0; i < NUM; i++) {
+		meta = coroutine_stack_to_metadata(stacks[i], sizeof(*meta));
+		if (meta->magic != i)
+			break;
+	}
+	ok1(i == NUM);
+
+	/* Released stacks are reused, most recent first. */
+	stack = stacks[NUM - 1];
+	coroutine_stack_release(stack, sizeof(*meta));
+	ok1(coroutine_stack_pool_get(pool) == stack);
+
+	if (COROUTINE_AVAILABLE) {
+		/* High water is measured on release... */
+		run_dig(stacks[0], 10000);
+		ok1(coroutine_stack_used(stacks[0]) >= 10000);
+		ok1(coroutine_stack_used(stacks[0]) < 12000);
+		ok1(coroutine_stack_pool_high_water(pool) == 0);
+		coroutine_stack_release(stacks[0], sizeof(*meta));
+		ok1(coroutine_stack_pool_high_water(pool) >= 10000);
+
+		/* ...and the stack zeroed again, for the next user. */
+		stack = coroutine_stack_pool_get(pool);
+		ok1(stack == stacks[0]);
+		ok1(coroutine_stack_used(stack) == 0);
+		run_dig(stack, 20000);
+		coroutine_stack_release(stack, sizeof(*meta));
+		ok1(coroutine_stack_pool_high_water(pool) >= 20000);
+		ok1(coroutine_stack_pool_high_water(pool) < 22000);
+		stacks[0] = coroutine_stack_pool_get(pool);
+	} else {
+		skip(8, "Coroutines not available");
+	}
+
+	/* Trimming keeps the stacks, and they come back zero. */
+	if (COROUTINE_AVAILABLE)
+		run_dig(stacks[1], 30000);
+	coroutine_stack_release(stacks[1], sizeof(*meta));
+	coroutine_stack_pool_trim(pool);
+	stack = coroutine_stack_pool_get(pool);
+	ok1(stack == stacks[1]);
+	ok1(coroutine_stack_used(stack) == 0);
+	coroutine_stack_release(stack, sizeof(*meta));
+
+	for (i = 0; i < NUM; i++)
+		if (i != 1)
+			coroutine_stack_release(stacks[i], sizeof(*meta));
+	coroutine_stack_pool_free(pool);
+
+	/* Without guard pages. */
+	pool = coroutine_stack_pool_new(STKSZ, 0,
+					COROUTINE_STACK_POOL_NO_GUARD);
+	stack = coroutine_stack_pool_get(pool);
+	ok1(coroutine_stack_size(stack) == STKSZ - COROUTINE_STK_OVERHEAD);
+	coroutine_stack_release(stack, 0);
+	ok1(coroutine_stack_pool_get(pool) == stack);
+	coroutine_stack_pool_free(pool);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,83 @@
+/* Measure crcsync throughput for various block sizes.
+ * New file is the old one with random edits every few blocks. */
+#include <ccan/crcsync/crcsync.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const size_t block_sizes[] = { 512, 2048, 8192, 65536 };
+
+static double mb_per_sec(size_t len, struct timerel t)
+{
+	return (double)len / (time_to_usec(t) + 1);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t i, len, used, num;
+	unsigned int b, nthreads;
+	uint8_t *oldbuf, *newbuf;
+
+	if (argc > 3 || (argc > 1 && atol(argv[1]) == 0)) {
+		fprintf(stderr, "Usage: bench [<megabytes> [<threads>]]\n");
+		exit(1);
+	}
+	len = (argc > 1 ? atol(argv[1]) : 64) * 1024 * 1024;
+	nthreads = argc > 2 ? atoi(argv[2]) : 4;
+
+	oldbuf = malloc(len);
+	newbuf = malloc(len);
+	for (i = 0; i < len; i++)
+		oldbuf[i] = random();
+
+	printf("%zuMB, %u threads:\n", len / 1024 / 1024, nthreads);
+	for (b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+		size_t bs = block_sizes[b], nblocks = (len + bs - 1) / bs;
+		uint64_t *crcs = malloc(sizeof(crcs[0]) * nblocks);
+		struct crc_context *ctx;
+		struct timemono start;
+		struct timerel t_crc, t_stream, t_all;
+		long res, matches = 0, *results;
+
+		/* Change one byte every 7 blocks or so. */
+		memcpy(newbuf, oldbuf, len);
+		for (i = 0; i < len / bs / 7; i++)
+			newbuf[random() % len]++;
+
+		start = time_mono();
+		crc_of_blocks(oldbuf, len, bs, 64, crcs);
+		t_crc = timemono_since(start);
+
+		ctx = crc_context_new(bs, 64, crcs, nblocks, len % bs);
+		start = time_mono();
+		for (used = 0; used < len; ) {
+			used += crc_read_block(ctx, &res, newbuf + used,
+					       len - used);
+			matches += (res < 0);
+		}
+		while ((res = crc_read_flush(ctx)) != 0)
+			matches += (res < 0);
+		t_stream = timemono_since(start);
+
+		start = time_mono();
+		results = crc_read_all(ctx, newbuf, len, nthreads, &num);
+		t_all = timemono_since(start);
+		assert(results);
+		for (i = 0; i < num; i++)
+			matches -= (results[i] < 0);
+		assert(matches == 0);
+
+		printf("blocksize %6zu: crc_of_blocks %7.1f MB/s,"
+		       " crc_read_block %7.1f MB/s, crc_read_all %7.1f MB/s\n",
+		       bs, mb_per_sec(len, t_crc), mb_per_sec(len, t_stream),
+		       mb_per_sec(len, t_all));
+		free(results);
+		crc_context_free(ctx);
+		free(crcs);
+	}
+	free(oldbuf);
+	free(newbuf);
+	return 0;
+}
@@ -46,8 +46,14 @@ struct crc_context {
 	size_t tail_size;
 	uint64_t tail_crc;
 
-	/* Uncrc tab. */
+	/* Uncrc tab, and crc64_iso_table() for rolling inline. */
 	uint64_t uncrc_tab[256];
+	const uint64_t *crc_tab;
+
+	/* Hash index of crc[]: a bitmap prefilter, then chains. */
+	unsigned int hash_bits, filter_bits;
+	uint64_t *filter;
+	unsigned int *hash_head, *hash_next;
 
 	/* This doesn't count the last CRC. */
 	unsigned int num_crcs;
@@ -72,6 +78,55 @@ static void init_uncrc_tab(uint64_t uncrc_tab[], unsigned int wsize)
 	}
 }
 
+/* Spread the (upper) masked crc bits across the hash. */
+static uint64_t crc_hash(uint64_t crc)
+{
+	return crc * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool filter_test(const struct crc_context *ctx, uint64_t hash)
+{
+	uint64_t bit = hash >> (64 - ctx->filter_bits);
+
+	return ctx->filter[bit / 64] & (1ULL << (bit % 64));
+}
+
+/* Build the hash chains so the lowest matching index is always found first. */
+static bool init_index(struct crc_context *ctx)
+{
+	unsigned int i;
+
+	/* At least twice as many heads as crcs, and 8 filter bits per crc. */
+	for (ctx->hash_bits = 6;
+	     (1ULL << ctx->hash_bits) < 2ULL * ctx->num_crcs;
+	     ctx->hash_bits++);
+	ctx->filter_bits = ctx->hash_bits + 2;
+
+	ctx->filter = calloc((1ULL << ctx->filter_bits) / 64,
+			     sizeof(ctx->filter[0]));
+	ctx->hash_head = malloc(sizeof(ctx->hash_head[0])
+				<< ctx->hash_bits);
+	ctx->hash_next = malloc(sizeof(ctx->hash_next[0])
+				* (ctx->num_crcs + 1));
+	if (!ctx->filter || !ctx->hash_head || !ctx->hash_next)
+		return false;
+
+	/* num_crcs means "end of chain". */
+	for (i = 0; i < (1U << ctx->hash_bits); i++)
+		ctx->hash_head[i] = ctx->num_crcs;
+
+	for (i = ctx->num_crcs; i > 0; i--) {
+		uint64_t hash = crc_hash(ctx->crc[i-1]);
+		uint64_t bit = hash >> (64 - ctx->filter_bits);
+		unsigned int h = hash >> (64 - ctx->hash_bits);
+
+		ctx->filter[bit / 64] |= (1ULL << (bit % 64));
+		ctx->hash_next[i-1] = ctx->hash_head[h];
+		ctx->hash_head[h] = i-1;
+	}
+	return true;
+}
+
 struct crc_context *crc_context_new(size_t block_size, unsigned crcbits,
 				    const uint64_t crc[], unsigned num_crcs,
 				    size_t tail_size)
@@ -98,30 +153,48 @@ struct crc_context *crc_context_new(size_t block_size, unsigned crcbits,
 		ctx->literal_bytes = 0;
 		ctx->total_bytes = 0;
 		ctx->have_match = -1;
+		ctx->filter = NULL;
+		ctx->hash_head = ctx->hash_next = NULL;
 		init_uncrc_tab(ctx->uncrc_tab, block_size);
+		ctx->crc_tab = crc64_iso_table();
 		ctx->buffer = malloc(block_size);
-		if (!ctx->buffer) {
-			free(ctx);
+		if (!ctx->crc_tab || !ctx->buffer || !init_index(ctx)) {
+			crc_context_free(ctx);
 			ctx = NULL;
 		}
 	}
 	return ctx;
 }
 
-/* Return -1 or index into matching crc. */
-static int crc_matches(const struct crc_context *ctx)
+/* Return -1 or index of (first) block crc equal to this one. */
+static int crc_lookup(const struct crc_context *ctx, uint64_t crc)
 {
+	uint64_t hash;
 	unsigned int i;
 
-	if (ctx->literal_bytes < ctx->block_size)
+	crc &= ctx->crcmask;
+	hash = crc_hash(crc);
+	if (!filter_test(ctx, hash))
 		return -1;
 
-	for (i = 0; i < ctx->num_crcs; i++)
-		if ((ctx->running_crc & ctx->crcmask) == ctx->crc[i])
+	for (i = ctx->hash_head[hash >> (64 - ctx->hash_bits)];
+	     i != ctx->num_crcs;
+	     i = ctx->hash_next[i]) {
+		if (ctx->crc[i] == crc)
 			return i;
+	}
 	return -1;
 }
 
+/* Return -1 or index into matching crc. */
+static int crc_matches(const struct crc_context *ctx)
+{
+	if (ctx->literal_bytes < ctx->block_size)
+		return -1;
+
+	return crc_lookup(ctx, ctx->running_crc);
+}
+
 static bool tail_matches(const struct crc_context *ctx)
 {
 	if (ctx->literal_bytes != ctx->tail_size)
@@ -130,9 +203,11 @@ static bool tail_matches(const struct crc_context *ctx)
 	return (ctx->running_crc & ctx->crcmask) == ctx->tail_crc;
 }
 
-static uint64_t crc_add_byte(uint64_t crc, uint8_t newbyte)
+/* crc64_iso() of one more byte, using crc64_iso_table() inline. */
+static uint64_t crc_add_byte(uint64_t crc, uint8_t newbyte,
+			     const uint64_t crc_tab[])
 {
-	return crc64_iso(crc, &newbyte, 1);
+	return crc_tab[(crc ^ newbyte) & 0xFF] ^ (crc >> 8);
 }
 
 static uint64_t crc_remove_byte(uint64_t crc, uint8_t oldbyte,
@@ -142,9 +217,10 @@ static uint64_t crc_remove_byte(uint64_t crc, uint8_t oldbyte,
 }
 
 static uint64_t crc_roll(uint64_t crc, uint8_t oldbyte, uint8_t newbyte,
-			 const uint64_t uncrc_tab[])
+			 const uint64_t uncrc_tab[], const uint64_t crc_tab[])
 {
-	return crc_add_byte(crc_remove_byte(crc, oldbyte, uncrc_tab), newbyte);
+	return crc_add_byte(crc_remove_byte(crc, oldbyte, uncrc_tab), newbyte,
+			    crc_tab);
 }
 
 static size_t buffer_size(const struct crc_context *ctx)
@@ -185,15 +261,24 @@ size_t crc_read_block(struct crc_context *ctx, long *result,
 		if (old) {
 			ctx->running_crc = crc_roll(ctx->running_crc,
 						    *old, *p,
-						    ctx->uncrc_tab);
+						    ctx->uncrc_tab,
+						    ctx->crc_tab);
 			old++;
 			/* End of stored buffer?  Start on data they gave us. */
 			if (old == (uint8_t *)ctx->buffer + ctx->buffer_end)
 				old = buf;
 		} else {
-			ctx->running_crc = crc_add_byte(ctx->running_crc, *p);
-			if (p == (uint8_t *)buf + ctx->block_size - 1)
-				old = buf;
+			ctx->running_crc = crc_add_byte(ctx->running_crc, *p,
+							ctx->crc_tab);
+			/* Window full?  Start rolling from its first byte,
+			 * which may still be in our saved buffer. */
+			if (ctx->literal_bytes == ctx->block_size) {
+				if (buffer_size(ctx))
+					old = (uint8_t *)ctx->buffer
+						+ ctx->buffer_start;
+				else
+					old = buf;
+			}
 			/* We don't roll this csum, we only look for it after
 			 * a block match.  It's simpler and faster. */
 			if (tail_matches(ctx)) {
@@ -280,15 +365,279 @@ long crc_read_flush(struct crc_context *ctx)
 	assert(ctx->literal_bytes == ret);
 	ctx->buffer_start = ctx->buffer_end = 0;
 	ctx->literal_bytes = 0;
+	ctx->running_crc = 0;
 	return ret;
 }
 
+/* A match found while scanning a whole buffer. */
+struct crc_match {
+	size_t start, len;
+	long crcnum;
+};
+
+static bool tail_at(const struct crc_context *ctx,
+		    const uint8_t *buf, size_t buflen, size_t off)
+{
+	if (!ctx->tail_size || off + ctx->tail_size > buflen)
+		return false;
+	return (crc64_iso(0, buf + off, ctx->tail_size) & ctx->crcmask)
+		== ctx->tail_crc;
+}
+
+/* Find first full block matching at offset >= off and < end. */
+static bool find_block(const struct crc_context *ctx,
+		       const uint8_t *buf, size_t buflen,
+		       size_t off, size_t end, struct crc_match *m)
+{
+	uint64_t crc;
+	int crcmatch;
+
+	if (buflen < ctx->block_size)
+		return false;
+	if (end > buflen - ctx->block_size + 1)
+		end = buflen - ctx->block_size + 1;
+	if (off >= end)
+		return false;
+
+	crc = crc64_iso(0, buf + off, ctx->block_size);
+	for (;;) {
+		crcmatch = crc_lookup(ctx, crc);
+		if (crcmatch >= 0) {
+			m->start = off;
+			m->len = ctx->block_size;
+			m->crcnum = crcmatch;
+			return true;
+		}
+		if (++off == end)
+			return false;
+		crc = crc_roll(crc, buf[off - 1],
+			       buf[off + ctx->block_size - 1],
+			       ctx->uncrc_tab, ctx->crc_tab);
+	}
+}
+
+/* What crc_read_block would find after starting afresh at off. */
+static bool find_match(const struct crc_context *ctx,
+		       const uint8_t *buf, size_t buflen,
+		       size_t off, size_t end, struct crc_match *m)
+{
+	/* We only look for the tail immediately after a match. */
+	if (tail_at(ctx, buf, buflen, off)) {
+		m->start = off;
+		m->len = ctx->tail_size;
+		m->crcnum = ctx->num_crcs;
+		return true;
+	}
+	return find_block(ctx, buf, buflen, off, end, m);
+}
+
+/* Results of scanning [start, end) as if it were the start of the file. */
+struct crc_range {
+	size_t start, end;
+	struct crc_match *m;
+	size_t num_m;
+	bool failed;
+};
+
+static void scan_range(const struct crc_context *ctx,
+		       const uint8_t *buf, size_t buflen,
+		       struct crc_range *r)
+{
+	size_t off = r->start, max = 0;
+	struct crc_match m;
+
+	r->m = NULL;
+	r->num_m = 0;
+	r->failed = false;
+	while (off < r->end && find_match(ctx, buf, buflen, off, r->end, &m)) {
+		if (r->num_m == max) {
+			struct crc_match *newm;
+			max = max ? max * 2 : 16;
+			newm = realloc(r->m, sizeof(r->m[0]) * max);
+			if (!newm) {
+				r->failed = true;
+				return;
+			}
+			r->m = newm;
+		}
+		r->m[r->num_m++] = m;
+		off = m.start + m.len;
+	}
+}
+
+/* Where range's scan restarted before finding match i. */
+static size_t range_restart(const struct crc_range *r, size_t i)
+{
+	if (i == 0)
+		return r->start;
+	return r->m[i-1].start + r->m[i-1].len;
+}
+
+/*
+ * Find the first full block match at or after off, using the ranges'
+ * results where they tell us the answer.  Each range restarted at
+ * range_restart(r, i), and found no blocks between there and r->m[i]
+ * (unless that's a tail match), nor any after its final restart.
+ */
+static bool next_block(const struct crc_context *ctx,
+		       const uint8_t *buf, size_t buflen,
+		       const struct crc_range *ranges, size_t num_ranges,
+		       size_t off, struct crc_match *m)
+{
+	size_t r = 0;
+
+	while (r < num_ranges) {
+		const struct crc_range *range = &ranges[r];
+		size_t lo, hi, stop;
+
+		if (off >= range->end) {
+			r++;
+			continue;
+		}
+		if (off < range->start)
+			off = range->start;
+
+		/* Binary search for last restart <= off. */
+		lo = 0;
+		hi = range->num_m + 1;
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (range_restart(range, mid) <= off)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		/* Nothing found from restart to end of range? */
+		if (lo == range->num_m) {
+			off = range->end;
+			r++;
+			continue;
+		}
+		/* Block found at or after us, nothing in between? */
+		if (range->m[lo].crcnum < ctx->num_crcs
+		    && range->m[lo].start >= off) {
+			*m = range->m[lo];
+			return true;
+		}
+
+		/* We're inside a match they skipped: scan to next restart. */
+		stop = range_restart(range, lo + 1);
+		if (stop > range->end)
+			stop = range->end;
+		if (find_block(ctx, buf, buflen, off, stop, m))
+			return true;
+		off = stop;
+	}
+	return false;
+}
+
+static bool add_result(long **results, size_t *num, size_t *max, long res)
+{
+	if (*num == *max) {
+		long *newres;
+		*max = *max ? *max * 2 : 64;
+		newres = realloc(*results, sizeof(**results) * *max);
+		if (!newres)
+			return false;
+		*results = newres;
+	}
+	(*results)[(*num)++] = res;
+	return true;
+}
+
+long *crc_read_all(struct crc_context *ctx, const void *buf, size_t buflen,
+		   unsigned int nthreads, size_t *num_results)
+{
+	struct crc_range *ranges;
+	size_t i, num_ranges, range_len, off, max = 0;
+	long *results = NULL;
+	bool failed = false;
+	struct crc_match m;
+	int r;
+
+	/* This would be possible, but it's simpler to start afresh. */
+	assert(ctx->literal_bytes == 0);
+	assert(buffer_size(ctx) == 0);
+	assert(ctx->have_match == -1);
+
+	*num_results = 0;
+
+	/* Don't bother splitting unless there are several blocks each. */
+	if (nthreads == 0)
+		nthreads = 1;
+	num_ranges = nthreads;
+	if (buflen / num_ranges < ctx->block_size * 4)
+		num_ranges = buflen / (ctx->block_size * 4) + 1;
+	range_len = (buflen + num_ranges - 1) / num_ranges;
+
+	ranges = malloc(sizeof(ranges[0]) * num_ranges);
+	if (!ranges)
+		return NULL;
+	for (i = 0; i < num_ranges; i++) {
+		ranges[i].start = i * range_len;
+		ranges[i].end = ranges[i].start + range_len;
+		if (ranges[i].end > buflen)
+			ranges[i].end = buflen;
+	}
+
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nthreads)
+#endif
+	for (r = 0; r < (int)num_ranges; r++)
+		scan_range(ctx, buf, buflen, &ranges[r]);
+
+	for (i = 0; i < num_ranges; i++)
+		failed |= ranges[i].failed;
+
+	/* Now stitch them together: a range's results are only right
+	 * once we restart exactly where that range restarted. */
+	off = 0;
+	while (!failed && off < buflen) {
+		if (tail_at(ctx, buf, buflen, off)) {
+			m.start = off;
+			m.len = ctx->tail_size;
+			m.crcnum = ctx->num_crcs;
+		} else if (!next_block(ctx, buf, buflen, ranges, num_ranges,
+				       off, &m))
+			break;
+
+		if (m.start != off)
+			failed |= !add_result(&results, num_results, &max,
+					      m.start - off);
+		failed |= !add_result(&results, num_results, &max,
+				      -m.crcnum-1);
+		off = m.start + m.len;
+	}
+	if (!failed && off < buflen)
+		failed |= !add_result(&results, num_results, &max,
+				      buflen - off);
+
+	for (i = 0; i < num_ranges; i++)
+		free(ranges[i].m);
+	free(ranges);
+
+	if (failed) {
+		free(results);
+		return NULL;
+	}
+	/* Caller expects non-NULL on success. */
+	if (!results)
+		results = malloc(sizeof(*results));
+	return results;
+}
+
 /**
  * crc_context_free - free a context returned from crc_context_new.
  * @ctx: the context returned from crc_context_new, or NULL.
  */
 void crc_context_free(struct crc_context *ctx)
 {
+	if (!ctx)
+		return;
+	free(ctx->filter);
+	free(ctx->hash_head);
+	free(ctx->hash_next);
 	free(ctx->buffer);
 	free(ctx);
 }
@@ -1,6 +1,7 @@
 /* Licensed under LGPLv2.1+ - see LICENSE file for details */
 #ifndef CCAN_CRCSYNC_H
 #define CCAN_CRCSYNC_H
+#include "config.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -60,6 +61,43 @@ size_t crc_read_block(struct crc_context *ctx, long *result,
  */
 long crc_read_flush(struct crc_context *ctx);
 
+/**
+ * crc_read_all - search a whole buffer for block matches, in parallel.
+ * @ctx: struct crc_context from crc_context_new.
+ * @buf: pointer to bytes
+ * @buflen: length of buffer
+ * @nthreads: number of ranges to scan in parallel (1 for no threads).
+ * @num_results: set to the number of results returned.
+ *
+ * This is equivalent to calling crc_read_block() until the buffer is
+ * consumed, then crc_read_flush() until it returns 0, except that
+ * consecutive literals are merged.  The buffer is split into @nthreads
+ * ranges which are scanned at once (if compiled with OpenMP), and the
+ * results stitched back together at the range boundaries.
+ *
+ * @ctx must not have been used, or must have been flushed.  Returns a
+ * malloc'ed array of results (same format as crc_read_block), or NULL
+ * on allocation failure.
+ *
+ * Example:
+ *	static void print_all(struct crc_context *ctx,
+ *			      const char *file, size_t len)
+ *	{
+ *		size_t i, num;
+ *		long *res = crc_read_all(ctx, file, len, 4, &num);
+ *
+ *		for (i = 0; i < num; i++) {
+ *			if (res[i] < 0)
+ *				printf("MATCHED CRC %lu\n", -res[i] - 1);
+ *			else
+ *				printf("%lu literal bytes\n", res[i]);
+ *		}
+ *		free(res);
+ *	}
+ */
+long *crc_read_all(struct crc_context *ctx, const void *buf, size_t buflen,
+		   unsigned int nthreads, size_t *num_results);
+
 /**
  * crc_context_free - free a context returned from crc_context_new.
  * @ctx: the context returned from crc_context_new, or NULL.
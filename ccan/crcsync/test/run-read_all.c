@@ -0,0 +1,124 @@
+#include <ccan/crcsync/crcsync.h>
+#include <ccan/crcsync/crcsync.c>
+#include <ccan/tap/tap.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define BUFFER_SIZE 10000
+#define NUM_TRIES 20
+
+/* Streaming results, with literals merged, in random-sized pieces. */
+static long *stream_results(struct crc_context *ctx,
+			    const uint8_t *buf, size_t len, size_t *num)
+{
+	long *res = malloc(sizeof(long) * (len + 2));
+	size_t used, ret;
+	long result;
+
+	*num = 0;
+	for (used = 0; used < len; used += ret) {
+		size_t chunk = random() % 300 + 1;
+		if (chunk > len - used)
+			chunk = len - used;
+		ret = crc_read_block(ctx, &result, buf + used, chunk);
+		if (result > 0 && *num && res[*num-1] > 0)
+			res[*num-1] += result;
+		else if (result != 0)
+			res[(*num)++] = result;
+	}
+	while ((result = crc_read_flush(ctx)) != 0) {
+		if (result > 0 && *num && res[*num-1] > 0)
+			res[*num-1] += result;
+		else
+			res[(*num)++] = result;
+	}
+	return res;
+}
+
+static bool same_results(struct crc_context *ctx,
+			 const uint8_t *buf, size_t len, unsigned nthreads)
+{
+	long *expect, *res;
+	size_t num_expect, num;
+	bool same;
+
+	expect = stream_results(ctx, buf, len, &num_expect);
+	res = crc_read_all(ctx, buf, len, nthreads, &num);
+	same = (res && num == num_expect
+		&& memcmp(res, expect, sizeof(long) * num) == 0);
+	free(expect);
+	free(res);
+	return same;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buffer1, *buffer2;
+	unsigned int i, j, block_size;
+
+	plan_tests(NUM_TRIES * 3 + 2);
+
+	buffer1 = malloc(BUFFER_SIZE);
+	buffer2 = malloc(BUFFER_SIZE * 2);
+
+	/* Small alphabet, so blocks are often repeated. */
+	for (i = 0; i < BUFFER_SIZE; i++)
+		buffer1[i] = random() % 4;
+
+	for (i = 0; i < NUM_TRIES; i++) {
+		size_t len1 = random() % BUFFER_SIZE + 1, len2 = 0;
+		uint64_t *crcs;
+		struct crc_context *ctx;
+
+		block_size = random() % 64 + 1;
+		crcs = malloc(sizeof(crcs[0])
+			      * ((len1 + block_size - 1) / block_size));
+		crc_of_blocks(buffer1, len1, block_size, 64, crcs);
+		ctx = crc_context_new(block_size, 64, crcs,
+				      (len1 + block_size - 1) / block_size,
+				      len1 % block_size);
+
+		/* Build new buffer from pieces of old, and garbage. */
+		while (len2 < BUFFER_SIZE) {
+			size_t off = random() % len1, n = random() % 200;
+			if (off + n > len1)
+				n = len1 - off;
+			if (random() % 3 == 0) {
+				for (j = 0; j < n; j++)
+					buffer2[len2 + j] = random();
+			} else
+				memcpy(buffer2 + len2, buffer1 + off, n);
+			len2 += n;
+		}
+
+		ok1(same_results(ctx, buffer2, len2, 1));
+		ok1(same_results(ctx, buffer2, len2, 3));
+		ok1(same_results(ctx, buffer2, len2, 16));
+		crc_context_free(ctx);
+		free(crcs);
+	}
+
+	/* Identical buffers should be all matches, whatever the split. */
+	{
+		uint64_t crcs[BUFFER_SIZE / 100];
+		struct crc_context *ctx;
+		size_t num;
+		long *res;
+
+		crc_of_blocks(buffer1, BUFFER_SIZE, 100, 64, crcs);
+		ctx = crc_context_new(100, 64, crcs, BUFFER_SIZE / 100, 0);
+		res = crc_read_all(ctx, buffer1, BUFFER_SIZE, 7, &num);
+		ok1(num == BUFFER_SIZE / 100);
+		for (i = 0; i < num; i++)
+			if (res[i] != -(long)i - 1)
+				break;
+		ok1(i == num);
+		free(res);
+		crc_context_free(ctx);
+	}
+
+	free(buffer1);
+	free(buffer2);
+	return exit_status();
+}
@@ -23,7 +23,8 @@ static void test_roll(unsigned int wsize)
 
 		crc = crc64_iso(0, data+i, wsize);
 		rollcrc = crc_roll(crc64_iso(0, data+i-1, wsize),
-				   data[i-1], data[i+wsize-1], uncrc_tab);
+				   data[i-1], data[i+wsize-1], uncrc_tab,
+				   crc64_iso_table());
 
 		ok(crc == rollcrc, "wsize %u, i %u", wsize, i);
 	}
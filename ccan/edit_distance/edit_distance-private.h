@@ -7,6 +7,10 @@
 #ifndef CCAN_EDIT_DISTANCE_PRIVATE_H
 #define CCAN_EDIT_DISTANCE_PRIVATE_H
 
+#include "config.h"
+#include <stdint.h>		/* uint64_t */
+#include <string.h>		/* memset */
+
 #include "edit_distance.h"
 
 /** Unsafe (arguments evaluated multiple times) 3-value minimum. */
@@ -27,6 +31,81 @@
 /** Index of element in lower triangular matrix. */
 #define ED_TMAT_IND(r, c) (ED_TMAT_SIZE(r) + c)
 
+#if defined(ED_HASH_ELEM) && defined(ED_HASH_ON_STACK) && \
+		defined(ED_INS_COST_CONST) && defined(ED_DEL_COST_CONST)
+/** Defined when LCS distance can be computed bit-parallel (the cost macros
+ * are only constant when they are the default unit costs). */
+# define ED_BITPARALLEL_LCS
+# ifdef ED_SUB_COST_CONST
+/** Defined when unit-cost Levenshtein distance can be computed bit-parallel. */
+#  define ED_BITPARALLEL_LEV
+# endif
+#endif
+
+#ifdef ED_BITPARALLEL_LCS
+/** Number of bits in each word of the bit-parallel algorithms. */
+# define ED_BP_BITS 64
+
+/** Number of words needed to hold one bit per element of @p len elements. */
+# define ED_BP_WORDS(len) (((size_t)(len) + ED_BP_BITS - 1) / ED_BP_BITS)
+
+/** Maximum number of words per element for which the match bitmasks are
+ * stored on the stack (<code>(ED_HASH_MAX + 1) * ED_BP_STACK_WORDS</code>
+ * words in total).  Longer @p src is handled with malloc. */
+# ifndef ED_BP_STACK_WORDS
+#  define ED_BP_STACK_WORDS 4
+# endif
+
+/**
+ * Builds the match bitmasks of @p src for the bit-parallel algorithms.
+ *
+ * Bit <code>i % ED_BP_BITS</code> of
+ * <code>peq[ED_HASH_ELEM(e) * words + i / ED_BP_BITS]</code> is set if and
+ * only if <code>src[i]</code> is @p e.  Only the entries for elements of
+ * @p src and @p tgt are initialized, unless that is more work than clearing
+ * the whole table.
+ * @private
+ */
+static inline void ed_bp_peq(uint64_t *peq, size_t words,
+			     const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen)
+{
+	ed_size i;
+
+	if ((size_t)slen + tlen > (size_t)ED_HASH_MAX + 1) {
+		memset(peq, 0, ((size_t)ED_HASH_MAX + 1) * words * sizeof(*peq));
+	} else {
+		for (i = 0; i < slen; ++i) {
+			memset(peq + (size_t)(ED_HASH_ELEM(src[i])) * words, 0,
+			       words * sizeof(*peq));
+		}
+		for (i = 0; i < tlen; ++i) {
+			memset(peq + (size_t)(ED_HASH_ELEM(tgt[i])) * words, 0,
+			       words * sizeof(*peq));
+		}
+	}
+
+	for (i = 0; i < slen; ++i) {
+		peq[(size_t)(ED_HASH_ELEM(src[i])) * words + i / ED_BP_BITS] |=
+		    (uint64_t)1 << (i % ED_BP_BITS);
+	}
+}
+
+/** Number of set bits in @p v. @private */
+static inline unsigned int ed_bp_popcount(uint64_t v)
+{
+# if HAVE_BUILTIN_POPCOUNTLL
+	return __builtin_popcountll(v);
+# else
+	unsigned int n = 0;
+	for (; v; v &= v - 1) {
+		++n;
+	}
+	return n;
+# endif
+}
+#endif
+
 /**
  * Calculates non-trivial LCS distance (for internal use).
  * @private
@@ -39,6 +118,26 @@
 ed_dist edit_distance_lcs(const ed_elem *src, ed_size slen,
 			  const ed_elem *tgt, ed_size tlen);
 
+/**
+ * Calculates non-trivial LCS distance using the Wagner-Fischer algorithm,
+ * whatever the costs (for internal use).
+ * @private
+ * @see edit_distance_lcs()
+ */
+ed_dist edit_distance_lcs_wf(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen);
+
+#ifdef ED_BITPARALLEL_LCS
+/**
+ * Calculates non-trivial unit-cost LCS distance using the bit-parallel
+ * algorithm of Hyyrö @cite Hyyro04 (for internal use).
+ * @private
+ * @see edit_distance_lcs()
+ */
+ed_dist edit_distance_lcs_bp(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen);
+#endif
+
 /**
  * Calculates non-trivial Levenshtein distance (for internal use).
  * @private
@@ -51,6 +150,27 @@ ed_dist edit_distance_lcs(const ed_elem *src, ed_size slen,
 ed_dist edit_distance_lev(const ed_elem *src, ed_size slen,
 			  const ed_elem *tgt, ed_size tlen);
 
+/**
+ * Calculates non-trivial Levenshtein distance using the Wagner-Fischer
+ * algorithm, whatever the costs (for internal use).
+ * @private
+ * @see edit_distance_lev()
+ */
+ed_dist edit_distance_lev_wf(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen);
+
+#ifdef ED_BITPARALLEL_LEV
+/**
+ * Calculates non-trivial unit-cost Levenshtein distance using the
+ * bit-parallel algorithm of Myers @cite Myers99, blocked as described by
+ * Hyyrö @cite Hyyro03 (for internal use).
+ * @private
+ * @see edit_distance_lev()
+ */
+ed_dist edit_distance_lev_bp(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen);
+#endif
+
 /**
  * Calculates non-trivial Restricted Damerau-Levenshtein distance (for internal
  * use).
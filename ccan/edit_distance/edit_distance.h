@@ -60,6 +60,10 @@ enum ed_measure {
 	 * This implementation uses an iterative version of the Wagner-Fischer
 	 * algorithm @cite Wagner74 which requires <code>O(slen * tlen)</code>
 	 * time and <code>min(slen, tlen) + 1</code> space.
+	 *
+	 * With the default costs and element type, the bit-parallel algorithm
+	 * of Hyyrö @cite Hyyro04 is used instead, which requires
+	 * <code>O(ceil(slen / 64) * tlen)</code> time.
 	 */
 	EDIT_DISTANCE_LCS = 1,
 	/**
@@ -73,6 +77,11 @@ enum ed_measure {
 	 * This implementation uses a modified version of the Wagner-Fischer
 	 * algorithm @cite Wagner74 which requires <code>O(slen * tlen)</code>
 	 * time and only <code>min(slen, tlen) + 1</code> space.
+	 *
+	 * With the default costs and element type, the bit-parallel algorithm
+	 * of Myers @cite Myers99 (blocked for longer strings as described by
+	 * Hyyrö @cite Hyyro03) is used instead, which requires
+	 * <code>O(ceil(slen / 64) * tlen)</code> time.
 	 */
 	EDIT_DISTANCE_LEV,
 	/**
@@ -10,8 +10,8 @@
 #include "edit_distance-params.h"
 #include "edit_distance-private.h"
 
-ed_dist edit_distance_lcs(const ed_elem *src, ed_size slen,
-			  const ed_elem *tgt, ed_size tlen)
+ed_dist edit_distance_lcs_wf(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen)
 {
 	ed_size i, j;
 
@@ -69,3 +69,73 @@ ed_dist edit_distance_lcs(const ed_elem *src, ed_size slen,
 	}
 	return total;
 }
+
+#ifdef ED_BITPARALLEL_LCS
+ed_dist edit_distance_lcs_bp(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen)
+{
+	const size_t words = ED_BP_WORDS(slen);
+	size_t b;
+	ed_size j, lcs = 0;
+
+	/* Optimization: Avoid malloc when the match bitmasks fit on the
+	 * stack.
+	 */
+	uint64_t stackpeq[((size_t)ED_HASH_MAX + 1) * ED_BP_STACK_WORDS];
+	uint64_t stackv[ED_BP_STACK_WORDS];
+	uint64_t *peq = stackpeq, *v = stackv;
+
+	if (words > ED_BP_STACK_WORDS) {
+		peq = malloc((((size_t)ED_HASH_MAX + 1) * words + words) *
+			     sizeof(uint64_t));
+		v = peq + ((size_t)ED_HASH_MAX + 1) * words;
+	}
+
+	ed_bp_peq(peq, words, src, slen, tgt, tlen);
+
+	/* Zero bits of v mark the rows where the LCS of src[0..i] and
+	 * tgt[0..j] grows, so the LCS length is the number of zero bits.
+	 */
+	for (b = 0; b < words; ++b) {
+		v[b] = ~(uint64_t)0;
+	}
+
+	for (j = 0; j < tlen; ++j) {
+		const uint64_t *eq = peq + (size_t)(ED_HASH_ELEM(tgt[j])) * words;
+		uint64_t carry = 0;
+
+		for (b = 0; b < words; ++b) {
+			uint64_t u = v[b] & eq[b];
+			uint64_t sum = v[b] + carry;
+			uint64_t c = sum < carry;
+
+			sum += u;
+			carry = c | (sum < u);
+			v[b] = sum | (v[b] - u);
+		}
+	}
+
+	/* Bits past slen in the last word may have been flipped by carries. */
+	for (b = 0; b + 1 < words; ++b) {
+		lcs += ED_BP_BITS - ed_bp_popcount(v[b]);
+	}
+	lcs += ed_bp_popcount(~v[b] &
+			      (~(uint64_t)0 >> (words * ED_BP_BITS - slen)));
+
+	if (peq != stackpeq) {
+		free(peq);
+	}
+	return (ed_dist)(slen - lcs) * ED_DEL_COST() +
+	    (ed_dist)(tlen - lcs) * ED_INS_COST();
+}
+#endif
+
+ed_dist edit_distance_lcs(const ed_elem *src, ed_size slen,
+			  const ed_elem *tgt, ed_size tlen)
+{
+#ifdef ED_BITPARALLEL_LCS
+	return edit_distance_lcs_bp(src, slen, tgt, tlen);
+#else
+	return edit_distance_lcs_wf(src, slen, tgt, tlen);
+#endif
+}
@@ -10,8 +10,8 @@
 #include "edit_distance-params.h"
 #include "edit_distance-private.h"
 
-ed_dist edit_distance_lev(const ed_elem *src, ed_size slen,
-			  const ed_elem *tgt, ed_size tlen)
+ed_dist edit_distance_lev_wf(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen)
 {
 	ed_size i, j;
 
@@ -74,3 +74,93 @@ ed_dist edit_distance_lev(const ed_elem *src, ed_size slen,
 	}
 	return total;
 }
+
+#ifdef ED_BITPARALLEL_LEV
+ed_dist edit_distance_lev_bp(const ed_elem *src, ed_size slen,
+			     const ed_elem *tgt, ed_size tlen)
+{
+	const size_t words = ED_BP_WORDS(slen);
+	const uint64_t last = (uint64_t)1 << ((slen - 1) % ED_BP_BITS);
+	size_t b;
+	ed_size j, dist = slen;
+
+	/* Optimization: Avoid malloc when the match bitmasks fit on the
+	 * stack.
+	 */
+	uint64_t stackpeq[((size_t)ED_HASH_MAX + 1) * ED_BP_STACK_WORDS];
+	uint64_t stackpv[ED_BP_STACK_WORDS], stackmv[ED_BP_STACK_WORDS];
+	uint64_t *peq = stackpeq, *pv = stackpv, *mv = stackmv;
+
+	if (words > ED_BP_STACK_WORDS) {
+		peq = malloc((((size_t)ED_HASH_MAX + 1) * words + 2 * words) *
+			     sizeof(uint64_t));
+		pv = peq + ((size_t)ED_HASH_MAX + 1) * words;
+		mv = pv + words;
+	}
+
+	ed_bp_peq(peq, words, src, slen, tgt, tlen);
+
+	/* pv and mv hold the positive and negative vertical deltas of the
+	 * current column of the distance matrix, which starts as 0..slen.
+	 */
+	for (b = 0; b < words; ++b) {
+		pv[b] = ~(uint64_t)0;
+		mv[b] = 0;
+	}
+
+	for (j = 0; j < tlen; ++j) {
+		const uint64_t *eqs = peq + (size_t)(ED_HASH_ELEM(tgt[j])) * words;
+		/* Horizontal delta into the top of the block (+1 for row 0). */
+		int hin = 1;
+
+		for (b = 0; b < words; ++b) {
+			uint64_t eq = eqs[b], xv = eq | mv[b], xh, ph, mh;
+			int hout;
+
+			if (hin < 0) {
+				eq |= 1;
+			}
+			xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+			ph = mv[b] | ~(xh | pv[b]);
+			mh = pv[b] & xh;
+
+			if (b + 1 == words) {
+				/* Track the bottom row, dist[slen][j]. */
+				if (ph & last) {
+					++dist;
+				} else if (mh & last) {
+					--dist;
+				}
+			}
+			hout = (int)(ph >> (ED_BP_BITS - 1)) -
+			    (int)(mh >> (ED_BP_BITS - 1));
+
+			ph <<= 1;
+			mh <<= 1;
+			if (hin < 0) {
+				mh |= 1;
+			} else if (hin > 0) {
+				ph |= 1;
+			}
+			pv[b] = mh | ~(xv | ph);
+			mv[b] = ph & xv;
+			hin = hout;
+		}
+	}
+
+	if (peq != stackpeq) {
+		free(peq);
+	}
+	return (ed_dist)dist;
+}
+#endif
+
+ed_dist edit_distance_lev(const ed_elem *src, ed_size slen,
+			  const ed_elem *tgt, ed_size tlen)
+{
+#ifdef ED_BITPARALLEL_LEV
+	return edit_distance_lev_bp(src, slen, tgt, tlen);
+#else
+	return edit_distance_lev_wf(src, slen, tgt, tlen);
+#endif
+}
@@ -0,0 +1,126 @@
+/** @file
+ * Runnable tests comparing the bit-parallel LCS and Levenshtein distance
+ * implementations to the Wagner-Fischer implementations.
+ *
+ * @copyright 2016 Kevin Locke <kevin@kevinlocke.name>
+ *            MIT license - see LICENSE file for details
+ */
+
+#include <stdbool.h>		/* bool */
+#include <stdlib.h>		/* rand, srand */
+
+#include <ccan/tap/tap.h>
+
+#include <ccan/edit_distance/edit_distance.c>
+#include <ccan/edit_distance/edit_distance_dl.c>
+#include <ccan/edit_distance/edit_distance_lcs.c>
+#include <ccan/edit_distance/edit_distance_lev.c>
+#include <ccan/edit_distance/edit_distance_rdl.c>
+
+/* Lengths around the word boundaries, plus enough to leave the stack. */
+static const ed_size lens[] = {
+	1, 2, 7, 63, 64, 65, 127, 128, 129, 255, 256, 257, 300, 700
+};
+
+#define NUM_LENS (sizeof(lens) / sizeof(lens[0]))
+
+static void random_string(ed_elem *s, ed_size len, int alphabet)
+{
+	ed_size i;
+
+	for (i = 0; i < len; ++i) {
+		s[i] = (ed_elem)('a' + rand() % alphabet);
+	}
+}
+
+/* Copy of src with roughly one element in @p rate changed. */
+static ed_size mutate(ed_elem *t, const ed_elem *s, ed_size len, int rate)
+{
+	ed_size i, n = 0;
+
+	for (i = 0; i < len; ++i) {
+		switch (rand() % rate) {
+		case 0:		/* delete */
+			break;
+		case 1:		/* insert */
+			t[n++] = (ed_elem)('a' + rand() % 26);
+			t[n++] = s[i];
+			break;
+		case 2:		/* substitute */
+			t[n++] = (ed_elem)('a' + rand() % 26);
+			break;
+		default:
+			t[n++] = s[i];
+			break;
+		}
+	}
+	return n;
+}
+
+static bool same(const ed_elem *s, ed_size slen,
+		 const ed_elem *t, ed_size tlen)
+{
+	if (slen == 0 || tlen == 0) {
+		return true;
+	}
+	return edit_distance_lcs_bp(s, slen, t, tlen) ==
+	    edit_distance_lcs_wf(s, slen, t, tlen) &&
+	    edit_distance_lev_bp(s, slen, t, tlen) ==
+	    edit_distance_lev_wf(s, slen, t, tlen);
+}
+
+int main(void)
+{
+	ed_elem s[700], t[1400];
+	unsigned int i, j;
+	bool ok;
+
+	plan_tests(4);
+
+	srand(1);
+
+	/* Unrelated strings over small and large alphabets. */
+	ok = true;
+	for (i = 0; i < NUM_LENS; ++i) {
+		for (j = 0; j < NUM_LENS; ++j) {
+			random_string(s, lens[i], 4);
+			random_string(t, lens[j], 4);
+			ok &= same(s, lens[i], t, lens[j]);
+		}
+	}
+	ok1(ok);
+
+	ok = true;
+	for (i = 0; i < NUM_LENS; ++i) {
+		for (j = 0; j < NUM_LENS; ++j) {
+			random_string(s, lens[i], 26);
+			random_string(t, lens[j], 26);
+			ok &= same(s, lens[i], t, lens[j]);
+		}
+	}
+	ok1(ok);
+
+	/* Similar strings, as seen when grouping. */
+	ok = true;
+	for (i = 0; i < NUM_LENS; ++i) {
+		for (j = 0; j < 10; ++j) {
+			ed_size tlen;
+
+			random_string(s, lens[i], 26);
+			tlen = mutate(t, s, lens[i], 10);
+			ok &= same(s, lens[i], t, tlen);
+			ok &= same(t, tlen, s, lens[i]);
+		}
+	}
+	ok1(ok);
+
+	/* Bytes outside ASCII hash to the top of the table. */
+	for (i = 0; i < 200; ++i) {
+		s[i] = (ed_elem)(i * 7);
+		t[i] = (ed_elem)(i * 11);
+	}
+	ok1(same(s, 200, t, 150) &&
+	    edit_distance(s, 200, s, 200, EDIT_DISTANCE_LEV) == 0);
+
+	return exit_status();
+}
@@ -0,0 +1,154 @@
+/* File descriptors per second from one process to another over a
+ * SOCK_SEQPACKET socketpair, the way an acceptor hands connections to
+ * workers: one per fdpass_send(), several per fdpass_send_fds() message,
+ * and batches of messages with fdpass_send_batch().  The receiver closes
+ * each one as it arrives.
+ *
+ * Usage: speed [<num-fds>] */
+#include <ccan/fdpass/fdpass.h>
+#include <ccan/time/time.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_PER_MSG 64
+#define MAX_BATCH 64
+
+/* Each message carries an int per fd (say, which listener it came from). */
+static int fds[MAX_BATCH][MAX_PER_MSG], data[MAX_BATCH][MAX_PER_MSG];
+static struct fdpass_msg msgs[MAX_BATCH];
+
+static void init_msgs(int per_msg, int batch)
+{
+	int i;
+
+	for (i = 0; i < batch; i++) {
+		msgs[i].fds = fds[i];
+		msgs[i].num_fds = per_msg;
+		msgs[i].data = data[i];
+		msgs[i].len = sizeof(int) * per_msg;
+	}
+}
+
+static void receiver(int sock, long num, int per_msg, int batch)
+{
+	long got = 0;
+	int i, n;
+	size_t j;
+
+	while (got < num) {
+		if (per_msg == 0) {
+			int fd = fdpass_recv(sock);
+			if (fd < 0)
+				err(1, "fdpass_recv");
+			close(fd);
+			got++;
+			continue;
+		}
+		init_msgs(per_msg, batch);
+		n = fdpass_recv_batch(sock, msgs, batch);
+		if (n < 0)
+			err(1, "fdpass_recv_batch");
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < msgs[i].num_fds; j++)
+				close(msgs[i].fds[j]);
+			got += msgs[i].num_fds;
+		}
+	}
+	exit(0);
+}
+
+static void sender(int sock, int fd, long num, int per_msg, int batch)
+{
+	long sent = 0;
+	int i, j, n;
+
+	for (i = 0; i < MAX_BATCH; i++)
+		for (j = 0; j < MAX_PER_MSG; j++) {
+			fds[i][j] = fd;
+			data[i][j] = j;
+		}
+
+	while (sent < num) {
+		if (per_msg == 0) {
+			if (!fdpass_send(sock, fd))
+				err(1, "fdpass_send");
+			sent++;
+		} else if (batch == 1) {
+			init_msgs(per_msg, 1);
+			if (!fdpass_send_fds(sock, &msgs[0]))
+				err(1, "fdpass_send_fds");
+			sent += per_msg;
+		} else {
+			init_msgs(per_msg, batch);
+			n = fdpass_send_batch(sock, msgs, batch);
+			if (n < 0)
+				err(1, "fdpass_send_batch");
+			sent += (long)n * per_msg;
+		}
+	}
+}
+
+static void run(const char *what, int fd, long num, int per_msg, int batch)
+{
+	struct timemono start;
+	int sv[2], status;
+	pid_t pid;
+	uint64_t usec;
+
+	/* Round to whole batches. */
+	if (per_msg)
+		num -= num % (per_msg * batch);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0)
+		err(1, "socketpair");
+
+	/* Don't let the child inherit unflushed output. */
+	fflush(stdout);
+	start = time_mono();
+	pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (pid == 0) {
+		close(sv[0]);
+		receiver(sv[1], num, per_msg, batch);
+	}
+	close(sv[1]);
+	sender(sv[0], fd, num, per_msg, batch);
+	if (waitpid(pid, &status, 0) != pid
+	    || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		errx(1, "%s: receiver failed", what);
+	usec = time_to_usec(timemono_since(start));
+	close(sv[0]);
+
+	printf("%-28s %9.0f fds/sec\n", what, (double)num * 1000000 / usec);
+}
+
+int main(int argc, char *argv[])
+{
+	long num = 200000;
+	int fd;
+
+	if (argc > 2)
+		errx(1, "Usage: %s [<num-fds>]", argv[0]);
+	if (argc == 2)
+		num = atol(argv[1]);
+
+	/* Something like an accepted connection. */
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		err(1, "socket");
+
+	run("fdpass_send", fd, num, 0, 1);
+	run("fdpass_send_fds 1/msg", fd, num, 1, 1);
+	run("fdpass_send_fds 16/msg", fd, num, 16, 1);
+	run("fdpass_send_fds 64/msg", fd, num, 64, 1);
+	run("fdpass_send_batch 16x1", fd, num, 1, 16);
+	run("fdpass_send_batch 64x1", fd, num, 1, 64);
+	run("fdpass_send_batch 16x16", fd, num, 16, 16);
+	return 0;
+}
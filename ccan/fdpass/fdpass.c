@@ -1,9 +1,12 @@
 /* CC0 license (public domain) - see LICENSE file for details */
+#include "config.h"
 #include <ccan/fdpass/fdpass.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 bool fdpass_send(int sockout, int fd)
 {
@@ -82,3 +85,253 @@ int fdpass_recv(int sockin)
 	memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
 	return fd;
 }
+
+/* Room for this many fds in the ancillary data (never zero, so it's
+ * always somewhere to point msg_control at). */
+static size_t control_space(size_t num_fds)
+{
+	if (num_fds > FDPASS_MAX_FDS)
+		num_fds = FDPASS_MAX_FDS;
+	return CMSG_SPACE(sizeof(int) * (num_fds ? num_fds : 1));
+}
+
+/* @control must have room for control_space(m->num_fds) bytes, aligned
+ * for a struct cmsghdr, and @dummy is used if there's no data. */
+static void init_msghdr(struct msghdr *msg, struct iovec *iov,
+			void *control, char *dummy,
+			const struct fdpass_msg *m)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_iov = iov;
+	msg->msg_iovlen = 1;
+	msg->msg_control = control;
+	msg->msg_controllen = control_space(m->num_fds);
+
+	/* As above, we never send (or receive into) 0 bytes. */
+	if (m->data && m->len) {
+		iov->iov_base = m->data;
+		iov->iov_len = m->len;
+	} else {
+		*dummy = 0;
+		iov->iov_base = dummy;
+		iov->iov_len = 1;
+	}
+}
+
+static void set_fds(struct msghdr *msg, const struct fdpass_msg *m)
+{
+	struct cmsghdr *cmsg;
+
+	if (!m->num_fds) {
+		msg->msg_control = NULL;
+		msg->msg_controllen = 0;
+		return;
+	}
+
+	memset(msg->msg_control, 0, msg->msg_controllen);
+	cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * m->num_fds);
+	memcpy(CMSG_DATA(cmsg), m->fds, sizeof(int) * m->num_fds);
+	msg->msg_controllen = CMSG_SPACE(sizeof(int) * m->num_fds);
+}
+
+/* Fills in @m from a received @msg of @len bytes.  If they didn't all
+ * fit, closes the ones which did. */
+static bool get_fds(struct msghdr *msg, size_t len, struct fdpass_msg *m)
+{
+	struct cmsghdr *cmsg;
+	size_t i, n = 0;
+	bool fit = !(msg->msg_flags & MSG_CTRUNC);
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		size_t num;
+
+		if (cmsg->cmsg_level != SOL_SOCKET
+		    || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < num; i++) {
+			int fd;
+
+			memcpy(&fd, CMSG_DATA(cmsg) + sizeof(int) * i,
+			       sizeof(fd));
+			if (n < m->num_fds)
+				m->fds[n++] = fd;
+			else {
+				close(fd);
+				fit = false;
+			}
+		}
+	}
+
+	if (!fit) {
+		for (i = 0; i < n; i++)
+			close(m->fds[i]);
+		m->num_fds = 0;
+		return false;
+	}
+
+	m->num_fds = n;
+	/* If they gave us nowhere to put data, we used the dummy byte. */
+	if (!m->data || !m->len)
+		m->len = 0;
+	else
+		m->len = len;
+	return true;
+}
+
+bool fdpass_send_fds(int sockout, const struct fdpass_msg *m)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	char dummy;
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * FDPASS_MAX_FDS)];
+		struct cmsghdr align;
+	} u;
+
+	if (m->num_fds > FDPASS_MAX_FDS) {
+		errno = EINVAL;
+		return false;
+	}
+
+	init_msghdr(&msg, &iov, u.buf, &dummy, m);
+	set_fds(&msg, m);
+	return sendmsg(sockout, &msg, 0) == (ssize_t)iov.iov_len;
+}
+
+static bool recv_fds(int sockin, struct fdpass_msg *m, int flags)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t ret;
+	char dummy;
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * FDPASS_MAX_FDS)];
+		struct cmsghdr align;
+	} u;
+
+	init_msghdr(&msg, &iov, u.buf, &dummy, m);
+	ret = recvmsg(sockin, &msg, flags);
+	if (ret < 0)
+		return false;
+	/* We always send something, so this is the other end closing. */
+	if (ret == 0) {
+		errno = ECONNRESET;
+		return false;
+	}
+	if (!get_fds(&msg, ret, m)) {
+		errno = EMSGSIZE;
+		return false;
+	}
+	return true;
+}
+
+bool fdpass_recv_fds(int sockin, struct fdpass_msg *m)
+{
+	return recv_fds(sockin, m, 0);
+}
+
+#if HAVE_SENDMMSG
+/* The headers, iovecs, control buffers and dummy bytes for a batch, in
+ * one allocation: free(hdrs) frees it all. */
+static struct mmsghdr *batch_hdrs(const struct fdpass_msg *msgs,
+				  unsigned int num)
+{
+	struct mmsghdr *hdrs;
+	struct iovec *iovs;
+	size_t i, control = 0;
+	char *p, *dummies;
+
+	for (i = 0; i < num; i++)
+		control += control_space(msgs[i].num_fds);
+
+	/* control_space() is a multiple of the cmsghdr alignment, and
+	 * the headers and iovecs come first, so each buffer is aligned. */
+	hdrs = malloc((sizeof(*hdrs) + sizeof(*iovs) + 1) * num + control);
+	if (!hdrs)
+		return NULL;
+	iovs = (struct iovec *)(hdrs + num);
+	p = (char *)(iovs + num);
+	dummies = p + control;
+	for (i = 0; i < num; i++) {
+		init_msghdr(&hdrs[i].msg_hdr, &iovs[i], p, &dummies[i],
+			    &msgs[i]);
+		p += control_space(msgs[i].num_fds);
+	}
+	return hdrs;
+}
+#endif
+
+int fdpass_send_batch(int sockout, const struct fdpass_msg *msgs,
+		      unsigned int num)
+{
+	unsigned int i;
+#if HAVE_SENDMMSG
+	struct mmsghdr *hdrs;
+	int ret;
+
+	for (i = 0; i < num; i++) {
+		if (msgs[i].num_fds > FDPASS_MAX_FDS) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	hdrs = batch_hdrs(msgs, num);
+	if (!hdrs)
+		return -1;
+	for (i = 0; i < num; i++)
+		set_fds(&hdrs[i].msg_hdr, &msgs[i]);
+	ret = sendmmsg(sockout, hdrs, num, 0);
+	free(hdrs);
+	return ret;
+#else
+	for (i = 0; i < num; i++) {
+		if (!fdpass_send_fds(sockout, &msgs[i]))
+			return i ? (int)i : -1;
+	}
+	return num;
+#endif
+}
+
+int fdpass_recv_batch(int sockin, struct fdpass_msg *msgs, unsigned int num)
+{
+	unsigned int i;
+#if HAVE_SENDMMSG
+	struct mmsghdr *hdrs;
+	int ret;
+
+	hdrs = batch_hdrs(msgs, num);
+	if (!hdrs)
+		return -1;
+	ret = recvmmsg(sockin, hdrs, num, MSG_WAITFORONE, NULL);
+	for (i = 0; ret > 0 && i < (unsigned int)ret; i++) {
+		/* An empty message is the other end closing. */
+		if (hdrs[i].msg_len == 0)
+			break;
+		get_fds(&hdrs[i].msg_hdr, hdrs[i].msg_len, &msgs[i]);
+	}
+	free(hdrs);
+	if (ret < 0)
+		return -1;
+	if (i == 0) {
+		errno = ECONNRESET;
+		return -1;
+	}
+	return i;
+#else
+	for (i = 0; i < num; i++) {
+		/* Wait for the first, then take what's already there. */
+		if (!recv_fds(sockin, &msgs[i], i ? MSG_DONTWAIT : 0)
+		    && errno != EMSGSIZE) {
+			if (!i)
+				return -1;
+			break;
+		}
+	}
+	return i;
+#endif
+}
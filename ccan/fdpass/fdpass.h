@@ -3,6 +3,7 @@
 #define CCAN_FDPASS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * fdpass_send - send a file descriptor across a socket
@@ -20,4 +21,157 @@ bool fdpass_send(int sockout, int fd);
  * On failure, returns -1 and sets errno.  Otherwise returns fd.
  */
 int fdpass_recv(int sockin);
+
+/**
+ * FDPASS_MAX_FDS - the most file descriptors one message can carry.
+ *
+ * This is Linux's limit (SCM_MAX_FD): sending more fails with EINVAL.
+ */
+#define FDPASS_MAX_FDS 253
+
+/**
+ * struct fdpass_msg - file descriptors and data, sent as one message.
+ * @fds: the file descriptors to send, or room to receive them.
+ * @num_fds: the number in @fds (or room in @fds, set to the number received).
+ * @data: the data to send with them, or room to receive it (may be NULL).
+ * @len: the length of @data (or room in @data, set to the length received).
+ */
+struct fdpass_msg {
+	int *fds;
+	size_t num_fds;
+	void *data;
+	size_t len;
+};
+
+/**
+ * fdpass_send_fds - send several file descriptors (and data) across a socket
+ * @sockout: socket to write to
+ * @msg: the file descriptors and data to send.
+ *
+ * This sends up to FDPASS_MAX_FDS descriptors in a single message, with
+ * @msg->len bytes of @msg->data (eg. something saying what each one is).
+ * Empty data is sent as a single 0 byte, since some systems don't
+ * pass descriptors without any data.
+ *
+ * The data only stays together with the descriptors over a socket which
+ * keeps message boundaries (SOCK_SEQPACKET or SOCK_DGRAM): over
+ * SOCK_STREAM, make sure both sides agree on @msg->len.
+ *
+ * On failure, sets errno and returns false.
+ *
+ * Example:
+ *	static bool send_pair(int sock, int fd1, int fd2)
+ *	{
+ *		int fds[2] = { fd1, fd2 };
+ *		struct fdpass_msg msg = { fds, 2, NULL, 0 };
+ *
+ *		return fdpass_send_fds(sock, &msg);
+ *	}
+ */
+bool fdpass_send_fds(int sockout, const struct fdpass_msg *msg);
+
+/**
+ * fdpass_recv_fds - receive several file descriptors (and data) from a socket
+ * @sockin: socket to read from
+ * @msg: where to put the file descriptors and data.
+ *
+ * This receives one message sent by fdpass_send_fds(), setting
+ * @msg->num_fds and @msg->len to what arrived.  If @msg->data is NULL,
+ * any data is discarded.
+ *
+ * If more descriptors arrive than @msg->fds has room for, they are all
+ * closed, and this fails with EMSGSIZE: room for FDPASS_MAX_FDS is
+ * always enough.
+ *
+ * On failure (including the other end closing), sets errno and returns
+ * false.
+ *
+ * Example:
+ *	static bool recv_pair(int sock, int *fd1, int *fd2)
+ *	{
+ *		int fds[FDPASS_MAX_FDS];
+ *		struct fdpass_msg msg = { fds, FDPASS_MAX_FDS, NULL, 0 };
+ *
+ *		if (!fdpass_recv_fds(sock, &msg) || msg.num_fds != 2)
+ *			return false;
+ *		*fd1 = fds[0];
+ *		*fd2 = fds[1];
+ *		return true;
+ *	}
+ */
+bool fdpass_recv_fds(int sockin, struct fdpass_msg *msg);
+
+/**
+ * fdpass_send_batch - send several messages of file descriptors at once
+ * @sockout: socket to write to
+ * @msgs: the messages to send
+ * @num: the number of messages
+ *
+ * This is fdpass_send_fds() on each of @msgs, but uses a single
+ * sendmmsg() system call where that's available.
+ *
+ * Returns the number of messages sent, which may be less than @num.
+ * On failure, sets errno and returns -1.
+ *
+ * Example:
+ *	// Hand each fd to the other side in its own message.
+ *	static bool send_each(int sock, int *fds, unsigned int num)
+ *	{
+ *		struct fdpass_msg msgs[num];
+ *		unsigned int i;
+ *		int done;
+ *
+ *		for (i = 0; i < num; i++) {
+ *			msgs[i].fds = &fds[i];
+ *			msgs[i].num_fds = 1;
+ *			msgs[i].data = NULL;
+ *			msgs[i].len = 0;
+ *		}
+ *		for (i = 0; i < num; i += done) {
+ *			done = fdpass_send_batch(sock, msgs + i, num - i);
+ *			if (done < 0)
+ *				return false;
+ *		}
+ *		return true;
+ *	}
+ */
+int fdpass_send_batch(int sockout, const struct fdpass_msg *msgs,
+		      unsigned int num);
+
+/**
+ * fdpass_recv_batch - receive several messages of file descriptors at once
+ * @sockin: socket to read from
+ * @msgs: where to put the messages
+ * @num: the number of messages there is room for
+ *
+ * This waits for one message, then takes as many more as are already
+ * waiting (up to @num), using a single recvmmsg() system call where
+ * that's available.  Each is received as fdpass_recv_fds() would, except
+ * that a message whose descriptors don't fit has them all closed and
+ * its num_fds set to 0.
+ *
+ * Returns the number of messages received.  On failure (including the
+ * other end closing), sets errno and returns -1.
+ *
+ * Example:
+ *	// Receive up to 16 messages of a single fd each.
+ *	static int recv_some(int sock, int fds[16])
+ *	{
+ *		struct fdpass_msg msgs[16];
+ *		int i, n;
+ *
+ *		for (i = 0; i < 16; i++) {
+ *			msgs[i].fds = &fds[i];
+ *			msgs[i].num_fds = 1;
+ *			msgs[i].data = NULL;
+ *			msgs[i].len = 0;
+ *		}
+ *		n = fdpass_recv_batch(sock, msgs, 16);
+ *		for (i = 0; i < n; i++)
+ *			if (msgs[i].num_fds != 1)
+ *				fds[i] = -1;
+ *		return n;
+ *	}
+ */
+int fdpass_recv_batch(int sockin, struct fdpass_msg *msgs, unsigned int num);
 #endif /* CCAN_FDPASS_H */
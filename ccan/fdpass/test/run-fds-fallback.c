@@ -0,0 +1,5 @@
+/* The same tests, without sendmmsg() and recvmmsg(). */
+#include "config.h"
+#undef HAVE_SENDMMSG
+#define HAVE_SENDMMSG 0
+#include "run-fds.c"
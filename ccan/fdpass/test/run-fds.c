@@ -0,0 +1,149 @@
+#include <ccan/fdpass/fdpass.h>
+/* Include the C files directly. */
+#include <ccan/fdpass/fdpass.c>
+#include <ccan/tap/tap.h>
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define NUM 10
+
+/* The lowest free fd: if it changes, something leaked. */
+static int next_fd(void)
+{
+	int fd = dup(STDIN_FILENO);
+
+	close(fd);
+	return fd;
+}
+
+/* Is @fd the read end of the same pipe as @wfd? */
+static bool same_pipe(int fd, int wfd)
+{
+	char c;
+
+	return write(wfd, "x", 1) == 1 && read(fd, &c, 1) == 1 && c == 'x';
+}
+
+int main(void)
+{
+	int sv[2], pfds[3][2], fds[FDPASS_MAX_FDS + 1], fd;
+	struct fdpass_msg msg, msgs[NUM + 1];
+	char data[10];
+	int i, idx[NUM];
+
+	plan_tests(23);
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0)
+		abort();
+	for (i = 0; i < 3; i++)
+		if (pipe(pfds[i]) != 0)
+			abort();
+	fd = next_fd();
+
+	/* Three at once, with data. */
+	for (i = 0; i < 3; i++)
+		fds[i] = pfds[i][0];
+	msg.fds = fds;
+	msg.num_fds = 3;
+	memcpy(data, "abc", 3);
+	msg.data = data;
+	msg.len = 3;
+	ok1(fdpass_send_fds(sv[0], &msg));
+	memset(data, 0, sizeof(data));
+	msg.num_fds = FDPASS_MAX_FDS;
+	msg.len = sizeof(data);
+	ok1(fdpass_recv_fds(sv[1], &msg));
+	ok1(msg.num_fds == 3 && msg.len == 3 && memcmp(data, "abc", 3) == 0);
+	ok1(same_pipe(fds[0], pfds[0][1])
+	    && same_pipe(fds[1], pfds[1][1])
+	    && same_pipe(fds[2], pfds[2][1]));
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+
+	/* No data, and nowhere to put it. */
+	for (i = 0; i < 3; i++)
+		fds[i] = pfds[i][0];
+	msg.num_fds = 2;
+	msg.data = NULL;
+	msg.len = 0;
+	ok1(fdpass_send_fds(sv[0], &msg));
+	msg.num_fds = 2;
+	msg.data = data;
+	msg.len = 0;
+	ok1(fdpass_recv_fds(sv[1], &msg) && msg.num_fds == 2 && msg.len == 0);
+	ok1(same_pipe(fds[1], pfds[1][1]));
+	close(fds[0]);
+	close(fds[1]);
+
+	/* Not enough room: they're all closed. */
+	for (i = 0; i < 3; i++)
+		fds[i] = pfds[i][0];
+	msg.num_fds = 3;
+	ok1(fdpass_send_fds(sv[0], &msg));
+	msg.num_fds = 2;
+	ok1(!fdpass_recv_fds(sv[1], &msg) && errno == EMSGSIZE);
+	ok1(msg.num_fds == 0 && next_fd() == fd);
+
+	/* Too many to send. */
+	for (i = 0; i < FDPASS_MAX_FDS + 1; i++)
+		fds[i] = pfds[0][0];
+	msg.num_fds = FDPASS_MAX_FDS + 1;
+	ok1(!fdpass_send_fds(sv[0], &msg) && errno == EINVAL);
+	msg.num_fds = FDPASS_MAX_FDS;
+	ok1(fdpass_send_fds(sv[0], &msg));
+	ok1(fdpass_recv_fds(sv[1], &msg) && msg.num_fds == FDPASS_MAX_FDS);
+	for (i = 0; i < FDPASS_MAX_FDS; i++)
+		close(fds[i]);
+	ok1(next_fd() == fd);
+
+	/* A batch, one fd and its index each. */
+	for (i = 0; i < NUM; i++) {
+		idx[i] = i;
+		fds[i] = pfds[i % 3][0];
+		msgs[i].fds = &fds[i];
+		msgs[i].num_fds = 1;
+		msgs[i].data = &idx[i];
+		msgs[i].len = sizeof(idx[i]);
+	}
+	ok1(fdpass_send_batch(sv[0], msgs, NUM) == NUM);
+	for (i = 0; i < NUM; i++) {
+		fds[i] = -1;
+		idx[i] = -1;
+	}
+	/* It takes what's there, even with room for more. */
+	ok1(fdpass_recv_batch(sv[1], msgs, NUM + 1) == NUM);
+	for (i = 0; i < NUM; i++) {
+		if (msgs[i].num_fds != 1 || msgs[i].len != sizeof(int)
+		    || idx[i] != i || !same_pipe(fds[i], pfds[i % 3][1]))
+			break;
+		close(fds[i]);
+	}
+	ok1(i == NUM);
+
+	/* One which doesn't fit doesn't stop the rest. */
+	fds[0] = fds[1] = fds[2] = pfds[0][0];
+	msgs[0].fds = fds;
+	msgs[0].num_fds = 2;
+	msgs[1].fds = fds + 2;
+	msgs[1].num_fds = 1;
+	msgs[0].data = msgs[1].data = NULL;
+	msgs[0].len = msgs[1].len = 0;
+	ok1(fdpass_send_batch(sv[0], msgs, 2) == 2);
+	msgs[0].num_fds = 1;
+	msgs[1].num_fds = 1;
+	ok1(fdpass_recv_batch(sv[1], msgs, 2) == 2);
+	ok1(msgs[0].num_fds == 0 && msgs[1].num_fds == 1);
+	close(fds[2]);
+	ok1(next_fd() == fd);
+
+	/* The other end closing is an error. */
+	close(sv[0]);
+	msg.num_fds = 1;
+	ok1(!fdpass_recv_fds(sv[1], &msg) && errno == ECONNRESET);
+	ok1(fdpass_recv_batch(sv[1], msgs, 2) == -1 && errno == ECONNRESET);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,91 @@
+/* Times lexing and parsing a handful of typical queries many times over:
+ * into a token list with graphql_lexparse(), into a token array and an arena
+ * with graphql_lexparse_arena(), and through a graphql_cache which has seen
+ * them all before. */
+#include <ccan/graphql/graphql.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUNS 20000
+
+static const char *queries[] = {
+	"{ hero { name } }",
+	"query HeroNameAndFriends($episode: Episode = JEDI, $withFriends: Boolean) {\n"
+	"  hero(episode: $episode) {\n"
+	"    name\n"
+	"    friends @include(if: $withFriends) { name }\n"
+	"  }\n"
+	"}",
+	"query { user(id: 4) { ...friendFields ... on User @skip(if: false) { birthday } } }\n"
+	"fragment friendFields on User { id name profilePic(size: 50) }",
+	"{ nearestThing(location: { lon: 12.43, lat: -53.211 }, tags: [], kind: null, exact: true) {\n"
+	"    id name description(format: \"markdown\", maxLength: 200)\n"
+	"    owner { id name avatar(size: 64) friends(first: 10) { id name } }\n"
+	"    reviews(first: 20, orderBy: { field: \"created\", direction: DESC }) {\n"
+	"      id rating body author { id name }\n"
+	"    }\n"
+	"  }\n"
+	"}",
+};
+
+#define NUM_QUERIES (sizeof(queries) / sizeof(queries[0]))
+
+static void report(const char *what, struct timemono start, size_t bytes)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-24s %8llu usec (%llu nsec per query, %.1f MB/s)\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / (RUNS * NUM_QUERIES)),
+	       bytes / (time_to_nsec(diff) / 1000.0));
+}
+
+int main(void)
+{
+	struct graphql_executable_document *doc;
+	const struct graphql_parsed *cached;
+	struct graphql_parsed *parsed;
+	struct graphql_cache *cache;
+	struct list_head *tokens;
+	struct timemono start;
+	size_t bytes = 0;
+	unsigned int i, q;
+
+	for (q = 0; q < NUM_QUERIES; q++)
+		bytes += strlen(queries[q]) * RUNS;
+
+	start = time_mono();
+	for (i = 0; i < RUNS; i++) {
+		for (q = 0; q < NUM_QUERIES; q++) {
+			if (graphql_lexparse(NULL, queries[q], &tokens, &doc))
+				abort();
+			tal_free(tokens);
+		}
+	}
+	report("graphql_lexparse", start, bytes);
+
+	start = time_mono();
+	for (i = 0; i < RUNS; i++) {
+		for (q = 0; q < NUM_QUERIES; q++) {
+			if (graphql_lexparse_arena(NULL, queries[q], &parsed))
+				abort();
+			tal_free(parsed);
+		}
+	}
+	report("graphql_lexparse_arena", start, bytes);
+
+	cache = graphql_cache_new(NULL, 16);
+	start = time_mono();
+	for (i = 0; i < RUNS; i++) {
+		for (q = 0; q < NUM_QUERIES; q++) {
+			if (graphql_cache_lexparse(cache, queries[q], &cached))
+				abort();
+		}
+	}
+	report("graphql_cache_lexparse", start, bytes);
+	tal_free(cache);
+
+	return 0;
+}
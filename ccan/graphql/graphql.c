@@ -1,6 +1,7 @@
 /* MIT (BSD) license - see LICENSE file for details */
 #include "graphql.h"
 
+#include "ccan/hash/hash.h"
 #include "ccan/tal/str/str.h"
 #include "ccan/utf8/utf8.h"
 
@@ -28,33 +29,117 @@
 // Helper for copying an overlapping string, since strcpy() is not safe for that
 #define cpystr(d,s) { char *cpystr_p; char *cpystr_q; for(cpystr_p = (s), cpystr_q = (d); *cpystr_p;) *cpystr_q++ = *cpystr_p++; *cpystr_q++ = *cpystr_p++; }
 
+/* The arena
+ *
+ * In array mode, AST nodes (and any strings the lexer has to rewrite) are
+ * carved out of large chunks rather than allocated one by one. When a parser
+ * function fails, everything it allocated is handed back by resetting the
+ * arena to where it was on entrance, as long as that is still in the same
+ * chunk.
+ */
+#define ARENA_CHUNK_MIN 1024
+
+struct arena {
+	const tal_t *ctx; // chunks are allocated from this
+	char *start, *cur, *end;
+	size_t next_size;
+};
+
+static void arena_init(struct arena *arena, const tal_t *ctx, size_t size) {
+	arena->ctx = ctx;
+	arena->start = arena->cur = arena->end = NULL;
+	arena->next_size = size < ARENA_CHUNK_MIN ? ARENA_CHUNK_MIN : size;
+}
+
+static void *arena_alloc(struct arena *arena, size_t size) {
+	void *p;
+
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if ((size_t)(arena->end - arena->cur) < size) {
+		size_t len = arena->next_size;
+		while (len < size)
+			len *= 2;
+		arena->start = arena->cur = tal_arr(arena->ctx, char, len);
+		arena->end = arena->start + len;
+		arena->next_size = len * 2;
+	}
+	p = arena->cur;
+	arena->cur += size;
+	memset(p, 0, size);
+	return p;
+}
+
+static void arena_reset(struct arena *arena, char *mark) {
+	if (mark >= arena->start && mark <= arena->cur)
+		arena->cur = mark;
+}
+
+/* The parser's view of the tokens
+ *
+ * In list mode, the parser works through an array of pointers to the listed
+ * tokens, and the ones it consumes are removed from the list at the end. In
+ * array mode, it works through the lexer's array directly.
+ */
+struct parser {
+	struct graphql_token *arr;	// array mode: the tokens
+	struct graphql_token **ptrs;	// list mode: the listed tokens
+	size_t num, pos;
+	const tal_t *ctx;		// list mode: AST nodes are allocated from this
+	struct arena *arena;		// array mode: AST nodes are allocated from this
+};
+
+static struct graphql_token *parser_tok(const struct parser *ps, size_t i) {
+	if (i >= ps->num)
+		return NULL;
+	return ps->arr ? &ps->arr[i] : ps->ptrs[i];
+}
+
+static void *parser_release(struct parser *ps, void *obj, char *mark) {
+	if (ps->arena)
+		arena_reset(ps->arena, mark);
+	else
+		tal_free(obj);
+	return NULL;
+}
+
+// Token strings are not NUL-terminated in array mode.
+static bool tok_streq(const struct graphql_token *tok, const char *str) {
+	size_t len = strlen(str);
+	return tok->token_len == len && memcmp(tok->token_string, str, len) == 0;
+}
+
 /* Parser shorthands
  *
  * These shorthands are motivated by the parser functions, so they can be
  * written in a format that corresponds closely to the specification.
  */
 #define RET static void *
-#define PARAMS struct list_head *tokens, struct list_head *used, const char **err
-#define ARGS tokens, used, err
+#define PARAMS struct parser *ps, const char **err
+#define ARGS ps, err
 #define INIT(type) \
-	struct graphql_token *rollback_top = list_top(tokens, struct graphql_token, node); \
-	struct graphql_##type *obj = talz(tokens, struct graphql_##type); \
+	size_t rollback_top = ps->pos; \
+	char *rollback_mem = ps->arena ? ps->arena->cur : NULL; \
+	struct graphql_##type *obj = ps->arena ? \
+		arena_alloc(ps->arena, sizeof(struct graphql_##type)) : \
+		talz(ps->ctx, struct graphql_##type); \
 	(void)rollback_top; /* avoids unused variable warning */ \
 
 #define EXIT \
 	goto exit_label; /* avoids unused label warning */ \
 	exit_label: \
-	if (*err) obj = tal_free(obj); \
+	if (*err) obj = parser_release(ps, obj, rollback_mem); \
 	return obj; \
 
-#define CONSUME_ONE list_add(used, &list_pop(tokens, struct graphql_token, node)->node);
-#define RESTORE_ONE list_add(tokens, &list_pop(used, struct graphql_token, node)->node);
-#define ROLLBACK(args) while (list_top(tokens, struct graphql_token, node) != rollback_top) { RESTORE_ONE; }
+#define TOP parser_tok(ps, ps->pos)
+#define LAST_CONSUMED parser_tok(ps, ps->pos - 1)
+#define CONSUME_ONE ps->pos++;
+#define RESTORE_ONE ps->pos--;
+#define ROLLBACK(args) ps->pos = rollback_top;
 #define OR if (!*err) goto exit_label; *err = NULL;
 #define REQ if (*err) { ROLLBACK(args); goto exit_label; }
 #define OPT *err = NULL;
 #define WHILE_OPT while(!*err); *err = NULL;
-#define LOOKAHEAD(args, tok) struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+#define LOOKAHEAD(args, tok) struct graphql_token *tok = TOP;
 #define MSG(msg) if (*err) *err = msg;
 
 
@@ -75,11 +160,11 @@
 /* The following functions construct the "leaves" of the abstract syntax tree. */
 
 RET parse_keyword(PARAMS, const char *keyword, const char *errmsg) {
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != 'a') {
 		*err = errmsg; return NULL;
 	}
-	if (!streq(tok->token_string, keyword)) {
+	if (!tok_streq(tok, keyword)) {
 		*err = errmsg; return NULL;
 	}
 	CONSUME_ONE;
@@ -89,7 +174,7 @@ RET parse_keyword(PARAMS, const char *keyword, const char *errmsg) {
 // Note: a static buffer is used here.
 RET parse_punct(PARAMS, int punct) {
 	static char punctbuf[16];
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != punct) {
 		if (punct == PUNCT_SPREAD)
 			sprintf(punctbuf, "expected: '...'");
@@ -102,7 +187,7 @@ RET parse_punct(PARAMS, int punct) {
 }
 
 RET parse_name(PARAMS) {
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != 'a') {
 		*err = "name expected"; return NULL;
 	}
@@ -111,7 +196,7 @@ RET parse_name(PARAMS) {
 }
 
 RET parse_int(PARAMS) {
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != 'i') {
 		*err = "integer expected"; return NULL;
 	}
@@ -120,7 +205,7 @@ RET parse_int(PARAMS) {
 }
 
 RET parse_float(PARAMS) {
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != 'f') {
 		*err = "float expected"; return NULL;
 	}
@@ -129,7 +214,7 @@ RET parse_float(PARAMS) {
 }
 
 RET parse_string(PARAMS) {
-	struct graphql_token *tok = list_top(tokens, struct graphql_token, node);
+	struct graphql_token *tok = TOP;
 	if (!tok || tok->token_type != 's') {
 		*err = "string expected"; return NULL;
 	}
@@ -211,10 +296,10 @@ RET parse_list_value(PARAMS) {
 RET parse_enum_value(PARAMS) {
 	INIT(enum_value);
 	obj->val = parse_name(ARGS); REQ
-	struct graphql_token *tok = list_top(used, struct graphql_token, node);
-	if (streq(tok->token_string, "true")
-	 || streq(tok->token_string, "false")
-	 || streq(tok->token_string, "null")) {
+	struct graphql_token *tok = LAST_CONSUMED;
+	if (tok_streq(tok, "true")
+	 || tok_streq(tok, "false")
+	 || tok_streq(tok, "null")) {
 		*err = "enum value cannot be true, false, or null";
 		ROLLBACK(ARGS);
 	}
@@ -310,8 +395,8 @@ RET parse_type_condition(PARAMS) {
 RET parse_fragment_name(PARAMS) {
 	INIT(fragment_name);
 	obj->name = parse_name(ARGS); REQ
-	struct graphql_token *tok = list_top(used, struct graphql_token, node);
-	if (streq(tok->token_string, "on")) {
+	struct graphql_token *tok = LAST_CONSUMED;
+	if (tok_streq(tok, "on")) {
 		*err = "invalid fragment name";
 		ROLLBACK(ARGS);
 	}
@@ -518,25 +603,62 @@ RET parse_document(PARAMS) {
 }
 void *currently_unused = parse_document; // to hide the warning till this is used
 
-/* Convert input string into tokens.
+/* Where the lexer puts tokens
  *
- * All data (i.e. the list and the tokens it contains) are allocated to the
- * specified tal context.
+ * In list mode, each token is allocated and linked into a list, and has its
+ * own copy of its string. In array mode, tokens are appended to an array, and
+ * their strings point into the input unless they had to be rewritten.
  */
-const char *graphql_lex(const tal_t *ctx, const char *input, struct list_head **tokens) {
+struct lexer {
+	struct list_head *list;		// list mode: the token list
+	struct graphql_token *arr;	// array mode: the token array
+	size_t num;			// array mode: tokens used in the array
+	const tal_t *str_ctx;		// array mode: rewritten strings, or...
+	struct arena *arena;		// ...from here, if set
+};
+
+static struct graphql_token *new_token(struct lexer *lx) {
+	struct graphql_token *tok;
+
+	if (lx->list) {
+		tok = talz(lx->list, struct graphql_token);
+		list_add_tail(lx->list, &tok->node);
+		return tok;
+	}
+	if (lx->num == tal_count(lx->arr))
+		tal_resize(&lx->arr, lx->num * 2);
+	tok = &lx->arr[lx->num++];
+	memset(tok, 0, sizeof(*tok));
+	return tok;
+}
+
+static void set_token_string(struct lexer *lx, struct graphql_token *tok, const char *str, size_t len) {
+	if (lx->list)
+		tok->token_string = tal_strndup(tok, str, len);
+	else
+		tok->token_string = (char *)str;
+	tok->token_len = len;
+}
+
+// A copy of a string token for rewriting, in either mode.
+static void copy_token_string(struct lexer *lx, struct graphql_token *tok, const char *str, size_t len) {
+	if (lx->list)
+		tok->token_string = tal_strndup(tok, str, len);
+	else if (lx->arena) {
+		tok->token_string = arena_alloc(lx->arena, len + 1);
+		memcpy(tok->token_string, str, len);
+	} else
+		tok->token_string = tal_strndup(lx->str_ctx, str, len);
+}
+
+/* Convert input string into tokens. */
+static const char *lex(struct lexer *lx, const char *input) {
 
 	unsigned int c;
 	const char *p, *line_beginning;
 	unsigned int line_num = 1;
-	struct list_head *tok_list;
 	struct graphql_token *tok;
 
-	// Initialize token output list.
-	tok_list = tal(ctx, struct list_head);
-	if (tokens)
-		*tokens = tok_list;
-	list_head_init(tok_list);
-
 	// Note: label and goto are used here like a continue statement except that
         // it skips iteration, for when characters are fetched in the loop body.
 	p = input;
@@ -588,8 +710,7 @@ newchar:
 				c = PUNCT_SPREAD;
 			}
 
-			tok = talz(tok_list, struct graphql_token);
-			list_add_tail(tok_list, &tok->node);
+			tok = new_token(lx);
 			tok->token_type = c;
 			tok->token_string = NULL;
 			tok->source_line = line_num;
@@ -600,8 +721,7 @@ newchar:
 		} else if (NAME_START(c)) {
 
 			// Name/identifier tokens.
-			tok = talz(tok_list, struct graphql_token);
-			list_add_tail(tok_list, &tok->node);
+			tok = new_token(lx);
 			tok->token_type = 'a';
 			// tok->token_string updated below.
 			tok->source_line = line_num;
@@ -625,7 +745,7 @@ newchar:
 			tok->source_len = name_len;
 
 			// Copy the token string.
-			tok->token_string = tal_strndup(tok, name_begin, name_len);
+			set_token_string(lx, tok, name_begin, name_len);
 
 			goto newchar;
 
@@ -678,10 +798,9 @@ newchar:
 			const char *num_end = p - 1;
 			int num_len = num_end - num_start;
 
-			tok = talz(tok_list, struct graphql_token);
-			list_add_tail(tok_list, &tok->node);
+			tok = new_token(lx);
 			tok->token_type = type;
-			tok->token_string = tal_strndup(tok, num_start, num_len);
+			set_token_string(lx, tok, num_start, num_len);
 			tok->source_line = line_num;
 			tok->source_column = num_start - line_beginning + 1;
 			tok->source_offset = num_start - input;
@@ -761,15 +880,22 @@ newchar:
 			}
 			int str_len = str_end - str_begin;
 
-			tok = talz(tok_list, struct graphql_token);
-			list_add_tail(tok_list, &tok->node);
+			tok = new_token(lx);
 			tok->token_type = 's';
-			tok->token_string = tal_strndup(tok, str_begin, str_len);
 			tok->source_line = line_num;
 			tok->source_column = str_begin - line_beginning + 1;
 			tok->source_offset = str_begin - input;
 			tok->source_len = str_len;
 
+			// Strings without escapes need no rewriting, so in array
+			// mode they can stay in the input.
+			if (!lx->list && !str_block && !memchr(str_begin, '\\', str_len)) {
+				set_token_string(lx, tok, str_begin, str_len);
+				c = *p++;
+				goto newchar;
+			}
+			copy_token_string(lx, tok, str_begin, str_len);
+
 			// Process escape sequences. These always shorten the string (so the memory allocation is always enough).
 			char d;
 			char *q = tok->token_string;
@@ -936,6 +1062,7 @@ newchar:
 					} while (d);
 				}
 			}
+			tok->token_len = strlen(tok->token_string);
 			c = *p++;
 			goto newchar;
 
@@ -948,11 +1075,61 @@ newchar:
 	return "unexpected end-of-input encountered";
 }
 
+/* Convert input string into a list of tokens.
+ *
+ * All data (i.e. the list and the tokens it contains) are allocated to the
+ * specified tal context.
+ */
+const char *graphql_lex(const tal_t *ctx, const char *input, struct list_head **tokens) {
+	struct lexer lx = { 0 };
+
+	// Initialize token output list.
+	lx.list = tal(ctx, struct list_head);
+	if (tokens)
+		*tokens = lx.list;
+	list_head_init(lx.list);
+
+	return lex(&lx, input);
+}
+
+/* Convert input string into an array of tokens.
+ *
+ * The array is allocated to the specified tal context, and any strings that
+ * had to be rewritten are allocated to the array.
+ */
+const char *graphql_lex_array(const tal_t *ctx, const char *input, struct graphql_token **tokens) {
+	struct lexer lx = { 0 };
+	const char *err;
+
+	lx.arr = tal_arr(ctx, struct graphql_token, 16);
+	lx.str_ctx = tal(lx.arr, char);
+	err = lex(&lx, input);
+	tal_resize(&lx.arr, lx.num);
+	*tokens = lx.arr;
+	return err;
+}
+
 // Convert lexed tokens into AST.
 const char *graphql_parse(struct list_head *tokens, struct graphql_executable_document **doc) {
-	struct list_head used = LIST_HEAD_INIT(used);
+	struct parser ps = { 0 };
+	struct graphql_token *tok;
 	const char *err = NULL;
-	*doc = parse_executable_document(tokens, &used, &err);
+	size_t i;
+
+	ps.ctx = tokens;
+	list_for_each(tokens, tok, node)
+		ps.num++;
+	ps.ptrs = tal_arr(NULL, struct graphql_token *, ps.num);
+	i = 0;
+	list_for_each(tokens, tok, node)
+		ps.ptrs[i++] = tok;
+
+	*doc = parse_executable_document(&ps, &err);
+
+	// Remove the consumed tokens from the list.
+	for (i = 0; i < ps.pos; i++)
+		list_del_from(tokens, &ps.ptrs[i]->node);
+	tal_free(ps.ptrs);
 	return err;
 }
 
@@ -964,5 +1141,132 @@ const char *graphql_lexparse(const tal_t *ctx, const char *input, struct list_he
 	return err;
 }
 
+// Lex and parse into an arena belonging to parsed, which is filled in.
+static const char *lexparse_arena(struct graphql_parsed *parsed, const tal_t *owner, const char *input, size_t len) {
+	struct arena arena;
+	struct lexer lx = { 0 };
+	struct parser ps = { 0 };
+	const char *err;
+
+	// A typical query fits in the first chunk.
+	arena_init(&arena, owner, len * 4);
+	lx.arr = tal_arr(owner, struct graphql_token, len / 4 + 16);
+	lx.arena = &arena;
+
+	parsed->input = input;
+	err = lex(&lx, input);
+	parsed->tokens = lx.arr;
+	parsed->num_tokens = lx.num;
+	parsed->next_token = 0;
+	if (err)
+		return err;
+
+	ps.arr = lx.arr;
+	ps.num = lx.num;
+	ps.arena = &arena;
+	parsed->doc = parse_executable_document(&ps, &err);
+	parsed->next_token = ps.pos;
+	return err;
+}
+
+const char *graphql_lexparse_arena(const tal_t *ctx, const char *input, struct graphql_parsed **parsed) {
+	*parsed = talz(ctx, struct graphql_parsed);
+	return lexparse_arena(*parsed, *parsed, input, strlen(input));
+}
+
+/* The document cache
+ *
+ * Parsed documents are kept in a hash table keyed on their text, and the least
+ * recently used is thrown out to make room for a new one. Each entry owns its
+ * copy of the text, its tokens and its arena.
+ */
+struct cache_entry {
+	struct cache_entry *next;	// in the same bucket
+	struct list_node lru;
+	const char *text;
+	size_t len;
+	size_t hash;
+	struct graphql_parsed parsed;
+};
+
+struct graphql_cache {
+	struct cache_entry **buckets;	// twice max_entries, a power of two
+	size_t mask;
+	size_t count;
+	struct list_head lru;		// most recently used first
+	size_t max_entries;
+	struct cache_entry *failed;	// the last failed parse, until the next call
+};
+
+struct graphql_cache *graphql_cache_new(const tal_t *ctx, size_t max_entries) {
+	struct graphql_cache *cache = tal(ctx, struct graphql_cache);
+	size_t n = 2;
+
+	cache->max_entries = max_entries ? max_entries : 1;
+	while (n < cache->max_entries * 2)
+		n *= 2;
+	cache->buckets = tal_arrz(cache, struct cache_entry *, n);
+	cache->mask = n - 1;
+	cache->count = 0;
+	list_head_init(&cache->lru);
+	cache->failed = NULL;
+	return cache;
+}
+
+static struct cache_entry **cache_bucket(struct graphql_cache *cache, size_t hash) {
+	return &cache->buckets[hash & cache->mask];
+}
+
+static void cache_evict(struct graphql_cache *cache) {
+	struct cache_entry *old = list_tail(&cache->lru, struct cache_entry, lru);
+	struct cache_entry **pp;
 
+	for (pp = cache_bucket(cache, old->hash); *pp != old; pp = &(*pp)->next)
+		;
+	*pp = old->next;
+	list_del_from(&cache->lru, &old->lru);
+	cache->count--;
+	tal_free(old);
+}
 
+const char *graphql_cache_lexparse(struct graphql_cache *cache, const char *input, const struct graphql_parsed **parsed) {
+	struct cache_entry *e, **bucket;
+	size_t len, hash;
+	const char *err;
+	char *text;
+
+	cache->failed = tal_free(cache->failed);
+
+	len = strlen(input);
+	hash = hash_any(input, len, 0);
+	bucket = cache_bucket(cache, hash);
+	for (e = *bucket; e; e = e->next) {
+		if (e->hash == hash && e->len == len
+		    && memcmp(e->text, input, len) == 0) {
+			list_del_from(&cache->lru, &e->lru);
+			list_add(&cache->lru, &e->lru);
+			*parsed = &e->parsed;
+			return GRAPHQL_SUCCESS;
+		}
+	}
+
+	e = talz(cache, struct cache_entry);
+	text = tal_dup_arr(e, char, input, len + 1, 0);
+	err = lexparse_arena(&e->parsed, e, text, len);
+	*parsed = &e->parsed;
+	if (err) {
+		cache->failed = e;
+		return err;
+	}
+
+	if (cache->count >= cache->max_entries)
+		cache_evict(cache);
+	e->text = text;
+	e->len = len;
+	e->hash = hash;
+	e->next = *bucket;
+	*bucket = e;
+	cache->count++;
+	list_add(&cache->lru, &e->lru);
+	return GRAPHQL_SUCCESS;
+}
@@ -250,9 +250,10 @@ enum token_type_enum {
 };
 
 struct graphql_token {
-	struct list_node node;
+	struct list_node node; // not used by graphql_lex_array()
 	enum token_type_enum token_type;
-	char *token_string;
+	char *token_string; // not NUL-terminated from graphql_lex_array()
+	unsigned int token_len; // the length of token_string
 	unsigned int source_line;
 	unsigned int source_column;
 	unsigned int source_offset;
@@ -287,5 +288,79 @@ const char *graphql_parse(struct list_head *tokens, struct graphql_executable_do
 /* The lexer and parser in one function, for convenience. */
 const char *graphql_lexparse(const tal_t *ctx, const char *input, struct list_head **tokens, struct graphql_executable_document **doc);
 
+/* The array lexer.
+ * INPUTS:
+ *	ctx - parent tal context or NULL
+ *	input - string to parse
+ *	tokens - a variable to receive the resulting token array
+ * OPERATION:
+ *	The tokens go into one array (tal_count() gives the number) rather than
+ *	a list of separate allocations. A token's string points into the input,
+ *	so the input must outlive the array, and is not NUL-terminated: use
+ *	token_len. Only strings with escape sequences and block strings are
+ *	rewritten, and copied to do so. On failure, the array holds the tokens
+ *	lexed before the error.
+ * RETURN:
+ *	GRAPHQL_SUCCESS or an error string.
+ */
+const char *graphql_lex_array(const tal_t *ctx, const char *input, struct graphql_token **tokens);
+
+/* A document parsed by graphql_lexparse_arena() or graphql_cache_lexparse(). */
+struct graphql_parsed {
+	const char *input; // the text parsed, which the tokens point into
+	struct graphql_token *tokens; // lexed as by graphql_lex_array()
+	size_t num_tokens;
+	size_t next_token; // on failure, the token where parsing stopped
+	struct graphql_executable_document *doc;
+	void *data; // for application use
+};
+
+/* The lexer and parser in one function, in array mode.
+ * INPUTS:
+ *	ctx - parent tal context or NULL
+ *	input - string to parse, which must outlive the result
+ *	parsed - a variable to receive the tokens and AST
+ * OPERATION:
+ *	The tokens are lexed into an array, and the AST is carved out of a few
+ *	large blocks, so that a document takes a handful of allocations and is
+ *	freed with tal_free(*parsed). On failure, *parsed is still set and,
+ *	as with graphql_lexparse(), tokens from next_token on were not
+ *	consumed: if lexing failed that is all of them, and the last token is
+ *	the last good one.
+ * RETURN:
+ *	GRAPHQL_SUCCESS or an error string.
+ */
+const char *graphql_lexparse_arena(const tal_t *ctx, const char *input, struct graphql_parsed **parsed);
+
+/* A cache of parsed documents, for callers who see the same queries again and
+ * again. */
+struct graphql_cache;
+
+/* Create a cache.
+ * INPUTS:
+ *	ctx - parent tal context or NULL
+ *	max_entries - how many documents to keep; the least recently used is
+ *		dropped to make room for a new one
+ * RETURN:
+ *	The cache, to be freed with tal_free().
+ */
+struct graphql_cache *graphql_cache_new(const tal_t *ctx, size_t max_entries);
+
+/* Look up a document in the cache by its text, lexing and parsing it (as by
+ * graphql_lexparse_arena()) if it is not there.
+ * INPUTS:
+ *	cache - the cache
+ *	input - string to parse; the cache keeps its own copy
+ *	parsed - a variable to receive the tokens and AST
+ * OPERATION:
+ *	*parsed belongs to the cache, and may be dropped by a later call, so do
+ *	not hold on to it across one. Documents which fail to parse are not
+ *	cached; *parsed is set as for graphql_lexparse_arena() and lasts until
+ *	the next call.
+ * RETURN:
+ *	GRAPHQL_SUCCESS or an error string.
+ */
+const char *graphql_cache_lexparse(struct graphql_cache *cache, const char *input, const struct graphql_parsed **parsed);
+
 #endif
 
@@ -0,0 +1,255 @@
+/* Include the C files directly. */
+#include "ccan/graphql/graphql.c"
+#include "ccan/str/str.h"
+#include "ccan/tap/tap.h"
+
+/* Array mode must give the same tokens and the same AST as list mode, so we
+ * print both ASTs and compare the text. */
+
+static void print_tok(char **out, const struct graphql_token *tok) {
+	if (tok)
+		tal_append_fmt(out, "%.*s ", (int)tok->token_len, tok->token_string);
+}
+
+static void print_value(char **out, const struct graphql_value *val);
+
+static void print_args(char **out, const struct graphql_arguments *args) {
+	const struct graphql_argument *a;
+
+	if (!args)
+		return;
+	tal_append_fmt(out, "( ");
+	for (a = args->first; a; a = a->next) {
+		print_tok(out, a->name);
+		print_value(out, a->val);
+	}
+	tal_append_fmt(out, ") ");
+}
+
+static void print_directives(char **out, const struct graphql_directives *dirs) {
+	const struct graphql_directive *d;
+
+	if (!dirs)
+		return;
+	for (d = dirs->first; d; d = d->next) {
+		tal_append_fmt(out, "@");
+		print_tok(out, d->name);
+		print_args(out, d->args);
+	}
+}
+
+static void print_value(char **out, const struct graphql_value *val) {
+	const struct graphql_object_field *f;
+
+	if (val->var) {
+		tal_append_fmt(out, "$");
+		print_tok(out, val->var->name);
+	} else if (val->int_val)
+		print_tok(out, val->int_val->val);
+	else if (val->float_val)
+		print_tok(out, val->float_val->val);
+	else if (val->str_val) {
+		tal_append_fmt(out, "\"");
+		print_tok(out, val->str_val->val);
+	} else if (val->bool_val)
+		print_tok(out, val->bool_val->val);
+	else if (val->null_val)
+		print_tok(out, val->null_val->val);
+	else if (val->enum_val)
+		print_tok(out, val->enum_val->val);
+	else if (val->list_val)
+		tal_append_fmt(out, "[] ");
+	else if (val->obj_val) {
+		tal_append_fmt(out, "{ ");
+		for (f = val->obj_val->first; f; f = f->next) {
+			print_tok(out, f->name);
+			print_value(out, f->val);
+		}
+		tal_append_fmt(out, "} ");
+	}
+}
+
+static void print_sel_set(char **out, const struct graphql_selection_set *set) {
+	const struct graphql_selection *sel;
+
+	if (!set)
+		return;
+	tal_append_fmt(out, "{ ");
+	for (sel = set->first; sel; sel = sel->next) {
+		if (sel->field) {
+			if (sel->field->alias) {
+				print_tok(out, sel->field->alias->name);
+				tal_append_fmt(out, ": ");
+			}
+			print_tok(out, sel->field->name);
+			print_args(out, sel->field->args);
+			print_directives(out, sel->field->directives);
+			print_sel_set(out, sel->field->sel_set);
+		} else if (sel->frag_spread) {
+			tal_append_fmt(out, "... ");
+			print_tok(out, sel->frag_spread->name->name);
+			print_directives(out, sel->frag_spread->directives);
+		} else if (sel->inline_frag) {
+			tal_append_fmt(out, "... ");
+			if (sel->inline_frag->type_cond)
+				print_tok(out, sel->inline_frag->type_cond->named_type->name);
+			print_directives(out, sel->inline_frag->directives);
+			print_sel_set(out, sel->inline_frag->sel_set);
+		}
+	}
+	tal_append_fmt(out, "} ");
+}
+
+static char *print_doc(const tal_t *ctx, const struct graphql_executable_document *doc) {
+	const struct graphql_executable_definition *def;
+	const struct graphql_variable_definition *v;
+	char *out = tal_strdup(ctx, "");
+
+	for (def = doc->first_def; def; def = def->next_def) {
+		if (def->op_def) {
+			if (def->op_def->op_type)
+				print_tok(&out, def->op_def->op_type->op_type);
+			print_tok(&out, def->op_def->op_name);
+			if (def->op_def->vars) {
+				for (v = def->op_def->vars->first; v; v = v->next) {
+					tal_append_fmt(&out, "$");
+					print_tok(&out, v->var->name);
+					print_tok(&out, v->type->named->name);
+					if (v->default_val)
+						print_value(&out, v->default_val->val);
+				}
+			}
+			print_directives(&out, def->op_def->directives);
+			print_sel_set(&out, def->op_def->sel_set);
+		} else {
+			tal_append_fmt(&out, "fragment ");
+			print_tok(&out, def->frag_def->name->name);
+			print_tok(&out, def->frag_def->type_cond->named_type->name);
+			print_directives(&out, def->frag_def->directives);
+			print_sel_set(&out, def->frag_def->sel_set);
+		}
+	}
+	return out;
+}
+
+static const char *queries[] = {
+	"{ hero { name } }",
+	"query HeroNameAndFriends($episode: Episode = JEDI, $withFriends: Boolean) {\n"
+	"  hero(episode: $episode) {\n"
+	"    name\n"
+	"    friends @include(if: $withFriends) { name }\n"
+	"  }\n"
+	"}",
+	"mutation { likeStory(storyID: 12345) { story { likeCount } } }",
+	"query { user(id: 4) { ...friendFields ... on User @skip(if: false) { birthday } } }\n"
+	"fragment friendFields on User { id name profilePic(size: 50) }",
+	"{ nearestThing(location: { lon: 12.43, lat: -53.211 }, tags: [], kind: null, exact: true) }",
+	"{ search(text: \"plain\", escaped: \"tab\\there \\u00e9\", block: \"\"\"\n"
+	"      indented\n"
+	"        block\n"
+	"    \"\"\") { smallPic: profilePic(size: 64) } }",
+	"subscription S { onEvent(filter: { kinds: [], min: 1.5 }) { id } }",
+	/* Failures, at the lexer and at the parser. */
+	"{ field(arg: 01) }",
+	"{ field(arg: \"unterminated) }",
+	"{ field(arg: 1) ",
+	"query Q { a } fragment on on User { b }",
+	"{ a(x: true, y: on) { ...on } }",
+};
+
+/* graphql_lex_array() gives the tokens graphql_lex() does, in an array. */
+static bool same_tokens(const char *input) {
+	struct graphql_token *tokens, *tok;
+	struct list_head *list;
+	const char *err, *aerr;
+	size_t i = 0;
+	bool same;
+
+	err = graphql_lex(NULL, input, &list);
+	aerr = graphql_lex_array(list, input, &tokens);
+	same = streq(err ? err : "", aerr ? aerr : "");
+	list_for_each(list, tok, node) {
+		if (i >= tal_count(tokens)
+		    || tok->token_type != tokens[i].token_type
+		    || tok->source_offset != tokens[i].source_offset
+		    || tok->source_line != tokens[i].source_line
+		    || tok->source_column != tokens[i].source_column
+		    || tok->token_len != tokens[i].token_len
+		    || (tok->token_string && memcmp(tok->token_string, tokens[i].token_string, tok->token_len)))
+			same = false;
+		i++;
+	}
+	same &= i == tal_count(tokens);
+	tal_free(list);
+	return same;
+}
+
+#define NUM_QUERIES (sizeof(queries) / sizeof(queries[0]))
+
+int main(void) {
+	struct graphql_executable_document *doc;
+	const struct graphql_parsed *cached, *again;
+	struct graphql_parsed *parsed;
+	struct graphql_cache *cache;
+	struct graphql_token *tok;
+	struct list_head *list;
+	const char *err, *aerr;
+	char *copy;
+	size_t left, q;
+	bool same;
+
+	plan_tests(NUM_QUERIES * 5 + 11);
+
+	cache = graphql_cache_new(NULL, 4);
+	for (q = 0; q < NUM_QUERIES; q++) {
+		ok(same_tokens(queries[q]), "tokens of query %zu", q);
+
+		// The same AST, or the same error at the same token.
+		doc = NULL;
+		err = graphql_lexparse(NULL, queries[q], &list, &doc);
+		left = 0;
+		if (list)
+			list_for_each(list, tok, node)
+				left++;
+		aerr = graphql_lexparse_arena(NULL, queries[q], &parsed);
+		ok(streq(err ? err : "", aerr ? aerr : ""), "error of query %zu: %s", q, err ? err : "none");
+		if (err)
+			ok1(!parsed->doc);
+		else
+			ok1(streq(print_doc(list, doc), print_doc(list, parsed->doc)));
+		ok1(!parsed->tokens || parsed->num_tokens - parsed->next_token == left);
+		tal_free(parsed);
+
+		// The cache keeps its own copy of the text.
+		copy = tal_strdup(NULL, queries[q]);
+		aerr = graphql_cache_lexparse(cache, copy, &cached);
+		same = streq(err ? err : "", aerr ? aerr : "");
+		if (!err)
+			same &= streq(print_doc(list, doc), print_doc(list, cached->doc))
+				&& cached->input != copy;
+		tal_free(copy);
+		ok(same, "cached query %zu", q);
+		tal_free(list);
+	}
+
+	// Plain strings point into the input, escaped ones do not.
+	ok1(!graphql_lexparse_arena(NULL, queries[5], &parsed));
+	tok = parsed->doc->first_def->op_def->sel_set->first->field->args->first->val->str_val->val;
+	ok1(tok->token_string == parsed->input + tok->source_offset && tok->token_len == 5);
+	tok = parsed->doc->first_def->op_def->sel_set->first->field->args->first->next->val->str_val->val;
+	ok1(streq(tal_strndup(parsed, tok->token_string, tok->token_len), "tab\there \xc3\xa9"));
+	tal_free(parsed);
+
+	// Hits, misses and evictions: the cache holds the last four good queries.
+	ok1(cache->count == 4);
+	ok1(!graphql_cache_lexparse(cache, queries[6], &cached));
+	ok1(!graphql_cache_lexparse(cache, queries[6], &again) && again == cached);
+	ok1(!graphql_cache_lexparse(cache, queries[0], &cached));
+	ok1(cache->count == 4);
+	ok1(!graphql_cache_lexparse(cache, queries[0], &again) && again == cached);
+	ok1(graphql_cache_lexparse(cache, queries[7], &cached) && !cached->doc);
+	ok1(cache->count == 4);
+	tal_free(cache);
+
+	return exit_status();
+}
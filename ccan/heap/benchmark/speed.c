@@ -0,0 +1,151 @@
+/* Push/pop benchmark: struct heap vs HEAP_DEFINE_TYPE vs pairing heap. */
+#include <ccan/heap/heap.h>
+#include <ccan/heap/heap_type.h>
+#include <ccan/heap/pairing_heap.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+struct item {
+	uint64_t key;
+	struct pairing_heap_node node;
+};
+
+static uint64_t item_key(const struct item *item)
+{
+	return item->key;
+}
+
+#define u64_less(a, b) ((a) < (b))
+
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, u64_less, 2, heap2);
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, u64_less, 4, heap4);
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, u64_less, 8, heap8);
+
+static bool void_less(const void *a, const void *b)
+{
+	return ((const struct item *)a)->key < ((const struct item *)b)->key;
+}
+
+static bool node_less(const struct pairing_heap_node *a,
+		      const struct pairing_heap_node *b)
+{
+	return container_of(a, struct item, node)->key
+		< container_of(b, struct item, node)->key;
+}
+
+/* Fill, then the steady state of a scheduler: pop one, push a later one. */
+#define BENCH_TYPE(name)						\
+	static uint64_t bench_##name(struct item *items, size_t num,	\
+				     size_t ops)			\
+	{								\
+		struct name h;						\
+		struct item *item;					\
+		uint64_t sum = 0;					\
+		size_t i;						\
+									\
+		name##_init(&h);					\
+		for (i = 0; i < num; i++)				\
+			if (!name##_push(&h, &items[i]))		\
+				err(1, "pushing");			\
+		for (i = 0; i < ops; i++) {				\
+			item = name##_pop(&h);				\
+			sum += item->key;				\
+			item->key += random() % num;			\
+			name##_push(&h, item);				\
+		}							\
+		while ((item = name##_pop(&h)) != NULL)			\
+			sum += item->key;				\
+		name##_clear(&h);					\
+		return sum;						\
+	}
+
+BENCH_TYPE(heap2)
+BENCH_TYPE(heap4)
+BENCH_TYPE(heap8)
+
+static uint64_t bench_heap(struct item *items, size_t num, size_t ops)
+{
+	struct heap *h = heap_init(void_less);
+	struct item *item;
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < num; i++)
+		if (heap_push(h, &items[i]))
+			err(1, "pushing");
+	for (i = 0; i < ops; i++) {
+		item = heap_pop(h);
+		sum += item->key;
+		item->key += random() % num;
+		heap_push(h, item);
+	}
+	/* heap_pop() doesn't check for empty. */
+	while (h->len) {
+		item = heap_pop(h);
+		sum += item->key;
+	}
+	heap_free(h);
+	return sum;
+}
+
+static uint64_t bench_pairing(struct item *items, size_t num, size_t ops)
+{
+	struct pairing_heap h = PAIRING_HEAP_INIT(node_less);
+	struct item *item;
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < num; i++)
+		pairing_heap_push(&h, &items[i].node);
+	for (i = 0; i < ops; i++) {
+		item = pairing_heap_entry(pairing_heap_pop(&h),
+					  struct item, node);
+		sum += item->key;
+		item->key += random() % num;
+		pairing_heap_push(&h, &item->node);
+	}
+	while ((item = pairing_heap_entry(pairing_heap_pop(&h),
+					  struct item, node)) != NULL)
+		sum += item->key;
+	return sum;
+}
+
+static void run(const char *name,
+		uint64_t (*bench)(struct item *, size_t, size_t),
+		size_t num, size_t ops)
+{
+	struct item *items = malloc(sizeof(*items) * num);
+	struct timemono start;
+	uint64_t sum;
+	size_t i;
+
+	srandom(1);
+	for (i = 0; i < num; i++)
+		items[i].key = random();
+	start = time_mono();
+	sum = bench(items, num, ops);
+	printf("%-12s %zu entries, %zu pop/push: %llu usec (sum %llu)\n",
+	       name, num, ops,
+	       (unsigned long long)time_to_usec(timemono_since(start)),
+	       (unsigned long long)sum);
+	free(items);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t num = 1000000, ops = 10000000;
+
+	if (argc > 1)
+		num = atol(argv[1]);
+	if (argc > 2)
+		ops = atol(argv[2]);
+
+	run("heap", bench_heap, num, ops);
+	run("heap_type/2", bench_heap2, num, ops);
+	run("heap_type/4", bench_heap4, num, ops);
+	run("heap_type/8", bench_heap8, num, ops);
+	run("pairing", bench_pairing, num, ops);
+	return 0;
+}
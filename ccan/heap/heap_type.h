@@ -0,0 +1,197 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_HEAP_TYPE_H
+#define CCAN_HEAP_TYPE_H
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ccan/compiler/compiler.h>
+
+/* Child groups are aligned to this, so each sift step touches one line. */
+#define HEAP_TYPE_ALIGN 64
+
+/**
+ * HEAP_DEFINE_TYPE - create a type-safe d-ary heap for a type
+ * @type: a type whose pointers will be entries in the heap.
+ * @keytype: the type of the key, copied into the heap with each entry.
+ * @keyof: a function/macro to extract a key: @keytype @keyof(const type *elem)
+ * @less: a function/macro to compare keys: bool @less(@keytype a, @keytype b)
+ * @arity: number of children per node (eg. 2, 4 or 8).
+ * @name: a prefix for all the functions to define (of form <name>_*)
+ *
+ * Unlike struct heap, which keeps only pointers and calls a comparison
+ * function through a pointer, this keeps each entry's key next to the
+ * pointer and compares keys with @less inline, so sifting never touches
+ * the entries themselves.  The children of each node are stored together
+ * on a HEAP_TYPE_ALIGN boundary: choose @arity so that @arity entries
+ * (key plus pointer) fill a cache line, eg. 4 for 64-bit keys.
+ *
+ * The key of an entry must not change while it's in the heap.
+ *
+ * If @less is something akin to 'a < b', this is a min heap; '>' gives
+ * a max heap.
+ *
+ * This defines the heap type:
+ *	struct <name>;
+ *
+ * Initialization and freeing functions:
+ *	void <name>_init(struct <name> *h);
+ *	void <name>_clear(struct <name> *h);
+ *
+ * Count entries:
+ *	size_t <name>_count(const struct <name> *h);
+ *
+ * Add an entry (only fails if we run out of memory):
+ *	bool <name>_push(struct <name> *h, type *elem);
+ *
+ * Return (and remove, for pop) the root entry, or NULL if empty:
+ *	type *<name>_peek(const struct <name> *h);
+ *	type *<name>_pop(struct <name> *h);
+ *
+ * Example:
+ *	#include <ccan/heap/heap_type.h>
+ *	#include <stdio.h>
+ *
+ *	struct timer {
+ *		uint64_t expiry;
+ *		const char *name;
+ *	};
+ *
+ *	static uint64_t timer_expiry(const struct timer *t)
+ *	{
+ *		return t->expiry;
+ *	}
+ *
+ *	static bool u64_less(uint64_t a, uint64_t b)
+ *	{
+ *		return a < b;
+ *	}
+ *
+ *	HEAP_DEFINE_TYPE(struct timer, uint64_t, timer_expiry, u64_less, 4,
+ *			 timerheap);
+ *
+ *	int main(void)
+ *	{
+ *		struct timerheap h;
+ *		struct timer t[] = { { 3, "three" }, { 1, "one" }, { 2, "two" } };
+ *		struct timer *next;
+ *		unsigned int i;
+ *
+ *		timerheap_init(&h);
+ *		for (i = 0; i < 3; i++)
+ *			if (!timerheap_push(&h, &t[i]))
+ *				return 1;
+ *		// Prints one, two, three.
+ *		while ((next = timerheap_pop(&h)) != NULL)
+ *			printf("%s\n", next->name);
+ *		timerheap_clear(&h);
+ *		return 0;
+ *	}
+ */
+#define HEAP_DEFINE_TYPE(type, keytype, keyof, less, arity, name)	\
+	struct name##_entry { keytype key; type *elem; };		\
+	struct name {							\
+		struct name##_entry *data;				\
+		size_t len, cap;					\
+		void *mem;						\
+	};								\
+	static inline UNNEEDED void name##_init(struct name *h)	\
+	{								\
+		h->data = NULL;						\
+		h->len = h->cap = 0;					\
+		h->mem = NULL;						\
+	}								\
+	static inline UNNEEDED void name##_clear(struct name *h)	\
+	{								\
+		free(h->mem);						\
+		name##_init(h);						\
+	}								\
+	static inline UNNEEDED size_t name##_count(const struct name *h) \
+	{								\
+		return h->len;						\
+	}								\
+	/* Place data so data[1] (first child of root) is aligned. */	\
+	static inline struct name##_entry *name##_align_(void *mem)	\
+	{								\
+		uintptr_t p = (uintptr_t)mem				\
+			+ sizeof(struct name##_entry);			\
+		p = (p + HEAP_TYPE_ALIGN - 1) & ~(uintptr_t)(HEAP_TYPE_ALIGN - 1); \
+		return (struct name##_entry *)p - 1;			\
+	}								\
+	static inline bool name##_grow_(struct name *h)		\
+	{								\
+		size_t cap = h->cap ? h->cap * 2 : 64;			\
+		size_t old_off = h->mem ? (char *)h->data - (char *)h->mem : 0; \
+		struct name##_entry *data;				\
+		void *mem;						\
+									\
+		mem = realloc(h->mem, cap * sizeof(*data)		\
+			      + HEAP_TYPE_ALIGN);			\
+		if (!mem)						\
+			return false;					\
+		data = name##_align_(mem);				\
+		/* realloc may have moved us off alignment. */		\
+		if (h->len && (char *)data - (char *)mem != (ptrdiff_t)old_off) \
+			memmove(data, (char *)mem + old_off,		\
+				h->len * sizeof(*data));		\
+		h->mem = mem;						\
+		h->data = data;						\
+		h->cap = cap;						\
+		return true;						\
+	}								\
+	static inline UNNEEDED bool name##_push(struct name *h, type *elem) \
+	{								\
+		struct name##_entry e;					\
+		size_t i = h->len;					\
+									\
+		if (h->len == h->cap && !name##_grow_(h))		\
+			return false;					\
+		e.key = keyof(elem);					\
+		e.elem = elem;						\
+		/* Move parents down into the hole until e fits. */	\
+		while (i) {						\
+			size_t parent = (i - 1) / (arity);		\
+			if (!less(e.key, h->data[parent].key))		\
+				break;					\
+			h->data[i] = h->data[parent];			\
+			i = parent;					\
+		}							\
+		h->data[i] = e;						\
+		h->len++;						\
+		return true;						\
+	}								\
+	static inline UNNEEDED type *name##_peek(const struct name *h)	\
+	{								\
+		return h->len ? h->data[0].elem : NULL;			\
+	}								\
+	static inline UNNEEDED type *name##_pop(struct name *h)	\
+	{								\
+		struct name##_entry e;					\
+		type *ret;						\
+		size_t i = 0, c, j, best;				\
+									\
+		if (!h->len)						\
+			return NULL;					\
+		ret = h->data[0].elem;					\
+		e = h->data[--h->len];					\
+		/* Move smallest children up into hole until e fits. */ \
+		while ((c = i * (arity) + 1) < h->len) {		\
+			size_t end = c + (arity);			\
+			if (end > h->len)				\
+				end = h->len;				\
+			best = c;					\
+			for (j = c + 1; j < end; j++)			\
+				if (less(h->data[j].key, h->data[best].key)) \
+					best = j;			\
+			if (!less(h->data[best].key, e.key))		\
+				break;					\
+			h->data[i] = h->data[best];			\
+			i = best;					\
+		}							\
+		h->data[i] = e;						\
+		return ret;						\
+	}
+
+#endif /* CCAN_HEAP_TYPE_H */
@@ -0,0 +1,119 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#include <ccan/heap/pairing_heap.h>
+
+/* Make b a child of a (a is a root, b is unattached). */
+static void add_child(struct pairing_heap_node *a, struct pairing_heap_node *b)
+{
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+}
+
+/* Combine two unattached trees, returning the new root. */
+static struct pairing_heap_node *meld(const struct pairing_heap *h,
+				      struct pairing_heap_node *a,
+				      struct pairing_heap_node *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	if (h->less(b, a)) {
+		add_child(b, a);
+		return b;
+	}
+	add_child(a, b);
+	return a;
+}
+
+/* Unlink node (and its subtree) from its parent and siblings. */
+static void detach(struct pairing_heap_node *node)
+{
+	if (node->prev->child == node)
+		node->prev->child = node->next;
+	else
+		node->prev->next = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	node->next = node->prev = NULL;
+}
+
+/*
+ * The standard two-pass merge: meld siblings in pairs left to right, then
+ * meld the pairs together right to left.  We link the pairs through ->prev
+ * in the first pass, so the second pass can walk them backwards.
+ */
+static struct pairing_heap_node *merge_pairs(const struct pairing_heap *h,
+					     struct pairing_heap_node *first)
+{
+	struct pairing_heap_node *a, *b, *next, *pairs = NULL, *root;
+
+	while (first) {
+		a = first;
+		b = a->next;
+		next = b ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b)
+			b->next = b->prev = NULL;
+		a = meld(h, a, b);
+		a->prev = pairs;
+		pairs = a;
+		first = next;
+	}
+
+	root = NULL;
+	while (pairs) {
+		a = pairs;
+		pairs = a->prev;
+		a->prev = NULL;
+		root = meld(h, root, a);
+	}
+	return root;
+}
+
+void pairing_heap_push(struct pairing_heap *h, struct pairing_heap_node *node)
+{
+	node->child = node->next = node->prev = NULL;
+	h->root = meld(h, h->root, node);
+	h->len++;
+}
+
+struct pairing_heap_node *pairing_heap_pop(struct pairing_heap *h)
+{
+	struct pairing_heap_node *root = h->root;
+
+	if (!root)
+		return NULL;
+	h->root = merge_pairs(h, root->child);
+	if (h->root)
+		h->root->prev = NULL;
+	root->child = NULL;
+	h->len--;
+	return root;
+}
+
+void pairing_heap_decrease(struct pairing_heap *h,
+			   struct pairing_heap_node *node)
+{
+	if (node == h->root)
+		return;
+	detach(node);
+	h->root = meld(h, h->root, node);
+}
+
+void pairing_heap_del(struct pairing_heap *h, struct pairing_heap_node *node)
+{
+	struct pairing_heap_node *sub;
+
+	if (node == h->root) {
+		pairing_heap_pop(h);
+		return;
+	}
+	detach(node);
+	sub = merge_pairs(h, node->child);
+	node->child = NULL;
+	h->root = meld(h, h->root, sub);
+	h->len--;
+}
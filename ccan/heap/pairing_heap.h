@@ -0,0 +1,146 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_HEAP_PAIRING_HEAP_H
+#define CCAN_HEAP_PAIRING_HEAP_H
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <ccan/container_of/container_of.h>
+
+/**
+ * struct pairing_heap_node - node embedded in each entry of a pairing heap
+ * @child: first child, or NULL.
+ * @next: next sibling, or NULL.
+ * @prev: previous sibling, or parent if we're the first child (NULL for root).
+ *
+ * Like a list_node, this lives inside the structure you put in the heap,
+ * so the heap itself never allocates.
+ */
+struct pairing_heap_node {
+	struct pairing_heap_node *child, *next, *prev;
+};
+
+typedef bool (*pairing_heap_less_func_t)(const struct pairing_heap_node *,
+					 const struct pairing_heap_node *);
+
+/**
+ * struct pairing_heap - a pairing heap, supporting decrease-key
+ * @root: the root node, or NULL if empty.
+ * @less: function to compare heap entries
+ * @len: number of entries in the heap
+ *
+ * As with struct heap, if @less is akin to 'return a.foo < b.foo', this
+ * is a min heap.  Push and decrease-key are O(1), pop is O(log n)
+ * amortized.
+ */
+struct pairing_heap {
+	struct pairing_heap_node *root;
+	pairing_heap_less_func_t less;
+	size_t len;
+};
+
+/**
+ * PAIRING_HEAP_INIT - initialiser for an empty pairing heap
+ * @func: comparison function to be used in the heap
+ */
+#define PAIRING_HEAP_INIT(func) { NULL, func, 0 }
+
+/**
+ * pairing_heap_init - initialise an empty pairing heap
+ * @h: the heap
+ * @less: comparison function to be used in the heap
+ */
+static inline void pairing_heap_init(struct pairing_heap *h,
+				     pairing_heap_less_func_t less)
+{
+	h->root = NULL;
+	h->less = less;
+	h->len = 0;
+}
+
+/**
+ * pairing_heap_push - add a node to the heap
+ * @h: the heap
+ * @node: the (unused) node to add
+ *
+ * Complexity: O(1)
+ */
+void pairing_heap_push(struct pairing_heap *h, struct pairing_heap_node *node);
+
+/**
+ * pairing_heap_peek - return the root node of the heap, or NULL if empty
+ * @h: the heap
+ */
+static inline struct pairing_heap_node *
+pairing_heap_peek(const struct pairing_heap *h)
+{
+	return h->root;
+}
+
+/**
+ * pairing_heap_pop - remove and return the root node, or NULL if empty
+ * @h: the heap
+ *
+ * Complexity: O(log n) amortized
+ */
+struct pairing_heap_node *pairing_heap_pop(struct pairing_heap *h);
+
+/**
+ * pairing_heap_decrease - restore heap order after a node moved up
+ * @h: the heap
+ * @node: a node in @h which now compares less than before
+ *
+ * Call this after changing an entry so it's "less" than it was (ie.
+ * decreasing the key of a min heap).
+ *
+ * Complexity: O(1), but makes the next pop more expensive.
+ */
+void pairing_heap_decrease(struct pairing_heap *h,
+			   struct pairing_heap_node *node);
+
+/**
+ * pairing_heap_del - remove any node from the heap
+ * @h: the heap
+ * @node: a node in @h
+ *
+ * Complexity: O(log n) amortized
+ */
+void pairing_heap_del(struct pairing_heap *h, struct pairing_heap_node *node);
+
+/**
+ * pairing_heap_entry - convert a pairing_heap_node into its containing struct
+ * @n: the node, or NULL.
+ * @type: the type of the containing structure.
+ * @member: the name of the pairing_heap_node in the structure.
+ *
+ * Returns NULL if @n is NULL.
+ *
+ * Example:
+ *	#include <ccan/heap/pairing_heap.h>
+ *
+ *	struct job {
+ *		unsigned int priority;
+ *		struct pairing_heap_node node;
+ *	};
+ *
+ *	static bool job_less(const struct pairing_heap_node *a,
+ *			     const struct pairing_heap_node *b)
+ *	{
+ *		return container_of(a, struct job, node)->priority
+ *			< container_of(b, struct job, node)->priority;
+ *	}
+ *
+ *	static struct job *next_job(struct pairing_heap *h)
+ *	{
+ *		return pairing_heap_entry(pairing_heap_pop(h), struct job, node);
+ *	}
+ *
+ *	static void bump_job(struct pairing_heap *h, struct job *job)
+ *	{
+ *		job->priority = 0;
+ *		pairing_heap_decrease(h, &job->node);
+ *	}
+ */
+#define pairing_heap_entry(n, type, member) \
+	container_of_or_null((n), type, member)
+
+#endif /* CCAN_HEAP_PAIRING_HEAP_H */
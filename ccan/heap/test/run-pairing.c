@@ -0,0 +1,120 @@
+#include <stdlib.h>
+
+#include <ccan/heap/pairing_heap.h>
+/* Include the C files directly. */
+#include <ccan/heap/pairing_heap.c>
+#include <ccan/tap/tap.h>
+
+struct item {
+	int v;
+	bool in_heap;
+	struct pairing_heap_node node;
+};
+
+static bool less(const struct pairing_heap_node *a,
+		 const struct pairing_heap_node *b)
+{
+	return container_of(a, struct item, node)->v
+		< container_of(b, struct item, node)->v;
+}
+
+/* Check heap order and child/sibling links below node. */
+static bool subtree_ok(const struct pairing_heap_node *node, size_t *count)
+{
+	const struct pairing_heap_node *c, *prev = node;
+
+	(*count)++;
+	for (c = node->child; c; prev = c, c = c->next) {
+		if (c->prev != prev)
+			return false;
+		if (less(c, node))
+			return false;
+		if (!subtree_ok(c, count))
+			return false;
+	}
+	return true;
+}
+
+static bool heap_ok(const struct pairing_heap *h)
+{
+	size_t count = 0;
+
+	if (!h->root)
+		return h->len == 0;
+	if (h->root->prev || h->root->next)
+		return false;
+	return subtree_ok(h->root, &count) && count == h->len;
+}
+
+static bool some_test(size_t n)
+{
+	struct item *items = calloc(n, sizeof(*items)), *item;
+	struct pairing_heap h;
+	size_t i, left = n;
+	int prev;
+
+	pairing_heap_init(&h, less);
+	if (pairing_heap_peek(&h) || pairing_heap_pop(&h))
+		return false;
+
+	for (i = 0; i < n; i++) {
+		items[i].v = rand() % 100000;
+		items[i].in_heap = true;
+		pairing_heap_push(&h, &items[i].node);
+	}
+	if (!heap_ok(&h))
+		return false;
+
+	/* Pop one, so there's some structure to play with. */
+	item = pairing_heap_entry(pairing_heap_pop(&h), struct item, node);
+	item->in_heap = false;
+	left--;
+	if (!heap_ok(&h))
+		return false;
+
+	/* Decrease some keys, delete others. */
+	for (i = 0; i < n; i++) {
+		if (!items[i].in_heap)
+			continue;
+		switch (rand() % 4) {
+		case 0:
+			items[i].v -= rand() % 1000;
+			pairing_heap_decrease(&h, &items[i].node);
+			break;
+		case 1:
+			pairing_heap_del(&h, &items[i].node);
+			items[i].in_heap = false;
+			left--;
+			break;
+		}
+		if (i % 64 == 0 && !heap_ok(&h))
+			return false;
+	}
+	if (!heap_ok(&h) || h.len != left)
+		return false;
+
+	for (i = 0; i < left; i++) {
+		item = pairing_heap_entry(pairing_heap_pop(&h), struct item, node);
+		if (!item || !item->in_heap)
+			return false;
+		if (i > 0 && item->v < prev)
+			return false;
+		prev = item->v;
+		item->in_heap = false;
+	}
+	if (pairing_heap_pop(&h) || h.len != 0)
+		return false;
+	free(items);
+	return true;
+}
+
+int main(void)
+{
+	plan_tests(3);
+
+	ok1(some_test(1));
+	ok1(some_test(100));
+	ok1(some_test(5000));
+
+	return exit_status();
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <ccan/heap/heap_type.h>
+#include <ccan/tap/tap.h>
+
+struct item {
+	void *foobar;
+	uint64_t v;
+};
+
+static uint64_t item_key(const struct item *item)
+{
+	return item->v;
+}
+
+#define key_less(a, b) ((a) < (b))
+#define key_more(a, b) ((a) > (b))
+
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, key_less, 2, heap2);
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, key_less, 4, heap4);
+HEAP_DEFINE_TYPE(struct item, uint64_t, item_key, key_more, 8, maxheap8);
+
+#define CHECK_HEAP(name, cmp)						\
+	static bool check_##name(size_t num)				\
+	{								\
+		struct item *items = calloc(num, sizeof(*items)), *item; \
+		struct name h;						\
+		uint64_t prev = 0;					\
+		size_t i;						\
+									\
+		name##_init(&h);					\
+		if (name##_peek(&h) || name##_pop(&h))			\
+			return false;					\
+		for (i = 0; i < num; i++) {				\
+			items[i].v = rand() % (num * 2);		\
+			if (!name##_push(&h, &items[i]))		\
+				return false;				\
+			/* Children of root start on a cache line. */	\
+			if ((uintptr_t)(h.data + 1) % HEAP_TYPE_ALIGN)	\
+				return false;				\
+		}							\
+		if (name##_count(&h) != num)				\
+			return false;					\
+		for (i = 0; i < num; i++) {				\
+			item = name##_peek(&h);				\
+			if (name##_pop(&h) != item)			\
+				return false;				\
+			if (i > 0 && cmp(item->v, prev))		\
+				return false;				\
+			prev = item->v;					\
+		}							\
+		if (name##_count(&h) != 0 || name##_pop(&h))		\
+			return false;					\
+		name##_clear(&h);					\
+		free(items);						\
+		return true;						\
+	}
+
+CHECK_HEAP(heap2, key_less)
+CHECK_HEAP(heap4, key_less)
+CHECK_HEAP(maxheap8, key_more)
+
+int main(void)
+{
+	plan_tests(9);
+
+	ok1(check_heap2(5000));
+	ok1(check_heap2(1));
+	ok1(check_heap2(33));
+	ok1(check_heap4(5000));
+	ok1(check_heap4(1));
+	ok1(check_heap4(33));
+	ok1(check_maxheap8(5000));
+	ok1(check_maxheap8(1));
+	ok1(check_maxheap8(33));
+
+	return exit_status();
+}
@@ -71,3 +71,75 @@ struct io_plan *io_recv_fd_(struct io_conn *conn,
 
 	return io_set_plan(conn, IO_IN, do_fd_recv, next, next_arg);
 }
+
+static void destroy_conn_close_send_fds(struct io_conn *conn,
+					struct io_plan_arg *arg)
+{
+	const struct fdpass_msg *msg = arg->u1.const_vp;
+	size_t i;
+
+	for (i = 0; i < msg->num_fds; i++)
+		close(msg->fds[i]);
+}
+
+static int do_fds_send(int fd, struct io_plan_arg *arg)
+{
+	if (!fdpass_send_fds(fd, arg->u1.const_vp)) {
+		/* In case ccan/io ever gets smart with non-blocking. */
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		return -1;
+	}
+	if (arg->u2.vp) {
+		struct io_conn *conn = arg->u2.vp;
+		destroy_conn_close_send_fds(conn, arg);
+		tal_del_destructor2(conn, destroy_conn_close_send_fds, arg);
+	}
+	return 1;
+}
+
+struct io_plan *io_send_fds_(struct io_conn *conn,
+			     const struct fdpass_msg *msg,
+			     bool fdclose,
+			     struct io_plan *(*next)(struct io_conn *, void *),
+			     void *next_arg)
+{
+	struct io_plan_arg *arg = io_plan_arg(conn, IO_OUT);
+
+	arg->u1.const_vp = msg;
+	/* We need conn ptr for destructor */
+	arg->u2.vp = fdclose ? conn : NULL;
+	/* If conn closes before sending, we still need to close fds */
+	if (fdclose)
+		tal_add_destructor2(conn, destroy_conn_close_send_fds, arg);
+
+	return io_set_plan(conn, IO_OUT, do_fds_send, next, next_arg);
+}
+
+static int do_fds_recv(int fd, struct io_plan_arg *arg)
+{
+	struct fdpass_msg *msg = arg->u1.vp;
+
+	if (!fdpass_recv_fds(fd, msg)) {
+		/* In case ccan/io ever gets smart with non-blocking. */
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		/* If they can't handle the error, this will close conn! */
+		if (!io_get_extended_errors())
+			return -1;
+		msg->num_fds = 0;
+	}
+	return 1;
+}
+
+struct io_plan *io_recv_fds_(struct io_conn *conn,
+			     struct fdpass_msg *msg,
+			     struct io_plan *(*next)(struct io_conn *, void *),
+			     void *next_arg)
+{
+	struct io_plan_arg *arg = io_plan_arg(conn, IO_IN);
+
+	arg->u1.vp = msg;
+
+	return io_set_plan(conn, IO_IN, do_fds_recv, next, next_arg);
+}
@@ -2,6 +2,7 @@
 #ifndef CCAN_IO_FDPASS_H
 #define CCAN_IO_FDPASS_H
 #include <ccan/io/io.h>
+#include <ccan/fdpass/fdpass.h>
 
 /**
  * io_send_fd - output plan to send a file descriptor
@@ -67,4 +68,75 @@ struct io_plan *io_recv_fd_(struct io_conn *conn,
 			    int *fd,
 			    struct io_plan *(*next)(struct io_conn *, void *),
 			    void *arg);
+
+/**
+ * io_send_fds - output plan to send several file descriptors (and data)
+ * @conn: the connection that plan is for.
+ * @msg: the file descriptors and data to send.
+ * @fdclose: true to close the file descriptors after successful sending.
+ * @next: function to call output is done.
+ * @arg: @next argument
+ *
+ * This is io_send_fd() for a whole struct fdpass_msg: up to
+ * FDPASS_MAX_FDS descriptors, and some data, in a single message (see
+ * fdpass_send_fds()).  @msg must stay around until @next is called.
+ *
+ * The other end must use io_recv_fds (or fdpass_recv_fds).
+ *
+ * Example:
+ * static struct io_plan *hand_off(struct io_conn *conn,
+ *				   struct fdpass_msg *msg)
+ * {
+ *	// Send them all, close them here, then close conn.
+ *	return io_send_fds(conn, msg, true, io_close_cb, NULL);
+ * }
+ */
+#define io_send_fds(conn, msg, fdclose, next, arg)			\
+	io_send_fds_((conn), (msg), (fdclose),				\
+		     typesafe_cb_preargs(struct io_plan *, void *,	\
+					 (next), (arg), struct io_conn *), \
+		     (arg))
+struct io_plan *io_send_fds_(struct io_conn *conn,
+			     const struct fdpass_msg *msg, bool fdclose,
+			     struct io_plan *(*next)(struct io_conn *, void *),
+			     void *arg);
+
+/**
+ * io_recv_fds - input plan to receive several file descriptors (and data)
+ * @conn: the connection that plan is for.
+ * @msg: where to put the file descriptors and data.
+ * @next: function to call once input is done.
+ * @arg: @next argument
+ *
+ * This creates a plan to receive a message sent by io_send_fds, setting
+ * @msg->num_fds and @msg->len to what arrived (see fdpass_recv_fds()).
+ * On an error, if io_get_extended_errors() is true, then @next is called
+ * and @msg->num_fds will be 0, otherwise the finish function is called.
+ *
+ * Example:
+ * static struct io_plan *got_fds(struct io_conn *conn,
+ *				  struct fdpass_msg *msg)
+ * {
+ *	size_t i;
+ *
+ *	for (i = 0; i < msg->num_fds; i++)
+ *		close(msg->fds[i]);
+ *	return io_close(conn);
+ * }
+ *
+ * static struct io_plan *take_fds(struct io_conn *conn,
+ *				   struct fdpass_msg *msg)
+ * {
+ *	return io_recv_fds(conn, msg, got_fds, msg);
+ * }
+ */
+#define io_recv_fds(conn, msg, next, arg)				\
+	io_recv_fds_((conn), (msg),					\
+		     typesafe_cb_preargs(struct io_plan *, void *,	\
+					 (next), (arg), struct io_conn *), \
+		     (arg))
+struct io_plan *io_recv_fds_(struct io_conn *conn,
+			     struct fdpass_msg *msg,
+			     struct io_plan *(*next)(struct io_conn *, void *),
+			     void *arg);
 #endif /* CCAN_IO_FDPASS_H */
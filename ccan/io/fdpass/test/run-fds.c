@@ -0,0 +1,112 @@
+#include <ccan/io/fdpass/fdpass.h>
+/* Include the C files directly. */
+#include <ccan/io/fdpass/fdpass.c>
+#include <ccan/tap/tap.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+
+struct pipes {
+	int fds[3];
+	int wfds[3];
+	char data[4];
+	struct fdpass_msg msg;
+};
+
+static struct io_plan *try_reading(struct io_conn *conn, struct pipes *in)
+{
+	char buf[6];
+	int i;
+
+	ok1(in->msg.num_fds == 3);
+	ok1(in->msg.len == 3 && memcmp(in->data, "abc", 3) == 0);
+	for (i = 0; i < 3; i++) {
+		if (read(in->fds[i], buf, sizeof(buf)) != sizeof(buf)
+		    || memcmp(buf, "hello!", sizeof(buf)) != 0)
+			break;
+		close(in->fds[i]);
+	}
+	ok1(i == 3);
+	return io_close(conn);
+}
+
+static struct io_plan *get_fds(struct io_conn *conn, struct pipes *in)
+{
+	in->msg.fds = in->fds;
+	in->msg.num_fds = 3;
+	in->msg.data = in->data;
+	in->msg.len = sizeof(in->data);
+	return io_recv_fds(conn, &in->msg, try_reading, in);
+}
+
+static struct io_plan *try_writing(struct io_conn *conn, struct pipes *out)
+{
+	int i;
+
+	/* They were closed for us. */
+	ok1(fcntl(out->fds[0], F_GETFD) == -1 && errno == EBADF);
+	for (i = 0; i < 3; i++) {
+		if (write(out->wfds[i], "hello!", 6) != 6)
+			break;
+		close(out->wfds[i]);
+	}
+	ok1(i == 3);
+	return io_close(conn);
+}
+
+static struct io_plan *send_fds(struct io_conn *conn, struct pipes *out)
+{
+	out->msg.fds = out->fds;
+	out->msg.num_fds = 3;
+	memcpy(out->data, "abc", 3);
+	out->msg.data = out->data;
+	out->msg.len = 3;
+	return io_send_fds(conn, &out->msg, true, try_writing, out);
+}
+
+static struct io_plan *got_nothing(struct io_conn *conn, struct pipes *in)
+{
+	ok1(in->msg.num_fds == 0);
+	return io_close(conn);
+}
+
+static struct io_plan *get_nothing(struct io_conn *conn, struct pipes *in)
+{
+	in->msg.fds = in->fds;
+	in->msg.num_fds = 3;
+	in->msg.data = NULL;
+	in->msg.len = 0;
+	return io_recv_fds(conn, &in->msg, got_nothing, in);
+}
+
+int main(void)
+{
+	struct pipes in, out;
+	int sv[2], pfd[2];
+	int i;
+
+	plan_tests(8);
+	ok1(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	for (i = 0; i < 3; i++) {
+		if (pipe(pfd) != 0)
+			abort();
+		out.fds[i] = pfd[0];
+		out.wfds[i] = pfd[1];
+	}
+
+	/* Pass read ends of pipes to ourselves, test. */
+	io_new_conn(NULL, sv[0], get_fds, &in);
+	io_new_conn(NULL, sv[1], send_fds, &out);
+
+	io_loop(NULL, NULL);
+
+	/* With extended errors, the other end closing means no fds. */
+	ok1(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	close(sv[1]);
+	io_set_extended_errors(true);
+	io_new_conn(NULL, sv[0], get_nothing, &in);
+	io_loop(NULL, NULL);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,485 @@
+/* GNU LGPL version 2 (or later) - see LICENSE file for details */
+#include <ccan/io/net/net.h>
+#include <ccan/list/list.h>
+#include <ccan/str/str.h>
+#include <ccan/tal/str/str.h>
+#include <ccan/timer/timer.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+struct race_addr {
+	int family, socktype, protocol;
+	socklen_t addrlen;
+	struct sockaddr_storage addr;
+};
+
+struct attempt {
+	struct list_node list;
+	struct io_race *race;
+	struct io_conn *conn;
+	const struct race_addr *addr;
+};
+
+struct io_race {
+	/* On the races list, so io_race_expired() can find us. */
+	struct list_node list;
+	struct timers *timers;
+	struct timer timer;
+	struct timerel delay;
+
+	/* Addresses in the order to try them, and the next one to try. */
+	struct race_addr *addrs;
+	size_t next;
+
+	/* Attempts still connecting. */
+	struct list_head attempts;
+	int err;
+	/* Inside start_next(): it cleans up failed attempts itself. */
+	bool in_start;
+	/* Still inside io_race_connect_(): don't call fail. */
+	bool starting, failed;
+
+	struct io_plan *(*init)(struct io_conn *, void *);
+	void (*fail)(void *arg, int err);
+	void *arg;
+};
+
+static LIST_HEAD(races);
+
+static bool usable(const struct addrinfo *ai)
+{
+	return (ai->ai_family == AF_INET || ai->ai_family == AF_INET6)
+		&& ai->ai_addrlen <= sizeof(struct sockaddr_storage);
+}
+
+/* RFC 8305 section 4: alternate between the address families, starting
+ * with whichever getaddrinfo() put first, otherwise keeping its order. */
+static struct race_addr *order_addrs(const tal_t *ctx,
+				     const struct addrinfo *addrinfo)
+{
+	const struct addrinfo *ai, *next[2];
+	struct race_addr *addrs;
+	size_t n = 0, i;
+	int first = 0;
+
+	for (ai = addrinfo; ai; ai = ai->ai_next) {
+		if (!usable(ai))
+			continue;
+		if (!n++)
+			first = ai->ai_family;
+	}
+
+	addrs = tal_arr(ctx, struct race_addr, n);
+	if (!addrs)
+		return NULL;
+
+	/* next[0] walks the first family, next[1] the other one. */
+	next[0] = next[1] = addrinfo;
+	for (i = 0; i < n; i++) {
+		int which = i % 2;
+
+		for (;;) {
+			while (next[which] && (!usable(next[which])
+					       || (next[which]->ai_family == first)
+					       != !which))
+				next[which] = next[which]->ai_next;
+			if (next[which])
+				break;
+			/* That family has run out: finish with the other. */
+			which = !which;
+		}
+
+		ai = next[which];
+		next[which] = ai->ai_next;
+		addrs[i].family = ai->ai_family;
+		addrs[i].socktype = ai->ai_socktype;
+		addrs[i].protocol = ai->ai_protocol;
+		addrs[i].addrlen = ai->ai_addrlen;
+		memcpy(&addrs[i].addr, ai->ai_addr, ai->ai_addrlen);
+	}
+	return addrs;
+}
+
+static void destroy_race(struct io_race *race)
+{
+	struct attempt *att;
+
+	list_del(&race->list);
+	timer_del(race->timers, &race->timer);
+
+	/* Losers (or everyone, if we're abandoned) just go away. */
+	list_for_each(&race->attempts, att, list) {
+		io_set_finish(att->conn, NULL, NULL);
+		tal_free(att->conn);
+	}
+}
+
+static void race_failed(struct io_race *race)
+{
+	if (race->starting) {
+		race->failed = true;
+		return;
+	}
+	race->fail(race->arg, race->err);
+	tal_free(race);
+}
+
+static void attempt_failed(struct io_conn *conn, struct attempt *att);
+
+static struct io_plan *attempt_connected(struct io_conn *conn,
+					 struct attempt *att)
+{
+	struct io_race *race = att->race;
+	struct io_plan *(*init)(struct io_conn *, void *) = race->init;
+	void *arg = race->arg;
+
+	list_del(&att->list);
+	io_set_finish(conn, NULL, NULL);
+	tal_steal(tal_parent(race), conn);
+	tal_free(race);
+
+	return init(conn, arg);
+}
+
+static struct io_plan *attempt_init(struct io_conn *conn, struct attempt *att)
+{
+	struct addrinfo ai;
+
+	memset(&ai, 0, sizeof(ai));
+	ai.ai_family = att->addr->family;
+	ai.ai_socktype = att->addr->socktype;
+	ai.ai_protocol = att->addr->protocol;
+	ai.ai_addrlen = att->addr->addrlen;
+	ai.ai_addr = (struct sockaddr *)&att->addr->addr;
+
+	att->conn = conn;
+	list_add_tail(&att->race->attempts, &att->list);
+	io_set_finish(conn, attempt_failed, att);
+	return io_connect(conn, &ai, attempt_connected, att);
+}
+
+/* Start attempts until one is in flight or we run out of addresses. */
+static void start_next(struct io_race *race)
+{
+	timer_del(race->timers, &race->timer);
+
+	race->in_start = true;
+	while (race->next < tal_count(race->addrs)) {
+		const struct race_addr *addr = &race->addrs[race->next++];
+		struct attempt *att;
+		int fd;
+
+		fd = socket(addr->family, addr->socktype, addr->protocol);
+		if (fd < 0) {
+			race->err = errno;
+			continue;
+		}
+
+		att = tal(race, struct attempt);
+		if (!att) {
+			race->err = errno;
+			close(fd);
+			continue;
+		}
+		att->race = race;
+		att->addr = addr;
+		att->conn = NULL;
+
+		/* If connect fails at once, attempt_failed() has run. */
+		if (io_new_conn(race, fd, attempt_init, att)) {
+			race->in_start = false;
+			timer_addrel(race->timers, &race->timer, race->delay);
+			return;
+		}
+		if (!att->conn) {
+			race->err = errno;
+			close(fd);
+		}
+		tal_free(att);
+	}
+	race->in_start = false;
+
+	if (list_empty(&race->attempts))
+		race_failed(race);
+}
+
+static void attempt_failed(struct io_conn *conn, struct attempt *att)
+{
+	struct io_race *race = att->race;
+
+	race->err = errno;
+	list_del(&att->list);
+	att->conn = conn;
+
+	/* Don't wait for the timer: the next one can go now. */
+	if (!race->in_start) {
+		tal_free(att);
+		start_next(race);
+	}
+}
+
+struct io_race *io_race_connect_(const tal_t *ctx,
+				 struct timers *timers,
+				 const struct addrinfo *addrinfo,
+				 struct timerel delay,
+				 struct io_plan *(*init)(struct io_conn *,
+							 void *),
+				 void (*fail)(void *arg, int err),
+				 void *arg)
+{
+	struct io_race *race = tal(ctx, struct io_race);
+
+	if (!race)
+		return NULL;
+
+	race->addrs = order_addrs(race, addrinfo);
+	if (!race->addrs)
+		return tal_free(race);
+
+	race->timers = timers;
+	timer_init(&race->timer);
+	race->delay = delay;
+	race->next = 0;
+	list_head_init(&race->attempts);
+	/* In case we found nothing. */
+	race->err = ENOENT;
+	race->in_start = race->failed = false;
+	race->init = init;
+	race->fail = fail;
+	race->arg = arg;
+	list_add(&races, &race->list);
+	tal_add_destructor(race, destroy_race);
+
+	/* Failures before we return don't call fail, they return NULL. */
+	race->starting = true;
+	start_next(race);
+	race->starting = false;
+
+	if (race->failed) {
+		errno = race->err;
+		return tal_free(race);
+	}
+	return race;
+}
+
+bool io_race_expired(struct timer *expired)
+{
+	struct io_race *race;
+
+	list_for_each(&races, race, list) {
+		if (&race->timer == expired) {
+			start_next(race);
+			return true;
+		}
+	}
+	return false;
+}
+
+struct dns_entry {
+	struct list_node list;
+	char *hostname, *service;
+	int family, socktype;
+	struct addrinfo *addrinfo;
+	struct timemono expires;
+};
+
+struct io_dns_cache {
+	/* Most recently used first. */
+	struct list_head entries;
+	size_t num, max;
+	struct timerel ttl;
+};
+
+static void destroy_dns_entry(struct dns_entry *e)
+{
+	freeaddrinfo(e->addrinfo);
+}
+
+struct io_dns_cache *io_dns_cache_new(const tal_t *ctx, struct timerel ttl,
+				      size_t max_entries)
+{
+	struct io_dns_cache *cache = tal(ctx, struct io_dns_cache);
+
+	if (!cache)
+		return NULL;
+
+	list_head_init(&cache->entries);
+	cache->num = 0;
+	cache->max = max_entries;
+	cache->ttl = ttl;
+	return cache;
+}
+
+static void dns_entry_del(struct io_dns_cache *cache, struct dns_entry *e)
+{
+	list_del(&e->list);
+	cache->num--;
+	tal_free(e);
+}
+
+const struct addrinfo *io_dns_lookup(struct io_dns_cache *cache,
+				     const char *hostname,
+				     const char *service,
+				     int family, int socktype)
+{
+	struct timemono now = time_mono();
+	struct dns_entry *e, *next;
+	struct addrinfo *addrinfo;
+
+	list_for_each_safe(&cache->entries, e, next, list) {
+		if (!timemono_before(now, e->expires)) {
+			dns_entry_del(cache, e);
+			continue;
+		}
+		if (e->family == family && e->socktype == socktype
+		    && streq(e->hostname, hostname)
+		    && streq(e->service, service)) {
+			list_del(&e->list);
+			list_add(&cache->entries, &e->list);
+			return e->addrinfo;
+		}
+	}
+
+	addrinfo = net_client_lookup(hostname, service, family, socktype);
+	if (!addrinfo)
+		return NULL;
+
+	e = tal(cache, struct dns_entry);
+	if (!e)
+		goto out;
+	e->hostname = tal_strdup(e, hostname);
+	e->service = tal_strdup(e, service);
+	if (!e->hostname || !e->service) {
+		tal_free(e);
+		goto out;
+	}
+	e->family = family;
+	e->socktype = socktype;
+	e->addrinfo = addrinfo;
+	e->expires = timemono_add(now, cache->ttl);
+	tal_add_destructor(e, destroy_dns_entry);
+	list_add(&cache->entries, &e->list);
+
+	if (++cache->num > cache->max)
+		dns_entry_del(cache, list_tail(&cache->entries,
+					       struct dns_entry, list));
+	return addrinfo;
+
+out:
+	freeaddrinfo(addrinfo);
+	return NULL;
+}
+
+struct pool_entry {
+	struct list_node list;
+	char *key;
+	int fd;
+	struct timemono idle_since;
+};
+
+struct io_pool {
+	/* Most recently released first. */
+	struct list_head idle;
+	size_t num, max;
+	struct timerel timeout;
+};
+
+static void destroy_pool_entry(struct pool_entry *e)
+{
+	close(e->fd);
+}
+
+struct io_pool *io_pool_new(const tal_t *ctx, size_t max_idle,
+			    struct timerel idle_timeout)
+{
+	struct io_pool *pool = tal(ctx, struct io_pool);
+
+	if (!pool)
+		return NULL;
+
+	list_head_init(&pool->idle);
+	pool->num = 0;
+	pool->max = max_idle;
+	pool->timeout = idle_timeout;
+	return pool;
+}
+
+static void pool_entry_del(struct io_pool *pool, struct pool_entry *e)
+{
+	list_del(&e->list);
+	pool->num--;
+	tal_free(e);
+}
+
+static bool pool_entry_expired(const struct io_pool *pool,
+			       const struct pool_entry *e,
+			       struct timemono now)
+{
+	return !timemono_before(now, timemono_add(e->idle_since,
+						  pool->timeout));
+}
+
+struct io_plan *io_pool_release(struct io_conn *conn, struct io_pool *pool,
+				const char *key)
+{
+	struct timemono now = time_mono();
+	struct pool_entry *e, *next;
+
+	list_for_each_safe(&pool->idle, e, next, list) {
+		if (pool_entry_expired(pool, e, now))
+			pool_entry_del(pool, e);
+	}
+
+	e = tal(pool, struct pool_entry);
+	if (!e)
+		return io_close(conn);
+	e->key = tal_strdup(e, key);
+	if (!e->key) {
+		tal_free(e);
+		return io_close(conn);
+	}
+	e->fd = io_conn_fd(conn);
+	e->idle_since = now;
+	tal_add_destructor(e, destroy_pool_entry);
+	list_add(&pool->idle, &e->list);
+
+	if (++pool->num > pool->max)
+		pool_entry_del(pool, list_tail(&pool->idle,
+					       struct pool_entry, list));
+	return io_close_taken_fd(conn);
+}
+
+/* An idle connection should have nothing to say: if it's readable, the
+ * other end has hung up (or is confused). */
+static bool still_idle(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, 0) == 0;
+}
+
+int io_pool_take(struct io_pool *pool, const char *key)
+{
+	struct timemono now = time_mono();
+	struct pool_entry *e, *next;
+	int fd;
+
+	list_for_each_safe(&pool->idle, e, next, list) {
+		if (!streq(e->key, key))
+			continue;
+		if (pool_entry_expired(pool, e, now) || !still_idle(e->fd)) {
+			pool_entry_del(pool, e);
+			continue;
+		}
+		fd = e->fd;
+		tal_del_destructor(e, destroy_pool_entry);
+		pool_entry_del(pool, e);
+		return fd;
+	}
+	return -1;
+}
@@ -0,0 +1,230 @@
+/* GNU LGPL version 2 (or later) - see LICENSE file for details */
+#ifndef CCAN_IO_NET_H
+#define CCAN_IO_NET_H
+#include <ccan/io/io.h>
+#include <ccan/net/net.h>
+#include <ccan/time/time.h>
+
+/* RFC 8305 recommends 250 milliseconds between connection attempts. */
+#define IO_RACE_DELAY_MSEC 250
+
+/**
+ * struct io_race - a connection race in progress.
+ */
+struct io_race;
+
+/**
+ * io_race_connect - race connections to each address (Happy Eyeballs)
+ * @ctx: the context to tal from (or NULL)
+ * @timers: the timers handed to io_loop().
+ * @addrinfo: linked list of addresses (usually from net_client_lookup).
+ * @delay: how long to wait for one attempt before starting the next.
+ * @init: function to call for the winning connection.
+ * @fail: function to call if every attempt fails.
+ * @arg: argument to @init and @fail.
+ *
+ * This connects to @addrinfo the way RFC 8305 describes: the addresses
+ * are tried alternating between IPv6 and IPv4 (starting with whichever
+ * family comes first in @addrinfo), and a new attempt is started
+ * whenever @delay passes or the previous attempt fails, without
+ * abandoning the ones already in flight.  The first to connect wins: the
+ * others are closed, and @init is called for the new connection just
+ * as io_new_conn() would (the connection is allocated off @ctx).
+ *
+ * If every attempt fails, @fail is called with the errno of the last
+ * failure.  The addresses are copied, so @addrinfo can be freed as soon
+ * as this returns.
+ *
+ * Timers expire through io_loop(), so hand every expired timer to
+ * io_race_expired() before treating it as one of your own.
+ *
+ * Returns NULL (and sets errno) if every address fails immediately;
+ * neither @init nor @fail are called then.  Freeing the returned race
+ * abandons it (calling neither).
+ *
+ * Example:
+ * static struct io_plan *connected(struct io_conn *conn, char *host)
+ * {
+ *	printf("Connected to %s\n", host);
+ *	return io_close(conn);
+ * }
+ *
+ * static void failed(char *host, int err)
+ * {
+ *	printf("Could not connect to %s: %s\n", host, strerror(err));
+ * }
+ *
+ * static void connect_to(struct timers *timers, char *host)
+ * {
+ *	struct addrinfo *addrinfo;
+ *
+ *	addrinfo = net_client_lookup(host, "http", AF_UNSPEC, SOCK_STREAM);
+ *	if (!addrinfo)
+ *		errx(1, "Failed to look up %s", host);
+ *	if (!io_race_connect(NULL, timers, addrinfo,
+ *			     time_from_msec(IO_RACE_DELAY_MSEC),
+ *			     connected, failed, host))
+ *		err(1, "Failed to connect to %s", host);
+ *	freeaddrinfo(addrinfo);
+ * }
+ */
+#define io_race_connect(ctx, timers, addrinfo, delay, init, fail, arg)	\
+	io_race_connect_((ctx), (timers), (addrinfo), (delay),		\
+			 typesafe_cb_preargs(struct io_plan *, void *,	\
+					     (init), (arg),		\
+					     struct io_conn *),		\
+			 typesafe_cb_postargs(void, void *, (fail), (arg), \
+					      int),			\
+			 (arg))
+struct io_race *io_race_connect_(const tal_t *ctx,
+				 struct timers *timers,
+				 const struct addrinfo *addrinfo,
+				 struct timerel delay,
+				 struct io_plan *(*init)(struct io_conn *,
+							 void *),
+				 void (*fail)(void *arg, int err),
+				 void *arg);
+
+/**
+ * io_race_expired - handle a timer which belongs to a connection race.
+ * @expired: the timer returned by io_loop().
+ *
+ * Returns false if @expired isn't one of ours; otherwise it starts the
+ * next connection attempt and returns true.
+ *
+ * Example:
+ * static void run(struct timers *timers)
+ * {
+ *	struct timer *expired;
+ *
+ *	while (!io_loop(timers, &expired)) {
+ *		if (!expired)
+ *			break;
+ *		if (!io_race_expired(expired))
+ *			abort();
+ *	}
+ * }
+ */
+bool io_race_expired(struct timer *expired);
+
+/**
+ * struct io_dns_cache - remembered name lookups.
+ */
+struct io_dns_cache;
+
+/**
+ * io_dns_cache_new - create a cache in front of net_client_lookup()
+ * @ctx: the context to tal from (or NULL)
+ * @ttl: how long an answer may be reused.
+ * @max_entries: how many answers to keep.
+ *
+ * getaddrinfo() doesn't tell us the record's TTL, so answers are kept
+ * for @ttl: use something no longer than the TTLs you expect to see.
+ * Failed lookups are not cached.  tal_free() the cache to free it.
+ *
+ * Example:
+ *	struct io_dns_cache *cache;
+ *
+ *	cache = io_dns_cache_new(NULL, time_from_sec(30), 64);
+ *	if (!cache)
+ *		err(1, "Creating DNS cache");
+ */
+struct io_dns_cache *io_dns_cache_new(const tal_t *ctx, struct timerel ttl,
+				      size_t max_entries);
+
+/**
+ * io_dns_lookup - look up a name to connect to, through a cache.
+ * @cache: the cache from io_dns_cache_new().
+ * @hostname: the name to look up
+ * @service: the service to look up
+ * @family: Usually AF_UNSPEC, otherwise AF_INET or AF_INET6.
+ * @socktype: SOCK_DGRAM or SOCK_STREAM.
+ *
+ * This returns the answer net_client_lookup() gave for the same
+ * question, if it is younger than the cache's ttl, otherwise it asks
+ * again.  The answer belongs to the cache: it is valid until the next
+ * io_dns_lookup() on @cache, so don't freeaddrinfo() it.
+ *
+ * Returns NULL on error.
+ *
+ * Example:
+ *	const struct addrinfo *addr;
+ *
+ *	addr = io_dns_lookup(cache, "ccan.ozlabs.org", "http",
+ *			     AF_UNSPEC, SOCK_STREAM);
+ *	if (!addr)
+ *		errx(1, "Failed to look up ccan.ozlabs.org");
+ */
+const struct addrinfo *io_dns_lookup(struct io_dns_cache *cache,
+				     const char *hostname,
+				     const char *service,
+				     int family, int socktype);
+
+/**
+ * struct io_pool - idle connections, waiting to be reused.
+ */
+struct io_pool;
+
+/**
+ * io_pool_new - create a pool of idle connections
+ * @ctx: the context to tal from (or NULL)
+ * @max_idle: the most connections to keep (the oldest go first).
+ * @idle_timeout: how long a connection may sit idle.
+ *
+ * tal_free() the pool to close every connection in it.
+ *
+ * Example:
+ *	struct io_pool *pool;
+ *
+ *	pool = io_pool_new(NULL, 16, time_from_sec(60));
+ *	if (!pool)
+ *		err(1, "Creating connection pool");
+ */
+struct io_pool *io_pool_new(const tal_t *ctx, size_t max_idle,
+			    struct timerel idle_timeout);
+
+/**
+ * io_pool_release - plan to put a connection's fd into a pool
+ * @conn: the connection, which is finished with for now.
+ * @pool: the pool from io_pool_new().
+ * @key: what it's connected to (eg. "host:port").
+ *
+ * This closes @conn without closing its fd, and keeps the fd in @pool
+ * for io_pool_take() to hand out again.  The finish function is called
+ * as usual.
+ *
+ * Example:
+ * static struct io_plan *request_done(struct io_conn *conn,
+ *				       struct io_pool *pool)
+ * {
+ *	return io_pool_release(conn, pool, "ccan.ozlabs.org:http");
+ * }
+ */
+struct io_plan *io_pool_release(struct io_conn *conn, struct io_pool *pool,
+				const char *key);
+
+/**
+ * io_pool_take - take an idle fd out of a pool
+ * @pool: the pool from io_pool_new().
+ * @key: the key given to io_pool_release().
+ *
+ * Returns the most recently released fd for @key, or -1 if there isn't
+ * one.  Connections which have idled too long, or which the other end
+ * has closed (or written to) while idle, are closed rather than
+ * returned.  The fd now belongs to the caller: hand it to io_new_conn().
+ *
+ * Example:
+ * static struct io_plan *send_request(struct io_conn *conn, void *unused)
+ * {
+ *	return io_write(conn, "GET / HTTP/1.1\r\n\r\n", 18, io_close_cb, NULL);
+ * }
+ *
+ * static bool reuse(struct io_pool *pool)
+ * {
+ *	int fd = io_pool_take(pool, "ccan.ozlabs.org:http");
+ *
+ *	return fd >= 0 && io_new_conn(NULL, fd, send_request, NULL);
+ * }
+ */
+int io_pool_take(struct io_pool *pool, const char *key);
+#endif /* CCAN_IO_NET_H */
@@ -0,0 +1,226 @@
+#include <ccan/io/net/net.h>
+/* Include the C files directly. */
+#include <ccan/io/net/net.c>
+#include <ccan/tap/tap.h>
+#include <ccan/timer/timer.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#define DELAY_MSEC 100
+
+/* A listener on an ephemeral loopback port.  With stall set, its
+ * backlog is full, so further connects hang until we give up. */
+static int listener(bool stall, struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)addr, sizeof(*addr)) != 0
+	    || listen(fd, stall ? 0 : 5) != 0
+	    || getsockname(fd, (struct sockaddr *)addr, &len) != 0)
+		abort();
+
+	if (stall) {
+		/* One fills the queue (Linux lets backlog+1 through). */
+		int c = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(c, (struct sockaddr *)addr, sizeof(*addr)) != 0)
+			abort();
+	}
+	return fd;
+}
+
+/* A port nobody is listening on. */
+static void refused(struct sockaddr_in *addr)
+{
+	close(listener(false, addr));
+}
+
+static struct addrinfo *addrs(size_t n, struct sockaddr_in *sin)
+{
+	struct addrinfo *ai = calloc(n, sizeof(*ai));
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		ai[i].ai_family = AF_INET;
+		ai[i].ai_socktype = SOCK_STREAM;
+		ai[i].ai_addrlen = sizeof(sin[i]);
+		ai[i].ai_addr = (struct sockaddr *)&sin[i];
+		ai[i].ai_next = i + 1 < n ? &ai[i+1] : NULL;
+	}
+	return ai;
+}
+
+struct result {
+	int port, err;
+	struct timemono start;
+	struct timerel took;
+};
+
+static struct io_plan *won(struct io_conn *conn, struct result *r)
+{
+	struct sockaddr_in peer;
+	socklen_t len = sizeof(peer);
+
+	getpeername(io_conn_fd(conn), (struct sockaddr *)&peer, &len);
+	r->port = ntohs(peer.sin_port);
+	r->took = timemono_since(r->start);
+	return io_close(conn);
+}
+
+static void lost(struct result *r, int err)
+{
+	r->err = err;
+	r->took = timemono_since(r->start);
+}
+
+static struct io_race *race(struct timers *timers, struct addrinfo *ai,
+			    struct result *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->start = time_mono();
+	return io_race_connect(NULL, timers, ai, time_from_msec(DELAY_MSEC),
+			       won, lost, r);
+}
+
+static void run(struct timers *timers)
+{
+	struct timer *expired;
+
+	while (!io_loop(timers, &expired) && expired) {
+		if (!io_race_expired(expired))
+			abort();
+	}
+}
+
+static struct io_plan *release(struct io_conn *conn, struct io_pool *pool)
+{
+	return io_pool_release(conn, pool, "here");
+}
+
+int main(void)
+{
+	struct sockaddr_in sin[4], in6[2];
+	struct addrinfo *ai, mixed[4];
+	struct race_addr *order;
+	struct io_dns_cache *cache;
+	const struct addrinfo *a1, *a2;
+	struct io_pool *pool;
+	struct timers timers;
+	struct timemono expires;
+	struct result r;
+	int fds[2], fd, other;
+
+	/* This is how many tests you plan to run */
+	plan_tests(29);
+
+	timers_init(&timers, time_mono());
+
+	/* Families alternate, starting with the first one given. */
+	memset(sin, 0, sizeof(sin));
+	ai = addrs(2, sin);
+	memset(in6, 0, sizeof(in6));
+	mixed[0] = ai[0];
+	mixed[0].ai_family = AF_INET6;
+	mixed[0].ai_addr = (struct sockaddr *)&in6[0];
+	mixed[1] = mixed[0];
+	mixed[1].ai_addr = (struct sockaddr *)&in6[1];
+	mixed[2] = ai[0];
+	mixed[3] = ai[1];
+	mixed[0].ai_next = &mixed[1];
+	mixed[1].ai_next = &mixed[2];
+	mixed[2].ai_next = &mixed[3];
+	mixed[3].ai_next = NULL;
+	order = order_addrs(NULL, mixed);
+	ok1(tal_count(order) == 4);
+	ok1(order[0].family == AF_INET6
+	    && !memcmp(&order[0].addr, &in6[0], sizeof(in6[0])));
+	ok1(order[1].family == AF_INET
+	    && !memcmp(&order[1].addr, &sin[0], sizeof(sin[0])));
+	ok1(order[2].family == AF_INET6
+	    && !memcmp(&order[2].addr, &in6[1], sizeof(in6[1])));
+	ok1(order[3].family == AF_INET
+	    && !memcmp(&order[3].addr, &sin[1], sizeof(sin[1])));
+	tal_free(order);
+	free(ai);
+
+	/* A stalled address loses to the next one after the delay. */
+	fds[0] = listener(true, &sin[0]);
+	fds[1] = listener(false, &sin[1]);
+	ai = addrs(2, sin);
+	ok1(race(&timers, ai, &r));
+	free(ai);
+	run(&timers);
+	ok1(r.port == ntohs(sin[1].sin_port));
+	ok1(time_to_msec(r.took) >= DELAY_MSEC);
+	ok1(time_to_msec(r.took) < 10 * DELAY_MSEC);
+
+	/* Refused addresses don't wait for the delay. */
+	refused(&sin[0]);
+	ai = addrs(2, sin);
+	ok1(race(&timers, ai, &r));
+	free(ai);
+	run(&timers);
+	ok1(r.port == ntohs(sin[1].sin_port));
+	ok1(time_to_msec(r.took) < DELAY_MSEC);
+
+	/* When they all fail, we hear about the last failure. */
+	refused(&sin[1]);
+	ai = addrs(2, sin);
+	ok1(race(&timers, ai, &r));
+	run(&timers);
+	ok1(r.port == 0 && r.err == ECONNREFUSED);
+	ok1(time_to_msec(r.took) < DELAY_MSEC);
+
+	/* Abandoning the race calls nothing. */
+	ok1(tal_free(race(&timers, ai, &r)) == NULL);
+	ok1(io_loop(NULL, NULL) == NULL);
+	ok1(r.port == 0 && r.err == 0);
+	free(ai);
+
+	/* Nor does having nothing to connect to. */
+	ai = addrs(1, sin);
+	ai->ai_family = AF_UNIX;
+	ok1(!race(&timers, ai, &r) && errno == ENOENT);
+	ok1(r.err == 0);
+	free(ai);
+	close(fds[0]);
+	close(fds[1]);
+
+	/* The cache answers from memory until the ttl runs out. */
+	cache = io_dns_cache_new(NULL, time_from_msec(DELAY_MSEC), 1);
+	a1 = io_dns_lookup(cache, "127.0.0.1", "80", AF_INET, SOCK_STREAM);
+	a2 = io_dns_lookup(cache, "127.0.0.1", "80", AF_INET, SOCK_STREAM);
+	ok1(a1 && a1 == a2);
+	io_dns_lookup(cache, "127.0.0.2", "80", AF_INET, SOCK_STREAM);
+	ok1(cache->num == 1);
+	expires = list_top(&cache->entries, struct dns_entry, list)->expires;
+	usleep(DELAY_MSEC * 1000);
+	a1 = io_dns_lookup(cache, "127.0.0.2", "80", AF_INET, SOCK_STREAM);
+	ok1(a1 && timemono_after(list_top(&cache->entries, struct dns_entry,
+					  list)->expires, expires));
+	tal_free(cache);
+
+	/* Released connections come back, until the other end hangs up. */
+	pool = io_pool_new(NULL, 2, time_from_sec(60));
+	fds[0] = listener(false, &sin[0]);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	ok1(connect(fd, (struct sockaddr *)&sin[0], sizeof(sin[0])) == 0);
+	other = accept(fds[0], NULL, NULL);
+	ok1(io_new_conn(NULL, fd, release, pool) == NULL);
+	ok1(io_pool_take(pool, "there") == -1);
+	ok1(io_pool_take(pool, "here") == fd);
+	ok1(io_new_conn(NULL, fd, release, pool) == NULL);
+	close(other);
+	ok1(io_pool_take(pool, "here") == -1 && pool->num == 0);
+	tal_free(pool);
+	close(fds[0]);
+
+	timers_cleanup(&timers);
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
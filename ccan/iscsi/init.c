@@ -118,9 +118,27 @@ int iscsi_set_targetname(struct iscsi_context *iscsi, const char *target_name)
 	return 0;
 }
 
+int iscsi_set_max_outstanding(struct iscsi_context *iscsi, int max_outstanding)
+{
+	if (iscsi == NULL) {
+		printf("Context is NULL when setting max outstanding\n");
+		return -1;
+	}
+	if (max_outstanding < 0) {
+		printf("Max outstanding can not be negative : %d\n", max_outstanding);
+		return -2;
+	}
+
+	iscsi->max_outstanding = max_outstanding;
+	iscsi_release_held_pdus(iscsi);
+
+	return 0;
+}
+
 int iscsi_destroy_context(struct iscsi_context *iscsi)
 {
 	struct iscsi_pdu *pdu;
+	int i;
 
 	if (iscsi == NULL) {
 		return 0;
@@ -143,6 +161,7 @@ int iscsi_destroy_context(struct iscsi_context *iscsi)
 	if (iscsi->inbuf != NULL) {
 		free(iscsi->inbuf);
 		iscsi->inbuf = NULL;
+		iscsi->inbuflen = 0;
 		iscsi->insize = 0;
 		iscsi->inpos = 0;
 	}
@@ -152,8 +171,15 @@ int iscsi_destroy_context(struct iscsi_context *iscsi)
 		pdu->callback(iscsi, ISCSI_STATUS_CANCELLED, NULL, pdu->private_data);
 		iscsi_free_pdu(iscsi, pdu);
 	}
-	while ((pdu = iscsi->waitpdu)) {
-	      	DLIST_REMOVE(iscsi->waitpdu, pdu);
+	for (i = 0; i < ISCSI_WAITPDU_HASHES; i++) {
+		while ((pdu = iscsi->waitpdu[i])) {
+		      	DLIST_REMOVE(iscsi->waitpdu[i], pdu);
+			pdu->callback(iscsi, ISCSI_STATUS_CANCELLED, NULL, pdu->private_data);
+			iscsi_free_pdu(iscsi, pdu);
+		}
+	}
+	while ((pdu = iscsi->holdqueue)) {
+	      	DLIST_REMOVE(iscsi->holdqueue, pdu);
 		pdu->callback(iscsi, ISCSI_STATUS_CANCELLED, NULL, pdu->private_data);
 		iscsi_free_pdu(iscsi, pdu);
 	}
@@ -23,6 +23,18 @@
 #define discard_const(ptr) ((void *)((intptr_t)(ptr)))
 #endif
 
+#define ISCSI_HEADER_SIZE			48
+
+/* Outstanding PDUs are hashed on their itt, which goes up by one per PDU */
+#define ISCSI_WAITPDU_HASHES 1024
+#define ISCSI_WAITPDU_HASH(itt) ((itt) & (ISCSI_WAITPDU_HASHES - 1))
+
+/* Most PDUs queued for output are handed to a single writev() */
+#define ISCSI_MAX_IOV 64
+
+/* Initial size of the receive buffer, which is kept for the connection */
+#define ISCSI_INBUF_MIN 65536
+
 struct iscsi_context {
        const char *initiator_name;
        const char *target_name;
@@ -41,14 +53,24 @@ struct iscsi_context {
        void *connect_data;
 
        struct iscsi_pdu *outqueue;
-       struct iscsi_pdu *waitpdu;
+       struct iscsi_pdu *waitpdu[ISCSI_WAITPDU_HASHES];
+
+       /* scsi commands wait here while max_outstanding are in flight */
+       struct iscsi_pdu *holdqueue;
+       int max_outstanding;
+       int outstanding;
 
        int insize;
        int inpos;
        unsigned char *inbuf;
-};
+       int inbuflen;
 
-#define ISCSI_HEADER_SIZE			48
+       /* a data-in payload being read straight into its buffer */
+       unsigned char direct_hdr[ISCSI_HEADER_SIZE];
+       unsigned char *direct;
+       int direct_left;
+       int direct_pad;
+};
 
 #define ISCSI_PDU_IMMEDIATE		       0x40
 
@@ -108,6 +130,12 @@ struct iscsi_pdu {
        struct iscsi_data outdata;
        struct iscsi_data indata;
 
+       /* if non-zero, indata.data has room for this much data-in, and each
+        * data-in pdu is placed at its buffer offset */
+       int indata_len;
+       /* indata.data is the caller's (see iscsi_read10_into_async) */
+       int indata_is_caller;
+
        struct iscsi_scsi_cbdata *scsi_cbdata;
 };
 
@@ -131,6 +159,8 @@ struct scsi_task;
 void iscsi_pdu_set_cdb(struct iscsi_pdu *pdu, struct scsi_task *task);
 
 int iscsi_get_pdu_size(const unsigned char *hdr);
+struct iscsi_pdu *iscsi_find_pdu(struct iscsi_context *iscsi, uint32_t itt);
+void iscsi_release_held_pdus(struct iscsi_context *iscsi);
 int iscsi_process_pdu(struct iscsi_context *iscsi, const unsigned char *hdr, int size);
 
 int iscsi_process_login_reply(struct iscsi_context *iscsi, struct iscsi_pdu *pdu, const unsigned char *hdr, int size);
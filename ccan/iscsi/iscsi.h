@@ -78,6 +78,17 @@ int iscsi_set_alias(struct iscsi_context *iscsi, const char *alias);
  */
 int iscsi_set_targetname(struct iscsi_context *iscsi, const char *targetname);
 
+/*
+ * Limit the number of scsi commands sent to the target and not yet completed.
+ * Commands issued beyond this are held by the initiator and sent, in order,
+ * as earlier ones complete. Zero, the default, means no limit.
+ *
+ * Returns:
+ *  0: success
+ * <0: error
+ */
+int iscsi_set_max_outstanding(struct iscsi_context *iscsi, int max_outstanding);
+
 
 /* Types of icsi sessions. Discovery sessions are used to query for what targets exist behind
  * the portal connected to. Normal sessions are used to log in and do I/O to the SCSI LUNs
@@ -257,6 +268,13 @@ int iscsi_testunitready_async(struct iscsi_context *iscsi, int lun, iscsi_comman
 int iscsi_inquiry_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int evpd, int page_code, int maxsize, void *private_data);
 int iscsi_readcapacity10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int lba, int pmi, void *private_data);
 int iscsi_read10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int lba, int datalen, int blocksize, void *private_data);
+
+/*
+ * As iscsi_read10_async, but the data-in is read from the socket straight into
+ * buf, which must hold datalen bytes and stay valid until the callback.
+ * task->datain.data then points into buf, and buf is not freed along with the task.
+ */
+int iscsi_read10_into_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, unsigned char *buf, int datalen, int lba, int blocksize, void *private_data);
 int iscsi_write10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, unsigned char *data, int datalen, int lba, int fua, int fuanv, int blocksize, void *private_data);
 int iscsi_modesense6_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int dbd, int pc, int page_code, int sub_page_code, unsigned char alloc_len, void *private_data);
 
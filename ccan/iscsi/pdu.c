@@ -75,7 +75,7 @@ void iscsi_free_pdu(struct iscsi_context *iscsi, struct iscsi_pdu *pdu)
 		free(pdu->outdata.data);
 		pdu->outdata.data = NULL;
 	}
-	if (pdu->indata.data) {
+	if (pdu->indata.data && !pdu->indata_is_caller) {
 		free(pdu->indata.data);
 		pdu->indata.data = NULL;
 	}
@@ -156,12 +156,40 @@ int iscsi_get_pdu_size(const unsigned char *hdr)
 }
 
 
+struct iscsi_pdu *iscsi_find_pdu(struct iscsi_context *iscsi, uint32_t itt)
+{
+	struct iscsi_pdu *pdu;
+
+	for (pdu = iscsi->waitpdu[ISCSI_WAITPDU_HASH(itt)]; pdu; pdu = pdu->next) {
+		if (pdu->itt == itt) {
+			return pdu;
+		}
+	}
+	return NULL;
+}
+
+static void iscsi_retire_pdu(struct iscsi_context *iscsi, struct iscsi_pdu *pdu)
+{
+	int is_scsi = pdu->scsi_cbdata != NULL;
+
+	DLIST_REMOVE(iscsi->waitpdu[ISCSI_WAITPDU_HASH(pdu->itt)], pdu);
+	iscsi_free_pdu(iscsi, pdu);
+
+	/* that frees up a slot for a held scsi command */
+	if (is_scsi) {
+		iscsi->outstanding--;
+		iscsi_release_held_pdus(iscsi);
+	}
+}
+
 int iscsi_process_pdu(struct iscsi_context *iscsi, const unsigned char *hdr, int size)
 {
 	uint32_t itt;
 	enum iscsi_opcode opcode;
+	enum iscsi_opcode expected_response;
 	struct iscsi_pdu *pdu;
 	uint8_t	ahslen;
+	int is_finished = 1;
 
 	opcode = hdr[0] & 0x3f;
 	ahslen = hdr[4];
@@ -172,88 +200,75 @@ int iscsi_process_pdu(struct iscsi_context *iscsi, const unsigned char *hdr, int
 		return -1;
 	}
 
-	for (pdu = iscsi->waitpdu; pdu; pdu = pdu->next) {
-		enum iscsi_opcode expected_response = pdu->response_opcode;
-		int is_finished = 1;
+	pdu = iscsi_find_pdu(iscsi, itt);
+	if (pdu == NULL) {
+		return 0;
+	}
+	expected_response = pdu->response_opcode;
 
-		if (pdu->itt != itt) {
-			continue;
-		}
+	/* we have a special case with scsi-command opcodes, the are replied to by either a scsi-response
+	 * or a data-in, or a combination of both.
+	 */
+	if (opcode == ISCSI_PDU_DATA_IN && expected_response == ISCSI_PDU_SCSI_RESPONSE) {
+		expected_response = ISCSI_PDU_DATA_IN;
+	}
 
-		/* we have a special case with scsi-command opcodes, the are replied to by either a scsi-response
-		 * or a data-in, or a combination of both.
-		 */
-		if (opcode == ISCSI_PDU_DATA_IN && expected_response == ISCSI_PDU_SCSI_RESPONSE) {
-			expected_response = ISCSI_PDU_DATA_IN;
-		}
-				
-		if (opcode != expected_response) {
-			printf("Got wrong opcode back for itt:%d  got:%d expected %d\n", itt, opcode, pdu->response_opcode);
-			return -1;
+	if (opcode != expected_response) {
+		printf("Got wrong opcode back for itt:%d  got:%d expected %d\n", itt, opcode, pdu->response_opcode);
+		return -1;
+	}
+	switch (opcode) {
+	case ISCSI_PDU_LOGIN_RESPONSE:
+		if (iscsi_process_login_reply(iscsi, pdu, hdr, size) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi login reply failed\n");
+			return -2;
 		}
-		switch (opcode) {
-		case ISCSI_PDU_LOGIN_RESPONSE:
-			if (iscsi_process_login_reply(iscsi, pdu, hdr, size) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi login reply failed\n");
-				return -2;
-			}
-			break;
-		case ISCSI_PDU_TEXT_RESPONSE:
-			if (iscsi_process_text_reply(iscsi, pdu, hdr, size) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi text reply failed\n");
-				return -2;
-			}
-			break;
-		case ISCSI_PDU_LOGOUT_RESPONSE:
-			if (iscsi_process_logout_reply(iscsi, pdu, hdr, size) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi logout reply failed\n");
-				return -3;
-			}
-			break;
-		case ISCSI_PDU_SCSI_RESPONSE:
-			if (iscsi_process_scsi_reply(iscsi, pdu, hdr, size) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi response reply failed\n");
-				return -4;
-			}
-			break;
-		case ISCSI_PDU_DATA_IN:
-			if (iscsi_process_scsi_data_in(iscsi, pdu, hdr, size, &is_finished) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi data in failed\n");
-				return -4;
-			}
-			break;
-		case ISCSI_PDU_NOP_IN:
-			if (iscsi_process_nop_out_reply(iscsi, pdu, hdr, size) != 0) {
-				DLIST_REMOVE(iscsi->waitpdu, pdu);
-				iscsi_free_pdu(iscsi, pdu);
-				printf("iscsi nop-in failed\n");
-				return -5;
-			}
-			break;
-		default:
-			printf("Don't know how to handle opcode %d\n", opcode);
+		break;
+	case ISCSI_PDU_TEXT_RESPONSE:
+		if (iscsi_process_text_reply(iscsi, pdu, hdr, size) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi text reply failed\n");
 			return -2;
 		}
-
-		if (is_finished) {
-			DLIST_REMOVE(iscsi->waitpdu, pdu);
-			iscsi_free_pdu(iscsi, pdu);
-		} else {
-			printf("pdu is not yet finished, let it remain\n");
+		break;
+	case ISCSI_PDU_LOGOUT_RESPONSE:
+		if (iscsi_process_logout_reply(iscsi, pdu, hdr, size) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi logout reply failed\n");
+			return -3;
 		}
-		return 0;
+		break;
+	case ISCSI_PDU_SCSI_RESPONSE:
+		if (iscsi_process_scsi_reply(iscsi, pdu, hdr, size) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi response reply failed\n");
+			return -4;
+		}
+		break;
+	case ISCSI_PDU_DATA_IN:
+		if (iscsi_process_scsi_data_in(iscsi, pdu, hdr, size, &is_finished) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi data in failed\n");
+			return -4;
+		}
+		break;
+	case ISCSI_PDU_NOP_IN:
+		if (iscsi_process_nop_out_reply(iscsi, pdu, hdr, size) != 0) {
+			iscsi_retire_pdu(iscsi, pdu);
+			printf("iscsi nop-in failed\n");
+			return -5;
+		}
+		break;
+	default:
+		printf("Don't know how to handle opcode %d\n", opcode);
+		return -2;
 	}
 
+	/* a read may take many data-in pdus; keep it until the last */
+	if (is_finished) {
+		iscsi_retire_pdu(iscsi, pdu);
+	}
 	return 0;
 }
 
@@ -36,7 +36,7 @@ void iscsi_free_scsi_cbdata(struct iscsi_scsi_cbdata *scsi_cbdata)
 	if (scsi_cbdata == NULL) {
 		return;
 	}
-	if (scsi_cbdata->task == NULL) {
+	if (scsi_cbdata->task != NULL) {
 		scsi_free_scsi_task(scsi_cbdata->task);
 		scsi_cbdata->task = NULL;
 	}
@@ -64,7 +64,30 @@ static void iscsi_scsi_response_cb(struct iscsi_context *iscsi, int status, void
 }
 
 
-static int iscsi_scsi_command_async(struct iscsi_context *iscsi, int lun, struct scsi_task *task, iscsi_command_cb cb, struct iscsi_data *data, void *private_data)
+void iscsi_release_held_pdus(struct iscsi_context *iscsi)
+{
+	struct iscsi_pdu *pdu;
+
+	while ((pdu = iscsi->holdqueue) != NULL) {
+		if (iscsi->max_outstanding != 0 && iscsi->outstanding >= iscsi->max_outstanding) {
+			return;
+		}
+		DLIST_REMOVE(iscsi->holdqueue, pdu);
+
+		/* commands are numbered in the order they go out */
+		iscsi_pdu_set_cmdsn(pdu, iscsi->cmdsn);
+		pdu->cmdsn = iscsi->cmdsn;
+		iscsi->cmdsn++;
+
+		/* exp statsn */
+		iscsi_pdu_set_expstatsn(pdu, iscsi->statsn+1);
+
+		iscsi->outstanding++;
+		iscsi_queue_pdu(iscsi, pdu);
+	}
+}
+
+static int iscsi_scsi_command_async(struct iscsi_context *iscsi, int lun, struct scsi_task *task, iscsi_command_cb cb, struct iscsi_data *data, unsigned char *datain, void *private_data)
 {
 	struct iscsi_pdu *pdu;
 	struct iscsi_scsi_cbdata *scsi_cbdata;
@@ -114,6 +137,22 @@ static int iscsi_scsi_command_async(struct iscsi_context *iscsi, int lun, struct
 		break;
 	case SCSI_XFER_READ:
 		flags |= ISCSI_PDU_SCSI_READ;
+		if (task->expxferlen == 0) {
+			break;
+		}
+		/* data-in is read straight into this buffer */
+		if (datain != NULL) {
+			pdu->indata.data = datain;
+			pdu->indata_is_caller = 1;
+		} else {
+			pdu->indata.data = malloc(task->expxferlen);
+			if (pdu->indata.data == NULL) {
+				printf("failed to allocate %d bytes for data-in\n", task->expxferlen);
+				iscsi_free_pdu(iscsi, pdu);
+				return -8;
+			}
+		}
+		pdu->indata_len = task->expxferlen;
 		break;
 	case SCSI_XFER_WRITE:
 		flags |= ISCSI_PDU_SCSI_WRITE;
@@ -143,25 +182,15 @@ static int iscsi_scsi_command_async(struct iscsi_context *iscsi, int lun, struct
 	/* expxferlen */
 	iscsi_pdu_set_expxferlen(pdu, task->expxferlen);
 
-	/* cmdsn */
-	iscsi_pdu_set_cmdsn(pdu, iscsi->cmdsn);
-	pdu->cmdsn = iscsi->cmdsn;
-	iscsi->cmdsn++;
-
-	/* exp statsn */
-	iscsi_pdu_set_expstatsn(pdu, iscsi->statsn+1);
-		
 	/* cdb */
 	iscsi_pdu_set_cdb(pdu, task);
 
 	pdu->callback     = iscsi_scsi_response_cb;
 	pdu->private_data = scsi_cbdata;
 
-	if (iscsi_queue_pdu(iscsi, pdu) != 0) {
-		printf("failed to queue iscsi scsi pdu\n");
-		iscsi_free_pdu(iscsi, pdu);
-		return -6;
-	}
+	/* cmdsn and exp statsn are set once there is room to send it */
+	DLIST_ADD_END(iscsi->holdqueue, pdu, NULL);
+	iscsi_release_held_pdus(iscsi);
 
 	return 0;
 }
@@ -218,7 +247,7 @@ int iscsi_process_scsi_reply(struct iscsi_context *iscsi, struct iscsi_pdu *pdu,
 		task->datain.data = pdu->indata.data;
 		task->datain.size = pdu->indata.size;
 
-		pdu->callback(iscsi, ISCSI_STATUS_GOOD, &pdu->indata, pdu->private_data);
+		pdu->callback(iscsi, ISCSI_STATUS_GOOD, task, pdu->private_data);
 		break;
 	case ISCSI_STATUS_CHECK_CONDITION:
 		task->datain.data = discard_const(hdr + ISCSI_HEADER_SIZE);
@@ -270,22 +299,35 @@ int iscsi_process_scsi_data_in(struct iscsi_context *iscsi, struct iscsi_pdu *pd
 
 	dsl = ntohl(*(uint32_t *)&hdr[4])&0x00ffffff;
 
-	if (dsl > size - ISCSI_HEADER_SIZE) {
-		printf ("dsl is :%d, while buffser size if %d\n", dsl, size - ISCSI_HEADER_SIZE);
-	}
+	if (pdu->indata_len != 0) {
+		/* the socket code has already put the data at its offset */
+		uint32_t offset = ntohl(*(uint32_t *)&hdr[40]);
 
-	if (iscsi_add_data(&pdu->indata, discard_const(hdr + ISCSI_HEADER_SIZE), dsl, 0) != 0) {
-		printf("failed to add data to pdu in buffer\n");
-		return -3;
-	}
+		if (offset > (uint32_t)pdu->indata_len || dsl > pdu->indata_len - (int)offset) {
+			printf("data-in at offset:%u len:%d is beyond the %d byte buffer\n", offset, dsl, pdu->indata_len);
+			pdu->callback(iscsi, ISCSI_STATUS_ERROR, task, pdu->private_data);
+			return -3;
+		}
+		if ((int)offset + dsl > pdu->indata.size) {
+			pdu->indata.size = offset + dsl;
+		}
+	} else if (dsl != 0) {
+		if (dsl > size - ISCSI_HEADER_SIZE) {
+			printf ("dsl is :%d, while buffser size if %d\n", dsl, size - ISCSI_HEADER_SIZE);
+		}
 
+		if (iscsi_add_data(&pdu->indata, discard_const(hdr + ISCSI_HEADER_SIZE), dsl, 0) != 0) {
+			printf("failed to add data to pdu in buffer\n");
+			return -3;
+		}
+	}
 
+	/* a read larger than one pdu comes in several data-in, and only the
+	 * last has the final and status bits */
 	if ((flags&ISCSI_PDU_DATA_FINAL) == 0) {
-		printf("scsi data-in without Final bit: 0x%02x\n", flags);
 		*is_finished = 0;
 	}
 	if ((flags&ISCSI_PDU_DATA_CONTAINS_STATUS) == 0) {
-		printf("scsi data-in without Status bit: 0x%02x\n", flags);
 		*is_finished = 0;
 	}
 
@@ -322,7 +364,7 @@ int iscsi_testunitready_async(struct iscsi_context *iscsi, int lun, iscsi_comman
 		printf("Failed to create testunitready cdb\n");
 		return -1;
 	}
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, NULL, private_data);
 
 	return ret;
 }
@@ -343,7 +385,7 @@ int iscsi_reportluns_async(struct iscsi_context *iscsi, iscsi_command_cb cb, int
 		return -2;
 	}
 	/* report luns are always sent to lun 0 */
-	ret = iscsi_scsi_command_async(iscsi, 0, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, 0, task, cb, NULL, NULL, private_data);
 
 	return ret;
 }
@@ -357,7 +399,7 @@ int iscsi_inquiry_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb c
 		printf("Failed to create inquiry cdb\n");
 		return -1;
 	}
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, NULL, private_data);
 
 	return ret;
 }
@@ -371,12 +413,12 @@ int iscsi_readcapacity10_async(struct iscsi_context *iscsi, int lun, iscsi_comma
 		printf("Failed to create readcapacity10 cdb\n");
 		return -1;
 	}
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, NULL, private_data);
 
 	return ret;
 }
 
-int iscsi_read10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int lba, int datalen, int blocksize, void *private_data)
+static int iscsi_read10(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, unsigned char *buf, int lba, int datalen, int blocksize, void *private_data)
 {
 	struct scsi_task *task;
 	int ret;
@@ -390,11 +432,25 @@ int iscsi_read10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb
 		printf("Failed to create read10 cdb\n");
 		return -2;
 	}
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, buf, private_data);
 
 	return ret;
 }
 
+int iscsi_read10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, int lba, int datalen, int blocksize, void *private_data)
+{
+	return iscsi_read10(iscsi, lun, cb, NULL, lba, datalen, blocksize, private_data);
+}
+
+int iscsi_read10_into_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, unsigned char *buf, int datalen, int lba, int blocksize, void *private_data)
+{
+	if (buf == NULL) {
+		printf("read10 into a NULL buffer\n");
+		return -1;
+	}
+	return iscsi_read10(iscsi, lun, cb, buf, lba, datalen, blocksize, private_data);
+}
+
 
 int iscsi_write10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb cb, unsigned char *data, int datalen, int lba, int fua, int fuanv, int blocksize, void *private_data)
 {
@@ -415,7 +471,7 @@ int iscsi_write10_async(struct iscsi_context *iscsi, int lun, iscsi_command_cb c
 	outdata.data = data;
 	outdata.size = datalen;
 
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, &outdata, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, &outdata, NULL, private_data);
 
 	return ret;
 }
@@ -429,7 +485,7 @@ int iscsi_modesense6_async(struct iscsi_context *iscsi, int lun, iscsi_command_c
 		printf("Failed to create modesense6 cdb\n");
 		return -2;
 	}
-	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, private_data);
+	ret = iscsi_scsi_command_async(iscsi, lun, task, cb, NULL, NULL, private_data);
 
 	return ret;
 }
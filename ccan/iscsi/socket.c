@@ -28,6 +28,7 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include "iscsi.h"
 #include "iscsi-private.h"
@@ -168,11 +169,37 @@ int iscsi_which_events(struct iscsi_context *iscsi)
 	return events;
 }
 
+/* Where the payload of a data-in pdu goes, if it can skip the receive buffer */
+static unsigned char *iscsi_datain_dest(struct iscsi_context *iscsi, const unsigned char *hdr)
+{
+	struct iscsi_pdu *pdu;
+	uint32_t offset;
+	int dsl;
+
+	if ((hdr[0] & 0x3f) != ISCSI_PDU_DATA_IN || hdr[4] != 0) {
+		return NULL;
+	}
+	dsl = ntohl(*(uint32_t *)&hdr[4])&0x00ffffff;
+	if (dsl == 0) {
+		return NULL;
+	}
+	pdu = iscsi_find_pdu(iscsi, ntohl(*(uint32_t *)&hdr[16]));
+	if (pdu == NULL || pdu->indata_len == 0) {
+		return NULL;
+	}
+	/* iscsi_process_scsi_data_in() fails the command for this */
+	offset = ntohl(*(uint32_t *)&hdr[40]);
+	if (offset > (uint32_t)pdu->indata_len || dsl > pdu->indata_len - (int)offset) {
+		return NULL;
+	}
+	return pdu->indata.data + offset;
+}
+
 static int iscsi_read_from_socket(struct iscsi_context *iscsi)
 {
-	int available;
-	int size;
-	unsigned char *buf;
+	struct iovec iov[3];
+	unsigned char pad[4];
+	int available, need, iovcnt = 0;
 	ssize_t count;
 
 	if (ioctl(iscsi->fd, FIONREAD, &available) != 0) {
@@ -183,53 +210,116 @@ static int iscsi_read_from_socket(struct iscsi_context *iscsi)
 		printf("no data readable in socket, socket is closed\n");
 		return -2;
 	}
-	size = iscsi->insize - iscsi->inpos + available;
-	buf = malloc(size);
-	if (buf == NULL) {
-		printf("failed to allocate %d bytes for input buffer\n", size);
-		return -3;
-	}
-	if (iscsi->insize > iscsi->inpos) {
-		memcpy(buf, iscsi->inbuf + iscsi->inpos, iscsi->insize - iscsi->inpos);
+
+	/* keep what we have of a partial pdu at the start of the buffer */
+	if (iscsi->inpos > 0) {
+		memmove(iscsi->inbuf, iscsi->inbuf + iscsi->inpos, iscsi->insize - iscsi->inpos);
 		iscsi->insize -= iscsi->inpos;
 		iscsi->inpos   = 0;
 	}
+	need = available - iscsi->direct_left - iscsi->direct_pad;
+	if (iscsi->inbuflen - iscsi->insize < need) {
+		int len = iscsi->inbuflen ? iscsi->inbuflen : ISCSI_INBUF_MIN;
+		unsigned char *buf;
 
-	count = read(iscsi->fd, buf + iscsi->insize, available);
+		while (len - iscsi->insize < need) {
+			len *= 2;
+		}
+		buf = realloc(iscsi->inbuf, len);
+		if (buf == NULL) {
+			printf("failed to allocate %d bytes for input buffer\n", len);
+			return -3;
+		}
+		iscsi->inbuf    = buf;
+		iscsi->inbuflen = len;
+	}
+
+	/* the rest of a data-in payload goes straight to where it belongs,
+	 * and only what follows it into the buffer */
+	if (iscsi->direct_left > 0) {
+		iov[iovcnt].iov_base = iscsi->direct;
+		iov[iovcnt].iov_len  = iscsi->direct_left;
+		iovcnt++;
+	}
+	if (iscsi->direct_pad > 0) {
+		iov[iovcnt].iov_base = pad;
+		iov[iovcnt].iov_len  = iscsi->direct_pad;
+		iovcnt++;
+	}
+	if (iscsi->inbuflen > iscsi->insize) {
+		iov[iovcnt].iov_base = iscsi->inbuf + iscsi->insize;
+		iov[iovcnt].iov_len  = iscsi->inbuflen - iscsi->insize;
+		iovcnt++;
+	}
+
+	count = readv(iscsi->fd, iov, iovcnt);
 	if (count == -1) {
 		if (errno == EINTR) {
-			free(buf);
-			buf = NULL;
 			return 0;
 		}
 		printf("read from socket failed, errno:%d\n", errno);
-		free(buf);
-		buf = NULL;
 		return -4;
 	}
 
-	if (iscsi->inbuf != NULL) {
-		free(iscsi->inbuf);
+	if (iscsi->direct_left + iscsi->direct_pad > 0) {
+		int n;
+
+		n = count < iscsi->direct_left ? count : iscsi->direct_left;
+		iscsi->direct      += n;
+		iscsi->direct_left -= n;
+		count              -= n;
+		n = count < iscsi->direct_pad ? count : iscsi->direct_pad;
+		iscsi->direct_pad  -= n;
+		count              -= n;
+		if (iscsi->direct_left + iscsi->direct_pad > 0) {
+			return 0;
+		}
+		iscsi->direct = NULL;
+		if (iscsi_process_pdu(iscsi, iscsi->direct_hdr, ISCSI_HEADER_SIZE) != 0) {
+			printf("failed to process pdu\n");
+			return -5;
+		}
 	}
-	iscsi->inbuf   = buf;
 	iscsi->insize += count;
 
 	while (1) {
-		if (iscsi->insize - iscsi->inpos < 48) {
+		unsigned char *hdr = iscsi->inbuf + iscsi->inpos;
+		unsigned char *dest;
+
+		if (iscsi->insize - iscsi->inpos < ISCSI_HEADER_SIZE) {
 			return 0;
 		}
-		count = iscsi_get_pdu_size(iscsi->inbuf + iscsi->inpos);
-		if (iscsi->insize + iscsi->inpos < count) {
+		count = iscsi_get_pdu_size(hdr);
+
+		dest = iscsi_datain_dest(iscsi, hdr);
+		if (dest != NULL) {
+			int dsl  = ntohl(*(uint32_t *)&hdr[4])&0x00ffffff;
+			int have = iscsi->insize - iscsi->inpos - ISCSI_HEADER_SIZE;
+
+			if (have < count - ISCSI_HEADER_SIZE) {
+				/* read the rest of it in place */
+				int n = have < dsl ? have : dsl;
+
+				memcpy(dest, hdr + ISCSI_HEADER_SIZE, n);
+				memcpy(iscsi->direct_hdr, hdr, ISCSI_HEADER_SIZE);
+				iscsi->direct      = dest + n;
+				iscsi->direct_left = dsl - n;
+				iscsi->direct_pad  = count - ISCSI_HEADER_SIZE - dsl - (have - n);
+				iscsi->inpos = iscsi->insize = 0;
+				return 0;
+			}
+			memcpy(dest, hdr + ISCSI_HEADER_SIZE, dsl);
+		}
+
+		if (iscsi->insize - iscsi->inpos < count) {
 			return 0;
 		}
-		if (iscsi_process_pdu(iscsi, iscsi->inbuf + iscsi->inpos, count) != 0) {
+		if (iscsi_process_pdu(iscsi, hdr, count) != 0) {
 			printf("failed to process pdu\n");
 			return -5;
 		}
 		iscsi->inpos += count;
 		if (iscsi->inpos == iscsi->insize) {
-			free(iscsi->inbuf);
-			iscsi->inbuf = NULL;
 			iscsi->insize = 0;
 			iscsi->inpos = 0;
 		}
@@ -244,7 +334,10 @@ static int iscsi_read_from_socket(struct iscsi_context *iscsi)
 
 static int iscsi_write_to_socket(struct iscsi_context *iscsi)
 {
+	struct iovec iov[ISCSI_MAX_IOV];
+	struct iscsi_pdu *pdu;
 	ssize_t count;
+	int iovcnt;
 
 	if (iscsi == NULL) {
 		printf("trying to write to socket for NULL context\n");
@@ -256,12 +349,20 @@ static int iscsi_write_to_socket(struct iscsi_context *iscsi)
 	}
 
 	while (iscsi->outqueue != NULL) {
-		ssize_t total;
+		/* hand as much of the queue as we can to one writev */
+		iovcnt = 0;
+		for (pdu = iscsi->outqueue; pdu && iovcnt < ISCSI_MAX_IOV; pdu = pdu->next) {
+			ssize_t total;
 
-		total = iscsi->outqueue->outdata.size;
-		total = (total +3) & 0xfffffffc;
+			total = pdu->outdata.size;
+			total = (total +3) & 0xfffffffc;
 
-		count = write(iscsi->fd, iscsi->outqueue->outdata.data + iscsi->outqueue->written, total - iscsi->outqueue->written);
+			iov[iovcnt].iov_base = pdu->outdata.data + pdu->written;
+			iov[iovcnt].iov_len  = total - pdu->written;
+			iovcnt++;
+		}
+
+		count = writev(iscsi->fd, iov, iovcnt);
 		if (count == -1) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
 				printf("socket would block, return from write to socket\n");
@@ -271,12 +372,21 @@ static int iscsi_write_to_socket(struct iscsi_context *iscsi)
 			return -3;
 		}
 
-		iscsi->outqueue->written += count;
-		if (iscsi->outqueue->written == total) {
-			struct iscsi_pdu *pdu = iscsi->outqueue;
+		/* pdus that are all written now wait for their reply */
+		while ((pdu = iscsi->outqueue) != NULL && count > 0) {
+			ssize_t left;
+
+			left = pdu->outdata.size;
+			left = ((left +3) & 0xfffffffc) - pdu->written;
+			if (count < left) {
+				pdu->written += count;
+				break;
+			}
+			pdu->written += left;
+			count        -= left;
 
-	       	    	DLIST_REMOVE(iscsi->outqueue, pdu);
-			DLIST_ADD_END(iscsi->waitpdu, pdu, NULL);
+			DLIST_REMOVE(iscsi->outqueue, pdu);
+			DLIST_ADD(iscsi->waitpdu[ISCSI_WAITPDU_HASH(pdu->itt)], pdu);
 		}
 	}
 	return 0;
@@ -0,0 +1,260 @@
+#include <ccan/iscsi/iscsi.h>
+#include <ccan/iscsi/discovery.c>
+#include <ccan/iscsi/socket.c>
+#include <ccan/iscsi/init.c>
+#include <ccan/iscsi/pdu.c>
+#include <ccan/iscsi/scsi-lowlevel.c>
+#include <ccan/iscsi/nop.c>
+#include <ccan/iscsi/login.c>
+#include <ccan/iscsi/scsi-command.c>
+#include <ccan/tap/tap.h>
+#include <sys/socket.h>
+
+#define BLOCKSIZE 512
+#define NUM_READS 8
+#define READ_BLOCKS 16
+#define READ_SIZE (READ_BLOCKS * BLOCKSIZE)
+#define MAX_OUTSTANDING 4
+
+/* We play the target on the other end of a socketpair. */
+static int target;
+static uint32_t statsn;
+
+struct result {
+	int lba;
+	int done;
+	int status;
+	int good;
+	unsigned char *datain;
+	int size;
+};
+
+static unsigned char disk_byte(unsigned int addr)
+{
+	return (addr * 2654435761U) >> 24;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, 4);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+static void command_cb(struct iscsi_context *iscsi, int status, void *command_data, void *private_data)
+{
+	struct result *r = private_data;
+	struct scsi_task *task = command_data;
+	int i;
+
+	r->done++;
+	r->status = status;
+	if (task == NULL || status != ISCSI_STATUS_GOOD) {
+		return;
+	}
+	r->datain = task->datain.data;
+	r->size = task->datain.size;
+	r->good = 1;
+	for (i = 0; i < r->size; i++) {
+		if (r->datain[i] != disk_byte(r->lba * BLOCKSIZE + i)) {
+			r->good = 0;
+		}
+	}
+}
+
+/* Read one pdu the initiator sent. */
+static void read_pdu(unsigned char *hdr)
+{
+	unsigned char data[READ_SIZE];
+	int len, got;
+
+	for (got = 0; got < ISCSI_HEADER_SIZE; got += len) {
+		len = read(target, hdr + got, ISCSI_HEADER_SIZE - got);
+		if (len <= 0) {
+			abort();
+		}
+	}
+	len = iscsi_get_pdu_size(hdr) - ISCSI_HEADER_SIZE;
+	for (got = 0; got < len; got += read(target, data, len - got))
+		;
+}
+
+/* A data-in pdu carrying [offset, offset+len) of the read at lba. */
+static int build_datain(unsigned char *p, uint32_t itt, int lba, int offset, int len, int last)
+{
+	int i;
+
+	memset(p, 0, ISCSI_HEADER_SIZE + len + 3);
+	p[0] = ISCSI_PDU_DATA_IN;
+	if (last) {
+		p[1] = ISCSI_PDU_DATA_FINAL|ISCSI_PDU_DATA_CONTAINS_STATUS;
+	}
+	put32(p + 4, len);
+	put32(p + 16, itt);
+	put32(p + 24, ++statsn);
+	put32(p + 40, offset);
+	for (i = 0; i < len; i++) {
+		p[ISCSI_HEADER_SIZE + i] = disk_byte(lba * BLOCKSIZE + offset + i);
+	}
+	return (ISCSI_HEADER_SIZE + len + 3) & ~3;
+}
+
+/* Hand the initiator a reply a few bytes at a time. */
+static int send_pieces(struct iscsi_context *iscsi, const unsigned char *buf, int len, int piece)
+{
+	int off, n;
+
+	for (off = 0; off < len; off += n) {
+		n = len - off < piece ? len - off : piece;
+		if (write(target, buf + off, n) != n) {
+			return -1;
+		}
+		if (iscsi_service(iscsi, POLLIN) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	struct iscsi_context *iscsi;
+	struct result res[NUM_READS + 2];
+	unsigned char *bufs[NUM_READS];
+	unsigned char hdr[MAX_OUTSTANDING][ISCSI_HEADER_SIZE];
+	static unsigned char reply[MAX_OUTSTANDING * (READ_SIZE + 4 * ISCSI_HEADER_SIZE)];
+	unsigned char data[BLOCKSIZE];
+	int sv[2], i, n, len, done, sent, over_limit, cmdsn_ok, held;
+
+	plan_tests(17);
+
+	iscsi = iscsi_create_context("some name");
+	ok1(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	iscsi->fd = sv[0];
+	target = sv[1];
+	set_nonblocking(iscsi->fd);
+	iscsi->is_connected = 1;
+	iscsi->is_loggedin = 1;
+	iscsi->session_type = ISCSI_SESSION_NORMAL;
+
+	ok1(iscsi_set_max_outstanding(iscsi, -1) != 0);
+	ok1(iscsi_set_max_outstanding(iscsi, MAX_OUTSTANDING) == 0);
+
+	/* Half of the reads land in our own buffers. */
+	memset(res, 0, sizeof(res));
+	for (i = 0; i < NUM_READS; i++) {
+		res[i].lba = i * READ_BLOCKS * 3;
+		if (i % 2) {
+			bufs[i] = NULL;
+			n = iscsi_read10_async(iscsi, 0, command_cb, res[i].lba, READ_SIZE, BLOCKSIZE, &res[i]);
+		} else {
+			bufs[i] = malloc(READ_SIZE);
+			n = iscsi_read10_into_async(iscsi, 0, command_cb, bufs[i], READ_SIZE, res[i].lba, BLOCKSIZE, &res[i]);
+		}
+		if (n != 0) {
+			break;
+		}
+	}
+	ok1(i == NUM_READS);
+	ok1(iscsi->outstanding == MAX_OUTSTANDING);
+
+	/* Serve them as they come, a batch at a time, answering backwards and
+	 * splitting each read over several data-in. */
+	done = sent = over_limit = 0;
+	cmdsn_ok = 1;
+	while (done < NUM_READS) {
+		struct iscsi_pdu *pdu;
+
+		for (n = 0, pdu = iscsi->outqueue; pdu; pdu = pdu->next) {
+			n++;
+		}
+		if (n == 0 || iscsi_service(iscsi, POLLOUT) != 0) {
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			read_pdu(hdr[i]);
+			if (get32(hdr[i] + 24) != (uint32_t)sent++) {
+				cmdsn_ok = 0;
+			}
+		}
+		for (len = 0, i = n - 1; i >= 0; i--) {
+			uint32_t itt = get32(hdr[i] + 16);
+			int lba = get32(hdr[i] + 34);
+
+			len += build_datain(reply + len, itt, lba, 0, 1001, 0);
+			len += build_datain(reply + len, itt, lba, 1001, 3003, 0);
+			len += build_datain(reply + len, itt, lba, 4004, READ_SIZE - 4004, 1);
+		}
+		if (send_pieces(iscsi, reply, len, 1000) != 0) {
+			break;
+		}
+		if (iscsi->outstanding > MAX_OUTSTANDING) {
+			over_limit = 1;
+		}
+		done += n;
+	}
+	ok1(done == NUM_READS);
+	ok1(!over_limit);
+	ok1(cmdsn_ok);
+	for (i = 0, n = 0; i < NUM_READS; i++) {
+		if (res[i].done == 1 && res[i].status == ISCSI_STATUS_GOOD
+		    && res[i].good && res[i].size == READ_SIZE
+		    && (bufs[i] == NULL || res[i].datain == bufs[i])) {
+			n++;
+		}
+	}
+	ok1(n == NUM_READS);
+	ok1(iscsi->outstanding == 0);
+	ok1(iscsi->insize == 0 && iscsi->direct == NULL);
+
+	/* A write goes out with its data, and completes on the response. */
+	memset(data, 0x5a, sizeof(data));
+	ok1(iscsi_write10_async(iscsi, 0, command_cb, data, BLOCKSIZE, 7, 0, 0, BLOCKSIZE, &res[NUM_READS]) == 0);
+	ok1(iscsi_service(iscsi, POLLOUT) == 0);
+	read_pdu(hdr[0]);
+	memset(reply, 0, ISCSI_HEADER_SIZE);
+	reply[0] = ISCSI_PDU_SCSI_RESPONSE;
+	reply[1] = ISCSI_PDU_DATA_FINAL;
+	memcpy(reply + 16, hdr[0] + 16, 4);
+	put32(reply + 24, ++statsn);
+	send_pieces(iscsi, reply, ISCSI_HEADER_SIZE, 7);
+	ok1(res[NUM_READS].done == 1 && res[NUM_READS].status == ISCSI_STATUS_GOOD);
+
+	/* Data-in beyond the end of the buffer fails the read. */
+	res[NUM_READS + 1].lba = 0;
+	iscsi_read10_into_async(iscsi, 0, command_cb, bufs[0], BLOCKSIZE, 0, BLOCKSIZE, &res[NUM_READS + 1]);
+	iscsi_service(iscsi, POLLOUT);
+	read_pdu(hdr[0]);
+	len = build_datain(reply, get32(hdr[0] + 16), 0, BLOCKSIZE - 8, 16, 1);
+	send_pieces(iscsi, reply, len, len);
+	ok1(res[NUM_READS + 1].done == 1 && res[NUM_READS + 1].status == ISCSI_STATUS_ERROR);
+
+	/* Held commands are cancelled with the context. */
+	memset(res, 0, sizeof(res));
+	for (i = 0; i < MAX_OUTSTANDING + 2; i++) {
+		iscsi_read10_async(iscsi, 0, command_cb, 0, BLOCKSIZE, BLOCKSIZE, &res[i]);
+	}
+	iscsi->is_loggedin = 0;
+	held = iscsi->holdqueue != NULL;
+	ok1(iscsi_destroy_context(iscsi) == 0);
+	for (i = 0, n = 0; i < MAX_OUTSTANDING + 2; i++) {
+		if (res[i].done == 1) {
+			n++;
+		}
+	}
+	ok1(held && n == MAX_OUTSTANDING + 2);
+	close(target);
+	for (i = 0; i < NUM_READS; i++) {
+		free(bufs[i]);
+	}
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,353 @@
+/* Measures how many READ10/WRITE10 commands per second libiscsi can push
+ * through one session, at a range of queue depths and transfer sizes.
+ *
+ * It forks a minimal target on the loopback interface which accepts any
+ * login, answers every read with zeroes (split into 64k data-in pdus) and
+ * discards every write, so what is measured is the initiator and the
+ * socket, not a disk.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ccan/iscsi/iscsi.h>
+#include <ccan/iscsi/scsi-lowlevel.h>
+
+#define BLOCKSIZE	512
+#define CAPACITY	(1 << 21)	/* blocks */
+#define SEGMENT		65536		/* target's data-in pdu size */
+#define STUB_INBUF	(4 << 20)
+#define STUB_IOV	1000
+
+static uint32_t get32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, 4);
+}
+
+/*
+ * The target
+ */
+static struct iovec stub_iov[STUB_IOV];
+static unsigned char stub_hdr[STUB_IOV][48];
+static int stub_iovcnt, stub_nhdr;
+static uint32_t stub_statsn;
+static unsigned char zeroes[SEGMENT];
+
+static void stub_flush(int fd)
+{
+	struct iovec *iov = stub_iov;
+	int cnt = stub_iovcnt;
+
+	while (cnt > 0) {
+		ssize_t n = writev(fd, iov, cnt > 1024 ? 1024 : cnt);
+
+		if (n <= 0) {
+			exit(0);
+		}
+		while (cnt > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	stub_iovcnt = stub_nhdr = 0;
+}
+
+static unsigned char *stub_reply(int fd, const void *payload, int len)
+{
+	unsigned char *hdr;
+
+	if (stub_iovcnt + 2 > STUB_IOV) {
+		stub_flush(fd);
+	}
+	hdr = stub_hdr[stub_nhdr++];
+	memset(hdr, 0, 48);
+	put32(hdr + 4, len);
+	stub_iov[stub_iovcnt].iov_base = hdr;
+	stub_iov[stub_iovcnt++].iov_len = 48;
+	if (len) {
+		stub_iov[stub_iovcnt].iov_base = (void *)payload;
+		stub_iov[stub_iovcnt++].iov_len = len;
+	}
+	return hdr;
+}
+
+static void stub_answer(int fd, const unsigned char *req)
+{
+	unsigned char *hdr;
+	uint32_t len, off;
+
+	switch (req[0] & 0x3f) {
+	case 0x03:	/* login */
+		hdr = stub_reply(fd, NULL, 0);
+		hdr[0] = 0x23;
+		hdr[1] = 0x87;
+		memcpy(hdr + 16, req + 16, 4);
+		put32(hdr + 24, stub_statsn++);
+		break;
+	case 0x01:	/* scsi command */
+		if (req[32] != 0x28) {
+			hdr = stub_reply(fd, NULL, 0);
+			hdr[0] = 0x21;
+			hdr[1] = 0x80;
+			memcpy(hdr + 16, req + 16, 4);
+			put32(hdr + 24, stub_statsn++);
+			break;
+		}
+		len = get32(req + 20);
+		for (off = 0; off < len; off += SEGMENT) {
+			uint32_t n = len - off < SEGMENT ? len - off : SEGMENT;
+
+			hdr = stub_reply(fd, zeroes, n);
+			hdr[0] = 0x25;
+			memcpy(hdr + 16, req + 16, 4);
+			put32(hdr + 40, off);
+			if (off + n == len) {
+				hdr[1] = 0x81;
+				put32(hdr + 24, stub_statsn++);
+			}
+		}
+		break;
+	}
+}
+
+static void stub_target(int listenfd)
+{
+	unsigned char *in = malloc(STUB_INBUF);
+	int fd, insize = 0, inpos;
+
+	fd = accept(listenfd, NULL, NULL);
+	if (fd == -1 || in == NULL) {
+		exit(1);
+	}
+	for (;;) {
+		ssize_t n = read(fd, in + insize, STUB_INBUF - insize);
+
+		if (n <= 0) {
+			exit(0);
+		}
+		insize += n;
+		for (inpos = 0; insize - inpos >= 48; inpos += n) {
+			n = ((get32(in + inpos + 4) & 0xffffff) + 48 + 3) & ~3;
+			if (insize - inpos < n) {
+				break;
+			}
+			stub_answer(fd, in + inpos);
+		}
+		stub_flush(fd);
+		memmove(in, in + inpos, insize - inpos);
+		insize -= inpos;
+	}
+}
+
+/*
+ * The initiator
+ */
+struct bench {
+	int write;
+	int size;
+	long issued, completed, total;
+	int finished;
+};
+
+struct slot {
+	struct bench *b;
+	unsigned char *buf;
+};
+
+static void io_cb(struct iscsi_context *iscsi, int status, void *command_data, void *private_data);
+
+static void issue(struct iscsi_context *iscsi, struct slot *s)
+{
+	struct bench *b = s->b;
+	int blocks = b->size / BLOCKSIZE;
+	int lba = (b->issued * blocks) % (CAPACITY - blocks);
+	int ret;
+
+	if (b->write) {
+		ret = iscsi_write10_async(iscsi, 0, io_cb, s->buf, b->size, lba, 0, 0, BLOCKSIZE, s);
+	} else {
+		ret = iscsi_read10_into_async(iscsi, 0, io_cb, s->buf, b->size, lba, BLOCKSIZE, s);
+	}
+	if (ret != 0) {
+		fprintf(stderr, "failed to send command\n");
+		exit(10);
+	}
+	b->issued++;
+}
+
+static void io_cb(struct iscsi_context *iscsi, int status, void *command_data, void *private_data)
+{
+	struct slot *s = private_data;
+
+	(void)command_data;
+	if (status != ISCSI_STATUS_GOOD) {
+		fprintf(stderr, "command failed, status:%d\n", status);
+		exit(10);
+	}
+	s->b->completed++;
+	s->b->finished = s->b->completed == s->b->total;
+	if (s->b->issued < s->b->total) {
+		issue(iscsi, s);
+	}
+}
+
+static void done_cb(struct iscsi_context *iscsi, int status, void *command_data, void *private_data)
+{
+	(void)iscsi;
+	(void)command_data;
+	if (status != 0) {
+		fprintf(stderr, "connect/login failed, status:%d\n", status);
+		exit(10);
+	}
+	*(int *)private_data = 1;
+}
+
+static void run(struct iscsi_context *iscsi, int *done)
+{
+	struct pollfd pfd;
+
+	while (!*done) {
+		pfd.fd = iscsi_get_fd(iscsi);
+		pfd.events = iscsi_which_events(iscsi);
+		if (poll(&pfd, 1, -1) < 0) {
+			continue;
+		}
+		if (iscsi_service(iscsi, pfd.revents) < 0) {
+			fprintf(stderr, "iscsi_service failed\n");
+			exit(10);
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Keep depth commands on the wire, and as many again held in the initiator
+ * so there is always one to send the moment a slot frees up. */
+static void bench(struct iscsi_context *iscsi, int write, int size, int depth)
+{
+	struct bench b;
+	struct slot *slots;
+	double start, secs;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.write = write;
+	b.size = size;
+	b.total = (256L << 20) / size;
+	if (b.total < 20 * depth) {
+		b.total = 20 * depth;
+	}
+	if (b.total > 200000) {
+		b.total = 200000;
+	}
+
+	iscsi_set_max_outstanding(iscsi, depth);
+	slots = calloc(2 * depth, sizeof(*slots));
+	for (i = 0; i < 2 * depth; i++) {
+		slots[i].b = &b;
+		slots[i].buf = calloc(1, size);
+	}
+
+	start = now();
+	for (i = 0; i < 2 * depth && b.issued < b.total; i++) {
+		issue(iscsi, &slots[i]);
+	}
+	run(iscsi, &b.finished);
+	secs = now() - start;
+
+	printf("%-6s %8d %6d %12.0f %10.1f\n", write ? "write" : "read",
+	       size, depth, b.total / secs, b.total * (double)size / secs / (1 << 20));
+
+	for (i = 0; i < 2 * depth; i++) {
+		free(slots[i].buf);
+	}
+	free(slots);
+}
+
+int main(void)
+{
+	static const int sizes[] = { 4096, 65536, 1048576 };
+	static const int depths[] = { 1, 4, 16, 64, 256 };
+	struct iscsi_context *iscsi;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	char target[64];
+	int listenfd, status, done;
+	unsigned int s, d, w;
+	pid_t child;
+
+	listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listenfd == -1
+	    || bind(listenfd, (struct sockaddr *)&sin, sizeof(sin)) != 0
+	    || listen(listenfd, 1) != 0
+	    || getsockname(listenfd, (struct sockaddr *)&sin, &len) != 0) {
+		perror("listen");
+		exit(10);
+	}
+	child = fork();
+	if (child == 0) {
+		stub_target(listenfd);
+	}
+	close(listenfd);
+
+	iscsi = iscsi_create_context("iqn.2002-10.com.ronnie:bench");
+	iscsi_set_targetname(iscsi, "iqn.2002-10.com.ronnie:stub");
+	iscsi_set_session_type(iscsi, ISCSI_SESSION_NORMAL);
+	sprintf(target, "127.0.0.1:%d", ntohs(sin.sin_port));
+	done = 0;
+	if (iscsi_connect_async(iscsi, target, done_cb, &done) != 0) {
+		exit(10);
+	}
+	run(iscsi, &done);
+	done = 0;
+	if (iscsi_login_async(iscsi, done_cb, &done) != 0) {
+		exit(10);
+	}
+	run(iscsi, &done);
+
+	printf("%-6s %8s %6s %12s %10s\n", "op", "size", "depth", "IOPS", "MB/s");
+	for (w = 0; w < 2; w++) {
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+				bench(iscsi, w, sizes[s], depths[d]);
+			}
+		}
+	}
+
+	kill(child, SIGTERM);
+	waitpid(child, &status, 0);
+	return 0;
+}
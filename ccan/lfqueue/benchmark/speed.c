@@ -0,0 +1,124 @@
+/* Contention benchmark for the lock-free stack, queue and ring, against
+ * ccan/lqueue behind a lock.  Each thread dequeues an element and enqueues
+ * it again, as fast as it can, for 1 to 64 threads. */
+#include <ccan/lfqueue/lfqueue.h>
+#include <ccan/lfring/lfring.h>
+#include <ccan/lfstack/lfstack.h>
+#include <ccan/lqueue/lqueue.h>
+#include <ccan/time/time.h>
+#include <omp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_THREADS 64
+#define PER_THREAD 16
+#define OPS 2000000
+
+struct elem {
+	struct lfstack_link sl;
+	struct lqueue_link ql;
+};
+
+static struct elem elems[MAX_THREADS * PER_THREAD];
+
+static LFSTACK(struct elem, sl) stack;
+static LFQUEUE(struct elem) queue;
+static LFRING(struct elem) ring;
+static LQUEUE(struct elem, ql) locked;
+static omp_lock_t lock;
+
+static bool stack_op(void)
+{
+	struct elem *e = lfstack_pop(&stack);
+	if (!e)
+		return false;
+	lfstack_push(&stack, e);
+	return true;
+}
+
+static bool queue_op(void)
+{
+	struct elem *e = lfqueue_dequeue(&queue);
+	if (!e)
+		return false;
+	lfqueue_enqueue(&queue, e);
+	return true;
+}
+
+static bool ring_op(void)
+{
+	struct elem *e = lfring_dequeue(&ring);
+	if (!e)
+		return false;
+	lfring_enqueue(&ring, e);
+	return true;
+}
+
+static bool locked_op(void)
+{
+	struct elem *e;
+
+	omp_set_lock(&lock);
+	e = lqueue_dequeue(&locked);
+	omp_unset_lock(&lock);
+	if (!e)
+		return false;
+	omp_set_lock(&lock);
+	lqueue_enqueue(&locked, e);
+	omp_unset_lock(&lock);
+	return true;
+}
+
+/* The total work is the same whatever the thread count.  A dequeue can
+ * miss when the elements are all held by other threads (or, for lfring,
+ * while one is half-way through an enqueue): those are counted, but not
+ * retried. */
+static void run(const char *what, bool (*op)(void), int threads)
+{
+	struct timemono start = time_mono();
+	struct timerel diff;
+	long i, misses = 0;
+
+#pragma omp parallel for num_threads(threads) schedule(static) \
+	reduction(+:misses)
+	for (i = 0; i < OPS; i++)
+		if (!op())
+			misses++;
+	diff = timemono_since(start);
+	printf("%-12s %2i threads: %8llu usec (%llu nsec per op, %ld missed)\n",
+	       what, threads, (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)time_to_nsec(diff) / OPS, misses);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, threads, max = argc > 1 ? atoi(argv[1]) : MAX_THREADS;
+
+	if (max > MAX_THREADS)
+		max = MAX_THREADS;
+
+	lfstack_init(&stack);
+	if (!lfqueue_init(&queue) || !lfring_init(&ring, MAX_THREADS * PER_THREAD))
+		abort();
+	lqueue_init(&locked);
+	omp_init_lock(&lock);
+	for (i = 0; i < MAX_THREADS * PER_THREAD; i++) {
+		lfstack_push(&stack, &elems[i]);
+		lfqueue_enqueue(&queue, &elems[i]);
+		lfring_enqueue(&ring, &elems[i]);
+		lqueue_enqueue(&locked, &elems[i]);
+	}
+
+	for (threads = 1; threads <= max; threads *= 2) {
+		run("lfstack", stack_op, threads);
+		run("lfqueue", queue_op, threads);
+		run("lfring", ring_op, threads);
+		run("lqueue+lock", locked_op, threads);
+	}
+
+	omp_destroy_lock(&lock);
+	lfring_free(&ring);
+	lfqueue_free(&queue);
+	return 0;
+}
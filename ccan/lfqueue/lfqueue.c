@@ -0,0 +1,127 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#include <ccan/lfqueue/lfqueue.h>
+#include <stdlib.h>
+
+/* The halves may be read from different states: a CAS using them then
+ * fails, and anything checked against them is checked again. */
+static void read_ptr(struct lfqueue_ptr_ *p, struct lfqueue_ptr_ *out)
+{
+	out->gen = __atomic_load_n(&p->gen, __ATOMIC_ACQUIRE);
+	out->node = __atomic_load_n(&p->node, __ATOMIC_ACQUIRE);
+}
+
+static bool same_ptr(struct lfqueue_ptr_ *p, const struct lfqueue_ptr_ *old)
+{
+	struct lfqueue_ptr_ now;
+
+	read_ptr(p, &now);
+	return now.node == old->node && now.gen == old->gen;
+}
+
+static bool cas_ptr(struct lfqueue_ptr_ *p, struct lfqueue_ptr_ *old,
+		    struct lfqueue_node_ *node)
+{
+	struct lfqueue_ptr_ want;
+
+	want.node = node;
+	want.gen = old->gen + 1;
+	return __atomic_compare_exchange(p, old, &want, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static struct lfqueue_node_ *new_node(struct lfqueue_ *q)
+{
+	struct lfqueue_node_ *n = lfstack_pop(&q->spare);
+
+	if (!n) {
+		n = malloc(sizeof(*n));
+		if (!n)
+			return NULL;
+		n->next.gen = 0;
+	}
+	/* Keep the count going: another thread may still hold a stale
+	 * pointer to this node's next. */
+	__atomic_store_n(&n->next.node, NULL, __ATOMIC_RELAXED);
+	return n;
+}
+
+bool lfqueue_init_(struct lfqueue_ *q)
+{
+	lfstack_init(&q->spare);
+	q->head.node = q->tail.node = new_node(q);
+	q->head.gen = q->tail.gen = 0;
+	return q->head.node != NULL;
+}
+
+void lfqueue_free_(struct lfqueue_ *q)
+{
+	struct lfqueue_node_ *n, *next;
+	struct lfstack_link *l;
+
+	for (n = q->head.node; n; n = next) {
+		next = n->next.node;
+		free(n);
+	}
+	l = lfstack_pop_all(&q->spare);
+	while (l) {
+		n = lfstack_entry(&q->spare, l);
+		l = l->down;
+		free(n);
+	}
+}
+
+bool lfqueue_enqueue_(struct lfqueue_ *q, void *e)
+{
+	struct lfqueue_node_ *n = new_node(q);
+	struct lfqueue_ptr_ tail, next;
+
+	if (!n)
+		return false;
+	__atomic_store_n(&n->elem, e, __ATOMIC_RELAXED);
+
+	for (;;) {
+		read_ptr(&q->tail, &tail);
+		read_ptr(&tail.node->next, &next);
+		if (!same_ptr(&q->tail, &tail))
+			continue;
+		if (next.node == NULL) {
+			/* Link it after the last node... */
+			if (cas_ptr(&tail.node->next, &next, n))
+				break;
+		} else {
+			/* ...or help move the tail up to the last node. */
+			cas_ptr(&q->tail, &tail, next.node);
+		}
+	}
+	/* Someone else may already have moved it on. */
+	cas_ptr(&q->tail, &tail, n);
+	return true;
+}
+
+void *lfqueue_dequeue_(struct lfqueue_ *q)
+{
+	struct lfqueue_ptr_ head, tail, next;
+	void *e;
+
+	for (;;) {
+		read_ptr(&q->head, &head);
+		read_ptr(&q->tail, &tail);
+		read_ptr(&head.node->next, &next);
+		if (!same_ptr(&q->head, &head))
+			continue;
+		if (head.node == tail.node) {
+			if (next.node == NULL)
+				return NULL;
+			/* Tail is behind: help it on. */
+			cas_ptr(&q->tail, &tail, next.node);
+		} else {
+			/* Read before next.node can become a spare. */
+			e = __atomic_load_n(&next.node->elem, __ATOMIC_RELAXED);
+			if (cas_ptr(&q->head, &head, next.node))
+				break;
+		}
+	}
+	/* The old dummy is ours now; next.node is the new dummy. */
+	lfstack_push(&q->spare, head.node);
+	return e;
+}
@@ -0,0 +1,161 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_LFQUEUE_H
+#define CCAN_LFQUEUE_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ccan/lfstack/lfstack.h>
+#include <ccan/tcon/tcon.h>
+
+/* Head, tail and free list are kept this far apart, so enqueuers and
+ * dequeuers don't share a cache line. */
+#define LFQUEUE_CACHELINE 64
+
+struct lfqueue_node_;
+
+/**
+ * struct lfqueue_ptr_ - a node pointer with a modification count (internal)
+ * @node: the node pointed to.
+ * @gen: incremented on every change, so a stale @node never matches.
+ */
+struct lfqueue_ptr_ {
+	struct lfqueue_node_ *node;
+	uintptr_t gen;
+} __attribute__((aligned(2 * sizeof(void *))));
+
+/**
+ * struct lfqueue_node_ - a queue node (internal type)
+ * @next: the next node towards the back.
+ * @elem: the element held (unused in the dummy node at the front).
+ * @free: link on the queue's list of spare nodes.
+ */
+struct lfqueue_node_ {
+	struct lfqueue_ptr_ next;
+	void *elem;
+	struct lfstack_link free;
+};
+
+/**
+ * struct lfqueue_ - a lock-free queue (internal type)
+ * @head: the dummy node in front of the first element.
+ * @tail: the last node, or one just before it.
+ * @spare: nodes available for reuse.
+ */
+struct lfqueue_ {
+	struct lfqueue_ptr_ head __attribute__((aligned(LFQUEUE_CACHELINE)));
+	struct lfqueue_ptr_ tail __attribute__((aligned(LFQUEUE_CACHELINE)));
+	LFSTACK(struct lfqueue_node_, free) spare
+		__attribute__((aligned(LFQUEUE_CACHELINE)));
+};
+
+/**
+ * LFQUEUE - declare a lock-free queue
+ * @type: the type of elements in the queue
+ *
+ * The LFQUEUE macro declares an lfqueue, an unbounded queue of pointers
+ * to @type which any number of threads may enqueue to and dequeue from
+ * at once.  It must be initialized with lfqueue_init() before use, and
+ * freed with lfqueue_free().
+ *
+ * This is the Michael-Scott queue, which always keeps a dummy node at
+ * the front: dequeuing hands out the element of the node after it, which
+ * becomes the new dummy.  So the nodes belong to the queue rather than
+ * being embedded in the elements.  Nodes are recycled through a
+ * lock-free free list and only freed by lfqueue_free(), so once the
+ * queue has grown to its working size, it doesn't allocate.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *	};
+ *	LFQUEUE(struct element) my_queue;
+ */
+#define LFQUEUE(etype)							\
+	TCON_WRAP(struct lfqueue_, etype *canary)
+
+/**
+ * lfqueue_init - initialize a queue
+ * @q: the lfqueue
+ *
+ * Returns false if out of memory.  This must not race with other
+ * operations on the queue.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *	};
+ *	LFQUEUE(struct element) *qp = malloc(sizeof(*qp));
+ *	if (!lfqueue_init(qp))
+ *		abort();
+ */
+#define lfqueue_init(q_) \
+	lfqueue_init_(tcon_unwrap(q_))
+bool lfqueue_init_(struct lfqueue_ *q);
+
+/**
+ * lfqueue_free - free a queue's nodes
+ * @q: the lfqueue
+ *
+ * This does not free the elements: dequeue them first if necessary.
+ * This must not race with other operations on the queue.
+ *
+ * Example:
+ *	lfqueue_free(qp);
+ */
+#define lfqueue_free(q_) \
+	lfqueue_free_(tcon_unwrap(q_))
+void lfqueue_free_(struct lfqueue_ *q);
+
+/**
+ * lfqueue_empty - is a queue empty?
+ * @q: the lfqueue
+ *
+ * With other threads enqueuing and dequeuing, this may be out of date
+ * as soon as it returns.
+ */
+#define lfqueue_empty(q_) \
+	lfqueue_empty_(tcon_unwrap(q_))
+static inline bool lfqueue_empty_(struct lfqueue_ *q)
+{
+	struct lfqueue_node_ *head;
+
+	head = __atomic_load_n(&q->head.node, __ATOMIC_ACQUIRE);
+	return __atomic_load_n(&head->next.node, __ATOMIC_ACQUIRE) == NULL;
+}
+
+/**
+ * lfqueue_enqueue - add an element to the back of a queue
+ * @q: the lfqueue
+ * @e: the element (not NULL)
+ *
+ * Returns false if a node was needed and we ran out of memory.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *	} *e = malloc(sizeof(*e));
+ *	LFQUEUE(struct element) *qp = malloc(sizeof(*qp));
+ *	if (!lfqueue_init(qp) || !lfqueue_enqueue(qp, e))
+ *		abort();
+ */
+#define lfqueue_enqueue(q_, e_) \
+	lfqueue_enqueue_(tcon_unwrap(tcon_check((q_), canary, (e_))), (e_))
+bool lfqueue_enqueue_(struct lfqueue_ *q, void *e);
+
+/**
+ * lfqueue_dequeue - remove the element at the front of a queue
+ * @q: the lfqueue
+ *
+ * Returns NULL if the queue is empty.
+ *
+ * Example:
+ *	e = lfqueue_dequeue(qp);
+ *	free(e);
+ */
+#define lfqueue_dequeue(q_) \
+	tcon_cast((q_), canary, lfqueue_dequeue_(tcon_unwrap(q_)))
+void *lfqueue_dequeue_(struct lfqueue_ *q);
+
+#endif /* CCAN_LFQUEUE_H */
@@ -0,0 +1,62 @@
+#include <ccan/lfqueue/lfqueue.h>
+/* Include the C files directly. */
+#include <ccan/lfqueue/lfqueue.c>
+#include <ccan/tap/tap.h>
+
+struct waiter {
+	const char *name;
+};
+
+int main(void)
+{
+	LFQUEUE(struct waiter) q;
+	struct waiter a = { "Alice" };
+	struct waiter b = { "Bob" };
+	struct waiter c = { "Carol" };
+	struct lfstack_link *l;
+	int i, spares;
+
+	/* This is how many tests you plan to run */
+	plan_tests(20);
+
+	ok1(lfqueue_init(&q));
+	ok1(lfqueue_empty(&q));
+	ok1(lfqueue_dequeue(&q) == NULL);
+
+	ok1(lfqueue_enqueue(&q, &a));
+	ok1(!lfqueue_empty(&q));
+	ok1(lfqueue_enqueue(&q, &b));
+	ok1(lfqueue_enqueue(&q, &c));
+
+	ok1(lfqueue_dequeue(&q) == &a);
+	ok1(lfqueue_dequeue(&q) == &b);
+	ok1(!lfqueue_empty(&q));
+	ok1(lfqueue_dequeue(&q) == &c);
+	ok1(lfqueue_empty(&q));
+	ok1(lfqueue_dequeue(&q) == NULL);
+
+	/* Three dequeues leave three spare nodes... */
+	spares = 0;
+	for (l = tcon_unwrap(&tcon_unwrap(&q)->spare)->top; l; l = l->down)
+		spares++;
+	ok1(spares == 3);
+
+	/* ...which are reused before anything is allocated. */
+	ok1(lfqueue_enqueue(&q, &c));
+	ok1(lfqueue_enqueue(&q, &a));
+	ok1(!lfstack_empty(&tcon_unwrap(&q)->spare));
+
+	/* Keep two queued, over many laps of the spares. */
+	for (i = 0; i < 1000; i++) {
+		lfqueue_enqueue(&q, i & 1 ? &a : &b);
+		if (lfqueue_dequeue(&q) != (i == 0 ? &c : (i & 1 ? &a : &b)))
+			break;
+	}
+	ok1(i == 1000);
+	ok1(lfqueue_dequeue(&q) == &b);
+	ok1(lfqueue_dequeue(&q) == &a);
+	lfqueue_free(&q);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
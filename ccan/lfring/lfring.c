@@ -0,0 +1,25 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#include <ccan/lfring/lfring.h>
+#include <stdlib.h>
+
+bool lfring_init_(struct lfring_ *r, size_t size)
+{
+	size_t i, n = 2;
+
+	while (n < size)
+		n *= 2;
+	r->cells = malloc(n * sizeof(*r->cells));
+	if (!r->cells)
+		return false;
+	for (i = 0; i < n; i++)
+		r->cells[i].seq = i;
+	r->mask = n - 1;
+	r->head = r->tail = 0;
+	return true;
+}
+
+void lfring_free_(struct lfring_ *r)
+{
+	free(r->cells);
+	r->cells = NULL;
+}
@@ -0,0 +1,195 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_LFRING_H
+#define CCAN_LFRING_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ccan/tcon/tcon.h>
+
+/* Head and tail are kept this far apart, so producers and consumers don't
+ * share a cache line. */
+#define LFRING_CACHELINE 64
+
+/**
+ * struct lfring_cell_ - a slot in a ring (internal type)
+ * @seq: position this slot is next ready for: pos when empty, pos + 1 when
+ *	full.
+ * @elem: the element stored in the slot.
+ */
+struct lfring_cell_ {
+	size_t seq;
+	void *elem;
+};
+
+/**
+ * struct lfring_ - a bounded lock-free ring (internal type)
+ * @mask: number of slots, minus one.
+ * @cells: the slots.
+ * @tail: position of next enqueue.
+ * @head: position of next dequeue.
+ */
+struct lfring_ {
+	size_t mask;
+	struct lfring_cell_ *cells;
+	size_t tail __attribute__((aligned(LFRING_CACHELINE)));
+	size_t head __attribute__((aligned(LFRING_CACHELINE)));
+} __attribute__((aligned(LFRING_CACHELINE)));
+
+/**
+ * LFRING - declare a bounded lock-free ring
+ * @type: the type of elements in the ring
+ *
+ * The LFRING macro declares an lfring, a fixed-size queue of pointers to
+ * @type which any number of threads may enqueue to and dequeue from at
+ * once.  It must be initialized with lfring_init() before use, and
+ * freed with lfring_free().
+ *
+ * Each enqueue or dequeue claims its slot with one compare and swap on
+ * the tail or head, and the two are kept on separate cache lines.  A
+ * thread which claims a slot and is then descheduled holds up only that
+ * slot: until it finishes, dequeuers see the ring as empty there (or
+ * enqueuers see it as full).
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *	};
+ *	LFRING(struct element) my_ring;
+ */
+#define LFRING(etype)							\
+	TCON_WRAP(struct lfring_, etype *canary)
+
+/**
+ * lfring_init - initialize a ring
+ * @r: the lfring
+ * @size: the minimum number of elements it can hold.
+ *
+ * The size is rounded up to a power of two.  Returns false if out of
+ * memory.  This must not race with other operations on the ring.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *	};
+ *	LFRING(struct element) *rp = malloc(sizeof(*rp));
+ *	if (!lfring_init(rp, 1000))
+ *		abort();
+ */
+#define lfring_init(r_, size) \
+	lfring_init_(tcon_unwrap(r_), (size))
+bool lfring_init_(struct lfring_ *r, size_t size);
+
+/**
+ * lfring_free - free a ring's storage
+ * @r: the lfring
+ *
+ * This does not free the elements: dequeue them first if necessary.
+ * This must not race with other operations on the ring.
+ *
+ * Example:
+ *	lfring_free(rp);
+ */
+#define lfring_free(r_) \
+	lfring_free_(tcon_unwrap(r_))
+void lfring_free_(struct lfring_ *r);
+
+/**
+ * lfring_capacity - number of elements a ring can hold
+ * @r: the lfring
+ */
+#define lfring_capacity(r_) \
+	lfring_capacity_(tcon_unwrap(r_))
+static inline size_t lfring_capacity_(const struct lfring_ *r)
+{
+	return r->mask + 1;
+}
+
+/**
+ * lfring_enqueue - add an element to the back of a ring
+ * @r: the lfring
+ * @e: the element (not NULL)
+ *
+ * Returns false if the ring is full.
+ *
+ * Example:
+ *	struct element *e = malloc(sizeof(*e));
+ *	if (!lfring_enqueue(rp, e))
+ *		free(e);
+ */
+#define lfring_enqueue(r_, e_) \
+	lfring_enqueue_(tcon_unwrap(tcon_check((r_), canary, (e_))), (e_))
+static inline bool lfring_enqueue_(struct lfring_ *r, void *e)
+{
+	size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	struct lfring_cell_ *c;
+
+	for (;;) {
+		size_t seq;
+		intptr_t diff;
+
+		c = &r->cells[pos & r->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			/* Slot is free: claim it (pos is reloaded if not). */
+			if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Slot still holds the element from a lap ago. */
+			return false;
+		} else
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	}
+	c->elem = e;
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * lfring_dequeue - remove the element at the front of a ring
+ * @r: the lfring
+ *
+ * Returns NULL if the ring is empty.
+ *
+ * Example:
+ *	e = lfring_dequeue(rp);
+ *	free(e);
+ */
+#define lfring_dequeue(r_) \
+	tcon_cast((r_), canary, lfring_dequeue_(tcon_unwrap(r_)))
+static inline void *lfring_dequeue_(struct lfring_ *r)
+{
+	size_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	struct lfring_cell_ *c;
+	void *e;
+
+	for (;;) {
+		size_t seq;
+		intptr_t diff;
+
+		c = &r->cells[pos & r->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Slot not filled yet for this lap. */
+			return NULL;
+		} else
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	}
+	e = c->elem;
+	/* Ready for the enqueue one lap on. */
+	__atomic_store_n(&c->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+	return e;
+}
+
+#endif /* CCAN_LFRING_H */
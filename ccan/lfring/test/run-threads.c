@@ -0,0 +1,86 @@
+#include <ccan/lfring/lfring.h>
+/* Include the C files directly. */
+#include <ccan/lfring/lfring.c>
+#include <ccan/tap/tap.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define PER_THREAD 20000
+
+/* Only OpenMP gives us the threads to race. */
+#ifdef _OPENMP
+struct elem {
+	unsigned int thread, seq;
+	unsigned int received;
+};
+
+static struct elem elems[NUM_THREADS][PER_THREAD];
+
+/* Each thread enqueues its own elements, dequeuing whatever it can as it
+ * goes.  Every element must come out exactly once, and those from each
+ * producer in order as seen by each consumer. */
+static bool mpmc(size_t size)
+{
+	LFRING(struct elem) r;
+	bool ok = true;
+	int t;
+
+	memset(elems, 0, sizeof(elems));
+	if (!lfring_init(&r, size))
+		return false;
+
+#pragma omp parallel for num_threads(NUM_THREADS) reduction(&&:ok)
+	for (t = 0; t < NUM_THREADS; t++) {
+		unsigned int last[NUM_THREADS], i = 0;
+		struct elem *e;
+
+		memset(last, 0, sizeof(last));
+		while (i < PER_THREAD) {
+			elems[t][i].thread = t;
+			elems[t][i].seq = i + 1;
+			if (lfring_enqueue(&r, &elems[t][i]))
+				i++;
+			e = lfring_dequeue(&r);
+			if (e) {
+				if (e->seq <= last[e->thread])
+					ok = false;
+				last[e->thread] = e->seq;
+				__atomic_add_fetch(&e->received, 1,
+						   __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	/* Drain what's left. */
+	for (;;) {
+		struct elem *e = lfring_dequeue(&r);
+		if (!e)
+			break;
+		e->received++;
+	}
+	lfring_free(&r);
+
+	for (t = 0; t < NUM_THREADS; t++) {
+		unsigned int i;
+		for (i = 0; i < PER_THREAD; i++)
+			if (elems[t][i].received != 1)
+				ok = false;
+	}
+	return ok;
+}
+#endif /* _OPENMP */
+
+int main(void)
+{
+	plan_tests(3);
+
+#ifdef _OPENMP
+	ok1(mpmc(2));
+	ok1(mpmc(64));
+	ok1(mpmc(4096));
+#else
+	skip(3, "not compiled with OpenMP");
+#endif
+
+	return exit_status();
+}
@@ -0,0 +1,59 @@
+#include <ccan/lfring/lfring.h>
+/* Include the C files directly. */
+#include <ccan/lfring/lfring.c>
+#include <ccan/tap/tap.h>
+
+struct elem {
+	int id;
+};
+
+int main(void)
+{
+	LFRING(struct elem) r;
+	struct elem e[20];
+	int i, lap;
+	bool ok;
+
+	/* This is how many tests you plan to run */
+	plan_tests(10);
+
+	for (i = 0; i < 20; i++)
+		e[i].id = i;
+
+	ok1(lfring_init(&r, 5));
+	ok1(lfring_capacity(&r) == 8);
+	ok1(lfring_dequeue(&r) == NULL);
+
+	for (i = 0; i < 8; i++)
+		if (!lfring_enqueue(&r, &e[i]))
+			break;
+	ok1(i == 8);
+	ok1(!lfring_enqueue(&r, &e[8]));
+	for (i = 0; i < 8; i++)
+		if (lfring_dequeue(&r) != &e[i])
+			break;
+	ok1(i == 8);
+	ok1(lfring_dequeue(&r) == NULL);
+
+	/* Go round many times, at varying fill levels. */
+	ok = true;
+	for (lap = 0; lap < 100; lap++) {
+		int n = lap % 9;
+
+		for (i = 0; i < n; i++)
+			ok &= lfring_enqueue(&r, &e[i + lap % 11]);
+		for (i = 0; i < n; i++)
+			ok &= (lfring_dequeue(&r) == &e[i + lap % 11]);
+		ok &= (lfring_dequeue(&r) == NULL);
+	}
+	ok1(ok);
+	lfring_free(&r);
+
+	/* Smallest ring. */
+	ok1(lfring_init(&r, 0));
+	ok1(lfring_capacity(&r) == 2);
+	lfring_free(&r);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
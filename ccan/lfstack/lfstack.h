@@ -0,0 +1,240 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_LFSTACK_H
+#define CCAN_LFSTACK_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ccan/tcon/tcon.h>
+
+/**
+ * struct lfstack_link - a lock-free stack link
+ * @down: immedately lower entry in the stack, or NULL if this is the bottom.
+ *
+ * This is used as an entry in a stack.
+ *
+ * Example:
+ *	struct stacker {
+ *		char *name;
+ *		struct lfstack_link sl;
+ *	};
+ */
+struct lfstack_link {
+	struct lfstack_link *down;
+};
+
+/**
+ * struct lfstack_ - a lock-free stack (internal type)
+ * @top: the top of the stack (NULL if empty)
+ * @gen: incremented by every pop, so a stale @top never matches.
+ *
+ * Both fields are replaced together with a double-word compare and swap.
+ */
+struct lfstack_ {
+	struct lfstack_link *top;
+	uintptr_t gen;
+} __attribute__((aligned(2 * sizeof(void *))));
+
+/**
+ * LFSTACK - declare a lock-free stack
+ * @type: the type of elements in the stack
+ * @link: the field containing the lfstack_link in @type
+ *
+ * The LFSTACK macro declares an lfstack.  It can be prepended by
+ * "static" to define a static lfstack.  The stack begins in undefined
+ * state, you must either initialize with LFSTACK_INIT, or call
+ * lfstack_init() before using it.
+ *
+ * Any number of threads may push and pop concurrently.  Popping reads
+ * the link of an entry which another thread may have just popped, so
+ * entries must stay readable while the stack is in use: keep them in
+ * a pool, or only free them once no thread can be popping.
+ *
+ * See also:
+ *	lfstack_init()
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *		struct lfstack_link link;
+ *	};
+ *	LFSTACK(struct element, link) my_stack;
+ */
+#define LFSTACK(etype, link)						\
+	TCON_WRAP(struct lfstack_,					\
+		  TCON_CONTAINER(canary, etype, link))
+
+/**
+ * LFSTACK_INIT - initializer for an empty stack
+ *
+ * The LFSTACK_INIT macro returns a suitable initializer for a stack
+ * defined with LFSTACK.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *		struct lfstack_link link;
+ *	};
+ *	LFSTACK(struct element, link) my_stack = LFSTACK_INIT;
+ *
+ *	assert(lfstack_empty(&my_stack));
+ */
+#define LFSTACK_INIT				\
+	TCON_WRAP_INIT({ NULL, 0 })
+
+/**
+ * lfstack_entry - convert an lfstack_link back into the structure containing it.
+ * @s: the stack
+ * @l: the lfstack_link
+ *
+ * Example:
+ *	static struct element {
+ *		int value;
+ *		struct lfstack_link link;
+ *	} e;
+ *	LFSTACK(struct element, link) my_stack;
+ *	assert(lfstack_entry(&my_stack, &e.link) == &e);
+ */
+#define lfstack_entry(s_, l_) tcon_container_of((s_), canary, (l_))
+
+/**
+ * lfstack_init - initialize a stack
+ * @s: the lfstack to set to an empty stack
+ *
+ * This must not race with other operations on the stack.
+ *
+ * Example:
+ *	struct element {
+ *		int value;
+ *		struct lfstack_link link;
+ *	};
+ *	LFSTACK(struct element, link) *sp = malloc(sizeof(*sp));
+ *	lfstack_init(sp);
+ */
+#define lfstack_init(s_) \
+	lfstack_init_(tcon_unwrap(s_))
+static inline void lfstack_init_(struct lfstack_ *s)
+{
+	s->top = NULL;
+	s->gen = 0;
+}
+
+/**
+ * lfstack_empty - is a stack empty?
+ * @s: the stack
+ *
+ * If the stack is empty, returns true.  With other threads pushing and
+ * popping, this may be out of date as soon as it returns.
+ */
+#define lfstack_empty(s_) \
+	lfstack_empty_(tcon_unwrap(s_))
+static inline bool lfstack_empty_(const struct lfstack_ *s)
+{
+	return __atomic_load_n(&s->top, __ATOMIC_ACQUIRE) == NULL;
+}
+
+static inline bool lfstack_cas_(struct lfstack_ *s, struct lfstack_ *old,
+				struct lfstack_link *top, uintptr_t gen)
+{
+	struct lfstack_ want;
+
+	want.top = top;
+	want.gen = gen;
+	return __atomic_compare_exchange(s, old, &want, true,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* The halves may be read from different states: the CAS then fails. */
+static inline void lfstack_read_(struct lfstack_ *s, struct lfstack_ *old)
+{
+	old->gen = __atomic_load_n(&s->gen, __ATOMIC_ACQUIRE);
+	old->top = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * lfstack_push - add an entry to the top of the stack
+ * @s: the stack to add the node to
+ * @e: the item to push
+ *
+ * The lfstack_link does not need to be initialized; it will be overwritten.
+ *
+ * Example:
+ *	struct element *e = malloc(sizeof(*e));
+ *	lfstack_push(sp, e);
+ */
+#define lfstack_push(s_, e_) \
+	lfstack_push_(tcon_unwrap(s_), tcon_member_of((s_), canary, (e_)))
+static inline void lfstack_push_(struct lfstack_ *s, struct lfstack_link *e)
+{
+	struct lfstack_ old;
+
+	lfstack_read_(s, &old);
+	do {
+		__atomic_store_n(&e->down, old.top, __ATOMIC_RELAXED);
+	} while (!lfstack_cas_(s, &old, e, old.gen));
+}
+
+/**
+ * lfstack_pop - remove and return the entry from the top of the stack
+ * @s: the stack
+ *
+ * Returns NULL if the stack is empty.  Note that this leaves the
+ * returned entry's link in an undefined state; it can be added to
+ * another stack, but not deleted again.
+ *
+ * Example:
+ *	e = lfstack_pop(sp);
+ *	free(e);
+ */
+#define lfstack_pop(s_)					\
+	lfstack_entry((s_), lfstack_pop_(tcon_unwrap((s_))))
+static inline struct lfstack_link *lfstack_pop_(struct lfstack_ *s)
+{
+	struct lfstack_ old;
+
+	lfstack_read_(s, &old);
+	while (old.top) {
+		struct lfstack_link *down;
+
+		/* old.top may be popped (and reused) under us: then the
+		 * generation has moved on, and the CAS fails. */
+		down = __atomic_load_n(&old.top->down, __ATOMIC_RELAXED);
+		if (lfstack_cas_(s, &old, down, old.gen + 1))
+			return old.top;
+	}
+	return NULL;
+}
+
+/**
+ * lfstack_pop_all - atomically empty the stack
+ * @s: the stack
+ *
+ * Returns the link of the old top entry (NULL if the stack was empty);
+ * the rest follow through ->down, and no other thread can see them
+ * any more.  Use lfstack_entry() to get the entries.
+ *
+ * Example:
+ *	struct lfstack_link *l = lfstack_pop_all(sp);
+ *
+ *	while (l) {
+ *		e = lfstack_entry(sp, l);
+ *		l = l->down;
+ *		free(e);
+ *	}
+ */
+#define lfstack_pop_all(s_) \
+	lfstack_pop_all_(tcon_unwrap(s_))
+static inline struct lfstack_link *lfstack_pop_all_(struct lfstack_ *s)
+{
+	struct lfstack_ old;
+
+	lfstack_read_(s, &old);
+	while (old.top) {
+		if (lfstack_cas_(s, &old, NULL, old.gen + 1))
+			return old.top;
+	}
+	return NULL;
+}
+
+#endif /* CCAN_LFSTACK_H */
@@ -0,0 +1,71 @@
+#include "config.h"
+
+#include <ccan/lfstack/lfstack.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/tap/tap.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define NUM_ELEMS 1000
+#define NUM_OPS 200000
+#define NUM_THREADS 8
+
+/* Only OpenMP gives us the threads to race. */
+#ifdef _OPENMP
+struct elem {
+	unsigned int seen;
+	struct lfstack_link sl;
+};
+
+static struct elem elems[NUM_ELEMS];
+
+/* Every thread pops, then pushes back what it got: nothing may be lost
+ * or handed to two threads at once. */
+static bool churn(void)
+{
+	LFSTACK(struct elem, sl) s = LFSTACK_INIT;
+	struct lfstack_link *l;
+	unsigned int i, count = 0;
+	bool ok = true;
+
+	memset(elems, 0, sizeof(elems));
+	for (i = 0; i < NUM_ELEMS; i++)
+		lfstack_push(&s, &elems[i]);
+
+#pragma omp parallel for num_threads(NUM_THREADS) reduction(&&:ok)
+	for (i = 0; i < NUM_OPS; i++) {
+		struct elem *e = lfstack_pop(&s);
+
+		if (!e)
+			continue;
+		/* Nobody else may have this now. */
+		if (__atomic_add_fetch(&e->seen, 1, __ATOMIC_RELAXED) != 1)
+			ok = false;
+		__atomic_sub_fetch(&e->seen, 1, __ATOMIC_RELAXED);
+		lfstack_push(&s, e);
+	}
+
+	for (l = lfstack_pop_all(&s); l; l = l->down) {
+		struct elem *e = lfstack_entry(&s, l);
+		if (e->seen++)
+			ok = false;
+		count++;
+	}
+	return ok && count == NUM_ELEMS;
+}
+#endif /* _OPENMP */
+
+int main(void)
+{
+	plan_tests(3);
+
+#ifdef _OPENMP
+	ok1(churn());
+	ok1(churn());
+	ok1(churn());
+#else
+	skip(3, "not compiled with OpenMP");
+#endif
+
+	return exit_status();
+}
@@ -0,0 +1,53 @@
+#include "config.h"
+
+#include <ccan/lfstack/lfstack.h>
+#include <ccan/tap/tap.h>
+
+struct stacker {
+	const char *name;
+	struct lfstack_link sl;
+};
+
+int main(void)
+{
+	LFSTACK(struct stacker, sl) s = LFSTACK_INIT;
+	struct stacker a = { "Alice" };
+	struct stacker b = { "Bob" };
+	struct stacker c = { "Carol" };
+	struct lfstack_link *l;
+
+	/* This is how many tests you plan to run */
+	plan_tests(15);
+
+	ok1(lfstack_empty(&s));
+	ok1(lfstack_pop(&s) == NULL);
+
+	lfstack_push(&s, &a);
+	ok1(!lfstack_empty(&s));
+	lfstack_push(&s, &b);
+	lfstack_push(&s, &c);
+
+	ok1(lfstack_pop(&s) == &c);
+	ok1(lfstack_pop(&s) == &b);
+
+	/* Popped entries can go straight back on. */
+	lfstack_push(&s, &b);
+	ok1(lfstack_pop(&s) == &b);
+	ok1(lfstack_pop(&s) == &a);
+	ok1(lfstack_empty(&s));
+	ok1(lfstack_pop(&s) == NULL);
+
+	lfstack_push(&s, &a);
+	lfstack_push(&s, &b);
+	lfstack_push(&s, &c);
+	l = lfstack_pop_all(&s);
+	ok1(lfstack_empty(&s));
+	ok1(lfstack_entry(&s, l) == &c);
+	ok1(lfstack_entry(&s, l->down) == &b);
+	ok1(lfstack_entry(&s, l->down->down) == &a);
+	ok1(l->down->down->down == NULL);
+	ok1(lfstack_pop_all(&s) == NULL);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
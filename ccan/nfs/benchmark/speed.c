@@ -0,0 +1,163 @@
+/* Issues NFS NULL calls against a stub RPC server on the loopback interface,
+ * keeping a fixed number of them outstanding, and reports calls per second
+ * at each queue depth.  The stub answers every call it has read with one
+ * write, last call first as a multi-threaded server might, so deep queues
+ * mean many out-of-order replies arrive per read. */
+#include <ccan/nfs/nfs.h>
+#include <ccan/nfs/libnfs-raw.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <err.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CALLS 200000
+
+/* Record marker, xid, REPLY, MSG_ACCEPTED, null verifier, SUCCESS. */
+static void make_reply(uint32_t *r, uint32_t xid)
+{
+	r[0] = htonl(0x80000000 | 24);
+	r[1] = xid;
+	r[2] = htonl(1);
+	r[3] = htonl(0);
+	r[4] = htonl(0);
+	r[5] = htonl(0);
+	r[6] = htonl(0);
+}
+
+static void stub_server(int lfd)
+{
+	static char in[1 << 20];
+	static uint32_t out[(1 << 20) / 4];
+	size_t len = 0, pos, nout;
+	ssize_t n;
+	int fd = accept(lfd, NULL, NULL);
+
+	if (fd < 0)
+		err(1, "accept");
+	while ((n = read(fd, in + len, sizeof(in) - len)) > 0) {
+		len += n;
+		pos = nout = 0;
+		while (len - pos >= 8) {
+			uint32_t size = (ntohl(*(uint32_t *)(in + pos))
+					 & 0x7fffffff) + 4;
+			if (len - pos < size || nout + 7 > sizeof(out) / 4)
+				break;
+			nout += 7;
+			make_reply(out + sizeof(out) / 4 - nout,
+				   *(uint32_t *)(in + pos + 4));
+			pos += size;
+		}
+		memmove(in, in + pos, len - pos);
+		len -= pos;
+		if (nout && write(fd, out + sizeof(out) / 4 - nout, nout * 4)
+		    != (ssize_t)(nout * 4))
+			err(1, "write");
+	}
+	exit(0);
+}
+
+static unsigned int issued, done, failed;
+static int connected;
+
+static void null_cb(struct rpc_context *rpc, int status, void *data,
+		    void *private_data);
+
+static void issue(struct rpc_context *rpc)
+{
+	issued++;
+	if (rpc_nfs_null_async(rpc, null_cb, NULL) != 0)
+		errx(1, "rpc_nfs_null_async: %s", rpc_get_error(rpc));
+}
+
+static void null_cb(struct rpc_context *rpc, int status, void *data,
+		    void *private_data)
+{
+	if (status != RPC_STATUS_SUCCESS)
+		failed++;
+	done++;
+	if (issued < CALLS)
+		issue(rpc);
+}
+
+static void connect_cb(struct rpc_context *rpc, int status, void *data,
+		       void *private_data)
+{
+	if (status != RPC_STATUS_SUCCESS)
+		errx(1, "connect: %s", (char *)data);
+	connected = 1;
+}
+
+static void run(struct rpc_context *rpc)
+{
+	struct pollfd pfd;
+
+	pfd.fd = rpc_get_fd(rpc);
+	pfd.events = rpc_which_events(rpc);
+	if (poll(&pfd, 1, -1) < 0)
+		err(1, "poll");
+	if (rpc_service(rpc, pfd.revents) < 0)
+		errx(1, "rpc_service: %s", rpc_get_error(rpc));
+}
+
+int main(void)
+{
+	static const unsigned int depths[] = { 1, 16, 256, 4096, 16384 };
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	struct rpc_context *rpc;
+	unsigned int i, d;
+	int lfd;
+	pid_t pid;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) != 0
+	    || listen(lfd, 1) != 0
+	    || getsockname(lfd, (struct sockaddr *)&sin, &slen) != 0)
+		err(1, "listening on loopback");
+
+	pid = fork();
+	if (pid == 0)
+		stub_server(lfd);
+	close(lfd);
+
+	rpc = rpc_init_context();
+	if (rpc_connect_async(rpc, "127.0.0.1", ntohs(sin.sin_port), 0,
+			      connect_cb, NULL) != 0)
+		errx(1, "rpc_connect_async: %s", rpc_get_error(rpc));
+	while (!connected)
+		run(rpc);
+
+	for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+		struct timemono start = time_mono();
+		struct timerel diff;
+
+		issued = done = failed = 0;
+		for (i = 0; i < depths[d]; i++)
+			issue(rpc);
+		while (done < CALLS)
+			run(rpc);
+		diff = timemono_since(start);
+		if (failed)
+			errx(1, "%u calls failed", failed);
+		printf("depth %5u: %u calls in %6llu usec (%llu calls/sec)\n",
+		       depths[d], CALLS,
+		       (unsigned long long)time_to_usec(diff),
+		       (unsigned long long)CALLS * 1000000
+		       / (time_to_usec(diff) + 1));
+	}
+
+	rpc_destroy_context(rpc);
+	waitpid(pid, NULL, 0);
+	return 0;
+}
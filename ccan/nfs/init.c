@@ -91,16 +91,19 @@ char *rpc_get_error(struct rpc_context *rpc)
 void rpc_error_all_pdus(struct rpc_context *rpc, char *error)
 {
 	struct rpc_pdu *pdu;
+	int i;
 
 	while((pdu = rpc->outqueue) != NULL) {
 		pdu->cb(rpc, RPC_STATUS_ERROR, error, pdu->private_data);
 		DLIST_REMOVE(rpc->outqueue, pdu);
 		rpc_free_pdu(rpc, pdu);
 	}
-	while((pdu = rpc->waitpdu) != NULL) {
-		pdu->cb(rpc, RPC_STATUS_ERROR, error, pdu->private_data);
-		DLIST_REMOVE(rpc->waitpdu, pdu);
-		rpc_free_pdu(rpc, pdu);
+	for (i = 0; i < RPC_WAITPDU_HASHES; i++) {
+		while((pdu = rpc->waitpdu[i]) != NULL) {
+			pdu->cb(rpc, RPC_STATUS_ERROR, error, pdu->private_data);
+			DLIST_REMOVE(rpc->waitpdu[i], pdu);
+			rpc_free_pdu(rpc, pdu);
+		}
 	}
 }
 
@@ -108,16 +111,19 @@ void rpc_error_all_pdus(struct rpc_context *rpc, char *error)
 void rpc_destroy_context(struct rpc_context *rpc)
 {
 	struct rpc_pdu *pdu;
+	int i;
 
 	while((pdu = rpc->outqueue) != NULL) {
 		pdu->cb(rpc, RPC_STATUS_CANCEL, NULL, pdu->private_data);
 		DLIST_REMOVE(rpc->outqueue, pdu);
 		rpc_free_pdu(rpc, pdu);
 	}
-	while((pdu = rpc->waitpdu) != NULL) {
-		pdu->cb(rpc, RPC_STATUS_CANCEL, NULL, pdu->private_data);
-		DLIST_REMOVE(rpc->waitpdu, pdu);
-		rpc_free_pdu(rpc, pdu);
+	for (i = 0; i < RPC_WAITPDU_HASHES; i++) {
+		while((pdu = rpc->waitpdu[i]) != NULL) {
+			pdu->cb(rpc, RPC_STATUS_CANCEL, NULL, pdu->private_data);
+			DLIST_REMOVE(rpc->waitpdu[i], pdu);
+			rpc_free_pdu(rpc, pdu);
+		}
 	}
 
 	auth_destroy(rpc->auth);
@@ -137,6 +143,11 @@ void rpc_destroy_context(struct rpc_context *rpc)
 		rpc->error_string = NULL;
 	}
 
+	if (rpc->inbuf != NULL) {
+		free(rpc->inbuf);
+		rpc->inbuf = NULL;
+	}
+
 	free(rpc);
 }
 
@@ -19,6 +19,16 @@
 
 #include <rpc/auth.h>
 
+/* Outstanding PDUs are hashed on their xid, which goes up by one per call. */
+#define RPC_WAITPDU_HASHES 1024
+#define RPC_WAITPDU_HASH(xid) ((xid) & (RPC_WAITPDU_HASHES - 1))
+
+/* Most PDUs queued for output are handed to a single writev() */
+#define RPC_MAX_IOV 64
+
+/* Initial size of the receive buffer, which is kept for the connection */
+#define RPC_INBUF_MIN 65536
+
 struct rpc_context {
 	int fd;
 	int is_connected;
@@ -36,11 +46,12 @@ struct rpc_context {
        int encodebuflen;
 
        struct rpc_pdu *outqueue;
-       struct rpc_pdu *waitpdu;
+       struct rpc_pdu *waitpdu[RPC_WAITPDU_HASHES];
 
        int insize;
        int inpos;
        char *inbuf;
+       int inbuflen;
 };
 
 struct rpc_pdu {
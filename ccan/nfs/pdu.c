@@ -208,11 +208,11 @@ int rpc_process_pdu(struct rpc_context *rpc, char *buf, int size)
 	}
 	xdr_setpos(&xdr, pos);
 
-	for (pdu=rpc->waitpdu; pdu; pdu=pdu->next) {
+	for (pdu=rpc->waitpdu[RPC_WAITPDU_HASH(xid)]; pdu; pdu=pdu->next) {
 		if (pdu->xid != xid) {
 			continue;
 		}
-		DLIST_REMOVE(rpc->waitpdu, pdu);
+		DLIST_REMOVE(rpc->waitpdu[RPC_WAITPDU_HASH(xid)], pdu);
 		if (rpc_process_reply(rpc, pdu, &xdr) != 0) {
 			printf("rpc_procdess_reply failed\n");
 		}
@@ -25,6 +25,7 @@
 #include <rpc/xdr.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include "nfs.h"
 #include "libnfs-raw.h"
 #include "libnfs-private.h"
@@ -70,11 +71,18 @@ static int rpc_write_to_socket(struct rpc_context *rpc)
 	}
 
 	while (rpc->outqueue != NULL) {
-		ssize_t total;
-
-		total = rpc->outqueue->outdata.size;
+		struct iovec iov[RPC_MAX_IOV];
+		struct rpc_pdu *pdu;
+		int niov = 0;
+
+		/* Send as much of the queue as the socket will take at once */
+		for (pdu = rpc->outqueue; pdu != NULL && niov < RPC_MAX_IOV; pdu = pdu->next) {
+			iov[niov].iov_base = pdu->outdata.data + pdu->written;
+			iov[niov].iov_len  = pdu->outdata.size - pdu->written;
+			niov++;
+		}
 
-		count = write(rpc->fd, rpc->outqueue->outdata.data + rpc->outqueue->written, total - rpc->outqueue->written);
+		count = writev(rpc->fd, iov, niov);
 		if (count == -1) {
 			if (errno == EAGAIN || errno == EWOULDBLOCK) {
 				printf("socket would block, return from write to socket\n");
@@ -84,12 +92,21 @@ static int rpc_write_to_socket(struct rpc_context *rpc)
 			return -3;
 		}
 
-		rpc->outqueue->written += count;
-		if (rpc->outqueue->written == total) {
-			struct rpc_pdu *pdu = rpc->outqueue;
+		/* Everything written in full now waits for its reply */
+		while (count > 0) {
+			ssize_t left;
+
+			pdu  = rpc->outqueue;
+			left = pdu->outdata.size - pdu->written;
+			if (count < left) {
+				pdu->written += count;
+				break;
+			}
+			count -= left;
+			pdu->written = pdu->outdata.size;
 
 	       	    	DLIST_REMOVE(rpc->outqueue, pdu);
-			DLIST_ADD_END(rpc->waitpdu, pdu, NULL);
+			DLIST_ADD_END(rpc->waitpdu[RPC_WAITPDU_HASH(pdu->xid)], pdu, NULL);
 		}
 	}
 	return 0;
@@ -99,7 +116,7 @@ static int rpc_read_from_socket(struct rpc_context *rpc)
 {
 	int available;
 	int size;
-	unsigned char *buf;
+	char *buf;
 	ssize_t count;
 
 	if (ioctl(rpc->fd, FIONREAD, &available) != 0) {
@@ -110,56 +127,57 @@ static int rpc_read_from_socket(struct rpc_context *rpc)
 		rpc_set_error(rpc, "Socket has been closed");
 		return -2;
 	}
-	size = rpc->insize - rpc->inpos + available;
-	buf = malloc(size);
-	if (buf == NULL) {
-		rpc_set_error(rpc, "Out of memory: failed to allocate %d bytes for input buffer. Closing socket.", size);
-		return -3;
-	}
-	if (rpc->insize > rpc->inpos) {
-		memcpy(buf, rpc->inbuf + rpc->inpos, rpc->insize - rpc->inpos);
+
+	/* Keep any partial pdu at the start of the buffer, and make room */
+	if (rpc->inpos > 0) {
+		memmove(rpc->inbuf, rpc->inbuf + rpc->inpos, rpc->insize - rpc->inpos);
 		rpc->insize -= rpc->inpos;
 		rpc->inpos   = 0;
 	}
+	size = rpc->insize + available;
+	if (size > rpc->inbuflen) {
+		int len = rpc->inbuflen ? rpc->inbuflen : RPC_INBUF_MIN;
+
+		while (len < size) {
+			len *= 2;
+		}
+		buf = realloc(rpc->inbuf, len);
+		if (buf == NULL) {
+			rpc_set_error(rpc, "Out of memory: failed to allocate %d bytes for input buffer. Closing socket.", len);
+			return -3;
+		}
+		rpc->inbuf    = buf;
+		rpc->inbuflen = len;
+	}
 
-	count = read(rpc->fd, buf + rpc->insize, available);
+	count = read(rpc->fd, rpc->inbuf + rpc->insize, rpc->inbuflen - rpc->insize);
 	if (count == -1) {
 		if (errno == EINTR) {
-			free(buf);
-			buf = NULL;
 			return 0;
 		}
 		rpc_set_error(rpc, "Read from socket failed, errno:%d. Closing socket.", errno);
-		free(buf);
-		buf = NULL;
 		return -4;
 	}
-
-	if (rpc->inbuf != NULL) {
-		free(rpc->inbuf);
-	}
-	rpc->inbuf   = (char *)buf;
 	rpc->insize += count;
 
-	while (1) {
-		if (rpc->insize - rpc->inpos < 4) {
-			return 0;
-		}
+	while (rpc->insize - rpc->inpos >= 4) {
 		count = rpc_get_pdu_size(rpc->inbuf + rpc->inpos);
-		if (rpc->insize + rpc->inpos < count) {
-			return 0;
+		if (count < 0) {
+			rpc_set_error(rpc, "Invalid record marker received from server. Closing socket");
+			return -5;
+		}
+		if (rpc->insize - rpc->inpos < count) {
+			break;
 		}
 		if (rpc_process_pdu(rpc, rpc->inbuf + rpc->inpos, count) != 0) {
 			rpc_set_error(rpc, "Invalid/garbage pdu received from server. Closing socket");
 			return -5;
 		}
 		rpc->inpos += count;
-		if (rpc->inpos == rpc->insize) {
-			free(rpc->inbuf);
-			rpc->inbuf = NULL;
-			rpc->insize = 0;
-			rpc->inpos = 0;
-		}
+	}
+	if (rpc->inpos == rpc->insize) {
+		rpc->insize = 0;
+		rpc->inpos  = 0;
 	}
 	return 0;
 }
@@ -0,0 +1,90 @@
+/* Latency of pr_log_() calls, written synchronously and through the
+ * background writer, with 1 to 8 threads logging as fast as they can into
+ * a file.  Each call is timed, and we report the median, 99th percentile
+ * and worst call, and how many messages the async rings dropped. */
+#include <ccan/pr_log/pr_log.h>
+#include <ccan/time/time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_THREADS 8
+#define CALLS 200000
+
+static uint64_t lat[MAX_THREADS][CALLS];
+
+static void *log_thread(void *arg)
+{
+	uint64_t *l = arg;
+	int i;
+
+	for (i = 0; i < CALLS; i++) {
+		struct timemono start = time_mono();
+		pr_info("request %d from %p took %d usec: %s\n",
+			i, arg, i % 1000, "OK");
+		l[i] = time_to_nsec(timemono_since(start));
+	}
+	return NULL;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static void run(const char *what, int threads, unsigned long dropped)
+{
+	pthread_t tid[MAX_THREADS];
+	struct timemono start = time_mono();
+	uint64_t *all = malloc(sizeof(lat));
+	size_t n = (size_t)threads * CALLS;
+	struct timerel diff;
+	int i;
+
+	for (i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, log_thread, lat[i]);
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	diff = timemono_since(start);
+
+	for (i = 0; i < threads; i++)
+		memcpy(all + (size_t)i * CALLS, lat[i], sizeof(lat[i]));
+	qsort(all, n, sizeof(*all), cmp);
+	printf("%-5s %i threads: %6llu msec, per call median %4llu nsec,"
+	       " 99%% %6llu nsec, max %8llu nsec, %lu dropped\n",
+	       what, threads, (unsigned long long)time_to_msec(diff),
+	       (unsigned long long)all[n / 2],
+	       (unsigned long long)all[n * 99 / 100],
+	       (unsigned long long)all[n - 1],
+	       pr_log_async_dropped() - dropped);
+	free(all);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = argc > 1 ? argv[1] : "/tmp/pr_log-speed.log";
+	int threads, fd;
+
+	fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd < 0 || dup2(fd, STDERR_FILENO) < 0) {
+		perror(file);
+		return 1;
+	}
+
+	for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+		unsigned long dropped = pr_log_async_dropped();
+
+		run("sync", threads, dropped);
+		if (!pr_log_async_start(1024 * 1024))
+			return 1;
+		run("async", threads, dropped);
+		pr_log_async_stop();
+	}
+	unlink(file);
+	return 0;
+}
@@ -6,7 +6,14 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include <ccan/str/str.h>
 
@@ -32,6 +39,254 @@ int debug_level(void)
 	return debug;
 }
 
+/*
+ * Asynchronous output: each thread has a single-producer ring of records,
+ * each a 32-bit length then the formatted text, padded to 8 bytes.  A
+ * record never wraps: if it won't fit before the end, a PAD_RECORD fills
+ * the rest and it starts again at the beginning.  head and tail only ever
+ * grow; the writer thread owns tail, the logging thread owns head.
+ */
+#define PAD_RECORD UINT32_MAX
+#define RECORD_SIZE(len) ((sizeof(uint32_t) + (len) + 7) & ~(size_t)7)
+
+/* Most messages are formatted once, into this, then copied. */
+#define SHORT_RECORD 256
+/* How many records the writer hands to one writev(). */
+#define WRITE_BATCH 64
+/* How long the writer sleeps when there's nothing to write. */
+#define IDLE_NSEC 1000000
+
+struct log_ring {
+	struct log_ring *next;
+	/* Set when its thread exits: the writer frees it once drained. */
+	bool dead;
+	size_t size;
+	uint64_t head;
+	uint64_t tail;
+	/* Where tail will be once the writer's batch is written. */
+	uint64_t next_tail;
+	char buf[];
+};
+
+static bool async;
+static size_t async_ring_size;
+static unsigned long async_dropped;
+static bool async_stop;
+static pthread_t async_writer;
+/* Rings are pushed on here by logging threads, and removed by the writer. */
+static struct log_ring *rings;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static void ring_thread_exit(void *r)
+{
+	__atomic_store_n(&((struct log_ring *)r)->dead, true, __ATOMIC_RELEASE);
+}
+
+static void make_ring_key(void)
+{
+	if (pthread_key_create(&ring_key, ring_thread_exit) != 0)
+		abort();
+}
+
+static struct log_ring *my_ring(void)
+{
+	struct log_ring *r = pthread_getspecific(ring_key);
+
+	if (r)
+		return r;
+
+	r = malloc(sizeof(*r) + async_ring_size);
+	if (!r)
+		return NULL;
+	r->dead = false;
+	r->size = async_ring_size;
+	r->head = r->tail = r->next_tail = 0;
+	if (pthread_setspecific(ring_key, r) != 0) {
+		free(r);
+		return NULL;
+	}
+
+	r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &r->next, r, false,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return r;
+}
+
+/* Room for len bytes (plus a nul, for vsnprintf), or NULL if full. */
+static char *ring_reserve(struct log_ring *r, size_t len, uint64_t *end)
+{
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t off = r->head & (r->size - 1);
+	size_t need = RECORD_SIZE(len + 1), pad = 0;
+
+	if (need > r->size - off)
+		pad = r->size - off;
+	if (r->head + pad + need - tail > r->size)
+		return NULL;
+
+	if (pad) {
+		*(uint32_t *)(r->buf + off) = PAD_RECORD;
+		off = 0;
+	}
+	*(uint32_t *)(r->buf + off) = len;
+	*end = r->head + pad + need;
+	return r->buf + off + sizeof(uint32_t);
+}
+
+static void log_async(const char *fmt, va_list va)
+{
+	struct log_ring *r = my_ring();
+	char buf[SHORT_RECORD];
+	uint64_t end;
+	va_list va2;
+	char *dst;
+	int len;
+
+	va_copy(va2, va);
+	len = vsnprintf(buf, sizeof(buf), fmt, va);
+	if (len < 0 || !r || !(dst = ring_reserve(r, len, &end))) {
+		__atomic_add_fetch(&async_dropped, 1, __ATOMIC_RELAXED);
+		va_end(va2);
+		return;
+	}
+
+	if (len < (int)sizeof(buf))
+		memcpy(dst, buf, len);
+	else
+		vsnprintf(dst, len + 1, fmt, va2);
+	va_end(va2);
+
+	__atomic_store_n(&r->head, end, __ATOMIC_RELEASE);
+}
+
+static bool write_all(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt) {
+		ssize_t n = writev(fd, iov, iovcnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		while (iovcnt && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return true;
+}
+
+/* Write out one batch from every ring.  Returns false if they're empty. */
+static bool write_batch(void)
+{
+	struct iovec iov[WRITE_BATCH];
+	struct log_ring *r, **prev;
+	int n = 0;
+
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+		r->next_tail = r->tail;
+		while (r->next_tail != head && n < WRITE_BATCH) {
+			size_t off = r->next_tail & (r->size - 1);
+			uint32_t len = *(uint32_t *)(r->buf + off);
+
+			if (len == PAD_RECORD) {
+				r->next_tail += r->size - off;
+				continue;
+			}
+			iov[n].iov_base = r->buf + off + sizeof(uint32_t);
+			iov[n].iov_len = len;
+			n++;
+			r->next_tail += RECORD_SIZE(len + 1);
+		}
+	}
+
+	/* If stderr is gone, there's nothing better to do than discard. */
+	write_all(STDERR_FILENO, iov, n);
+
+	/* Rings of threads which have exited can go, once they're empty.
+	 * New rings only appear at the head of the list, so we leave it. */
+	prev = &rings;
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = *prev) {
+		__atomic_store_n(&r->tail, r->next_tail, __ATOMIC_RELEASE);
+		if (prev != &rings
+		    && __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE)
+		    && r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+			*prev = r->next;
+			free(r);
+			continue;
+		}
+		prev = &r->next;
+	}
+	return n != 0;
+}
+
+static void *async_writer_thread(void *unused)
+{
+	const struct timespec idle = { 0, IDLE_NSEC };
+
+	(void)unused;
+	while (!__atomic_load_n(&async_stop, __ATOMIC_ACQUIRE)) {
+		if (!write_batch())
+			nanosleep(&idle, NULL);
+	}
+
+	/* Everything logged before we were told to stop. */
+	while (write_batch());
+	return NULL;
+}
+
+bool pr_log_async_start(size_t ring_size)
+{
+	size_t size = 1;
+	int err;
+
+	if (async)
+		return true;
+
+	/* A power of two, so offsets are a mask, with room for a short
+	 * record at least. */
+	while ((size < ring_size || size < RECORD_SIZE(SHORT_RECORD))
+	       && size <= SIZE_MAX / 2)
+		size *= 2;
+
+	if (pthread_once(&ring_key_once, make_ring_key) != 0)
+		return false;
+
+	async_ring_size = size;
+	async_stop = false;
+	err = pthread_create(&async_writer, NULL, async_writer_thread, NULL);
+	if (err) {
+		errno = err;
+		return false;
+	}
+	__atomic_store_n(&async, true, __ATOMIC_RELEASE);
+	return true;
+}
+
+void pr_log_async_stop(void)
+{
+	if (!async)
+		return;
+
+	__atomic_store_n(&async, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&async_stop, true, __ATOMIC_RELEASE);
+	pthread_join(async_writer, NULL);
+}
+
+unsigned long pr_log_async_dropped(void)
+{
+	return __atomic_load_n(&async_dropped, __ATOMIC_RELAXED);
+}
+
 void pr_log_(char const *fmt, ...)
 {
 	int level = INT_MIN;
@@ -43,6 +298,9 @@ void pr_log_(char const *fmt, ...)
 
 	va_list va;
 	va_start(va, fmt);
-	vfprintf(stderr, fmt, va);
+	if (__atomic_load_n(&async, __ATOMIC_ACQUIRE))
+		log_async(fmt, va);
+	else
+		vfprintf(stderr, fmt, va);
 	va_end(va);
 }
@@ -3,6 +3,7 @@
 #define CCAN_PR_LOG_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <ccan/compiler/compiler.h>
 
 /*
@@ -60,6 +61,53 @@ static PRINTF_FMT(1,2) inline void pr_check_printf_args(const char *fmt, ...)
 void PRINTF_FMT(1,2) pr_log_(char const *fmt, ...);
 bool debug_is(int lvl);
 int debug_level(void);
+
+/**
+ * pr_log_async_start - write output from a background thread
+ * @ring_size: bytes of buffer for each thread which logs.
+ *
+ * Normally pr_log_() writes to stderr before it returns.  After this, each
+ * thread formats its messages into a ring buffer of its own, and a
+ * background thread writes them out in batches, so logging never waits
+ * for a write.  If a thread's ring is full, the message is dropped and
+ * counted (see pr_log_async_dropped()).
+ *
+ * Each thread's messages stay in order, but messages from different
+ * threads may not come out in the order they were logged, and output
+ * can lag by a millisecond or so.
+ *
+ * Returns false (and sets errno) if the thread can't be started.
+ *
+ * Example:
+ *
+ *	if (!pr_log_async_start(64 * 1024))
+ *		pr_warn("logging synchronously\n");
+ */
+bool pr_log_async_start(size_t ring_size);
+
+/**
+ * pr_log_async_stop - write out everything logged, then go back to
+ * synchronous output.
+ *
+ * Other threads should have stopped logging by the time this is called:
+ * anything they log meanwhile may be lost.
+ *
+ * Example:
+ *
+ *	pr_log_async_stop();
+ */
+void pr_log_async_stop(void);
+
+/**
+ * pr_log_async_dropped - how many messages were dropped, because a ring
+ * was full (or couldn't be allocated).
+ *
+ * Example:
+ *
+ *	if (pr_log_async_dropped())
+ *		pr_warn("lost %lu log messages\n", pr_log_async_dropped());
+ */
+unsigned long pr_log_async_dropped(void);
 #else
 static PRINTF_FMT(1,2) inline void pr_log_(char const *fmt, ...)
 {
@@ -67,6 +115,13 @@ static PRINTF_FMT(1,2) inline void pr_log_(char const *fmt, ...)
 }
 static inline bool debug_is(int lvl) { (void)lvl; return false; }
 static inline int debug_level(void) { return -1; }
+static inline bool pr_log_async_start(size_t ring_size)
+{
+	(void)ring_size;
+	return true;
+}
+static inline void pr_log_async_stop(void) { }
+static inline unsigned long pr_log_async_dropped(void) { return 0; }
 #endif
 
 #endif
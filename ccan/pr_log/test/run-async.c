@@ -0,0 +1,144 @@
+#include <ccan/pr_log/pr_log.h>
+#include <ccan/pr_log/pr_log.c>
+#include <ccan/tap/tap.h>
+#include <fcntl.h>
+
+#define THREADS 4
+#define MESSAGES 1000
+
+static void *log_thread(void *arg)
+{
+	int i;
+
+	for (i = 0; i < MESSAGES; i++)
+		pr_info("thread %ld message %d\n", (long)arg, i);
+	return NULL;
+}
+
+static char *slurp(int fd);
+
+static int count_lines(const char *buf, long *last, bool *in_order)
+{
+	long t;
+	int i, n = 0;
+
+	for (t = 0; t < THREADS; t++)
+		last[t] = -1;
+	*in_order = true;
+
+	while ((buf = strstr(buf, "thread "))) {
+		if (sscanf(buf, "thread %ld message %d", &t, &i) != 2
+		    || t < 0 || t >= THREADS || i <= last[t])
+			*in_order = false;
+		else
+			last[t] = i;
+		buf++;
+		n++;
+	}
+	return n;
+}
+
+/* Too long for a new thread's ring. */
+static void *log_too_long(void *unused)
+{
+	pr_info("%*s\n", 8192, "too long");
+	return unused;
+}
+
+static void *slurp_thread(void *fd)
+{
+	return slurp((long)fd);
+}
+
+static char *slurp(int fd)
+{
+	static char buf[1024 * 1024];
+	size_t len = 0;
+	ssize_t r;
+
+	while ((r = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+		len += r;
+	buf[len] = '\0';
+	return buf;
+}
+
+int main(void)
+{
+	pthread_t threads[THREADS];
+	char tmpl[] = "/tmp/pr_log-async.XXXXXX";
+	char tmpl2[] = "/tmp/pr_log-async.XXXXXX";
+	char big[SHORT_RECORD * 2];
+	long t, last[THREADS];
+	int fd, saved, p[2];
+	bool in_order;
+	char *out;
+
+	plan_tests(12);
+	debug = 6;
+	saved = dup(STDERR_FILENO);
+
+	/* Every thread's messages come out, in order. */
+	fd = mkstemp(tmpl);
+	unlink(tmpl);
+	dup2(fd, STDERR_FILENO);
+	ok1(pr_log_async_start(1024 * 1024));
+	for (t = 0; t < THREADS; t++)
+		pthread_create(&threads[t], NULL, log_thread, (void *)t);
+	for (t = 0; t < THREADS; t++)
+		pthread_join(threads[t], NULL);
+
+	/* Longer messages are formatted straight into the ring; messages
+	 * longer than the ring are dropped. */
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	pr_info("long %s\n", big);
+	pr_log_async_stop();
+	ok1(pr_log_async_dropped() == 0);
+
+	lseek(fd, 0, SEEK_SET);
+	out = slurp(fd);
+	ok1(count_lines(out, last, &in_order) == THREADS * MESSAGES);
+	ok1(in_order);
+	ok1(strstr(out, big) && strstr(out, big)[-1] == ' '
+	    && strstr(out, big)[sizeof(big) - 1] == '\n');
+	close(fd);
+
+	/* Stopped, we write synchronously again. */
+	fd = mkstemp(tmpl2);
+	unlink(tmpl2);
+	dup2(fd, STDERR_FILENO);
+	pr_info("thread 0 message 0\n");
+	lseek(fd, 0, SEEK_SET);
+	ok1(count_lines(slurp(fd), last, &in_order) == 1);
+	close(fd);
+
+	/* When nobody's reading, we drop rather than wait. */
+	ok1(pipe(p) == 0);
+	dup2(p[1], STDERR_FILENO);
+	close(p[1]);
+	ok1(pr_log_async_start(4096));
+	for (t = 0; t < THREADS; t++)
+		pthread_create(&threads[t], NULL, log_thread, (void *)t);
+	for (t = 0; t < THREADS; t++)
+		pthread_join(threads[t], NULL);
+	ok1(pr_log_async_dropped() > 0);
+
+	pthread_create(&threads[0], NULL, log_too_long, NULL);
+	pthread_join(threads[0], NULL);
+
+	/* Once we're stopped, the reader sees EOF. */
+	pthread_create(&threads[0], NULL, slurp_thread, (void *)(long)p[0]);
+	pr_log_async_stop();
+	dup2(saved, STDERR_FILENO);
+	pthread_join(threads[0], (void **)&out);
+	ok1(count_lines(out, last, &in_order) + pr_log_async_dropped()
+	    == THREADS * MESSAGES + 1);
+	ok1(in_order);
+	close(p[0]);
+
+	/* It can be started again. */
+	ok1(pr_log_async_start(4096));
+	pr_log_async_stop();
+
+	return exit_status();
+}
@@ -0,0 +1,143 @@
+/* Writes an mbox of messages with a few dozen headers each (a good part of
+ * them Received:), maps it, then times splitting it into messages and
+ * reading each one: walking every header, lazily and after indexing the
+ * message in one pass, and looking a few headers up by name. */
+#include "config.h"
+#include <ccan/rfc822/rfc822.h>
+#include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RECEIVED 20
+
+static void report(const char *what, struct timemono start,
+		   size_t msgs, size_t bytes)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-24s %8llu usec (%5llu nsec per message, %.0f MB/s)\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / msgs),
+	       bytes / (time_to_nsec(diff) / 1000.0));
+}
+
+static size_t lookups(struct rfc822_msg *msg)
+{
+	struct rfc822_header *h;
+	size_t n = 0;
+
+	n += rfc822_first_header_of_name(msg, "subject") != NULL;
+	n += rfc822_first_header_of_name(msg, "Message-Id") != NULL;
+	n += rfc822_first_header_of_name(msg, "X-Not-There") != NULL;
+	for (h = rfc822_first_header_of_name(msg, "Received"); h;
+	     h = rfc822_next_header_of_name(msg, h, "Received"))
+		n++;
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = argc > 2 ? argv[2] : "/tmp/rfc822-speed.mbox";
+	size_t nmsgs = argc > 1 ? atol(argv[1]) : 50000;
+	struct bytestring mbox, m;
+	struct rfc822_msg *msg;
+	struct rfc822_header *h;
+	struct timemono start;
+	size_t i, j, n, count, bytes;
+	struct stat st;
+	char *map;
+	FILE *f;
+	int fd;
+
+	f = fopen(file, "w");
+	if (!f) {
+		perror(file);
+		return 1;
+	}
+	for (i = 0; i < nmsgs; i++) {
+		fprintf(f, "From sender%zu@example.com Mon Jan  1 00:00:00 2024\n", i);
+		for (j = 0; j < RECEIVED; j++)
+			fprintf(f, "Received: from relay%zu.example.net (relay%zu.example.net [192.0.2.%zu])\n"
+				"\tby mx.example.org with ESMTPS id %zux%zu\n"
+				"\tfor <list@example.org>; Mon, 1 Jan 2024 00:00:%02zu +0000\n",
+				j, j, j, i, j, j);
+		fprintf(f, "Return-Path: <sender%zu@example.com>\n"
+			"DKIM-Signature: v=1; a=rsa-sha256; d=example.com; s=sel;\n"
+			"\th=from:to:subject:date; bh=abcdefghijklmnopqrstuvwxyz=;\n"
+			"\tb=ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789\n"
+			"Date: Mon, 1 Jan 2024 00:00:00 +0000\n"
+			"From: Sender %zu <sender%zu@example.com>\n"
+			"To: A List <list@example.org>\n"
+			"Subject: Message number %zu\n"
+			"Message-ID: <%zu@example.com>\n"
+			"MIME-Version: 1.0\n"
+			"Content-Type: text/plain; charset=us-ascii\n"
+			"List-Id: <list.example.org>\n"
+			"List-Unsubscribe: <mailto:list-leave@example.org>\n"
+			"Precedence: list\n"
+			"\n", i, i, i, i, i);
+		for (j = 0; j < 20; j++)
+			fprintf(f, "Line %zu of the body of message %zu, which is about as long as most.\n", j, i);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(file);
+		return 1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	bytes = st.st_size;
+	/* Fault it all in, so the first run isn't penalized. */
+	for (i = n = 0; i < bytes; i += 4096)
+		n += map[i];
+	printf("%zu messages, %zu bytes\n", nmsgs, bytes);
+
+	start = time_mono();
+	mbox = bytestring(map, bytes);
+	for (count = 0; (m = rfc822_mbox_next(&mbox)).ptr; count++);
+	report("rfc822_mbox_next", start, count, bytes);
+
+	start = time_mono();
+	mbox = bytestring(map, bytes);
+	for (n = 0; (m = rfc822_mbox_next(&mbox)).ptr;) {
+		msg = rfc822_start(NULL, m.ptr, m.len);
+		rfc822_for_each_header(msg, h)
+			n++;
+		n += rfc822_body(msg).len != 0;
+		rfc822_free(msg);
+	}
+	report("every header", start, count, bytes);
+
+	start = time_mono();
+	mbox = bytestring(map, bytes);
+	for (n = 0; (m = rfc822_mbox_next(&mbox)).ptr;) {
+		msg = rfc822_start(NULL, m.ptr, m.len);
+		n += rfc822_index(msg);
+		rfc822_for_each_header(msg, h)
+			n++;
+		rfc822_free(msg);
+	}
+	report("rfc822_index, every one", start, count, bytes);
+
+	start = time_mono();
+	mbox = bytestring(map, bytes);
+	for (n = 0; (m = rfc822_mbox_next(&mbox)).ptr;) {
+		msg = rfc822_start(NULL, m.ptr, m.len);
+		n += lookups(msg);
+		rfc822_free(msg);
+	}
+	report("lookups", start, count, bytes);
+
+	munmap(map, bytes);
+	close(fd);
+	remove(file);
+	return 0;
+}
@@ -11,6 +11,10 @@
 #include <ccan/mem/mem.h>
 #include <ccan/rfc822/rfc822.h>
 
+#if defined(__SSE2__) && HAVE_BUILTIN_CTZ
+#include <emmintrin.h>
+#endif
+
 #ifdef TAL_USE_TALLOC
 #include <ccan/tal/talloc/talloc.h>
 #else
@@ -53,10 +57,25 @@ void rfc822_set_allocation_failure_handler(void (*h)(const char *))
  */
 #define INDEX_HASH_SIZE		63
 
+/*
+ * Headers are allocated a chunk at a time, starting small for short
+ * messages.
+ */
+#define HEADER_CHUNK_MIN	8
+#define HEADER_CHUNK_MAX	64
+#define NAME_CHUNK		16
+
 struct rfc822_msg {
 	const char *data, *end;
 	const char *remainder;
 	struct list_head headers;
+	size_t nheaders;
+	struct rfc822_header *spare;
+	size_t nspare, chunk;
+	struct rfc822_headers_of_name *spare_names;
+	size_t nspare_names;
+	/* The name index is only built once someone looks up a name */
+	bool indexed;
 	struct list_head header_index[INDEX_HASH_SIZE];
 	const char *body;
 };
@@ -107,6 +126,13 @@ struct rfc822_msg *rfc822_start(const void *ctx, const char *p, size_t len)
 	msg->body = NULL;
 
 	list_head_init(&msg->headers);
+	msg->nheaders = 0;
+	msg->spare = NULL;
+	msg->nspare = 0;
+	msg->chunk = HEADER_CHUNK_MIN;
+	msg->spare_names = NULL;
+	msg->nspare_names = 0;
+	msg->indexed = false;
 
 	for (i = 0; i < INDEX_HASH_SIZE; i++)
 		list_head_init(&msg->header_index[i]);
@@ -141,16 +167,62 @@ static struct rfc822_header *next_header_cached(struct rfc822_msg *msg,
 	return list_entry(n->next, struct rfc822_header, list);
 }
 
-static const char *next_line(const char *start, const char *end)
+/*
+ * Find the start of the next line, noting the first colon on the way if
+ * we haven't seen one yet.  Header lines are short, so looking for both
+ * at once beats two calls to memchr().
+ */
+static const char *next_line(const char *p, const char *end,
+			     const char **colon)
 {
-	const char *p = memchr(start, '\n', end - start);
-
-	return p ? (p + 1) : end;
+#if defined(__SSE2__) && HAVE_BUILTIN_CTZ
+	const __m128i nl = _mm_set1_epi8('\n'), co = _mm_set1_epi8(':');
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned int n = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+		unsigned int c = _mm_movemask_epi8(_mm_cmpeq_epi8(v, co));
+
+		if (n)
+			/* Only colons before the newline */
+			c &= n ^ (n - 1);
+		if (c && !*colon)
+			*colon = p + __builtin_ctz(c);
+		if (n)
+			return p + __builtin_ctz(n) + 1;
+		p += 16;
+	}
+#endif
+	for (; p < end; p++) {
+		if (*p == ':' && !*colon)
+			*colon = p;
+		else if (*p == '\n')
+			return p + 1;
+	}
+	return end;
 }
 
 static struct rfc822_header *index_header(struct rfc822_msg *msg,
 					  struct rfc822_header *hdr);
 
+static struct rfc822_header *new_header(struct rfc822_msg *msg)
+{
+	struct rfc822_header *hi;
+
+	if (!msg->nspare) {
+		msg->spare = tal_arr(msg, struct rfc822_header, msg->chunk);
+		ALLOC_CHECK(msg->spare, NULL);
+		msg->nspare = msg->chunk;
+		if (msg->chunk < HEADER_CHUNK_MAX)
+			msg->chunk *= 2;
+	}
+
+	hi = msg->spare++;
+	msg->nspare--;
+	memset(hi, 0, sizeof(*hi));
+	return hi;
+}
+
 static struct rfc822_header *next_header_parse(struct rfc822_msg *msg)
 {
 	const char *h, *eh, *ev, *colon;
@@ -165,7 +237,8 @@ static struct rfc822_header *next_header_parse(struct rfc822_msg *msg)
 		return NULL;
 
 	h = msg->remainder;
-	eh = next_line(h, msg->end);
+	colon = NULL;
+	eh = next_line(h, msg->end, &colon);
 
 	ev = eh;
 	if ((ev > h) && (ev[-1] == '\n'))
@@ -183,7 +256,7 @@ static struct rfc822_header *next_header_parse(struct rfc822_msg *msg)
 	}
 
 	while ((eh < msg->end) && rfc822_iswsp(*eh))
-		eh = next_line(eh, msg->end);
+		eh = next_line(eh, msg->end, &colon);
 
 	if (eh >= msg->end)
 		msg->remainder = NULL;
@@ -191,13 +264,14 @@ static struct rfc822_header *next_header_parse(struct rfc822_msg *msg)
 		msg->remainder = eh;
 
 
-	hi = talz(msg, struct rfc822_header);
-	ALLOC_CHECK(hi, NULL);
+	hi = new_header(msg);
+	if (!hi)
+		return NULL;
 
 	hi->all = bytestring(h, eh - h);
 	list_add_tail(&msg->headers, &hi->list);
+	msg->nheaders++;
 
-	colon = memchr(h, ':', hi->all.len);
 	if (colon) {
 		hi->rawname = bytestring(h, colon - h);
 		hi->rawvalue = bytestring(colon + 1, eh - colon - 1);
@@ -208,6 +282,8 @@ static struct rfc822_header *next_header_parse(struct rfc822_msg *msg)
 
 	CHECK(msg, "<next_header_parse");
 
+	if (!msg->indexed)
+		return hi;
 	return index_header(msg, hi);
 }
 
@@ -225,6 +301,39 @@ struct rfc822_header *rfc822_next_header(struct rfc822_msg *msg,
 	return next_header_parse(msg);
 }
 
+size_t rfc822_index(struct rfc822_msg *msg)
+{
+	CHECK(msg, ">rfc822_index");
+
+	while (next_header_parse(msg))
+		;
+
+	CHECK(msg, "<rfc822_index");
+
+	return msg->nheaders;
+}
+
+struct bytestring rfc822_mbox_next(struct bytestring *mbox)
+{
+	const char *p = mbox->ptr, *end = mbox->ptr + mbox->len;
+	const char *q;
+
+	if (!mbox->len)
+		return bytestring_NULL;
+
+	/* Skip the "From " line */
+	if ((mbox->len >= 5) && !memcmp(p, "From ", 5)) {
+		q = memchr(p, '\n', end - p);
+		p = q ? (q + 1) : end;
+	}
+
+	q = memmem(p, end - p, "\nFrom ", 6);
+	q = q ? (q + 1) : end;
+
+	*mbox = bytestring(q, end - q);
+	return bytestring(p, q - p);
+}
+
 struct bytestring rfc822_body(struct rfc822_msg *msg)
 {
 	CHECK(msg, ">rfc822_body");
@@ -415,10 +524,10 @@ static unsigned headerhash(struct bytestring name)
 	return ret % INDEX_HASH_SIZE;
 }
 
-static struct rfc822_headers_of_name *headers_of_name(struct rfc822_msg *msg,
-						      struct bytestring name)
+static struct rfc822_headers_of_name *headers_of_name_hash(struct rfc822_msg *msg,
+							   struct bytestring name,
+							   unsigned hash)
 {
-	unsigned hash = headerhash(name);
 	struct rfc822_headers_of_name *hn;
 
 	list_for_each(&msg->header_index[hash], hn, bucket) {
@@ -429,17 +538,30 @@ static struct rfc822_headers_of_name *headers_of_name(struct rfc822_msg *msg,
 	return NULL;
 }
 
+static struct rfc822_headers_of_name *headers_of_name(struct rfc822_msg *msg,
+						      struct bytestring name)
+{
+	return headers_of_name_hash(msg, name, headerhash(name));
+}
+
 static struct rfc822_header *index_header(struct rfc822_msg *msg,
 					  struct rfc822_header *hdr)
 {
 	struct bytestring hname = rfc822_header_raw_name(msg, hdr);
-	struct rfc822_headers_of_name *hn = headers_of_name(msg, hname);
+	unsigned hash = headerhash(hname);
+	struct rfc822_headers_of_name *hn;
 
+	hn = headers_of_name_hash(msg, hname, hash);
 	if (!hn) {
-		unsigned hash = headerhash(hname);
-
-		hn = talz(msg, struct rfc822_headers_of_name);
-		ALLOC_CHECK(hn, NULL);
+		if (!msg->nspare_names) {
+			msg->spare_names = tal_arr(msg,
+						   struct rfc822_headers_of_name,
+						   NAME_CHUNK);
+			ALLOC_CHECK(msg->spare_names, NULL);
+			msg->nspare_names = NAME_CHUNK;
+		}
+		hn = msg->spare_names++;
+		msg->nspare_names--;
 
 		hn->name = hname;
 		hn->first = NULL;
@@ -453,13 +575,38 @@ static struct rfc822_header *index_header(struct rfc822_msg *msg,
 	return hdr;
 }
 
+/* Index the headers parsed so far; later ones are indexed as they're parsed */
+static bool build_index(struct rfc822_msg *msg)
+{
+	struct rfc822_header *hdr;
+	int i;
+
+	if (msg->indexed)
+		return true;
+
+	list_for_each(&msg->headers, hdr, list) {
+		if (!index_header(msg, hdr)) {
+			/* Drop what we did: next time starts from scratch. */
+			for (i = 0; i < INDEX_HASH_SIZE; i++)
+				list_head_init(&msg->header_index[i]);
+			return false;
+		}
+	}
+	msg->indexed = true;
+	return true;
+}
+
 struct rfc822_header *rfc822_first_header_of_name(struct rfc822_msg *msg,
 						  const char *name)
 {
 	struct bytestring namebs = bytestring_from_string(name);
-	struct rfc822_headers_of_name *hn = headers_of_name(msg, namebs);
+	struct rfc822_headers_of_name *hn;
 	struct rfc822_header *hdr;
 
+	if (!build_index(msg))
+		return NULL;
+
+	hn = headers_of_name(msg, namebs);
 	if (hn)
 		return hn->first;
 
@@ -479,6 +626,9 @@ struct rfc822_header *rfc822_next_header_of_name(struct rfc822_msg *msg,
 	if (!hdr)
 		return rfc822_first_header_of_name(msg, name);
 
+	if (!build_index(msg))
+		return NULL;
+
 	if (hdr->name_next) {
 		assert(rfc822_header_is(msg, hdr->name_next, name));
 		return hdr->name_next;
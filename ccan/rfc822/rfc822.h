@@ -104,6 +104,20 @@ void rfc822_free(struct rfc822_msg *msg);
 struct rfc822_header *rfc822_next_header(struct rfc822_msg *msg,
 					 struct rfc822_header *hdr);
 
+/**
+ * rfc822_index - parse all the headers of an rfc822 message
+ * @msg: message
+ *
+ * Headers are normally parsed as they are asked for.  This parses all
+ * that remain in one pass instead, which is quicker when most of them
+ * will be looked at anyway, and returns how many headers there are.
+ *
+ * The index of header names used by rfc822_first_header_of_name()
+ * and rfc822_next_header_of_name() is separate, and is only built the
+ * first time one of them is called.
+ */
+size_t rfc822_index(struct rfc822_msg *msg);
+
 #define rfc822_for_each_header(msg, hdr) \
 	for ((hdr) = rfc822_first_header((msg)); \
 	     (hdr);					\
@@ -118,6 +132,32 @@ struct rfc822_header *rfc822_next_header(struct rfc822_msg *msg,
  */
 struct bytestring rfc822_body(struct rfc822_msg *msg);
 
+/**
+ * rfc822_mbox_next - split the next message from an mbox
+ * @mbox: the rest of the mbox, which is moved past the message
+ *
+ * Returns the next message in @mbox, without its "From " line, or a
+ * NULL bytestring once @mbox is empty.  The message is not copied, so
+ * an mbox can be mapped and each message handed to rfc822_start() in
+ * turn.  Lines in the body starting "From " are expected to be quoted,
+ * as mbox writers do.
+ *
+ * Example:
+ *	static size_t count_headers(const char *map, size_t len)
+ *	{
+ *		struct bytestring mbox = bytestring(map, len), m;
+ *		size_t n = 0;
+ *
+ *		while ((m = rfc822_mbox_next(&mbox)).ptr) {
+ *			struct rfc822_msg *msg = rfc822_start(NULL, m.ptr, m.len);
+ *			n += rfc822_index(msg);
+ *			rfc822_free(msg);
+ *		}
+ *		return n;
+ *	}
+ */
+struct bytestring rfc822_mbox_next(struct bytestring *mbox);
+
 enum rfc822_header_errors {
 	RFC822_HDR_NO_COLON = 1,
 	RFC822_HDR_BAD_NAME_CHARS = 2,
@@ -0,0 +1,196 @@
+#include <ccan/foreach/foreach.h>
+#include <ccan/failtest/failtest_override.h>
+#include <ccan/failtest/failtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CCAN_RFC822_DEBUG
+
+#include <ccan/rfc822/rfc822.h>
+
+#include <ccan/rfc822/rfc822.c>
+
+#include "testdata.h"
+#include "helper.h"
+
+/* Colons either side of the 16 byte boundary, and on a continuation line */
+const char odd_hdrs[] =
+	"Short: 1\n"
+	"Fifteen-chars-x: 2\n"
+	"Sixteen-chars-xx: 3\n"
+	"A-header-name-of-thirty-one-ch: 4\n"
+	"No colon on the first line\n"
+	" but: one on the next\n"
+	"Received: a\n"
+	"Received: b\n"
+	"\tfolded\n"
+	"received: c\n"
+	"\n"
+	"Body: not a header\n";
+
+static bool same_hdr(struct rfc822_msg *a, struct rfc822_header *ha,
+		     struct rfc822_msg *b, struct rfc822_header *hb)
+{
+	struct bytestring ca = rfc822_header_raw_content(a, ha);
+	struct bytestring cb = rfc822_header_raw_content(b, hb);
+	struct bytestring na = rfc822_header_raw_name(a, ha);
+	struct bytestring nb = rfc822_header_raw_name(b, hb);
+
+	return ca.ptr == cb.ptr && ca.len == cb.len
+		&& na.ptr == nb.ptr && na.len == nb.len;
+}
+
+static bool hdr_is(struct rfc822_msg *msg, struct rfc822_header *h,
+		   const char *content)
+{
+	return h && bytestring_eq(rfc822_header_raw_content(msg, h),
+				  bytestring_from_string(content));
+}
+
+/* Indexing gives the same headers and body as parsing them lazily. */
+static void test_index(const char *buf, size_t len, const char *exname)
+{
+	struct rfc822_msg *lazy, *msg;
+	struct rfc822_header *hl, *h;
+	size_t n, count = 0;
+	bool same = true;
+
+	lazy = rfc822_start(NULL, buf, len);
+	allocation_failure_check();
+	msg = rfc822_start(NULL, buf, len);
+	allocation_failure_check();
+
+	n = rfc822_index(msg);
+	allocation_failure_check();
+
+	h = NULL;
+	rfc822_for_each_header(lazy, hl) {
+		allocation_failure_check();
+		h = rfc822_next_header(msg, h);
+		if (!h || !same_hdr(lazy, hl, msg, h))
+			same = false;
+		count++;
+	}
+	allocation_failure_check();
+	ok(same && n == count && !rfc822_next_header(msg, h),
+	   "%s: %zu headers", exname, n);
+	ok1(rfc822_body(lazy).ptr == rfc822_body(msg).ptr);
+
+	rfc822_free(lazy);
+	rfc822_free(msg);
+	allocation_failure_check();
+}
+
+static void test_odd(const char *buf, size_t len)
+{
+	struct rfc822_msg *msg;
+	struct rfc822_header *h;
+	struct bytestring name;
+
+	msg = rfc822_start(NULL, buf, len);
+	allocation_failure_check();
+
+	/* Look one up first, so the name index exists before the rest
+	 * are parsed. */
+	h = rfc822_first_header_of_name(msg, "fifteen-CHARS-x");
+	allocation_failure_check();
+	ok1(hdr_is(msg, h, "Fifteen-chars-x: 2\n"));
+
+	ok1(rfc822_index(msg) == 8);
+	allocation_failure_check();
+
+	h = rfc822_first_header_of_name(msg, "Sixteen-chars-xx");
+	allocation_failure_check();
+	ok1(hdr_is(msg, h, "Sixteen-chars-xx: 3\n"));
+	h = rfc822_first_header_of_name(msg, "A-header-name-of-thirty-one-ch");
+	allocation_failure_check();
+	if (h)
+		name = rfc822_header_raw_name(msg, h);
+	ok1(h && name.len == 30);
+
+	h = rfc822_first_header_of_name(msg, "No colon on the first line\n but");
+	allocation_failure_check();
+	ok1(hdr_is(msg, h, "No colon on the first line\n but: one on the next\n"));
+
+	h = rfc822_first_header_of_name(msg, "RECEIVED");
+	allocation_failure_check();
+	ok1(hdr_is(msg, h, "Received: a\n"));
+	h = rfc822_next_header_of_name(msg, h, "RECEIVED");
+	ok1(hdr_is(msg, h, "Received: b\n\tfolded\n"));
+	h = rfc822_next_header_of_name(msg, h, "RECEIVED");
+	ok1(hdr_is(msg, h, "received: c\n"));
+	ok1(!rfc822_next_header_of_name(msg, h, "RECEIVED"));
+	ok1(!rfc822_first_header_of_name(msg, "Body"));
+
+	rfc822_free(msg);
+	allocation_failure_check();
+}
+
+#define MBOX_MSG1 "From: a@example.com\nSubject: one\n\nA body\n"
+#define MBOX_MSG2 "From: b@example.com\r\nSubject: two\r\n\r\nBody\r\n"
+#define MBOX_MSG3 "From: c@example.com\n\n>From the last\n"
+
+static void test_mbox(void)
+{
+	const char *msgs[] = { MBOX_MSG1, MBOX_MSG2, MBOX_MSG3 };
+	const char mbox[] = "From a@example.com Mon Jan  1 00:00:00 2024\n" MBOX_MSG1 "\n"
+		"From b@example.com Mon Jan  1 00:00:01 2024\n" MBOX_MSG2 "\n"
+		"From c@example.com Mon Jan  1 00:00:02 2024\n" MBOX_MSG3;
+	struct bytestring rest, m;
+	int i;
+
+	rest = bytestring(mbox, sizeof(mbox) - 1);
+	for (i = 0; i < 3; i++) {
+		size_t len = strlen(msgs[i]);
+
+		m = rfc822_mbox_next(&rest);
+		/* The blank line before the next "From " stays with the body */
+		ok(m.ptr && m.len == len + (i < 2)
+		   && !memcmp(m.ptr, msgs[i], len),
+		   "mbox message %d", i);
+	}
+	m = rfc822_mbox_next(&rest);
+	ok1(!m.ptr && !rest.len);
+
+	/* Without a "From " line it's all one message */
+	rest = bytestring_from_string(msgs[0]);
+	m = rfc822_mbox_next(&rest);
+	ok1(m.ptr == msgs[0] && m.len == strlen(msgs[0]));
+}
+
+int main(int argc, char *argv[])
+{
+	struct aexample *e;
+
+	/* This is how many tests you plan to run */
+	plan_tests(3*2*num_aexamples() + 10 + 5);
+
+	failtest_setup(argc, argv);
+
+	for_each_aexample(e) {
+		int crlf;
+
+		foreach_int(crlf, 0, 1) {
+			const char *buf;
+			size_t len;
+			char exname[256];
+
+			snprintf(exname, sizeof(exname), "%s[%s]", e->name, NLT(crlf));
+
+			buf = assemble_msg(e, &len, crlf);
+			ok((buf), "assembled %s", exname);
+			if (!buf)
+				continue;
+
+			test_index(buf, len, exname);
+
+			tal_free(buf);
+		}
+	}
+
+	test_odd(odd_hdrs, sizeof(odd_hdrs) - 1);
+	test_mbox();
+
+	/* This exits depending on whether all tests passed */
+	failtest_exit(exit_status());
+}
@@ -0,0 +1,242 @@
+/* Builds pairs of id sets of different densities over 2^28 ids, and times
+ * building, lookups, union, intersection and iteration for roaring, a
+ * plain ccan/bitmap and (with JUDY=1) ccan/jset, along with their size. */
+#include <ccan/roaring/roaring.h>
+#include <ccan/bitmap/bitmap.h>
+#include <ccan/time/time.h>
+#ifdef BENCH_JSET
+#include <ccan/jset/jset.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIVERSE	(1UL << 28)
+#define LOOKUPS		1000000
+
+#ifdef BENCH_JSET
+struct jset_ul {
+	JSET_MEMBERS(unsigned long);
+};
+#endif
+
+static uint32_t *ids_a, *ids_b, *probes;
+
+/* Ids spaced about every gap, some in clumps of clump. */
+static size_t make_ids(uint32_t *ids, unsigned long gap, unsigned int clump)
+{
+	unsigned long v = random() % gap;
+	size_t n = 0;
+
+	while (v < UNIVERSE) {
+		unsigned int i, len = random() % clump + 1;
+		for (i = 0; i < len && v < UNIVERSE; i++)
+			ids[n++] = v++;
+		v += random() % (2 * gap) + 1;
+	}
+	return n;
+}
+
+static void report(const char *what, const char *op, struct timemono start,
+		   size_t num)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("  %-8s %-10s %9llu usec (%6llu nsec each)\n", what, op,
+	       (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)(time_to_nsec(diff) / (num ? num : 1)));
+}
+
+static void bench_roaring(size_t na, size_t nb)
+{
+	struct roaring *a = roaring_new(NULL), *b = roaring_new(a), *res;
+	struct roaring_iter it;
+	struct timemono start;
+	size_t i, hits = 0, len;
+	uint32_t v;
+	uint64_t sum = 0, count;
+	bool more;
+	void *buf;
+
+	start = time_mono();
+	for (i = 0; i < na; i++)
+		roaring_set(a, ids_a[i]);
+	for (i = 0; i < nb; i++)
+		roaring_set(b, ids_b[i]);
+	roaring_optimize(a);
+	roaring_optimize(b);
+	report("roaring", "build", start, na + nb);
+	printf("  %-8s %-10s %9zu bytes\n", "roaring", "size",
+	       roaring_memory(a));
+
+	start = time_mono();
+	for (i = 0; i < LOOKUPS; i++)
+		hits += roaring_test(a, probes[i]);
+	report("roaring", "test", start, LOOKUPS);
+
+	start = time_mono();
+	res = roaring_or(a, a, b);
+	report("roaring", "or", start, na + nb);
+	count = roaring_count(res);
+
+	start = time_mono();
+	res = roaring_and(a, a, b);
+	report("roaring", "and", start, na + nb);
+
+	start = time_mono();
+	for (more = roaring_iter_first(&it, a, &v); more;
+	     more = roaring_iter_next(&it, &v))
+		sum += v;
+	report("roaring", "iterate", start, na);
+
+	len = roaring_serialized_size(a);
+	buf = malloc(len);
+	roaring_serialize(a, buf);
+	start = time_mono();
+	res = roaring_view(a, buf, len);
+	report("roaring", "view", start, 1);
+
+	printf("  [%zu hits, %llu or, %llu and, sum %llu]\n", hits,
+	       (unsigned long long)count,
+	       (unsigned long long)roaring_count(roaring_and(a, res, b)),
+	       (unsigned long long)sum);
+	roaring_free(a);
+	free(buf);
+}
+
+static void bench_bitmap(size_t na, size_t nb)
+{
+	bitmap *a = bitmap_alloc0(UNIVERSE), *b = bitmap_alloc0(UNIVERSE);
+	bitmap *res = bitmap_alloc(UNIVERSE);
+	struct bitmap_iter it;
+	struct timemono start;
+	size_t i, hits = 0;
+	unsigned long v;
+	uint64_t sum = 0, count;
+
+	start = time_mono();
+	for (i = 0; i < na; i++)
+		bitmap_set_bit(a, ids_a[i]);
+	for (i = 0; i < nb; i++)
+		bitmap_set_bit(b, ids_b[i]);
+	report("bitmap", "build", start, na + nb);
+	printf("  %-8s %-10s %9zu bytes\n", "bitmap", "size",
+	       bitmap_sizeof(UNIVERSE));
+
+	start = time_mono();
+	for (i = 0; i < LOOKUPS; i++)
+		hits += bitmap_test_bit(a, probes[i]);
+	report("bitmap", "test", start, LOOKUPS);
+
+	start = time_mono();
+	bitmap_or(res, a, b, UNIVERSE);
+	report("bitmap", "or", start, na + nb);
+	count = bitmap_popcount(res, UNIVERSE);
+
+	start = time_mono();
+	bitmap_and(res, a, b, UNIVERSE);
+	report("bitmap", "and", start, na + nb);
+
+	start = time_mono();
+	bitmap_for_each_set(&it, v, a, 0, UNIVERSE)
+		sum += v;
+	report("bitmap", "iterate", start, na);
+
+	printf("  [%zu hits, %llu or, %lu and, sum %llu]\n", hits,
+	       (unsigned long long)count, bitmap_popcount(res, UNIVERSE),
+	       (unsigned long long)sum);
+	free(a);
+	free(b);
+	free(res);
+}
+
+#ifdef BENCH_JSET
+/* jset has no set operations: walk one set, testing the other. */
+static void bench_jset(size_t na, size_t nb)
+{
+	struct jset_ul *a = jset_new(struct jset_ul);
+	struct jset_ul *b = jset_new(struct jset_ul);
+	struct jset_ul *res;
+	struct timemono start;
+	size_t i, hits = 0;
+	unsigned long v;
+	uint64_t sum = 0;
+
+	/* jset can't iterate over 0, so everything is off by one. */
+	start = time_mono();
+	for (i = 0; i < na; i++)
+		jset_set(a, ids_a[i] + 1UL);
+	for (i = 0; i < nb; i++)
+		jset_set(b, ids_b[i] + 1UL);
+	report("jset", "build", start, na + nb);
+
+	start = time_mono();
+	for (i = 0; i < LOOKUPS; i++)
+		hits += jset_test(a, probes[i] + 1UL);
+	report("jset", "test", start, LOOKUPS);
+
+	start = time_mono();
+	res = jset_new(struct jset_ul);
+	for (v = jset_first(a); v; v = jset_next(a, v))
+		jset_set(res, v);
+	for (v = jset_first(b); v; v = jset_next(b, v))
+		jset_set(res, v);
+	report("jset", "or", start, na + nb);
+	jset_free(res);
+
+	start = time_mono();
+	res = jset_new(struct jset_ul);
+	for (v = jset_first(a); v; v = jset_next(a, v))
+		if (jset_test(b, v))
+			jset_set(res, v);
+	report("jset", "and", start, na + nb);
+
+	start = time_mono();
+	for (v = jset_first(a); v; v = jset_next(a, v))
+		sum += v - 1;
+	report("jset", "iterate", start, na);
+
+	printf("  [%zu hits, %lu and, sum %llu]\n", hits,
+	       (unsigned long)jset_count(res), (unsigned long long)sum);
+	jset_free(res);
+	jset_free(a);
+	jset_free(b);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		unsigned long gap;
+		unsigned int clump;
+	} shapes[] = {
+		{ "sparse (1 in 10000)", 10000, 1 },
+		{ "medium (1 in 64)", 64, 1 },
+		{ "clustered (runs of 1-2000)", 2000, 2000 },
+		{ "dense (1 in 2)", 2, 1 },
+	};
+	size_t s, i, na, nb;
+
+	ids_a = malloc(UNIVERSE * sizeof(uint32_t));
+	ids_b = malloc(UNIVERSE * sizeof(uint32_t));
+	probes = malloc(LOOKUPS * sizeof(uint32_t));
+	for (i = 0; i < LOOKUPS; i++)
+		probes[i] = random() % UNIVERSE;
+
+	for (s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+		srandom(s);
+		na = make_ids(ids_a, shapes[s].gap, shapes[s].clump);
+		nb = make_ids(ids_b, shapes[s].gap, shapes[s].clump);
+		printf("%s: %zu and %zu ids\n", shapes[s].name, na, nb);
+		bench_roaring(na, nb);
+		bench_bitmap(na, nb);
+#ifdef BENCH_JSET
+		bench_jset(na, nb);
+#endif
+	}
+	free(ids_a);
+	free(ids_b);
+	free(probes);
+	return 0;
+}
@@ -0,0 +1,1101 @@
+/* MIT (BSD) license - see LICENSE file for details */
+#include <ccan/roaring/roaring.h>
+#include <ccan/bitops/bitops.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* An array chunk beyond this size would be bigger than a bitmap. */
+#define ARRAY_MAX	4096
+#define WORDS		(65536 / 64)
+
+enum ctype { ARRAY, BITMAP, RUN };
+
+/* Inclusive, so a run can cover a whole chunk. */
+struct run {
+	uint16_t start, last;
+};
+
+struct container {
+	uint16_t key;
+	uint8_t type;
+	/* Data is in a roaring_view buffer: copy it before changing it. */
+	bool shared;
+	uint32_t card;
+	/* Entries in an array, or runs; and how many there's room for. */
+	uint32_t n, alloc;
+	union {
+		uint16_t *array;
+		uint64_t *bits;
+		struct run *runs;
+		void *p;
+	} u;
+};
+
+struct roaring {
+	size_t num;
+	/* tal array, sorted by key. */
+	struct container *c;
+};
+
+/* The serialized form: a header, the chunk descriptors, then the chunks. */
+#define ROARING_MAGIC	0x52424d31	/* "RBM1" */
+
+struct roaring_header {
+	uint32_t magic;
+	uint32_t num;
+};
+
+struct roaring_desc {
+	uint16_t key;
+	uint8_t type;
+	uint8_t pad;
+	uint32_t card;
+	uint32_t n;
+	uint32_t offset;
+};
+
+static size_t cont_bytes(const struct container *c)
+{
+	switch (c->type) {
+	case ARRAY:
+		return c->n * sizeof(uint16_t);
+	case BITMAP:
+		return WORDS * sizeof(uint64_t);
+	case RUN:
+		return c->n * sizeof(struct run);
+	}
+	abort();
+}
+
+static void cont_free(struct container *c)
+{
+	if (!c->shared)
+		tal_free(c->u.p);
+}
+
+/* Index of the first entry >= x. */
+static uint32_t array_find(const uint16_t *a, uint32_t n, uint16_t x)
+{
+	uint32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (a[mid] < x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Index of the first run starting after x. */
+static uint32_t run_find(const struct run *runs, uint32_t n, uint16_t x)
+{
+	uint32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (runs[mid].start <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static bool cont_test(const struct container *c, uint16_t x)
+{
+	uint32_t i;
+
+	switch (c->type) {
+	case ARRAY:
+		i = array_find(c->u.array, c->n, x);
+		return i < c->n && c->u.array[i] == x;
+	case BITMAP:
+		return (c->u.bits[x / 64] >> (x % 64)) & 1;
+	case RUN:
+		i = run_find(c->u.runs, c->n, x);
+		return i && c->u.runs[i-1].last >= x;
+	}
+	abort();
+}
+
+static void words_fill(uint64_t *w, uint32_t start, uint32_t last)
+{
+	uint32_t i = start / 64, j = last / 64;
+	uint64_t head = ~0ULL << (start % 64), tail = ~0ULL >> (63 - last % 64);
+
+	if (i == j) {
+		w[i] |= head & tail;
+		return;
+	}
+	w[i] |= head;
+	for (i++; i < j; i++)
+		w[i] = ~0ULL;
+	w[j] |= tail;
+}
+
+static uint32_t words_weight(const uint64_t *w)
+{
+	uint32_t i, card = 0;
+
+	for (i = 0; i < WORDS; i++)
+		card += bitops_weight64(w[i]);
+	return card;
+}
+
+/* A run starts at each set bit whose predecessor is clear. */
+static uint32_t words_runs(const uint64_t *w)
+{
+	uint32_t i, n = 0;
+	uint64_t carry = 0;
+
+	for (i = 0; i < WORDS; i++) {
+		n += bitops_weight64(w[i] & ~((w[i] << 1) | carry));
+		carry = w[i] >> 63;
+	}
+	return n;
+}
+
+static void words_to_array(const uint64_t *w, uint16_t *out)
+{
+	uint32_t i;
+
+	for (i = 0; i < WORDS; i++) {
+		uint64_t bits = w[i];
+		while (bits) {
+			*(out++) = i * 64 + bitops_ctz64(bits);
+			bits &= bits - 1;
+		}
+	}
+}
+
+/* First bit from x (< 65536) which is set, or clear if invert. */
+static uint32_t words_next(const uint64_t *w, uint32_t x, uint64_t invert)
+{
+	uint32_t i = x / 64;
+	uint64_t bits = (w[i] ^ invert) & (~0ULL << (x % 64));
+
+	while (!bits) {
+		if (++i == WORDS)
+			return 65536;
+		bits = w[i] ^ invert;
+	}
+	return i * 64 + bitops_ctz64(bits);
+}
+
+static void words_to_runs(const uint64_t *w, struct run *out)
+{
+	uint32_t x = words_next(w, 0, 0);
+
+	while (x < 65536) {
+		uint32_t end = words_next(w, x, ~0ULL);
+		out->start = x;
+		out->last = end - 1;
+		out++;
+		x = end < 65536 ? words_next(w, end, 0) : 65536;
+	}
+}
+
+/* Expand any container into a bitmap. */
+static void cont_words(const struct container *c, uint64_t *w)
+{
+	uint32_t i;
+
+	if (c->type == BITMAP) {
+		memcpy(w, c->u.bits, WORDS * sizeof(uint64_t));
+		return;
+	}
+	memset(w, 0, WORDS * sizeof(uint64_t));
+	if (c->type == ARRAY) {
+		for (i = 0; i < c->n; i++)
+			w[c->u.array[i] / 64] |= 1ULL << (c->u.array[i] % 64);
+	} else {
+		for (i = 0; i < c->n; i++)
+			words_fill(w, c->u.runs[i].start, c->u.runs[i].last);
+	}
+}
+
+/* Fill in c (whose old contents are gone) as an array or a bitmap.
+ * Returns false if w is empty. */
+static bool cont_from_words(struct roaring *r, struct container *c,
+			    const uint64_t *w)
+{
+	c->card = words_weight(w);
+	c->shared = false;
+	if (c->card == 0)
+		return false;
+	if (c->card <= ARRAY_MAX) {
+		c->type = ARRAY;
+		c->n = c->alloc = c->card;
+		c->u.array = tal_arr(r, uint16_t, c->n);
+		words_to_array(w, c->u.array);
+	} else {
+		c->type = BITMAP;
+		c->n = c->alloc = 0;
+		c->u.bits = tal_dup_arr(r, uint64_t, w, WORDS, 0);
+	}
+	return true;
+}
+
+static void cont_copy(struct roaring *r, struct container *dst,
+		      const struct container *src)
+{
+	*dst = *src;
+	dst->shared = false;
+	dst->alloc = dst->n;
+	dst->u.p = tal_dup_arr(r, char, (const char *)src->u.p,
+			       cont_bytes(src), 0);
+}
+
+/* Before changing a chunk: make sure we own it, and it's not runs. */
+static void cont_prepare(struct roaring *r, struct container *c)
+{
+	uint64_t w[WORDS];
+
+	if (c->type == RUN) {
+		cont_words(c, w);
+		cont_free(c);
+		cont_from_words(r, c, w);
+	} else if (c->shared) {
+		cont_copy(r, c, c);
+	}
+}
+
+static void array_to_bitmap(struct roaring *r, struct container *c)
+{
+	uint64_t *bits = tal_arrz(r, uint64_t, WORDS);
+	uint32_t i;
+
+	for (i = 0; i < c->n; i++)
+		bits[c->u.array[i] / 64] |= 1ULL << (c->u.array[i] % 64);
+	cont_free(c);
+	c->type = BITMAP;
+	c->n = c->alloc = 0;
+	c->u.bits = bits;
+}
+
+static bool cont_set(struct roaring *r, struct container *c, uint16_t x)
+{
+	uint32_t i;
+
+	if (c->type == BITMAP) {
+		uint64_t bit = 1ULL << (x % 64);
+		if (c->u.bits[x / 64] & bit)
+			return false;
+		c->u.bits[x / 64] |= bit;
+		c->card++;
+		return true;
+	}
+
+	i = array_find(c->u.array, c->n, x);
+	if (i < c->n && c->u.array[i] == x)
+		return false;
+	if (c->n == ARRAY_MAX) {
+		array_to_bitmap(r, c);
+		return cont_set(r, c, x);
+	}
+	if (c->n == c->alloc) {
+		c->alloc = c->alloc * 2 > ARRAY_MAX ? ARRAY_MAX : c->alloc * 2;
+		tal_resize(&c->u.array, c->alloc);
+	}
+	memmove(c->u.array + i + 1, c->u.array + i,
+		(c->n - i) * sizeof(uint16_t));
+	c->u.array[i] = x;
+	c->n++;
+	c->card++;
+	return true;
+}
+
+static bool cont_clear(struct roaring *r, struct container *c, uint16_t x)
+{
+	uint32_t i;
+
+	if (c->type == BITMAP) {
+		uint64_t bit = 1ULL << (x % 64);
+		if (!(c->u.bits[x / 64] & bit))
+			return false;
+		c->u.bits[x / 64] &= ~bit;
+		if (--c->card == ARRAY_MAX) {
+			uint64_t *bits = c->u.bits;
+			cont_from_words(r, c, bits);
+			tal_free(bits);
+		}
+		return true;
+	}
+
+	i = array_find(c->u.array, c->n, x);
+	if (i == c->n || c->u.array[i] != x)
+		return false;
+	memmove(c->u.array + i, c->u.array + i + 1,
+		(c->n - i - 1) * sizeof(uint16_t));
+	c->n--;
+	c->card--;
+	return true;
+}
+
+/* Index of the first container with key >= key. */
+static size_t find_key(const struct roaring *r, uint16_t key)
+{
+	size_t lo = 0, hi = r->num;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (r->c[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct container *add_container(struct roaring *r, size_t i,
+				       uint16_t key)
+{
+	if (r->num == tal_count(r->c))
+		tal_resize(&r->c, r->num ? r->num * 2 : 4);
+	memmove(r->c + i + 1, r->c + i, (r->num - i) * sizeof(r->c[0]));
+	r->num++;
+	memset(&r->c[i], 0, sizeof(r->c[i]));
+	r->c[i].key = key;
+	return &r->c[i];
+}
+
+/* Append a container filled in by the caller, for the set operations. */
+static struct container *next_container(struct roaring *r, uint16_t key)
+{
+	return add_container(r, r->num, key);
+}
+
+static void del_container(struct roaring *r, size_t i)
+{
+	cont_free(&r->c[i]);
+	memmove(r->c + i, r->c + i + 1, (r->num - i - 1) * sizeof(r->c[0]));
+	r->num--;
+}
+
+struct roaring *roaring_new(const tal_t *ctx)
+{
+	struct roaring *r = tal(ctx, struct roaring);
+
+	r->num = 0;
+	r->c = tal_arr(r, struct container, 0);
+	return r;
+}
+
+void roaring_free(struct roaring *r)
+{
+	tal_free(r);
+}
+
+bool roaring_set(struct roaring *r, uint32_t v)
+{
+	size_t i = find_key(r, v >> 16);
+	struct container *c;
+
+	if (i == r->num || r->c[i].key != v >> 16) {
+		c = add_container(r, i, v >> 16);
+		c->type = ARRAY;
+		c->alloc = 4;
+		c->u.array = tal_arr(r, uint16_t, c->alloc);
+	} else {
+		c = &r->c[i];
+		if (cont_test(c, v & 0xFFFF))
+			return false;
+		cont_prepare(r, c);
+	}
+	return cont_set(r, c, v & 0xFFFF);
+}
+
+bool roaring_clear(struct roaring *r, uint32_t v)
+{
+	size_t i = find_key(r, v >> 16);
+	struct container *c;
+
+	if (i == r->num || r->c[i].key != v >> 16)
+		return false;
+	c = &r->c[i];
+	if (!cont_test(c, v & 0xFFFF))
+		return false;
+	cont_prepare(r, c);
+	cont_clear(r, c, v & 0xFFFF);
+	if (c->card == 0)
+		del_container(r, i);
+	return true;
+}
+
+bool roaring_test(const struct roaring *r, uint32_t v)
+{
+	size_t i = find_key(r, v >> 16);
+
+	return i < r->num && r->c[i].key == v >> 16
+		&& cont_test(&r->c[i], v & 0xFFFF);
+}
+
+uint64_t roaring_count(const struct roaring *r)
+{
+	uint64_t count = 0;
+	size_t i;
+
+	for (i = 0; i < r->num; i++)
+		count += r->c[i].card;
+	return count;
+}
+
+/* Number of values in c which are <= x. */
+static uint32_t cont_rank(const struct container *c, uint16_t x)
+{
+	uint32_t i, rank = 0;
+
+	switch (c->type) {
+	case ARRAY:
+		i = array_find(c->u.array, c->n, x);
+		return i + (i < c->n && c->u.array[i] == x);
+	case BITMAP:
+		for (i = 0; i < x / 64; i++)
+			rank += bitops_weight64(c->u.bits[i]);
+		return rank + bitops_weight64(c->u.bits[i]
+					      & (~0ULL >> (63 - x % 64)));
+	case RUN:
+		for (i = 0; i < c->n && c->u.runs[i].start <= x; i++) {
+			if (c->u.runs[i].last >= x)
+				return rank + x - c->u.runs[i].start + 1;
+			rank += c->u.runs[i].last - c->u.runs[i].start + 1;
+		}
+		return rank;
+	}
+	abort();
+}
+
+uint64_t roaring_rank(const struct roaring *r, uint32_t v)
+{
+	size_t i, end = find_key(r, v >> 16);
+	uint64_t rank = 0;
+
+	for (i = 0; i < end; i++)
+		rank += r->c[i].card;
+	if (end < r->num && r->c[end].key == v >> 16)
+		rank += cont_rank(&r->c[end], v & 0xFFFF);
+	return rank;
+}
+
+/* The nth (from 0) value in c, which must have more than n. */
+static uint16_t cont_select(const struct container *c, uint32_t n)
+{
+	uint32_t i;
+
+	switch (c->type) {
+	case ARRAY:
+		return c->u.array[n];
+	case BITMAP:
+		for (i = 0; ; i++) {
+			uint64_t bits = c->u.bits[i];
+			uint32_t weight = bitops_weight64(bits);
+			if (n < weight) {
+				while (n--)
+					bits &= bits - 1;
+				return i * 64 + bitops_ctz64(bits);
+			}
+			n -= weight;
+		}
+	case RUN:
+		for (i = 0; ; i++) {
+			uint32_t len = c->u.runs[i].last - c->u.runs[i].start + 1;
+			if (n < len)
+				return c->u.runs[i].start + n;
+			n -= len;
+		}
+	}
+	abort();
+}
+
+bool roaring_select(const struct roaring *r, uint64_t n, uint32_t *v)
+{
+	size_t i;
+
+	for (i = 0; i < r->num; i++) {
+		if (n < r->c[i].card) {
+			*v = ((uint32_t)r->c[i].key << 16)
+				| cont_select(&r->c[i], n);
+			return true;
+		}
+		n -= r->c[i].card;
+	}
+	return false;
+}
+
+/* The first value in c which is >= x, or 65536. */
+static uint32_t cont_next(const struct container *c, uint32_t x)
+{
+	uint32_t i;
+
+	switch (c->type) {
+	case ARRAY:
+		i = array_find(c->u.array, c->n, x);
+		return i < c->n ? c->u.array[i] : 65536;
+	case BITMAP:
+		return words_next(c->u.bits, x, 0);
+	case RUN:
+		i = run_find(c->u.runs, c->n, x);
+		if (i && c->u.runs[i-1].last >= x)
+			return x;
+		return i < c->n ? c->u.runs[i].start : 65536;
+	}
+	abort();
+}
+
+/* The last value in c which is <= x, or -1. */
+static int32_t cont_prev(const struct container *c, uint32_t x)
+{
+	uint32_t i;
+
+	switch (c->type) {
+	case ARRAY:
+		i = array_find(c->u.array, c->n, x);
+		if (i < c->n && c->u.array[i] == x)
+			return x;
+		return i ? c->u.array[i-1] : -1;
+	case BITMAP:
+		for (i = x / 64; ; i--) {
+			uint64_t bits = c->u.bits[i];
+			if (i == x / 64)
+				bits &= ~0ULL >> (63 - x % 64);
+			if (bits)
+				return i * 64 + 63 - bitops_clz64(bits);
+			if (i == 0)
+				return -1;
+		}
+	case RUN:
+		i = run_find(c->u.runs, c->n, x);
+		if (!i)
+			return -1;
+		return c->u.runs[i-1].last >= x ? x : c->u.runs[i-1].last;
+	}
+	abort();
+}
+
+/* The first value >= v; returns false if there isn't one. */
+static bool next_from(const struct roaring *r, uint32_t v, uint32_t *ret)
+{
+	size_t i = find_key(r, v >> 16);
+	uint32_t low = v & 0xFFFF;
+
+	for (; i < r->num; i++, low = 0) {
+		uint32_t x;
+		if (r->c[i].key != v >> 16)
+			low = 0;
+		x = cont_next(&r->c[i], low);
+		if (x < 65536) {
+			*ret = ((uint32_t)r->c[i].key << 16) | x;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* The last value <= v; returns false if there isn't one. */
+static bool prev_from(const struct roaring *r, uint32_t v, uint32_t *ret)
+{
+	size_t i = find_key(r, v >> 16);
+	uint32_t low = v & 0xFFFF;
+
+	/* The container for v, if any, then everything below it. */
+	if (i == r->num || r->c[i].key != v >> 16)
+		low = 0xFFFF;
+	else
+		i++;
+	while (i--) {
+		int32_t x = cont_prev(&r->c[i], low);
+		if (x >= 0) {
+			*ret = ((uint32_t)r->c[i].key << 16) | x;
+			return true;
+		}
+		low = 0xFFFF;
+	}
+	return false;
+}
+
+uint32_t roaring_first(const struct roaring *r)
+{
+	uint32_t v;
+
+	return next_from(r, 0, &v) ? v : 0;
+}
+
+uint32_t roaring_next(const struct roaring *r, uint32_t prev)
+{
+	uint32_t v;
+
+	if (prev == UINT32_MAX || !next_from(r, prev + 1, &v))
+		return 0;
+	return v;
+}
+
+uint32_t roaring_last(const struct roaring *r)
+{
+	uint32_t v;
+
+	return prev_from(r, UINT32_MAX, &v) ? v : 0;
+}
+
+uint32_t roaring_prev(const struct roaring *r, uint32_t next)
+{
+	uint32_t v;
+
+	if (next == 0 || !prev_from(r, next - 1, &v))
+		return 0;
+	return v;
+}
+
+static void iter_start(struct roaring_iter *it)
+{
+	const struct container *c;
+
+	it->i = 0;
+	if (it->c == it->r->num)
+		return;
+	c = &it->r->c[it->c];
+	if (c->type == BITMAP)
+		it->w = c->u.bits[0];
+	else if (c->type == RUN)
+		it->next = c->u.runs[0].start;
+}
+
+bool roaring_iter_first(struct roaring_iter *it, const struct roaring *r,
+			uint32_t *v)
+{
+	it->r = r;
+	it->c = 0;
+	iter_start(it);
+	return roaring_iter_next(it, v);
+}
+
+bool roaring_iter_next(struct roaring_iter *it, uint32_t *v)
+{
+	for (; it->c < it->r->num; it->c++, iter_start(it)) {
+		const struct container *c = &it->r->c[it->c];
+		uint32_t high = (uint32_t)c->key << 16;
+
+		switch (c->type) {
+		case ARRAY:
+			if (it->i == c->n)
+				continue;
+			*v = high | c->u.array[it->i++];
+			return true;
+		case BITMAP:
+			while (!it->w) {
+				if (++it->i == WORDS)
+					break;
+				it->w = c->u.bits[it->i];
+			}
+			if (!it->w)
+				continue;
+			*v = high | (it->i * 64 + bitops_ctz64(it->w));
+			it->w &= it->w - 1;
+			return true;
+		case RUN:
+			if (it->i == c->n)
+				continue;
+			*v = high | it->next;
+			if (it->next == c->u.runs[it->i].last) {
+				if (++it->i < c->n)
+					it->next = c->u.runs[it->i].start;
+			} else
+				it->next++;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Set operations.  Arrays and runs have direct versions where that pays;
+ * everything else is done by expanding both sides into bitmaps.
+ */
+enum setop { OR, AND, ANDNOT, XOR };
+
+static void words_op(uint64_t *a, const uint64_t *b, enum setop op)
+{
+	uint32_t i;
+
+	switch (op) {
+	case OR:
+		for (i = 0; i < WORDS; i++)
+			a[i] |= b[i];
+		break;
+	case AND:
+		for (i = 0; i < WORDS; i++)
+			a[i] &= b[i];
+		break;
+	case ANDNOT:
+		for (i = 0; i < WORDS; i++)
+			a[i] &= ~b[i];
+		break;
+	case XOR:
+		for (i = 0; i < WORDS; i++)
+			a[i] ^= b[i];
+		break;
+	}
+}
+
+/* Keep the values in a which are (or, for ANDNOT, aren't) in b. */
+static bool array_filter(struct roaring *r, struct container *res,
+			 const struct container *a, const struct container *b,
+			 enum setop op)
+{
+	uint16_t *out = tal_arr(r, uint16_t, a->n);
+	uint32_t i, n = 0;
+
+	for (i = 0; i < a->n; i++)
+		if (cont_test(b, a->u.array[i]) == (op == AND))
+			out[n++] = a->u.array[i];
+	if (!n) {
+		tal_free(out);
+		return false;
+	}
+	tal_resize(&out, n);
+	res->type = ARRAY;
+	res->card = res->n = res->alloc = n;
+	res->u.array = out;
+	return true;
+}
+
+/* Merge two arrays; the result may be too big for an array. */
+static bool array_merge(struct roaring *r, struct container *res,
+			const struct container *a, const struct container *b,
+			enum setop op)
+{
+	uint16_t *out = tal_arr(r, uint16_t, a->n + b->n);
+	uint32_t i = 0, j = 0, n = 0;
+
+	while (i < a->n && j < b->n) {
+		uint16_t x = a->u.array[i], y = b->u.array[j];
+		if (x < y) {
+			if (op != AND)
+				out[n++] = x;
+			i++;
+		} else if (y < x) {
+			if (op == OR || op == XOR)
+				out[n++] = y;
+			j++;
+		} else {
+			if (op == OR || op == AND)
+				out[n++] = x;
+			i++;
+			j++;
+		}
+	}
+	if (op != AND)
+		while (i < a->n)
+			out[n++] = a->u.array[i++];
+	if (op == OR || op == XOR)
+		while (j < b->n)
+			out[n++] = b->u.array[j++];
+
+	if (!n) {
+		tal_free(out);
+		return false;
+	}
+	res->shared = false;
+	res->card = n;
+	if (n > ARRAY_MAX) {
+		res->type = ARRAY;
+		res->n = n;
+		res->u.array = out;
+		array_to_bitmap(r, res);
+		res->card = n;
+		return true;
+	}
+	tal_resize(&out, n);
+	res->type = ARRAY;
+	res->n = res->alloc = n;
+	res->u.array = out;
+	return true;
+}
+
+/* Union or intersection of two run lists. */
+static bool run_merge(struct roaring *r, struct container *res,
+		      const struct container *a, const struct container *b,
+		      enum setop op)
+{
+	struct run *out = tal_arr(r, struct run, a->n + b->n);
+	uint32_t i = 0, j = 0, n = 0, card = 0;
+
+	if (op == AND) {
+		while (i < a->n && j < b->n) {
+			struct run x = a->u.runs[i], y = b->u.runs[j];
+			uint16_t start = x.start > y.start ? x.start : y.start;
+			uint16_t last = x.last < y.last ? x.last : y.last;
+			if (start <= last) {
+				out[n].start = start;
+				out[n++].last = last;
+			}
+			if (x.last < y.last)
+				i++;
+			else
+				j++;
+		}
+	} else {
+		while (i < a->n || j < b->n) {
+			struct run x;
+			if (j == b->n
+			    || (i < a->n && a->u.runs[i].start < b->u.runs[j].start))
+				x = a->u.runs[i++];
+			else
+				x = b->u.runs[j++];
+			/* Join it onto the last one if they touch. */
+			if (n && x.start <= (uint32_t)out[n-1].last + 1) {
+				if (x.last > out[n-1].last)
+					out[n-1].last = x.last;
+			} else
+				out[n++] = x;
+		}
+	}
+	if (!n) {
+		tal_free(out);
+		return false;
+	}
+	for (i = 0; i < n; i++)
+		card += out[i].last - out[i].start + 1;
+	tal_resize(&out, n);
+	res->type = RUN;
+	res->shared = false;
+	res->card = card;
+	res->n = res->alloc = n;
+	res->u.runs = out;
+	return true;
+}
+
+static bool cont_op(struct roaring *r, struct container *res,
+		    const struct container *a, const struct container *b,
+		    enum setop op)
+{
+	uint64_t wa[WORDS], wb[WORDS];
+
+	if (a->type == ARRAY && b->type == ARRAY)
+		return array_merge(r, res, a, b, op);
+	if (a->type == ARRAY && (op == AND || op == ANDNOT))
+		return array_filter(r, res, a, b, op);
+	if (b->type == ARRAY && op == AND)
+		return array_filter(r, res, b, a, op);
+	if (a->type == RUN && b->type == RUN && (op == OR || op == AND))
+		return run_merge(r, res, a, b, op);
+
+	cont_words(a, wa);
+	cont_words(b, wb);
+	words_op(wa, wb, op);
+	return cont_from_words(r, res, wa);
+}
+
+static struct roaring *roaring_op(const tal_t *ctx,
+				  const struct roaring *a,
+				  const struct roaring *b,
+				  enum setop op)
+{
+	struct roaring *r = roaring_new(ctx);
+	size_t i = 0, j = 0;
+
+	while (i < a->num || j < b->num) {
+		struct container *res;
+
+		if (j == b->num || (i < a->num && a->c[i].key < b->c[j].key)) {
+			/* Only in a. */
+			if (op != AND)
+				cont_copy(r, next_container(r, a->c[i].key),
+					  &a->c[i]);
+			i++;
+		} else if (i == a->num || b->c[j].key < a->c[i].key) {
+			/* Only in b. */
+			if (op == OR || op == XOR)
+				cont_copy(r, next_container(r, b->c[j].key),
+					  &b->c[j]);
+			j++;
+		} else {
+			res = next_container(r, a->c[i].key);
+			if (!cont_op(r, res, &a->c[i], &b->c[j], op))
+				r->num--;
+			i++;
+			j++;
+		}
+	}
+	return r;
+}
+
+struct roaring *roaring_or(const tal_t *ctx,
+			   const struct roaring *a, const struct roaring *b)
+{
+	return roaring_op(ctx, a, b, OR);
+}
+
+struct roaring *roaring_and(const tal_t *ctx,
+			    const struct roaring *a, const struct roaring *b)
+{
+	return roaring_op(ctx, a, b, AND);
+}
+
+struct roaring *roaring_andnot(const tal_t *ctx,
+			       const struct roaring *a, const struct roaring *b)
+{
+	return roaring_op(ctx, a, b, ANDNOT);
+}
+
+struct roaring *roaring_xor(const tal_t *ctx,
+			    const struct roaring *a, const struct roaring *b)
+{
+	return roaring_op(ctx, a, b, XOR);
+}
+
+size_t roaring_optimize(struct roaring *r)
+{
+	uint64_t w[WORDS];
+	size_t i, converted = 0;
+
+	for (i = 0; i < r->num; i++) {
+		struct container *c = &r->c[i];
+		uint32_t runs;
+
+		if (c->type == RUN)
+			continue;
+		cont_words(c, w);
+		runs = words_runs(w);
+		if (runs * sizeof(struct run) >= cont_bytes(c))
+			continue;
+		cont_free(c);
+		c->type = RUN;
+		c->shared = false;
+		c->n = c->alloc = runs;
+		c->u.runs = tal_arr(r, struct run, runs);
+		words_to_runs(w, c->u.runs);
+		converted++;
+	}
+	return converted;
+}
+
+size_t roaring_memory(const struct roaring *r)
+{
+	size_t i, bytes = sizeof(*r) + tal_count(r->c) * sizeof(r->c[0]);
+
+	for (i = 0; i < r->num; i++) {
+		const struct container *c = &r->c[i];
+		if (c->type == ARRAY)
+			bytes += c->alloc * sizeof(uint16_t);
+		else
+			bytes += cont_bytes(c);
+	}
+	return bytes;
+}
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+size_t roaring_serialized_size(const struct roaring *r)
+{
+	size_t i, len = sizeof(struct roaring_header)
+		+ r->num * sizeof(struct roaring_desc);
+
+	for (i = 0; i < r->num; i++)
+		len += align8(cont_bytes(&r->c[i]));
+	return len;
+}
+
+size_t roaring_serialize(const struct roaring *r, void *buf)
+{
+	struct roaring_header *hdr = buf;
+	struct roaring_desc *desc = (struct roaring_desc *)(hdr + 1);
+	size_t i, off = sizeof(*hdr) + r->num * sizeof(*desc);
+
+	hdr->magic = ROARING_MAGIC;
+	hdr->num = r->num;
+	for (i = 0; i < r->num; i++) {
+		const struct container *c = &r->c[i];
+		size_t bytes = cont_bytes(c);
+
+		desc[i].key = c->key;
+		desc[i].type = c->type;
+		desc[i].pad = 0;
+		desc[i].card = c->card;
+		desc[i].n = c->n;
+		desc[i].offset = off;
+		memcpy((char *)buf + off, c->u.p, bytes);
+		memset((char *)buf + off + bytes, 0, align8(bytes) - bytes);
+		off += align8(bytes);
+	}
+	return off;
+}
+
+/* Everything else trusts the card and the ordering, so check them. */
+static bool cont_valid(const struct container *c)
+{
+	uint32_t i, card = 0;
+
+	switch (c->type) {
+	case ARRAY:
+		if (!c->n || c->n != c->card || c->n > ARRAY_MAX)
+			return false;
+		for (i = 1; i < c->n; i++)
+			if (c->u.array[i] <= c->u.array[i-1])
+				return false;
+		return true;
+	case BITMAP:
+		return words_weight(c->u.bits) == c->card
+			&& c->card > ARRAY_MAX;
+	case RUN:
+		for (i = 0; i < c->n; i++) {
+			if (c->u.runs[i].last < c->u.runs[i].start)
+				return false;
+			if (i && c->u.runs[i].start
+			    <= (uint32_t)c->u.runs[i-1].last + 1)
+				return false;
+			card += c->u.runs[i].last - c->u.runs[i].start + 1;
+		}
+		return c->n && card == c->card;
+	}
+	return false;
+}
+
+struct roaring *roaring_view(const tal_t *ctx, const void *buf, size_t len)
+{
+	const struct roaring_header *hdr = buf;
+	const struct roaring_desc *desc = (const struct roaring_desc *)(hdr + 1);
+	struct roaring *r;
+	size_t i;
+
+	if ((uintptr_t)buf % 8 || len < sizeof(*hdr)
+	    || hdr->magic != ROARING_MAGIC
+	    || hdr->num > 65536
+	    || len < sizeof(*hdr) + hdr->num * sizeof(*desc))
+		goto invalid;
+
+	r = roaring_new(ctx);
+	tal_resize(&r->c, hdr->num);
+	for (i = 0; i < hdr->num; i++) {
+		struct container *c = &r->c[i];
+
+		if ((i && desc[i].key <= desc[i-1].key)
+		    || desc[i].type > RUN
+		    || desc[i].offset % 8
+		    || desc[i].offset > len)
+			goto free;
+		c->key = desc[i].key;
+		c->type = desc[i].type;
+		c->shared = true;
+		c->card = desc[i].card;
+		c->n = c->alloc = desc[i].n;
+		c->u.p = (char *)buf + desc[i].offset;
+		if (c->n > 65536 || cont_bytes(c) > len - desc[i].offset
+		    || !cont_valid(c))
+			goto free;
+		r->num++;
+	}
+	return r;
+
+free:
+	tal_free(r);
+invalid:
+	errno = EINVAL;
+	return NULL;
+}
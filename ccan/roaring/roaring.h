@@ -0,0 +1,283 @@
+/* MIT (BSD) license - see LICENSE file for details */
+#ifndef CCAN_ROARING_H
+#define CCAN_ROARING_H
+#include "config.h"
+#include <ccan/tal/tal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * struct roaring - a compressed set of 32-bit integers.
+ *
+ * The set is split into chunks of 65536 values by the top 16 bits; each
+ * chunk is stored as a sorted array, a bitmap or a list of runs, whichever
+ * suits its contents.
+ */
+struct roaring;
+
+/**
+ * struct roaring_iter - iterator over a roaring set.
+ *
+ * This is exposed so you can put one on the stack; the members are private.
+ */
+struct roaring_iter {
+	const struct roaring *r;
+	size_t c;
+	uint32_t i;
+	uint32_t next;
+	uint64_t w;
+};
+
+/**
+ * roaring_new - create a new, empty set.
+ * @ctx: the tal context to allocate from.
+ *
+ * Example:
+ *	struct roaring *r = roaring_new(NULL);
+ *	roaring_set(r, 100);
+ *	roaring_free(r);
+ */
+struct roaring *roaring_new(const tal_t *ctx);
+
+/**
+ * roaring_free - destroy a set.
+ * @r: the set (from roaring_new, a set operation or roaring_view).
+ */
+void roaring_free(struct roaring *r);
+
+/**
+ * roaring_set - add a value to the set.
+ * @r: the set.
+ * @v: the value.
+ *
+ * Returns false if it was already in the set.
+ */
+bool roaring_set(struct roaring *r, uint32_t v);
+
+/**
+ * roaring_clear - remove a value from the set.
+ * @r: the set.
+ * @v: the value.
+ *
+ * Returns false if it wasn't in the set.
+ */
+bool roaring_clear(struct roaring *r, uint32_t v);
+
+/**
+ * roaring_test - is a value in the set?
+ * @r: the set.
+ * @v: the value.
+ */
+bool roaring_test(const struct roaring *r, uint32_t v);
+
+/**
+ * roaring_count - the number of values in the set.
+ * @r: the set.
+ */
+uint64_t roaring_count(const struct roaring *r);
+
+/**
+ * roaring_rank - the number of values in the set which are <= v.
+ * @r: the set.
+ * @v: the value.
+ */
+uint64_t roaring_rank(const struct roaring *r, uint32_t v);
+
+/**
+ * roaring_select - find the nth value in the set.
+ * @r: the set.
+ * @n: which value, starting at 0.
+ * @v: set to the value.
+ *
+ * Returns false if the set has n or fewer values.  This is the inverse of
+ * roaring_rank: if roaring_select(r, n, &v), roaring_rank(r, v) == n + 1.
+ */
+bool roaring_select(const struct roaring *r, uint64_t n, uint32_t *v);
+
+/**
+ * roaring_first - return the first value in the set (must not contain 0).
+ * @r: the set.
+ *
+ * Like jset_first, this returns 0 if the set is empty, so it is ambiguous
+ * if 0 is in the set.  roaring_iter_first doesn't have that problem.
+ *
+ * Example:
+ *	static void dump(const struct roaring *r)
+ *	{
+ *		uint32_t v;
+ *
+ *		for (v = roaring_first(r); v; v = roaring_next(r, v))
+ *			printf("%u\n", v);
+ *	}
+ */
+uint32_t roaring_first(const struct roaring *r);
+
+/**
+ * roaring_next - return the value after this one (must not contain 0).
+ * @r: the set.
+ * @prev: the previous value (need not be in the set).
+ *
+ * Returns 0 if there are no more.
+ */
+uint32_t roaring_next(const struct roaring *r, uint32_t prev);
+
+/**
+ * roaring_last - return the last value in the set (must not contain 0).
+ * @r: the set.
+ *
+ * Returns 0 if the set is empty.
+ */
+uint32_t roaring_last(const struct roaring *r);
+
+/**
+ * roaring_prev - return the value before this one (must not contain 0).
+ * @r: the set.
+ * @next: the following value (need not be in the set).
+ *
+ * Returns 0 if there are no more.
+ */
+uint32_t roaring_prev(const struct roaring *r, uint32_t next);
+
+/**
+ * roaring_iter_first - start iterating over a set, in increasing order.
+ * @it: the iterator.
+ * @r: the set.
+ * @v: set to the first value.
+ *
+ * Returns false if the set is empty.  The set must not be changed while
+ * it is being iterated over.
+ *
+ * Example:
+ *	static uint64_t sum(const struct roaring *r)
+ *	{
+ *		struct roaring_iter it;
+ *		uint64_t total = 0;
+ *		uint32_t v;
+ *		bool more;
+ *
+ *		for (more = roaring_iter_first(&it, r, &v); more;
+ *		     more = roaring_iter_next(&it, &v))
+ *			total += v;
+ *		return total;
+ *	}
+ */
+bool roaring_iter_first(struct roaring_iter *it, const struct roaring *r,
+			uint32_t *v);
+
+/**
+ * roaring_iter_next - get the next value from an iterator.
+ * @it: the iterator (from roaring_iter_first).
+ * @v: set to the value.
+ *
+ * Returns false when there are no more.
+ */
+bool roaring_iter_next(struct roaring_iter *it, uint32_t *v);
+
+/**
+ * roaring_or - the union of two sets.
+ * @ctx: the tal context to allocate the result from.
+ * @a: the first set.
+ * @b: the second set.
+ */
+struct roaring *roaring_or(const tal_t *ctx,
+			   const struct roaring *a, const struct roaring *b);
+
+/**
+ * roaring_and - the intersection of two sets.
+ * @ctx: the tal context to allocate the result from.
+ * @a: the first set.
+ * @b: the second set.
+ */
+struct roaring *roaring_and(const tal_t *ctx,
+			    const struct roaring *a, const struct roaring *b);
+
+/**
+ * roaring_andnot - the values in one set but not the other.
+ * @ctx: the tal context to allocate the result from.
+ * @a: the first set.
+ * @b: the set of values to leave out.
+ */
+struct roaring *roaring_andnot(const tal_t *ctx,
+			       const struct roaring *a, const struct roaring *b);
+
+/**
+ * roaring_xor - the values in exactly one of two sets.
+ * @ctx: the tal context to allocate the result from.
+ * @a: the first set.
+ * @b: the second set.
+ */
+struct roaring *roaring_xor(const tal_t *ctx,
+			    const struct roaring *a, const struct roaring *b);
+
+/**
+ * roaring_optimize - store chunks as runs where that is smaller.
+ * @r: the set.
+ *
+ * Runs are never chosen as values are added or removed one at a time, as
+ * each change could mean rewriting a chunk.  Call this once a set has been
+ * built, particularly before serializing it.  Returns the number of chunks
+ * converted.
+ */
+size_t roaring_optimize(struct roaring *r);
+
+/**
+ * roaring_memory - the number of bytes the set uses.
+ * @r: the set.
+ *
+ * This counts the chunk index and the chunks themselves, not allocator
+ * overhead.
+ */
+size_t roaring_memory(const struct roaring *r);
+
+/**
+ * roaring_serialized_size - the number of bytes roaring_serialize will write.
+ * @r: the set.
+ */
+size_t roaring_serialized_size(const struct roaring *r);
+
+/**
+ * roaring_serialize - write out a set.
+ * @r: the set.
+ * @buf: a buffer of roaring_serialized_size(r) bytes.
+ *
+ * The format is in host byte order, with every chunk 8-byte aligned, so it
+ * can be used in place by roaring_view.  Returns the number of bytes
+ * written.
+ */
+size_t roaring_serialize(const struct roaring *r, void *buf);
+
+/**
+ * roaring_view - use a serialized set in place.
+ * @ctx: the tal context to allocate the result from.
+ * @buf: the serialized set, 8-byte aligned (eg. from mmap).
+ * @len: the length of @buf.
+ *
+ * The chunks are not copied, so @buf must stay valid (and unchanged) for
+ * as long as the result is used; it is never written to.  A chunk is
+ * copied the first time the result is changed.  The whole buffer is read
+ * once to check it, and NULL is returned (with errno set to EINVAL) if it
+ * is not a valid set written on a machine with the same byte order.
+ *
+ * Example:
+ *	#include <sys/mman.h>
+ *	#include <sys/stat.h>
+ *	#include <fcntl.h>
+ *
+ *	static struct roaring *map_set(const char *file)
+ *	{
+ *		struct stat st;
+ *		void *p;
+ *		int fd = open(file, O_RDONLY);
+ *
+ *		if (fd < 0 || fstat(fd, &st) != 0)
+ *			return NULL;
+ *		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+ *		close(fd);
+ *		if (p == MAP_FAILED)
+ *			return NULL;
+ *		return roaring_view(NULL, p, st.st_size);
+ *	}
+ */
+struct roaring *roaring_view(const tal_t *ctx, const void *buf, size_t len);
+#endif /* CCAN_ROARING_H */
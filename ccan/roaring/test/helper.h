@@ -0,0 +1,77 @@
+#include <ccan/tap/tap.h>
+#include <stdlib.h>
+
+/* The reference set: a byte per value, over a few chunks spread out
+ * across the 32-bit space. */
+static const uint32_t keys[] = { 0, 1, 2, 7, 1000, 65535 };
+#define NKEYS (sizeof(keys) / sizeof(keys[0]))
+#define NVALS (NKEYS * 65536)
+
+static uint32_t val(size_t i)
+{
+	return (keys[i / 65536] << 16) | (i % 65536);
+}
+
+/* Each chunk gets a different shape, so every container type (and
+ * conversions between them) gets exercised. */
+static void fill(struct roaring *r, unsigned char *ref, unsigned int seed)
+{
+	size_t i, k;
+
+	srandom(seed);
+	memset(ref, 0, NVALS);
+	for (k = 0; k < NKEYS; k++) {
+		unsigned int shape = (k + seed) % 4;
+		for (i = k * 65536; i < (k + 1) * 65536; i++) {
+			bool set;
+			switch (shape) {
+			case 0: /* sparse */
+				set = random() % 64 == 0;
+				break;
+			case 1: /* dense */
+				set = random() % 3 != 0;
+				break;
+			case 2: /* runs */
+				set = (i / 300) % 3 == 0 && random() % 512;
+				break;
+			default: /* empty */
+				set = false;
+			}
+			if (set) {
+				ref[i] = 1;
+				roaring_set(r, val(i));
+			}
+		}
+	}
+}
+
+static bool matches(const struct roaring *r, const unsigned char *ref)
+{
+	struct roaring_iter it;
+	uint64_t count = 0;
+	uint32_t v;
+	size_t i = 0;
+	bool more;
+
+	for (i = 0; i < NVALS; i++) {
+		if (roaring_test(r, val(i)) != ref[i])
+			return false;
+		count += ref[i];
+	}
+	if (roaring_count(r) != count)
+		return false;
+
+	/* Iteration gives exactly the set values, in order. */
+	i = 0;
+	for (more = roaring_iter_first(&it, r, &v); more;
+	     more = roaring_iter_next(&it, &v)) {
+		while (i < NVALS && !ref[i])
+			i++;
+		if (i == NVALS || v != val(i))
+			return false;
+		i++;
+	}
+	while (i < NVALS && !ref[i])
+		i++;
+	return i == NVALS;
+}
@@ -0,0 +1,67 @@
+#include <ccan/roaring/roaring.h>
+/* Include the C files directly. */
+#include <ccan/roaring/roaring.c>
+#include "helper.h"
+
+int main(void)
+{
+	unsigned char *ref = malloc(NVALS);
+	struct roaring *r = roaring_new(NULL), *view;
+	size_t len;
+	uint64_t *buf, *copy;
+	struct roaring_desc *desc;
+
+	plan_tests(14);
+
+	/* Empty set. */
+	buf = malloc(roaring_serialized_size(r));
+	ok1(roaring_serialize(r, buf) == roaring_serialized_size(r));
+	view = roaring_view(NULL, buf, roaring_serialized_size(r));
+	ok1(view && roaring_count(view) == 0);
+	roaring_free(view);
+	free(buf);
+
+	fill(r, ref, 2);
+	roaring_optimize(r);
+	len = roaring_serialized_size(r);
+	buf = malloc(len);
+	ok1(roaring_serialize(r, buf) == len);
+	copy = malloc(len);
+	memcpy(copy, buf, len);
+
+	view = roaring_view(NULL, buf, len);
+	ok1(view);
+	ok1(matches(view, ref));
+	ok1(roaring_memory(view) <= roaring_memory(r));
+
+	/* Changing the view changes a copy, never the buffer. */
+	ref[5] = 1;
+	roaring_set(view, val(5));
+	roaring_clear(view, val(5));
+	roaring_set(view, val(5));
+	ref[65536 * 2 + 300] = 0;
+	roaring_clear(view, val(65536 * 2 + 300));
+	ok1(matches(view, ref));
+	ok1(memcmp(buf, copy, len) == 0);
+	roaring_free(view);
+
+	/* Bad buffers. */
+	ok1(!roaring_view(NULL, buf, len - 8) && errno == EINVAL);
+	ok1(!roaring_view(NULL, (char *)buf + 8, len - 8));
+	ok1(!roaring_view(NULL, buf, 4));
+	desc = (struct roaring_desc *)((struct roaring_header *)buf + 1);
+	desc[1].key = desc[0].key;
+	ok1(!roaring_view(NULL, buf, len));
+	memcpy(buf, copy, len);
+	desc[0].card++;
+	ok1(!roaring_view(NULL, buf, len));
+	memcpy(buf, copy, len);
+	((struct roaring_header *)buf)->magic = 0x314d4252;
+	ok1(!roaring_view(NULL, buf, len));
+
+	roaring_free(r);
+	free(buf);
+	free(copy);
+	free(ref);
+	return exit_status();
+}
@@ -0,0 +1,78 @@
+#include <ccan/roaring/roaring.h>
+/* Include the C files directly. */
+#include <ccan/roaring/roaring.c>
+#include "helper.h"
+
+/* fill() shapes chunk k by (k + seed) % 4, so across the chunks every b
+ * seed makes each pair of shapes meet; optimized and not. */
+#define SEEDS 4
+
+int main(void)
+{
+	unsigned char *ra = malloc(NVALS), *rb = malloc(NVALS);
+	unsigned char *expect = malloc(NVALS);
+	unsigned int sa, sb, opt;
+	bool ok[4] = { true, true, true, true };
+
+	plan_tests(5);
+
+	for (opt = 0; opt < 2; opt++) {
+		for (sa = 0; sa < 2; sa++) {
+			for (sb = 0; sb < SEEDS; sb++) {
+				struct roaring *a = roaring_new(NULL);
+				struct roaring *b = roaring_new(a), *res;
+				size_t i;
+
+				fill(a, ra, sa);
+				fill(b, rb, sb + 100);
+				if (opt) {
+					roaring_optimize(a);
+					roaring_optimize(b);
+				}
+
+				res = roaring_or(a, a, b);
+				for (i = 0; i < NVALS; i++)
+					expect[i] = ra[i] | rb[i];
+				ok[0] &= matches(res, expect);
+
+				res = roaring_and(a, a, b);
+				for (i = 0; i < NVALS; i++)
+					expect[i] = ra[i] & rb[i];
+				ok[1] &= matches(res, expect);
+
+				res = roaring_andnot(a, a, b);
+				for (i = 0; i < NVALS; i++)
+					expect[i] = ra[i] & !rb[i];
+				ok[2] &= matches(res, expect);
+
+				res = roaring_xor(a, a, b);
+				for (i = 0; i < NVALS; i++)
+					expect[i] = ra[i] ^ rb[i];
+				ok[3] &= matches(res, expect);
+
+				roaring_free(a);
+			}
+		}
+	}
+	ok1(ok[0]);
+	ok1(ok[1]);
+	ok1(ok[2]);
+	ok1(ok[3]);
+
+	/* A set with itself. */
+	{
+		struct roaring *a = roaring_new(NULL);
+		fill(a, ra, 3);
+		roaring_optimize(a);
+		ok1(roaring_count(roaring_xor(a, a, a)) == 0
+		    && roaring_count(roaring_andnot(a, a, a)) == 0
+		    && matches(roaring_and(a, a, a), ra)
+		    && matches(roaring_or(a, a, a), ra));
+		roaring_free(a);
+	}
+
+	free(ra);
+	free(rb);
+	free(expect);
+	return exit_status();
+}
@@ -0,0 +1,102 @@
+#include <ccan/roaring/roaring.h>
+/* Include the C files directly. */
+#include <ccan/roaring/roaring.c>
+#include "helper.h"
+
+int main(void)
+{
+	struct roaring *r;
+	unsigned char *ref = malloc(NVALS);
+	uint32_t v, prev;
+	uint64_t rank;
+	size_t i;
+	bool ok;
+
+	plan_tests(23);
+
+	r = roaring_new(NULL);
+	ok1(roaring_count(r) == 0);
+	ok1(roaring_first(r) == 0 && roaring_last(r) == 0);
+	ok1(!roaring_select(r, 0, &v));
+	ok1(roaring_rank(r, UINT32_MAX) == 0);
+
+	ok1(roaring_set(r, 0));
+	ok1(!roaring_set(r, 0));
+	ok1(roaring_set(r, UINT32_MAX));
+	ok1(roaring_test(r, 0) && roaring_test(r, UINT32_MAX));
+	ok1(!roaring_test(r, 1));
+	ok1(roaring_last(r) == UINT32_MAX);
+	ok1(roaring_clear(r, 0));
+	ok1(!roaring_clear(r, 0));
+	ok1(roaring_first(r) == UINT32_MAX);
+	roaring_free(r);
+
+	r = roaring_new(NULL);
+	fill(r, ref, 1);
+	ok1(matches(r, ref));
+
+	ok1(roaring_optimize(r) > 0);
+	ok1(matches(r, ref));
+
+	/* Clear most of it again: bitmaps turn back into arrays, and runs
+	 * turn back into something we can change. */
+	for (i = 0; i < NVALS; i++) {
+		if (ref[i] && i % 4) {
+			ref[i] = 0;
+			roaring_clear(r, val(i));
+		}
+	}
+	ok1(matches(r, ref));
+	for (i = 0; i < NVALS; i += 7) {
+		ref[i] = !ref[i];
+		if (ref[i])
+			roaring_set(r, val(i));
+		else
+			roaring_clear(r, val(i));
+	}
+	ok1(matches(r, ref));
+	roaring_optimize(r);
+
+	/* rank and select agree with the reference, and each other. */
+	ok = true;
+	rank = 0;
+	for (i = 0; i < NVALS; i++) {
+		rank += ref[i];
+		if (roaring_rank(r, val(i)) != rank)
+			ok = false;
+		if (ref[i] && (!roaring_select(r, rank - 1, &v) || v != val(i)))
+			ok = false;
+	}
+	ok1(ok);
+	ok1(!roaring_select(r, rank, &v));
+
+	/* jset-style iteration, both ways (0 isn't in the set now). */
+	ref[0] = 0;
+	roaring_clear(r, 0);
+	ok = true;
+	i = 0;
+	for (v = roaring_first(r); v; v = roaring_next(r, v)) {
+		while (!ref[i])
+			i++;
+		if (v != val(i++))
+			ok = false;
+	}
+	ok1(ok && roaring_next(r, roaring_last(r)) == 0);
+	ok = true;
+	i = NVALS;
+	for (v = roaring_last(r); v; v = roaring_prev(r, v)) {
+		while (!ref[--i]);
+		if (v != val(i))
+			ok = false;
+	}
+	ok1(ok && roaring_prev(r, roaring_first(r)) == 0);
+
+	/* Values in between are fine for next and prev. */
+	prev = roaring_next(r, val(65536 * 3 + 10) - 1);
+	for (i = 65536 * 3 + 10; !ref[i]; i++);
+	ok1(prev == val(i));
+
+	roaring_free(r);
+	free(ref);
+	return exit_status();
+}
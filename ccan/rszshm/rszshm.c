@@ -177,7 +177,7 @@ int rszshm_grow(struct rszshm *r)
 		return -1;
 
 	if ((ret = rszshm_up(r)) == 0) {
-		int flen = r->hdr->flen * 2 < r->hdr->max ? r->hdr->flen * 2 : r->hdr->max;
+		size_t flen = r->hdr->flen * 2 < r->hdr->max ? r->hdr->flen * 2 : r->hdr->max;
 
 		if (ftruncate(r->fd, flen) != -1 &&
 		    mmap(r->hdr, flen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, r->fd, 0) != MAP_FAILED) {
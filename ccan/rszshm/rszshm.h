@@ -3,6 +3,7 @@
 #define CCAN_RSZSHM_H
 #include "config.h"
 
+#include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -0,0 +1,122 @@
+/* Times 1 to 8 processes hammering one table: growing it from the smallest
+ * size with disjoint inserts, then mixes of gets and puts over a million
+ * preloaded keys. */
+#include <ccan/shmht/shmht.h>
+#include <ccan/time/time.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_KEYS 1000000
+#define NUM_OPS 2000000
+#define MAX_PROCS 8
+
+static uint64_t rand64(uint64_t *seed)
+{
+	/* xorshift64 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+/* Each child waits for the pipe to close, then runs fn. */
+static void run(const char *desc, struct shmht *ht, unsigned int num,
+		uint64_t ops, void (*fn)(struct shmht *, unsigned int, void *),
+		void *arg)
+{
+	int p[2], status;
+	unsigned int i;
+	char c;
+	struct timemono start;
+	struct timerel diff;
+
+	if (pipe(p) != 0)
+		err(1, "pipe");
+	fflush(stdout);
+	for (i = 0; i < num; i++) {
+		switch (fork()) {
+		case -1:
+			err(1, "fork");
+		case 0:
+			close(p[1]);
+			if (read(p[0], &c, 1) != 0)
+				errx(1, "read");
+			fn(ht, i, arg);
+			exit(0);
+		}
+	}
+	close(p[0]);
+	start = time_mono();
+	close(p[1]);
+	for (i = 0; i < num; i++) {
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			errx(1, "child failed");
+	}
+	diff = timemono_since(start);
+	printf("%-22s %u procs: %6llu nsec per op, %6.1f Mops/sec\n",
+	       desc, num, (unsigned long long)time_to_nsec(diff) * num / ops,
+	       ops / (double)time_to_nsec(diff) * 1000.0);
+}
+
+static void insert(struct shmht *ht, unsigned int id, void *arg)
+{
+	uint64_t *per_proc = arg, i;
+
+	for (i = 0; i < *per_proc; i++)
+		if (shmht_put(ht, (i * MAX_PROCS + id) + 1, i) != 1)
+			errx(1, "put failed");
+}
+
+static void mix(struct shmht *ht, unsigned int id, void *arg)
+{
+	unsigned int *put_pct = arg;
+	uint64_t seed = id + 1, i, val;
+
+	for (i = 0; i < NUM_OPS; i++) {
+		uint64_t r = rand64(&seed), key = r % NUM_KEYS + 1;
+		if (r % 100 < *put_pct) {
+			if (shmht_put(ht, key, i) < 0)
+				errx(1, "put failed");
+		} else if (shmht_get(ht, key, &val) != 1)
+			errx(1, "get failed");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static unsigned int pcts[] = { 0, 10, 50 };
+	struct shmht ht;
+	unsigned int num, i;
+	uint64_t per_proc;
+	char desc[40];
+
+	for (num = 1; num <= MAX_PROCS; num *= 2) {
+		if (!shmht_mk(&ht, SHMHT_MIN_BITS, NULL))
+			err(1, "shmht_mk");
+		per_proc = NUM_KEYS / num;
+		run("insert (growing)", &ht, num, per_proc * num,
+		    insert, &per_proc);
+		shmht_dt(&ht);
+		rszshm_rm(&ht.r);
+	}
+
+	if (!shmht_mk(&ht, 21, NULL))
+		err(1, "shmht_mk");
+	for (i = 1; i <= NUM_KEYS; i++)
+		if (shmht_put(&ht, i, i) != 1)
+			errx(1, "preload failed");
+
+	for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++) {
+		sprintf(desc, "%u%% put, %u%% get", pcts[i], 100 - pcts[i]);
+		for (num = 1; num <= MAX_PROCS; num *= 2)
+			run(desc, &ht, num, (uint64_t)NUM_OPS * num,
+			    mix, &pcts[i]);
+	}
+	shmht_dt(&ht);
+	rszshm_rm(&ht.r);
+	return 0;
+}
@@ -0,0 +1,426 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#include <ccan/shmht/shmht.h>
+#include <ccan/hash/hash.h>
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+
+#define SHMHT_MAGIC 0x5348544854000001ULL
+
+/*
+ * Values are stored plus one, so 0 can mean empty.  While a value is being
+ * copied to the next table it has the top bit set: it can't be changed,
+ * but readers can still use it.  Once copied, it becomes VAL_MOVED.
+ */
+#define VAL_EMPTY	0
+#define VAL_DELETED	((UINT64_MAX >> 1))
+#define VAL_PRIME	(1ULL << 63)
+#define VAL_MOVED	VAL_PRIME
+
+/* t->next while the new table is being set up. */
+#define NEXT_ALLOCATING 1
+
+/* Slots copied to the next table in one go. */
+#define COPY_CHUNK (1ULL << SHMHT_MIN_BITS)
+
+struct shmht_hdr {
+	uint64_t magic;
+	/* Offset of the current table. */
+	uint64_t table;
+	/* End of the last table allocated. */
+	uint64_t brk;
+};
+
+struct shmht_slot {
+	uint64_t key;
+	uint64_t val;
+};
+
+struct shmht_table {
+	uint64_t bits;
+	/* Offset of the table we're growing into, if any. */
+	uint64_t next;
+	/* Slots with keys: every new key touches this, so keep it apart. */
+	uint64_t claimed __attribute__((aligned(64)));
+	/* While growing: next slot to copy, and number copied. */
+	uint64_t copy_next __attribute__((aligned(64)));
+	uint64_t copied;
+	struct shmht_slot slots[] __attribute__((aligned(64)));
+};
+
+/* All offsets are from the start of the region, which is page aligned. */
+static uint64_t first_table(void)
+{
+	return (sizeof(struct rszshm_hdr) + sizeof(struct shmht_hdr) + 63)
+		& ~63ULL;
+}
+
+static uint64_t table_size(uint64_t bits)
+{
+	return sizeof(struct shmht_table) + (sizeof(struct shmht_slot) << bits);
+}
+
+static uint64_t hash_key(uint64_t key)
+{
+	return hash64_stable(&key, 1, 0);
+}
+
+static struct shmht_table *table_at(struct shmht *ht, uint64_t off)
+{
+	struct shmht_table *t = (void *)((char *)ht->r.hdr + off);
+
+	/* Another process may have grown the region to fit it. */
+	if (off + sizeof(*t) > ht->r.flen
+	    || off + table_size(t->bits) > ht->r.flen) {
+		if (rszshm_up(&ht->r) < 0)
+			return NULL;
+	}
+	return t;
+}
+
+static struct shmht_slot *find(struct shmht_table *t, uint64_t key, uint64_t h)
+{
+	uint64_t mask = (1ULL << t->bits) - 1, i, n;
+
+	for (n = 0, i = h & mask; n <= mask; n++, i = (i + 1) & mask) {
+		uint64_t k = __atomic_load_n(&t->slots[i].key, __ATOMIC_ACQUIRE);
+		if (k == key)
+			return &t->slots[i];
+		if (k == 0)
+			break;
+	}
+	return NULL;
+}
+
+/* Find key's slot, or claim an empty one as long as we're under limit. */
+static struct shmht_slot *claim(struct shmht_table *t, uint64_t key,
+				uint64_t h, uint64_t limit)
+{
+	uint64_t mask = (1ULL << t->bits) - 1, i, n;
+
+	for (n = 0, i = h & mask; n <= mask; n++, i = (i + 1) & mask) {
+		uint64_t k = __atomic_load_n(&t->slots[i].key, __ATOMIC_ACQUIRE);
+
+		if (k == 0) {
+			if (__atomic_load_n(&t->claimed, __ATOMIC_RELAXED)
+			    >= limit)
+				return NULL;
+			if (__atomic_compare_exchange_n(&t->slots[i].key, &k,
+							key, false,
+							__ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE)) {
+				__atomic_fetch_add(&t->claimed, 1,
+						   __ATOMIC_RELAXED);
+				return &t->slots[i];
+			}
+			/* k is now whoever beat us to it. */
+		}
+		if (k == key)
+			return &t->slots[i];
+	}
+	return NULL;
+}
+
+/* Returns the old value, or VAL_MOVED if it's being moved. */
+static uint64_t set(struct shmht_slot *s, uint64_t v)
+{
+	uint64_t old = __atomic_load_n(&s->val, __ATOMIC_RELAXED);
+
+	do {
+		if (old & VAL_PRIME)
+			return VAL_MOVED;
+	} while (!__atomic_compare_exchange_n(&s->val, &old, v, true,
+					      __ATOMIC_ACQ_REL,
+					      __ATOMIC_RELAXED));
+	return old;
+}
+
+/* Copy one slot of the old table into the new one (n). */
+static void copy_slot(struct shmht_table *n, struct shmht_slot *s)
+{
+	uint64_t v = __atomic_load_n(&s->val, __ATOMIC_ACQUIRE), k, empty;
+	struct shmht_slot *ns;
+
+	/* Freeze it, so nobody can change it under us. */
+	for (;;) {
+		if (v == VAL_MOVED)
+			return;
+		if (v & VAL_PRIME)
+			break;
+		if (v == VAL_EMPTY || v == VAL_DELETED) {
+			/* Nothing to copy. */
+			if (__atomic_compare_exchange_n(&s->val, &v, VAL_MOVED,
+							true, __ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE))
+				return;
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&s->val, &v, v | VAL_PRIME,
+						true, __ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE)) {
+			v |= VAL_PRIME;
+			break;
+		}
+	}
+
+	/* The new table is at least twice the size: it can't fill. */
+	k = __atomic_load_n(&s->key, __ATOMIC_RELAXED);
+	ns = claim(n, k, hash_key(k), UINT64_MAX);
+	assert(ns);
+
+	/* Anything there already is newer. */
+	empty = VAL_EMPTY;
+	__atomic_compare_exchange_n(&ns->val, &empty, v & ~VAL_PRIME, false,
+				    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->val, VAL_MOVED, __ATOMIC_RELEASE);
+}
+
+/* Copy a chunk across: returns false if there were none left to do. */
+static bool help(struct shmht *ht, uint64_t t_off, struct shmht_table *t,
+		 uint64_t n_off, struct shmht_table *n)
+{
+	uint64_t size = 1ULL << t->bits, start, i;
+
+	start = __atomic_fetch_add(&t->copy_next, COPY_CHUNK, __ATOMIC_RELAXED);
+	if (start >= size)
+		return false;
+
+	for (i = start; i < start + COPY_CHUNK; i++)
+		copy_slot(n, &t->slots[i]);
+
+	/* Last one done makes the new table current. */
+	if (__atomic_add_fetch(&t->copied, COPY_CHUNK, __ATOMIC_ACQ_REL)
+	    == size)
+		__atomic_compare_exchange_n(&ht->hdr->table, &t_off, n_off,
+					    false, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED);
+	return true;
+}
+
+static void finish(struct shmht *ht, uint64_t t_off, struct shmht_table *t,
+		   uint64_t n_off, struct shmht_table *n)
+{
+	while (help(ht, t_off, t, n_off, n));
+
+	/* Others may still be copying their chunks. */
+	while (__atomic_load_n(&ht->hdr->table, __ATOMIC_ACQUIRE) == t_off)
+		sched_yield();
+}
+
+/* Set up a table twice the size, unless someone else beats us to it. */
+static int grow(struct shmht *ht, struct shmht_table *t)
+{
+	uint64_t next = 0, off, size;
+	struct shmht_table *n;
+
+	if (!__atomic_compare_exchange_n(&t->next, &next, NEXT_ALLOCATING,
+					 false, __ATOMIC_ACQUIRE,
+					 __ATOMIC_RELAXED))
+		return 0;
+
+	/* Tables are never reused, so the new one is all zeroes. */
+	off = ht->hdr->brk;
+	size = table_size(t->bits + 1);
+	while (off + size > ht->r.flen) {
+		if (rszshm_grow(&ht->r) < 0) {
+			__atomic_store_n(&t->next, 0, __ATOMIC_RELEASE);
+			return -1;
+		}
+	}
+	n = (void *)((char *)ht->r.hdr + off);
+	n->bits = t->bits + 1;
+	ht->hdr->brk = off + size;
+	__atomic_store_n(&t->next, off, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Returns -1 on error, otherwise sets *old to the previous value. */
+static int store(struct shmht *ht, uint64_t key, uint64_t v, uint64_t *old)
+{
+	uint64_t h = hash_key(key);
+
+	for (;;) {
+		uint64_t t_off, n_off, limit;
+		struct shmht_table *t, *n = NULL, *target;
+		struct shmht_slot *s;
+
+		t_off = __atomic_load_n(&ht->hdr->table, __ATOMIC_ACQUIRE);
+		t = table_at(ht, t_off);
+		if (!t)
+			return -1;
+
+		n_off = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+		if (n_off == NEXT_ALLOCATING) {
+			sched_yield();
+			continue;
+		}
+
+		if (n_off) {
+			n = table_at(ht, n_off);
+			if (!n)
+				return -1;
+			help(ht, t_off, t, n_off, n);
+			/* Make sure the new table has our key's old value. */
+			s = find(t, key, h);
+			if (s)
+				copy_slot(n, s);
+			/* Leave room for the rest of the old table. */
+			target = n;
+			limit = 1ULL << (n->bits - 1);
+		} else {
+			target = t;
+			limit = (1ULL << t->bits) - (1ULL << (t->bits - 2));
+		}
+
+		s = claim(target, key, h, limit);
+		if (!s) {
+			if (n)
+				finish(ht, t_off, t, n_off, n);
+			else if (grow(ht, t) < 0)
+				return -1;
+			continue;
+		}
+
+		*old = set(s, v);
+		if (*old != VAL_MOVED)
+			return 0;
+	}
+}
+
+int shmht_put(struct shmht *ht, uint64_t key, uint64_t val)
+{
+	uint64_t old;
+
+	if (key == 0 || val > SHMHT_MAX_VAL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (store(ht, key, val + 1, &old) < 0)
+		return -1;
+	return old == VAL_EMPTY || old == VAL_DELETED;
+}
+
+int shmht_get(struct shmht *ht, uint64_t key, uint64_t *val)
+{
+	uint64_t h = hash_key(key);
+
+	if (key == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (;;) {
+		uint64_t t_off, n_off, v = VAL_EMPTY;
+		struct shmht_table *t, *n;
+		struct shmht_slot *s;
+
+		t_off = __atomic_load_n(&ht->hdr->table, __ATOMIC_ACQUIRE);
+		t = table_at(ht, t_off);
+		if (!t)
+			return -1;
+
+		n_off = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+		if (n_off > NEXT_ALLOCATING) {
+			/* Growing: the new table is more recent. */
+			n = table_at(ht, n_off);
+			if (!n)
+				return -1;
+			s = find(n, key, h);
+			if (s)
+				v = __atomic_load_n(&s->val, __ATOMIC_ACQUIRE);
+			if (v == VAL_EMPTY) {
+				s = find(t, key, h);
+				if (s)
+					v = __atomic_load_n(&s->val,
+							    __ATOMIC_ACQUIRE);
+				if (v == VAL_MOVED) {
+					/* It's in the new table now (unless
+					 * there was nothing to copy). */
+					s = find(n, key, h);
+					v = s ? __atomic_load_n(&s->val,
+							__ATOMIC_ACQUIRE)
+						: VAL_EMPTY;
+				} else
+					v &= ~VAL_PRIME;
+			}
+			/* The new table has moved on too?  Start again. */
+			if (v & VAL_PRIME)
+				continue;
+		} else {
+			s = find(t, key, h);
+			if (s)
+				v = __atomic_load_n(&s->val, __ATOMIC_ACQUIRE);
+			/* Started moving since we looked? */
+			if (v & VAL_PRIME)
+				continue;
+		}
+
+		if (v == VAL_EMPTY || v == VAL_DELETED)
+			return 0;
+		*val = v - 1;
+		return 1;
+	}
+}
+
+int shmht_del(struct shmht *ht, uint64_t key)
+{
+	uint64_t val, old;
+
+	/* Don't use up a slot for a key which isn't there. */
+	switch (shmht_get(ht, key, &val)) {
+	case 1:
+		break;
+	case 0:
+		return 0;
+	default:
+		return -1;
+	}
+	if (store(ht, key, VAL_DELETED, &old) < 0)
+		return -1;
+	return old != VAL_EMPTY && old != VAL_DELETED;
+}
+
+struct shmht *shmht_mk(struct shmht *ht, unsigned int bits, const char *fname)
+{
+	uint64_t off = first_table();
+	struct shmht_table *t;
+
+	if (bits < SHMHT_MIN_BITS || bits > 40) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!rszshm_mk(&ht->r, off + table_size(bits)
+		       - sizeof(struct rszshm_hdr), fname))
+		return NULL;
+
+	ht->hdr = ht->r.dat;
+	t = (void *)((char *)ht->r.hdr + off);
+	t->bits = bits;
+	ht->hdr->table = off;
+	ht->hdr->brk = off + table_size(bits);
+	__atomic_store_n(&ht->hdr->magic, SHMHT_MAGIC, __ATOMIC_RELEASE);
+	return ht;
+}
+
+struct shmht *shmht_at(struct shmht *ht, const char *fname)
+{
+	if (!rszshm_at(&ht->r, fname))
+		return NULL;
+
+	ht->hdr = ht->r.dat;
+	if (ht->r.cap < sizeof(*ht->hdr)
+	    || __atomic_load_n(&ht->hdr->magic, __ATOMIC_ACQUIRE)
+	    != SHMHT_MAGIC) {
+		rszshm_dt(&ht->r);
+		errno = EINVAL;
+		return NULL;
+	}
+	return ht;
+}
+
+int shmht_dt(struct shmht *ht)
+{
+	return rszshm_dt(&ht->r);
+}
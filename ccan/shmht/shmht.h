@@ -0,0 +1,143 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_SHMHT_H
+#define CCAN_SHMHT_H
+#include "config.h"
+#include <stdint.h>
+#include <ccan/rszshm/rszshm.h>
+
+/**
+ * SHMHT_MAX_VAL - largest value which can be stored
+ *
+ * The top bit, and the largest value below it, are used internally.
+ */
+#define SHMHT_MAX_VAL ((UINT64_MAX >> 1) - 2)
+
+/**
+ * SHMHT_MIN_BITS - smallest table size (as a power of 2)
+ */
+#define SHMHT_MIN_BITS 7
+
+/**
+ * struct shmht - handle for a shared hash table
+ * @r: the rszshm region the table lives in.
+ * @hdr: the table header, at the start of the region.
+ *
+ * Each process has its own handle: everything in the region is referred
+ * to by offset, and @r is remapped when another process grows the region.
+ */
+struct shmht {
+	struct rszshm r;
+	struct shmht_hdr *hdr;
+};
+
+/**
+ * shmht_mk - create a shared hash table in a new rszshm region
+ * @ht: handle to populate
+ * @bits: log2 of the initial number of slots (at least SHMHT_MIN_BITS)
+ * @fname: path to file to be created, may be NULL or contain template
+ *
+ * The table holds 64-bit keys and values.  It starts with 1 << @bits
+ * slots, and doubles whenever it becomes three quarters full; the
+ * region is grown with rszshm_grow() as required.  Tables which have
+ * been outgrown are not reused, so the region ends up a little under
+ * twice the size of the final table.
+ *
+ * Children forked after this can use @ht directly.  Unrelated processes
+ * use shmht_at() with @ht->r.fname.
+ *
+ * Example:
+ *	struct shmht ht;
+ *
+ *	if (!shmht_mk(&ht, 10, NULL))
+ *		err(1, "shmht_mk");
+ *	printf("Attach to %s\n", ht.r.fname);
+ *
+ * Returns: @ht on success, NULL on error (with errno set).
+ */
+struct shmht *shmht_mk(struct shmht *ht, unsigned int bits, const char *fname);
+
+/**
+ * shmht_at - attach to an existing shared hash table
+ * @ht: handle to populate
+ * @fname: path to file created by shmht_mk()
+ *
+ * See rszshm_at() for the restrictions: in particular, children which
+ * inherited the mapping should not call this.
+ *
+ * Example:
+ *	struct shmht ht;
+ *
+ *	if (!shmht_at(&ht, "/dev/shm/rszshm_LAsEvt/0"))
+ *		err(1, "shmht_at");
+ *
+ * Returns: @ht on success, NULL on error (errno is EINVAL if the region
+ * doesn't contain a table).
+ */
+struct shmht *shmht_at(struct shmht *ht, const char *fname);
+
+/**
+ * shmht_dt - detach from a shared hash table
+ * @ht: handle from shmht_mk() or shmht_at()
+ *
+ * The table persists until the file is removed, eg. with rszshm_rm().
+ *
+ * Example:
+ *	if (shmht_dt(&ht) != 0 || rszshm_rm(&ht.r) != 0)
+ *		err(1, "Removing table");
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int shmht_dt(struct shmht *ht);
+
+/**
+ * shmht_put - set the value for a key
+ * @ht: handle from shmht_mk() or shmht_at()
+ * @key: the key (not 0)
+ * @val: the value (not more than SHMHT_MAX_VAL)
+ *
+ * Any number of processes can put, get and delete at once without
+ * locking.  If the table needs to grow, the process which notices
+ * allocates the new table, and every process which puts while it is
+ * being filled copies part of the old one across.
+ *
+ * Example:
+ *	if (shmht_put(&ht, 1, 100) < 0)
+ *		err(1, "shmht_put");
+ *
+ * Returns: 1 if @key was added, 0 if its value was replaced, -1 on error
+ * (errno is EINVAL for a bad key or value, or ENOMEM if the region can't
+ * grow).
+ */
+int shmht_put(struct shmht *ht, uint64_t key, uint64_t val);
+
+/**
+ * shmht_get - get the value for a key
+ * @ht: handle from shmht_mk() or shmht_at()
+ * @key: the key (not 0)
+ * @val: set to the value, if found.
+ *
+ * Example:
+ *	uint64_t val;
+ *
+ *	if (shmht_get(&ht, 1, &val) == 1)
+ *		printf("1 => %llu\n", (unsigned long long)val);
+ *
+ * Returns: 1 if found, 0 if not, -1 on error.
+ */
+int shmht_get(struct shmht *ht, uint64_t key, uint64_t *val);
+
+/**
+ * shmht_del - delete a key
+ * @ht: handle from shmht_mk() or shmht_at()
+ * @key: the key (not 0)
+ *
+ * The slot stays in use until the table next grows.
+ *
+ * Example:
+ *	if (shmht_del(&ht, 1) != 1)
+ *		printf("1 was not there\n");
+ *
+ * Returns: 1 if @key was deleted, 0 if it was not there, -1 on error.
+ */
+int shmht_del(struct shmht *ht, uint64_t key);
+#endif /* CCAN_SHMHT_H */
@@ -0,0 +1,93 @@
+#include <ccan/shmht/shmht.h>
+#include <ccan/shmht/shmht.c>
+#include <ccan/tap/tap.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define NUM_PROCS 4
+#define NUM 50000
+#define NUM_SHARED 1000
+
+/* Our own keys, then ones everyone writes; check as we go. */
+static bool work(struct shmht *ht, unsigned int id)
+{
+	uint64_t i, val, base = (id + 1) * NUM * 2;
+
+	for (i = 0; i < NUM; i++) {
+		if (shmht_put(ht, base + i, base + i) != 1)
+			return false;
+		if (shmht_put(ht, 1 + i % NUM_SHARED, (i % NUM_SHARED) * 10 + id) < 0)
+			return false;
+		/* Something we put earlier, maybe in a smaller table. */
+		if ((i / 2) % 3 == 0) {
+			if (i / 2 != i && shmht_get(ht, base + i / 2, &val) != 0)
+				return false;
+		} else if (shmht_get(ht, base + i / 2, &val) != 1
+			   || val != base + i / 2)
+			return false;
+		if (i % 3 == 0 && shmht_del(ht, base + i) != 1)
+			return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	struct shmht ht;
+	char fname[RSZSHM_PATH_MAX];
+	unsigned int id;
+	uint64_t i, val;
+	int status;
+	bool ok;
+
+	plan_tests(4 + NUM_PROCS);
+
+	ok1(shmht_mk(&ht, SHMHT_MIN_BITS, NULL) == &ht);
+	strcpy(fname, ht.r.fname);
+
+	fflush(stdout);
+	for (id = 0; id < NUM_PROCS; id++) {
+		if (fork() == 0) {
+			/* The last one attaches afresh, like an unrelated
+			 * process would. */
+			if (id == NUM_PROCS - 1) {
+				shmht_dt(&ht);
+				if (!shmht_at(&ht, fname))
+					exit(2);
+			}
+			exit(work(&ht, id) ? 0 : 1);
+		}
+	}
+
+	for (id = 0; id < NUM_PROCS; id++) {
+		wait(&status);
+		ok1(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+
+	ok = true;
+	for (id = 0; id < NUM_PROCS; id++) {
+		uint64_t base = (id + 1) * NUM * 2;
+		for (i = 0; i < NUM; i++) {
+			int ret = shmht_get(&ht, base + i, &val);
+			if (i % 3 == 0 ? ret != 0 : ret != 1 || val != base + i)
+				ok = false;
+		}
+	}
+	ok1(ok);
+
+	/* Whoever wrote last, it was a valid value for that key. */
+	ok = true;
+	for (i = 0; i < NUM_SHARED; i++)
+		if (shmht_get(&ht, i + 1, &val) != 1 || val / 10 != i
+		    || val % 10 >= NUM_PROCS)
+			ok = false;
+	ok1(ok);
+
+	/* Grown well past the initial table. */
+	ok1(ht.r.flen > table_size(SHMHT_MIN_BITS) * 1000);
+
+	shmht_dt(&ht);
+	rszshm_rm(&ht.r);
+	return exit_status();
+}
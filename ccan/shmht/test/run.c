@@ -0,0 +1,82 @@
+#include <ccan/shmht/shmht.h>
+#include <ccan/shmht/shmht.c>
+#include <ccan/tap/tap.h>
+#include <string.h>
+
+#define NUM 100000
+
+int main(void)
+{
+	struct shmht ht, ht2;
+	uint64_t i, val;
+	char fname[RSZSHM_PATH_MAX];
+	size_t flen;
+	bool ok;
+
+	plan_tests(25);
+
+	ok1(!shmht_mk(&ht, SHMHT_MIN_BITS - 1, NULL) && errno == EINVAL);
+	ok1(shmht_mk(&ht, SHMHT_MIN_BITS, NULL) == &ht);
+	flen = ht.r.flen;
+
+	ok1(shmht_put(&ht, 0, 1) == -1 && errno == EINVAL);
+	ok1(shmht_put(&ht, 1, SHMHT_MAX_VAL + 1) == -1 && errno == EINVAL);
+	ok1(shmht_get(&ht, 0, &val) == -1 && errno == EINVAL);
+
+	ok1(shmht_get(&ht, 1, &val) == 0);
+	ok1(shmht_put(&ht, 1, 0) == 1);
+	ok1(shmht_get(&ht, 1, &val) == 1 && val == 0);
+	ok1(shmht_put(&ht, 1, SHMHT_MAX_VAL) == 0);
+	ok1(shmht_get(&ht, 1, &val) == 1 && val == SHMHT_MAX_VAL);
+	ok1(shmht_del(&ht, 1) == 1);
+	ok1(shmht_get(&ht, 1, &val) == 0);
+	ok1(shmht_del(&ht, 1) == 0);
+	ok1(shmht_put(&ht, 1, 7) == 1);
+	ok1(shmht_get(&ht, 1, &val) == 1 && val == 7);
+
+	/* Lots of keys makes it grow many times, and the region too. */
+	ok = true;
+	for (i = 2; i < NUM; i++)
+		if (shmht_put(&ht, i, i * 3) != 1)
+			ok = false;
+	ok1(ok);
+	ok1(ht.r.flen > flen);
+	ok = true;
+	for (i = 2; i < NUM; i++)
+		if (shmht_get(&ht, i, &val) != 1 || val != i * 3)
+			ok = false;
+	ok1(ok);
+	ok1(shmht_get(&ht, NUM, &val) == 0);
+
+	/* Deletes and re-puts survive growth. */
+	ok = true;
+	for (i = 2; i < NUM; i += 2)
+		if (shmht_del(&ht, i) != 1)
+			ok = false;
+	for (i = NUM; i < NUM * 2; i++)
+		if (shmht_put(&ht, i, i) != 1)
+			ok = false;
+	ok1(ok);
+	ok = true;
+	for (i = 2; i < NUM * 2; i++) {
+		int ret = shmht_get(&ht, i, &val);
+		if (i < NUM && i % 2 == 0) {
+			if (ret != 0)
+				ok = false;
+		} else if (ret != 1 || val != (i < NUM ? i * 3 : i))
+			ok = false;
+	}
+	ok1(ok);
+
+	/* Not a table. */
+	ok1(!shmht_at(&ht2, "/dev/null"));
+
+	strcpy(fname, ht.r.fname);
+	ok1(shmht_dt(&ht) == 0);
+	ok1(shmht_at(&ht, fname) == &ht);
+	ok1(shmht_get(&ht, NUM + 1, &val) == 1 && val == NUM + 1);
+	shmht_dt(&ht);
+	rszshm_rm(&ht.r);
+
+	return exit_status();
+}
@@ -0,0 +1,138 @@
+/* Compares the bit-parallel LCS against the dynamic programming LCS it
+ * replaced, on synthetic syslog lines, then times grouping 10k, 100k and 1M
+ * of them with the q-gram index and, up to 100k, by scoring every group. */
+#include <ccan/strgrp/strgrp.c>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_LINES 2000
+#define LINE_MAX_LEN 256
+
+/* Each takes: stamp, pid, user, three small numbers, sequence number. */
+static const char *const fmts[] = {
+    "%s sshd[%d]: Accepted publickey for %s from 10.%d.%d.%d port %d ssh2",
+    "%s sshd[%d]: Failed password for invalid user %s from 192.168.%d.%d port %d%d ssh2",
+    "%s kernel: [%d.000000] usb (%s) %d-%d: new high-speed USB device number %d using xhci_hcd %d",
+    "%s systemd[%d]: Started Session %s-%d-%d-%d of user %d.",
+    "%s CRON[%d]: (%s) CMD (run-parts --report /etc/cron.hourly) [%d:%d:%d] %d",
+    "%s nginx[%d]: %s 10.%d.%d.%d - - \"GET /api/v1/users/%d/orders HTTP/1.1\" 200",
+    "%s postfix/smtpd[%d]: connect from %s[203.0.%d.%d] helo=<mail%d.example.com> %d",
+};
+
+static const char *const users[] = {
+    "root", "alice", "bob", "deploy", "www-data", "postgres", "admin",
+};
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Variable fields come from bounded pools, as in real logs, so the number
+ * of groups levels off rather than growing with every line. */
+static void log_line(char *buf, int seq) {
+    char stamp[32];
+    const char *user = users[random() % ARRAY_LEN(users)];
+    snprintf(stamp, sizeof(stamp), "Oct 19 %02d:%02d:%02d host%d",
+             (int)(random() % 24), (int)(random() % 60),
+             (int)(random() % 60), (int)(random() % 4));
+    snprintf(buf, LINE_MAX_LEN, fmts[random() % ARRAY_LEN(fmts)], stamp,
+             (int)(1000 + random() % 50), user, (int)(random() % 20),
+             (int)(random() % 20), (int)(random() % 20), seq % 5000);
+}
+
+/* The original Wagner-Fischer style LCS, for comparison. */
+static int
+dp_lcs(const char *const a, const char *const b) {
+    const int la = strlen(a);
+    const int lb = strlen(b);
+    int *const lookup = calloc(2 * (lb + 1), sizeof(int));
+    int ia, ib, result;
+    for (ia = la - 1; ia >= 0; ia--) {
+        int *const cur = &lookup[(ia & 1) * (lb + 1)];
+        const int *const last = &lookup[((ia + 1) & 1) * (lb + 1)];
+        for (ib = lb - 1; ib >= 0; ib--) {
+            if (a[ia] == b[ib]) {
+                cur[ib] = 1 + last[ib + 1];
+            } else {
+                cur[ib] = (last[ib] > cur[ib + 1]) ? last[ib] : cur[ib + 1];
+            }
+        }
+    }
+    result = lookup[0];
+    free(lookup);
+    return result;
+}
+
+static void report(const char *what, struct timemono start, size_t num) {
+    struct timerel diff = timemono_since(start);
+    printf("%-16s %8zu comparisons: %8llu usec (%llu nsec each)\n",
+           what, num, (unsigned long long)time_to_usec(diff),
+           (unsigned long long)(time_to_nsec(diff) / num));
+}
+
+static void group_lines(size_t n, bool exhaustive) {
+    struct strgrp *ctx = strgrp_new(0.85);
+    struct timemono start;
+    char line[LINE_MAX_LEN];
+    size_t i;
+
+    ctx->exhaustive = exhaustive;
+    srandom(n);
+    start = time_mono();
+    for (i = 0; i < n; i++) {
+        log_line(line, i);
+        strgrp_add(ctx, line, NULL);
+    }
+    printf("strgrp_add%s %7zu lines into %6u groups: %10llu usec\n",
+           exhaustive ? " (scan)" : "", n, ctx->n_grps,
+           (unsigned long long)time_to_usec(timemono_since(start)));
+    strgrp_free(ctx);
+}
+
+int main(int argc, char *argv[]) {
+    static char lines[N_LINES][LINE_MAX_LEN];
+    struct strgrp *ctx;
+    struct timemono start;
+    size_t i, j, n = argc > 1 ? strtoul(argv[1], NULL, 0) : 200;
+    long sum_dp = 0, sum_bp = 0;
+
+    if (n > N_LINES) {
+        n = N_LINES;
+    }
+    for (i = 0; i < N_LINES; i++) {
+        log_line(lines[i], i);
+    }
+
+    start = time_mono();
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            sum_dp += dp_lcs(lines[i], lines[j]);
+        }
+    }
+    report("dynamic", start, n * n);
+
+    ctx = strgrp_new(0.85);
+    start = time_mono();
+    for (i = 0; i < n; i++) {
+        const size_t len = strlen(lines[i]);
+        strpeq(ctx, lines[i], len);
+        for (j = 0; j < n; j++) {
+            sum_bp += lcs(ctx, len, lines[j]);
+        }
+    }
+    report("bit-parallel", start, n * n);
+    strgrp_free(ctx);
+
+    if (sum_dp != sum_bp) {
+        fprintf(stderr, "LCS mismatch: %ld vs %ld\n", sum_dp, sum_bp);
+        return 1;
+    }
+
+    for (i = 10000; i <= 1000000; i *= 10) {
+        // Scoring every group takes too long for 1M
+        if (i < 1000000) {
+            group_lines(i, true);
+        }
+        group_lines(i, false);
+    }
+    return 0;
+}
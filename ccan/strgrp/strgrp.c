@@ -44,6 +44,20 @@ struct grp_score {
 
 typedef darray(struct grp_score *) darray_score;
 
+// A q-gram bucket of a string and the number of the string's q-grams in it
+struct qgram {
+    uint32_t bucket;
+    uint32_t count;
+};
+
+// An entry in the q-gram index: a group and the count for its key
+struct qgram_post {
+    int grp;
+    uint32_t count;
+};
+
+typedef darray(struct qgram_post) darray_post;
+
 struct strgrp {
     double threshold;
     stringmap_grp known;
@@ -51,6 +65,20 @@ struct strgrp {
     darray_grp grps;
     struct grp_score *scores;
     int16_t pop[CHAR_N_VALUES];
+    // LCS match bitmasks of the string being grouped, see strpeq()
+    uint64_t *peq;
+    size_t peq_words;
+    // Inverted index from q-gram bucket to the groups whose key has q-grams
+    // in that bucket, see qgram_candidates()
+    darray_post *qindex;
+    // Q-grams of the string being grouped
+    struct qgram *grams;
+    size_t n_grams;
+    // Candidate group indices, and per-group shared q-gram counts
+    int *cands;
+    uint32_t *shared;
+    // Score every group rather than consulting qindex (for testing)
+    bool exhaustive;
 };
 
 struct strgrp_iter {
@@ -132,61 +160,249 @@ should_grp_score_len(const struct strgrp *const ctx,
     return ctx->threshold <= s;
 }
 
-/* Scoring - Longest Common Subsequence[2]
+/* Scoring - Longest Common Subsequence[2], computed bit-parallel[3]
  *
  * [2] https://en.wikipedia.org/wiki/Longest_common_subsequence_problem
+ * [3] H. Hyyrö, "Bit-Parallel LCS-length Computation Revisited", AWOCA 2004
+ *
+ * The string being grouped is compared against every candidate group key,
+ * so its match bitmasks are built once per lookup by strpeq(). Each
+ * comparison then takes ceil(strlen(str) / 64) word operations per key
+ * character rather than strlen(str), and needs no allocation unless str is
+ * very long.
  */
-#define ROWS 2
+#define LCS_WORD_BITS 64
+#define LCS_STACK_WORDS 16
+
+static inline int
+popcnt64(uint64_t v) {
+#if HAVE_BUILTIN_POPCOUNTLL
+    return __builtin_popcountll(v);
+#else
+    int n;
+    for (n = 0; v; v &= v - 1) {
+        n++;
+    }
+    return n;
+#endif
+}
 
-static inline int cmi(int i, int j) {
-    return ROWS * j + i;
+// Bit (i % 64) of ctx->peq[c * ctx->peq_words + i / 64] is set iff str[i] == c
+static bool
+strpeq(struct strgrp *const ctx, const char *const str, const size_t len) {
+    const size_t words = len ? (len + LCS_WORD_BITS - 1) / LCS_WORD_BITS : 1;
+    const size_t need = CHAR_N_VALUES * words;
+    size_t i;
+    if (!ctx->peq) {
+        ctx->peq = tal_arr(ctx, uint64_t, need);
+        if (!ctx->peq) {
+            return false;
+        }
+    } else if (tal_count(ctx->peq) < need) {
+        if (!tal_resize(&ctx->peq, need)) {
+            return false;
+        }
+    }
+    ctx->peq_words = words;
+    memset(ctx->peq, 0, need * sizeof(*ctx->peq));
+    for (i = 0; i < len; i++) {
+        ctx->peq[(unsigned char)str[i] * words + i / LCS_WORD_BITS] |=
+            (uint64_t)1 << (i % LCS_WORD_BITS);
+    }
+    return true;
 }
 
-static inline int16_t
-lcs(const char *const a, const char *const b) {
-    const int lb = strlen(b);
-    const int lbp1 = lb + 1;
-    int16_t *const lookup = calloc(ROWS * lbp1, sizeof(int16_t));
-    if (!lookup) {
+// Length of the LCS of the string described by ctx->peq (of length len) and
+// key, or -1 on allocation failure. Safe to call concurrently.
+static inline int
+lcs(const struct strgrp *const ctx, const size_t len, const char *const key) {
+    const size_t words = ctx->peq_words;
+    uint64_t stackv[LCS_STACK_WORDS];
+    uint64_t *const v = (words <= LCS_STACK_WORDS) ?
+        stackv : malloc(words * sizeof(*v));
+    const char *c;
+    size_t w;
+    int result = 0;
+    if (!v) {
         return -1;
     }
-    int ia, ib;
-    for (ia = (strlen(a) - 1); ia >= 0; ia--) {
-        const char iav = a[ia];
-        const int ial = (ia + 1) & 1; // ia last
-        for (ib = lb - 1; ib >= 0; ib--) {
-            const char ibv = b[ib];
-            const int iac = ia & 1; // ia current
-            const int ibl = ib + 1; // ib last
-            // don't need separate "ib current" as it's just ib
-            if (iav == ibv) {
-                lookup[cmi(iac, ib)] = 1 + lookup[cmi(ial, ibl)];
-            } else {
-                const int16_t valb = lookup[cmi(ial, ib)];
-                const int16_t vabl = lookup[cmi(iac, ibl)];
-                lookup[cmi(iac, ib)] = (valb > vabl) ? valb : vabl;
-            }
+    // Zero bits of v mark the positions of str where the LCS grows
+    for (w = 0; w < words; w++) {
+        v[w] = ~(uint64_t)0;
+    }
+    for (c = key; *c; c++) {
+        const uint64_t *const eq = &ctx->peq[(unsigned char)*c * words];
+        uint64_t carry = 0;
+        for (w = 0; w < words; w++) {
+            const uint64_t u = v[w] & eq[w];
+            uint64_t sum = v[w] + carry;
+            const uint64_t cin = sum < carry;
+            sum += u;
+            carry = cin | (sum < u);
+            v[w] = sum | (v[w] - u);
         }
     }
-    int16_t result = lookup[0];
-    free(lookup);
+    for (w = 0; w < words; w++) {
+        uint64_t zeros = ~v[w];
+        // Carries may flip the bits past the end of str
+        if (w == words - 1 && len % LCS_WORD_BITS) {
+            zeros &= ((uint64_t)1 << (len % LCS_WORD_BITS)) - 1;
+        }
+        result += popcnt64(zeros);
+    }
+    if (v != stackv) {
+        free(v);
+    }
     return result;
 }
 
-#undef ROWS
-
 static inline double
-nlcs(const char *const a, const char *const b) {
-    const double lcss = lcs(a, b);
-    const double la = (double) strlen(a);
-    const double lb = (double) strlen(b);
+nlcs(const struct strgrp *const ctx, const size_t len,
+        const struct strgrp_grp *const grp) {
+    const double lcss = lcs(ctx, len, grp->key);
+    const double la = (double) len;
+    const double lb = (double) grp->key_len;
     const double s = sqrt((2 * lcss * lcss) / (la * la + lb * lb));
     return s;
 }
 
 static inline double
-grp_score(const struct strgrp_grp *const grp, const char *const str) {
-    return nlcs(grp->key, str);
+grp_score(const struct strgrp *const ctx, const struct strgrp_grp *const grp,
+        const size_t len) {
+    return nlcs(ctx, len, grp);
+}
+
+/* Candidate selection - q-gram filtering[4]
+ *
+ * [4] E. Ukkonen, "Approximate string-matching with q-grams and maximal
+ *     matches", Theoretical Computer Science 92 (1992)
+ *
+ * If the LCS of a and b is L, a can be edited into b with la + lb - 2L
+ * insertions and deletions. Each edit destroys at most Q of the q-grams of
+ * the longer string, so a and b share at least
+ * max(la, lb) - Q + 1 - Q(la + lb - 2L) q-grams. Inverting the nlcs() score
+ * gives the smallest L that can reach the threshold, and so a lower bound on
+ * the shared q-grams of any group that can be picked. Groups below the bound
+ * are never scored, which leaves the result identical to scoring them all.
+ *
+ * The q-grams are hashed into buckets; that only overestimates the shared
+ * count, so the bound stays safe. The shared counts are accumulated through
+ * an inverted index from bucket to groups, so groups with nothing in common
+ * with the string are never visited at all.
+ */
+#define QGRAM_Q 2
+#define QGRAM_BITS 12
+#define QGRAM_BUCKETS (1 << QGRAM_BITS)
+
+static inline uint32_t
+qgram_bucket(const char *const c) {
+    const uint32_t v = (uint32_t)(unsigned char)c[0] << 8 | (unsigned char)c[1];
+    return (v * 2654435761u) >> (32 - QGRAM_BITS);
+}
+
+static int
+qgram_cmp(const void *a, const void *b) {
+    const struct qgram *qa = a, *qb = b;
+    return (qa->bucket > qb->bucket) - (qa->bucket < qb->bucket);
+}
+
+// Fill ctx->grams with the q-gram buckets of str and their counts
+static bool
+strqgrams(struct strgrp *const ctx, const char *const str, const size_t len) {
+    const size_t n = (len >= QGRAM_Q) ? len - QGRAM_Q + 1 : 0;
+    size_t i, j;
+    ctx->n_grams = 0;
+    if (!ctx->grams) {
+        ctx->grams = tal_arr(ctx, struct qgram, n);
+        if (!ctx->grams) {
+            return false;
+        }
+    } else if (tal_count(ctx->grams) < n) {
+        if (!tal_resize(&ctx->grams, n)) {
+            return false;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        ctx->grams[i].bucket = qgram_bucket(&str[i]);
+        ctx->grams[i].count = 1;
+    }
+    qsort(ctx->grams, n, sizeof(*ctx->grams), qgram_cmp);
+    for (i = j = 0; i < n; i++) {
+        if (j && ctx->grams[j - 1].bucket == ctx->grams[i].bucket) {
+            ctx->grams[j - 1].count++;
+        } else {
+            ctx->grams[j++] = ctx->grams[i];
+        }
+    }
+    ctx->n_grams = j;
+    return true;
+}
+
+// Lower bound on the q-grams a key of length lb shares with a string of
+// length la if their nlcs() score reaches threshold. May be negative.
+static long
+qgram_need(const size_t la, const size_t lb, const double threshold) {
+    const double l = threshold * sqrt((1.0 * la * la + 1.0 * lb * lb) / 2);
+    // Rounding down only loosens the bound
+    const long lreq = (long)floor(l);
+    const long d = (long)la + (long)lb - 2 * lreq;
+    const long lmax = (long)((la > lb) ? la : lb);
+    return lmax - QGRAM_Q + 1 - QGRAM_Q * d;
+}
+
+static int
+cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Collect the indices of the groups that may score at least the threshold
+// against the len-long string in ctx->grams into ctx->cands, in order.
+// Returns the number of candidates, or -1 if every group must be scored.
+static int
+qgram_candidates(struct strgrp *const ctx, const size_t len) {
+    const double t = ctx->threshold;
+    long need = LONG_MAX;
+    size_t lb, lo, hi, i, k;
+    int n = 0, m = 0;
+    if (ctx->exhaustive || !ctx->qindex || !(t > 0) || len < QGRAM_Q) {
+        return -1;
+    }
+    // Key lengths passing should_grp_score_len(), with a margin for rounding
+    lo = (size_t)floor(len * t / sqrt(2 - t * t));
+    lo = lo ? lo - 1 : 0;
+    hi = (t < 1) ? (size_t)ceil(len * sqrt(2 / (t * t) - 1)) + 1 : len + 1;
+    for (lb = lo; lb <= hi; lb++) {
+        const long nlb = qgram_need(len, lb, t);
+        if (nlb < need) {
+            need = nlb;
+        }
+    }
+    // Groups sharing no q-grams could still be picked
+    if (need <= 0) {
+        return -1;
+    }
+    for (k = 0; k < ctx->n_grams; k++) {
+        const struct qgram *const q = &ctx->grams[k];
+        const darray_post *const posts = &ctx->qindex[q->bucket];
+        for (i = 0; i < posts->size; i++) {
+            const struct qgram_post *const p = &posts->item[i];
+            if (!ctx->shared[p->grp]) {
+                ctx->cands[n++] = p->grp;
+            }
+            ctx->shared[p->grp] += (p->count < q->count) ? p->count : q->count;
+        }
+    }
+    for (i = 0; i < (size_t)n; i++) {
+        const int g = ctx->cands[i];
+        const size_t key_len = darray_item(ctx->grps, g)->key_len;
+        if (key_len >= lo && key_len <= hi
+                && ctx->shared[g] >= qgram_need(len, key_len, t)) {
+            ctx->cands[m++] = g;
+        }
+        ctx->shared[g] = 0;
+    }
+    qsort(ctx->cands, m, sizeof(*ctx->cands), cmp_int);
+    return m;
 }
 
 /* Structure management */
@@ -244,18 +460,33 @@ add_grp(struct strgrp *const ctx, const char *const str,
         return NULL;
     }
     memcpy(b->pop, ctx->pop, sizeof(ctx->pop));
+    if (!ctx->qindex) {
+        ctx->qindex = tal_arrz(ctx, darray_post, QGRAM_BUCKETS);
+        if (!ctx->qindex) {
+            return tal_free(b);
+        }
+    }
     darray_push(ctx->grps, b);
     ctx->n_grps++;
     if (ctx->scores) {
-        if (!tal_resize(&ctx->scores, ctx->n_grps)) {
+        if (!tal_resize(&ctx->scores, ctx->n_grps)
+                || !tal_resize(&ctx->cands, ctx->n_grps)
+                || !tal_resizez(&ctx->shared, ctx->n_grps)) {
             return NULL;
         }
     } else {
         ctx->scores = tal_arr(ctx, struct grp_score, ctx->n_grps);
-        if (!ctx->scores) {
+        ctx->cands = tal_arr(ctx, int, ctx->n_grps);
+        ctx->shared = tal_arrz(ctx, uint32_t, ctx->n_grps);
+        if (!ctx->scores || !ctx->cands || !ctx->shared) {
             return NULL;
         }
     }
+    size_t i;
+    for (i = 0; i < ctx->n_grams; i++) {
+        const struct qgram_post p = { ctx->n_grps - 1, ctx->grams[i].count };
+        darray_push(ctx->qindex[ctx->grams[i].bucket], p);
+    }
     return b;
 }
 
@@ -281,6 +512,11 @@ grp_for(struct strgrp *const ctx, const char *const str) {
     // group should be created, at which point add_grp() copies ctx->pop into
     // the new group's struct.
     strpopcnt(str, ctx->pop);
+    // Likewise ctx->grams, for the new group's q-gram index entries.
+    const size_t len = strlen(str);
+    if (!strqgrams(ctx, str, len)) {
+        return NULL;
+    }
     if (!ctx->n_grps) {
         return NULL;
     }
@@ -290,23 +526,33 @@ grp_for(struct strgrp *const ctx, const char *const str) {
             return *grp;
         }
     }
+    if (!strpeq(ctx, str, len)) {
+        return NULL;
+    }
     int i;
+    int n_cands = qgram_candidates(ctx, len);
+    if (n_cands < 0) {
+        for (i = 0; i < ctx->n_grps; i++) {
+            ctx->cands[i] = i;
+        }
+        n_cands = ctx->n_grps;
+    }
 // Keep ccanlint happy in reduced feature mode
 #if HAVE_OPENMP
     #pragma omp parallel for schedule(dynamic)
 #endif
-    for (i = 0; i < ctx->n_grps; i++) {
-        struct strgrp_grp *grp = darray_item(ctx->grps, i);
+    for (i = 0; i < n_cands; i++) {
+        struct strgrp_grp *grp = darray_item(ctx->grps, ctx->cands[i]);
         ctx->scores[i].grp = grp;
         ctx->scores[i].score = 0;
         if (should_grp_score_len(ctx, grp, str)) {
             if (should_grp_score_cos(ctx, grp, str)) {
-                ctx->scores[i].score = grp_score(grp, str);
+                ctx->scores[i].score = grp_score(ctx, grp, len);
             }
         }
     }
     struct grp_score *max = NULL;
-    for (i = 0; i < ctx->n_grps; i++) {
+    for (i = 0; i < n_cands; i++) {
         if (!max || ctx->scores[i].score > max->score) {
             max = &(ctx->scores[i]);
         }
@@ -401,6 +647,12 @@ strgrp_item_value(const struct strgrp_item *const item) {
 
 void
 strgrp_free(struct strgrp *const ctx) {
+    if (ctx->qindex) {
+        size_t i;
+        for (i = 0; i < QGRAM_BUCKETS; i++) {
+            darray_free(ctx->qindex[i]);
+        }
+    }
     darray_free(ctx->grps);
     stringmap_free(ctx->known);
     tal_free(ctx);
@@ -0,0 +1,77 @@
+#include "../strgrp.c"
+#include "../test/helpers.h"
+#include <stdio.h>
+
+#define N_STRS 1500
+#define STR_LEN 256
+
+static const char *const words[] = {
+    "sshd", "Accepted", "publickey", "for", "root", "from", "port", "ssh2",
+    "kernel:", "usb", "device", "error", "connection", "closed", "by",
+    "session", "opened", "user", "failed", "password", "invalid", "10.0.0.1",
+};
+
+#define N_WORDS (sizeof(words) / sizeof(words[0]))
+
+static void
+random_str(char *buf) {
+    int n = random() % 12 + 1;
+    buf[0] = '\0';
+    while (n--) {
+        strcat(buf, words[random() % N_WORDS]);
+        strcat(buf, (random() % 8) ? " " : "[1234]: ");
+    }
+}
+
+// Group strs both by scoring every group and through the q-gram index, and
+// check each string lands in a group with the same key.
+static bool
+same_groups(char strs[][STR_LEN], int n, double threshold) {
+    struct strgrp *scan, *index;
+    bool same = true;
+    int i;
+    scan = strgrp_new(threshold);
+    index = strgrp_new(threshold);
+    scan->exhaustive = true;
+    for (i = 0; i < n; i++) {
+        const struct strgrp_grp *a = strgrp_add(scan, strs[i], NULL);
+        const struct strgrp_grp *b = strgrp_add(index, strs[i], NULL);
+        if (!a || !b || strcmp(strgrp_grp_key(a), strgrp_grp_key(b))) {
+            same = false;
+        }
+    }
+    if (scan->n_grps != index->n_grps) {
+        same = false;
+    }
+    strgrp_free(scan);
+    strgrp_free(index);
+    return same;
+}
+
+int main(void) {
+    static char strs[N_STRS][STR_LEN];
+    int i;
+
+    plan_tests(6);
+    for (i = 0; i < N_STRS; i++) {
+        // Mostly variations on earlier strings
+        if (i && random() % 4) {
+            char *c;
+            strcpy(strs[i], strs[random() % i]);
+            for (c = strs[i]; *c; c++) {
+                if (random() % 10 == 0) {
+                    *c = 'a' + random() % 26;
+                }
+            }
+        } else {
+            random_str(strs[i]);
+        }
+    }
+    ok1(same_groups(strs, N_STRS, 0.3));
+    ok1(same_groups(strs, N_STRS, 0.6));
+    ok1(same_groups(strs, N_STRS, 0.75));
+    ok1(same_groups(strs, N_STRS, 0.85));
+    ok1(same_groups(strs, N_STRS, 0.95));
+    ok1(same_groups(strs, N_STRS, 1.0));
+    return exit_status();
+}
@@ -0,0 +1,147 @@
+/* Time reading a whole file with grab_file_raw(), grab_file_map() and
+ * grab_file_parallel(), then touching every byte.  Each is run with the
+ * file in the page cache, and again after asking the kernel to drop it
+ * (which only works for pages nobody has dirty).
+ *
+ * Usage: speed [<file>]
+ * Without a file, a 256MB one is created in /tmp and removed afterwards. */
+#include <ccan/tal/grab_file/grab_file.h>
+#include <ccan/tal/tal.h>
+#include <ccan/time/time.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_MB 256
+#define RUNS 3
+
+static uint64_t sum(const char *p, size_t len)
+{
+	uint64_t s = 0, w;
+	size_t i;
+
+	for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+		memcpy(&w, p + i, sizeof(w));
+		s += w;
+	}
+	for (; i < len; i++)
+		s += (unsigned char)p[i];
+	return s;
+}
+
+static void uncache(const char *file)
+{
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0)
+		err(1, "Opening %s", file);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* threads == 0 means map, 1 means grab_file_raw. */
+static uint64_t grab(const char *file, unsigned int threads)
+{
+	uint64_t s;
+
+	if (threads == 0) {
+		struct grab_map *map = grab_file_map(NULL, file);
+		if (!map)
+			err(1, "Mapping %s", file);
+		s = sum(map->data, map->len);
+		tal_free(map);
+	} else {
+		char *buf;
+
+		if (threads == 1)
+			buf = grab_file_raw(NULL, file);
+		else
+			buf = grab_file_parallel(NULL, file, threads);
+		if (!buf)
+			err(1, "Reading %s", file);
+		s = sum(buf, tal_count(buf) - (threads > 1));
+		tal_free(buf);
+	}
+	return s;
+}
+
+static void run(const char *file, const char *what, unsigned int threads,
+		bool cold, uint64_t expect, size_t len)
+{
+	uint64_t best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < RUNS; i++) {
+		struct timemono start;
+		uint64_t ns;
+
+		if (cold)
+			uncache(file);
+		start = time_mono();
+		if (grab(file, threads) != expect)
+			errx(1, "%s read the wrong contents", what);
+		ns = time_to_nsec(timemono_since(start));
+		if (ns < best)
+			best = ns;
+	}
+	printf("%-24s %-5s %8llu usec %8.0f MB/s\n", what, cold ? "cold" : "warm",
+	       (unsigned long long)best / 1000,
+	       (double)len / best * 1000);
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpfile[] = "/tmp/grab_file-speed.XXXXXX";
+	const char *file;
+	uint64_t expect;
+	size_t len;
+	char *buf;
+	int cold;
+
+	if (argc > 2)
+		errx(1, "Usage: %s [<file>]", argv[0]);
+
+	if (argc == 2)
+		file = argv[1];
+	else {
+		size_t i;
+		int fd = mkstemp(tmpfile);
+
+		if (fd < 0)
+			err(1, "Creating %s", tmpfile);
+		len = DEFAULT_MB * 1024 * 1024;
+		buf = malloc(len);
+		for (i = 0; i < len; i++)
+			buf[i] = i * 7 + i / 4096;
+		if (write(fd, buf, len) != len)
+			err(1, "Writing %s", tmpfile);
+		fsync(fd);
+		close(fd);
+		free(buf);
+		file = tmpfile;
+	}
+
+	buf = grab_file_raw(NULL, file);
+	if (!buf)
+		err(1, "Reading %s", file);
+	len = tal_count(buf);
+	expect = sum(buf, len);
+	tal_free(buf);
+
+	printf("%zu bytes\n", len);
+	for (cold = 0; cold < 2; cold++) {
+		run(file, "grab_file_raw", 1, cold, expect, len);
+		run(file, "grab_file_map", 0, cold, expect, len);
+		run(file, "grab_file_parallel(2)", 2, cold, expect, len);
+		run(file, "grab_file_parallel(4)", 4, cold, expect, len);
+		run(file, "grab_file_parallel(8)", 8, cold, expect, len);
+	}
+
+	if (file == tmpfile)
+		unlink(tmpfile);
+	return 0;
+}
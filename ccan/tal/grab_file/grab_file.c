@@ -5,8 +5,16 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/* Each thread reads this much at a time in grab_fd_parallel(). */
+#define PARALLEL_CHUNK (4 * 1024 * 1024)
+/* Below this, starting threads costs more than they save. */
+#define PARALLEL_MIN (4 * PARALLEL_CHUNK)
 
 static void *grab_fd_internal(const void *ctx, int fd, bool add_nul_term)
 {
@@ -48,16 +56,19 @@ static void *grab_fd_internal(const void *ctx, int fd, bool add_nul_term)
 	return buffer;
 }
 
+static int open_file(const char *filename)
+{
+	if (!filename)
+		return dup(STDIN_FILENO);
+	return open(filename, O_RDONLY, 0);
+}
+
 static void *grab_file_internal(const void *ctx, const char *filename, bool add_nul_term)
 {
 	int fd;
 	char *buffer;
 
-	if (!filename)
-		fd = dup(STDIN_FILENO);
-	else
-		fd = open(filename, O_RDONLY, 0);
-
+	fd = open_file(filename);
 	if (fd < 0)
 		return NULL;
 
@@ -85,3 +96,191 @@ void *grab_file_raw(const void *ctx, const char *filename)
 {
 	return grab_file_internal(ctx, filename, false);
 }
+
+static void unmap(struct grab_map *map)
+{
+	/* The mapping started at the page holding the first byte. */
+	uintptr_t start = (uintptr_t)map->data & ~((uintptr_t)getpagesize() - 1);
+
+	munmap((void *)start, (uintptr_t)map->data + map->len - start);
+}
+
+struct grab_map *grab_fd_map(const void *ctx, int fd)
+{
+	struct grab_map *map;
+	struct stat st;
+	off_t off;
+
+	map = tal(ctx, struct grab_map);
+	if (!map)
+		return NULL;
+
+	/* Like reading, start from the current offset. */
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+	    && (size_t)st.st_size == st.st_size
+	    && (off = lseek(fd, 0, SEEK_CUR)) >= 0 && off < st.st_size) {
+		/* mmap() wants a page-aligned offset. */
+		off_t start = off & ~((off_t)getpagesize() - 1);
+		char *p = mmap(NULL, st.st_size - start, PROT_READ, MAP_PRIVATE,
+			       fd, start);
+		if (p != MAP_FAILED) {
+			map->data = p + (off - start);
+			map->len = st.st_size - off;
+			tal_add_destructor(map, unmap);
+			/* And leave it at the end, as reading would. */
+			lseek(fd, 0, SEEK_END);
+			return map;
+		}
+	}
+
+	/* Pipes, empty files, and filesystems which won't map. */
+	map->data = grab_fd_raw(map, fd);
+	if (!map->data)
+		return tal_free(map);
+	map->len = tal_count(map->data);
+	return map;
+}
+
+struct grab_map *grab_file_map(const void *ctx, const char *filename)
+{
+	int fd;
+	struct grab_map *map;
+
+	fd = open_file(filename);
+	if (fd < 0)
+		return NULL;
+
+	map = grab_fd_map(ctx, fd);
+	close_noerr(fd);
+	return map;
+}
+
+struct parallel_read {
+	int fd;
+	off_t start;
+	char *buffer;
+	size_t size;
+	/* The next chunk to read, and where the file turned out to end. */
+	size_t next, end;
+	int err;
+};
+
+static bool read_chunk(struct parallel_read *pr, size_t off)
+{
+	size_t len = pr->size - off, end;
+
+	if (len > PARALLEL_CHUNK)
+		len = PARALLEL_CHUNK;
+
+	while (len) {
+		ssize_t ret = pread(pr->fd, pr->buffer + off, len,
+				    pr->start + off);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			__atomic_store_n(&pr->err, errno, __ATOMIC_RELAXED);
+			return false;
+		}
+		if (ret == 0) {
+			/* It shrank: the earliest end anyone saw wins. */
+			end = __atomic_load_n(&pr->end, __ATOMIC_RELAXED);
+			while (off < end
+			       && !__atomic_compare_exchange_n(&pr->end, &end,
+							       off, false,
+							       __ATOMIC_RELAXED,
+							       __ATOMIC_RELAXED));
+			return true;
+		}
+		off += ret;
+		len -= ret;
+	}
+	return true;
+}
+
+static void *read_chunks(void *arg)
+{
+	struct parallel_read *pr = arg;
+	size_t off;
+
+	while (!__atomic_load_n(&pr->err, __ATOMIC_RELAXED)) {
+		off = __atomic_fetch_add(&pr->next, PARALLEL_CHUNK,
+					 __ATOMIC_RELAXED);
+		if (off >= pr->size || !read_chunk(pr, off))
+			break;
+	}
+	return NULL;
+}
+
+void *grab_fd_parallel(const void *ctx, int fd, unsigned int threads)
+{
+	struct parallel_read pr;
+	pthread_t *tids;
+	unsigned int i, n;
+	struct stat st;
+
+	/* Like grab_fd_str(), we read from the current offset. */
+	if (threads < 2
+	    || fstat(fd, &st) != 0
+	    || !S_ISREG(st.st_mode)
+	    || (pr.start = lseek(fd, 0, SEEK_CUR)) < 0
+	    || st.st_size - pr.start < PARALLEL_MIN
+	    || (size_t)(st.st_size - pr.start) != st.st_size - pr.start
+	    || st.st_size - pr.start == SIZE_MAX)
+		return grab_fd_str(ctx, fd);
+
+	pr.fd = fd;
+	pr.size = pr.end = st.st_size - pr.start;
+	pr.next = 0;
+	pr.err = 0;
+	pr.buffer = tal_arr(ctx, char, pr.size + 1);
+	if (!pr.buffer)
+		return NULL;
+
+	/* No point having more threads than chunks. */
+	n = threads - 1;
+	if (n > (pr.size - 1) / PARALLEL_CHUNK)
+		n = (pr.size - 1) / PARALLEL_CHUNK;
+
+	/* If we can't start them all, we just read with fewer. */
+	tids = tal_arr(pr.buffer, pthread_t, n);
+	if (!tids)
+		n = 0;
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&tids[i], NULL, read_chunks, &pr) != 0)
+			break;
+	}
+	n = i;
+
+	read_chunks(&pr);
+	for (i = 0; i < n; i++)
+		pthread_join(tids[i], NULL);
+	tal_free(tids);
+
+	if (pr.err) {
+		tal_free(pr.buffer);
+		errno = pr.err;
+		return NULL;
+	}
+
+	/* Leave the offset at the end, as read() would have. */
+	lseek(fd, pr.start + pr.end, SEEK_SET);
+	pr.buffer[pr.end] = '\0';
+	if (pr.end != pr.size)
+		tal_resize(&pr.buffer, pr.end + 1);
+	return pr.buffer;
+}
+
+void *grab_file_parallel(const void *ctx, const char *filename,
+			 unsigned int threads)
+{
+	int fd;
+	char *buffer;
+
+	fd = open_file(filename);
+	if (fd < 0)
+		return NULL;
+
+	buffer = grab_fd_parallel(ctx, fd, threads);
+	close_noerr(fd);
+	return buffer;
+}
@@ -117,4 +117,116 @@ static inline void *grab_file(const void *ctx, const char *filename)
 	return grab_file_str(ctx, filename);
 }
 
+/**
+ * struct grab_map - the contents of a file, mapped into memory.
+ * @data: the contents of the file (read-only, and not NUL terminated).
+ * @len: the size in bytes.
+ */
+struct grab_map {
+	const char *data;
+	size_t len;
+};
+
+/**
+ * grab_fd_map - map all of a file descriptor into memory
+ * @ctx: the context to tallocate from (often NULL)
+ * @fd: the file descriptor to map
+ *
+ * For a regular file, this mmaps the file read-only instead of copying
+ * it, so the contents are only read as they are touched, and share the
+ * page cache rather than duplicating it.  Anything which can't be mapped
+ * (pipes, empty files, some filesystems) is read with grab_fd_raw()
+ * instead, so the result is the same either way: everything from the
+ * current offset of @fd, which is left at the end.
+ *
+ * The mapping is unmapped when the returned struct grab_map is
+ * tal_free()d; @fd can be closed as soon as this returns.  As with any
+ * mapping, truncating the file while it's mapped means SIGBUS when
+ * touching the missing part.
+ *
+ * Returns NULL on error.
+ *
+ * Example:
+ *	// Count the lines of a file.
+ *	static size_t count_lines(int fd)
+ *	{
+ *		struct grab_map *map = grab_fd_map(NULL, fd);
+ *		size_t i, lines = 0;
+ *
+ *		if (!map)
+ *			return 0;
+ *		for (i = 0; i < map->len; i++)
+ *			lines += (map->data[i] == '\n');
+ *		tal_free(map);
+ *		return lines;
+ *	}
+ */
+struct grab_map *grab_fd_map(const void *ctx, int fd);
+
+/**
+ * grab_file_map - map all of a file (or stdin) into memory
+ * @ctx: the context to tallocate from (often NULL)
+ * @filename: the file to map (NULL for stdin)
+ *
+ * This is grab_fd_map() on @filename.  tal_free() the result to unmap it.
+ *
+ * Example:
+ *	static bool file_has_nul(const char *filename)
+ *	{
+ *		struct grab_map *map = grab_file_map(NULL, filename);
+ *		bool ret;
+ *
+ *		if (!map)
+ *			return false;
+ *		ret = memchr(map->data, 0, map->len) != NULL;
+ *		tal_free(map);
+ *		return ret;
+ *	}
+ */
+struct grab_map *grab_file_map(const void *ctx, const char *filename);
+
+/**
+ * grab_fd_parallel - read all of a large file with several threads.
+ * @ctx: the context to tallocate from (often NULL)
+ * @fd: the file descriptor to read from
+ * @threads: the number of threads to read with.
+ *
+ * This is grab_fd_str(), but a large regular file is split into chunks,
+ * which @threads threads (including the caller) read at once with
+ * pread().  A single reader rarely keeps a fast SSD busy; several
+ * requests in flight at once can.  Small files, and anything which
+ * isn't a regular file, are simply read with grab_fd_str().
+ *
+ * The file's size is taken when this starts: if the file shrinks while
+ * it's being read, the result is cut short, and if it grows the extra
+ * isn't read.
+ *
+ * Returns NULL on error.
+ *
+ * Example:
+ *	static char *read_big_file(int fd)
+ *	{
+ *		return grab_fd_parallel(NULL, fd, 4);
+ *	}
+ */
+void *grab_fd_parallel(const void *ctx, int fd, unsigned int threads);
+
+/**
+ * grab_file_parallel - read all of a large file with several threads.
+ * @ctx: the context to tallocate from (often NULL)
+ * @filename: the file to read (NULL for stdin)
+ * @threads: the number of threads to read with.
+ *
+ * This is grab_fd_parallel() on @filename.  As with grab_file_str(), the
+ * tal_count() is the size in bytes plus one, for the NUL terminator.
+ *
+ * Example:
+ *	static char *read_big_file_name(const char *filename)
+ *	{
+ *		return grab_file_parallel(NULL, filename, 4);
+ *	}
+ */
+void *grab_file_parallel(const void *ctx, const char *filename,
+			 unsigned int threads);
+
 #endif /* CCAN_TAL_GRAB_FILE_H */
@@ -0,0 +1,77 @@
+#include <ccan/tal/grab_file/grab_file.h>
+#include <ccan/tal/grab_file/grab_file.c>
+#include <ccan/tap/tap.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(void)
+{
+	struct grab_map *map;
+	char *raw, tmpl[] = "run-map.XXXXXX";
+	void *addr;
+	size_t len;
+	int fds[2], fd;
+
+	plan_tests(14);
+
+	/* A regular file is mapped, not copied. */
+	raw = grab_file_raw(NULL, "test/run-map.c");
+	map = grab_file_map(NULL, "test/run-map.c");
+	ok1(map && map->len == tal_count(raw));
+	ok1(map && memcmp(map->data, raw, map->len) == 0);
+	addr = (void *)map->data;
+	len = map->len;
+	tal_free(raw);
+
+	/* Freeing it unmaps it. */
+	ok1(msync(addr, len, MS_ASYNC) == 0);
+	tal_free(map);
+	ok1(msync(addr, len, MS_ASYNC) != 0 && errno == ENOMEM);
+
+	/* Pipes get read instead. */
+	if (pipe(fds) != 0 || write(fds[1], "hello", 5) != 5)
+		abort();
+	close(fds[1]);
+	map = grab_fd_map(NULL, fds[0]);
+	ok1(map && map->len == 5 && memcmp(map->data, "hello", 5) == 0);
+	ok1(map && tal_parent(map->data) == map);
+	tal_free(map);
+	close(fds[0]);
+
+	/* So do empty files. */
+	fd = mkstemp(tmpl);
+	unlink(tmpl);
+	map = grab_fd_map(NULL, fd);
+	ok1(map && map->len == 0 && map->data);
+	tal_free(map);
+	close(fd);
+
+	/* Like reading, mapping starts at the current offset. */
+	fd = open("test/run-map.c", O_RDONLY);
+	raw = grab_file_raw(NULL, "test/run-map.c");
+	lseek(fd, 100, SEEK_SET);
+	map = grab_fd_map(NULL, fd);
+	ok1(map && map->len == tal_count(raw) - 100);
+	ok1(map && memcmp(map->data, raw + 100, map->len) == 0);
+	ok1(lseek(fd, 0, SEEK_CUR) == tal_count(raw));
+	tal_free(map);
+	/* ... which at the end means nothing. */
+	map = grab_fd_map(NULL, fd);
+	ok1(map && map->len == 0);
+	tal_free(map);
+	tal_free(raw);
+	close(fd);
+
+	/* Failures are failures. */
+	ok1(!grab_file_map(NULL, "test/does-not-exist"));
+	ok1(!grab_fd_map(NULL, -1));
+
+	/* And the context owns it. */
+	raw = tal(NULL, char);
+	map = grab_file_map(raw, "test/run-map.c");
+	ok1(map && tal_parent(map) == raw);
+	tal_free(raw);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
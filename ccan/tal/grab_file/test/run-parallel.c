@@ -0,0 +1,97 @@
+#include <ccan/tal/grab_file/grab_file.h>
+#include <ccan/tal/grab_file/grab_file.c>
+#include <ccan/tap/tap.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Not a multiple of the chunk size, so the last chunk is short. */
+#define SIZE (PARALLEL_MIN + PARALLEL_CHUNK / 2 + 7)
+
+static bool check(const char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (buf[i] != (char)(i * 7 + i / 4096))
+			return false;
+	return true;
+}
+
+int main(void)
+{
+	char *buf, *small, tmpl[] = "run-parallel.XXXXXX";
+	struct parallel_read pr;
+	size_t i;
+	int fd;
+
+	plan_tests(12);
+
+	buf = tal_arr(NULL, char, SIZE);
+	for (i = 0; i < SIZE; i++)
+		buf[i] = i * 7 + i / 4096;
+	fd = mkstemp(tmpl);
+	unlink(tmpl);
+	if (fd < 0 || write(fd, buf, SIZE) != SIZE)
+		abort();
+	tal_free(buf);
+
+	lseek(fd, 0, SEEK_SET);
+	buf = grab_fd_parallel(NULL, fd, 4);
+	ok1(buf && tal_count(buf) == SIZE + 1);
+	ok1(buf && check(buf, SIZE) && buf[SIZE] == '\0');
+	tal_free(buf);
+
+	/* Like read(), it starts at the current offset and leaves it at the end. */
+	lseek(fd, 1, SEEK_SET);
+	buf = grab_fd_parallel(NULL, fd, 4);
+	ok1(buf && tal_count(buf) == SIZE && buf[0] == (char)7);
+	ok1(lseek(fd, 0, SEEK_CUR) == SIZE);
+	tal_free(buf);
+
+	/* More threads than chunks is fine. */
+	lseek(fd, 0, SEEK_SET);
+	buf = grab_fd_parallel(NULL, fd, 100);
+	ok1(buf && tal_count(buf) == SIZE + 1 && check(buf, SIZE));
+	tal_free(buf);
+
+	/* One thread is the same as grab_fd_str. */
+	lseek(fd, 0, SEEK_SET);
+	buf = grab_fd_parallel(NULL, fd, 1);
+	ok1(buf && tal_count(buf) == SIZE + 1 && check(buf, SIZE));
+	tal_free(buf);
+
+	/* If the file is shorter than we thought, we stop where it ends. */
+	pr.fd = fd;
+	pr.start = 0;
+	pr.size = pr.end = SIZE + 2 * PARALLEL_CHUNK;
+	pr.next = 0;
+	pr.err = 0;
+	pr.buffer = tal_arr(NULL, char, pr.size);
+	read_chunks(&pr);
+	ok1(pr.err == 0 && pr.end == SIZE && check(pr.buffer, SIZE));
+	tal_free(pr.buffer);
+
+	/* Errors are reported. */
+	pr.fd = -1;
+	pr.size = pr.end = SIZE;
+	pr.next = 0;
+	pr.buffer = tal_arr(NULL, char, pr.size);
+	read_chunks(&pr);
+	ok1(pr.err == EBADF);
+	tal_free(pr.buffer);
+	ok1(!grab_fd_parallel(NULL, -1, 4));
+	close(fd);
+
+	/* Small files are read as usual. */
+	small = grab_file_str(NULL, "test/run-parallel.c");
+	buf = grab_file_parallel(NULL, "test/run-parallel.c", 4);
+	ok1(buf && tal_count(buf) == tal_count(small));
+	ok1(buf && strcmp(buf, small) == 0);
+	tal_free(buf);
+	tal_free(small);
+
+	ok1(!grab_file_parallel(NULL, "test/does-not-exist", 4));
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
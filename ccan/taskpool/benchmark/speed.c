@@ -0,0 +1,122 @@
+/* Times a coroutine switch, against swapcontext(), then spawning tasks
+ * and yielding between them in a taskpool. */
+#include <ccan/coroutine/coroutine.h>
+#include <ccan/taskpool/taskpool.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#define SWITCHES 10000000
+#define TASKS 1000000
+/* Each live task has its own stack: don't map a million at once. */
+#define BATCH 10000
+#define YIELDS 100
+
+static struct coroutine_state main_cs, co_cs;
+static ucontext_t main_uc, co_uc;
+
+static void co_pingpong(void *unused)
+{
+	for (;;)
+		coroutine_switch(&co_cs, &main_cs);
+}
+
+static void uc_pingpong(void)
+{
+	for (;;)
+		swapcontext(&co_uc, &main_uc);
+}
+
+static void report(const char *what, struct timemono start, size_t num)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-28s %8zu: %8llu usec (%llu nsec each, %.1fM/sec)\n",
+	       what, num, (unsigned long long)time_to_usec(diff),
+	       (unsigned long long)time_to_nsec(diff) / num,
+	       num / (time_to_nsec(diff) / 1000.0));
+}
+
+static struct taskpool *tp;
+
+static void nothing(void *unused)
+{
+}
+
+static void spawner(size_t *num)
+{
+	size_t i;
+
+	for (i = 0; i < *num; i++)
+		if (!taskpool_spawn(tp, nothing, NULL))
+			abort();
+}
+
+static void yielder(void *unused)
+{
+	unsigned int i;
+
+	for (i = 0; i < YIELDS; i++)
+		taskpool_yield(tp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct coroutine_stack *stack;
+	struct timemono start;
+	size_t i, num;
+	unsigned int threads, max = argc > 1 ? atoi(argv[1]) : 8;
+	char name[40];
+
+	stack = coroutine_stack_alloc(65536, 0);
+	coroutine_init(&co_cs, co_pingpong, NULL, stack);
+	start = time_mono();
+	for (i = 0; i < SWITCHES / 2; i++)
+		coroutine_switch(&main_cs, &co_cs);
+	report("coroutine_switch", start, SWITCHES);
+
+	getcontext(&co_uc);
+	co_uc.uc_stack.ss_sp = malloc(65536);
+	co_uc.uc_stack.ss_size = 65536;
+	makecontext(&co_uc, uc_pingpong, 0);
+	start = time_mono();
+	for (i = 0; i < SWITCHES / 2; i++)
+		swapcontext(&main_uc, &co_uc);
+	report("swapcontext", start, SWITCHES);
+
+	for (threads = 1; threads <= max; threads *= 2) {
+		tp = taskpool_new(threads, 0);
+
+		/* Spawned from outside, spread across the workers. */
+		start = time_mono();
+		for (i = 0; i < TASKS; i++) {
+			if (!taskpool_spawn(tp, nothing, NULL))
+				abort();
+			if (i % BATCH == BATCH - 1)
+				taskpool_run(tp);
+		}
+		sprintf(name, "spawn+run (%u threads)", threads);
+		report(name, start, TASKS);
+
+		/* Spawned from within a task, so others must steal. */
+		num = BATCH;
+		start = time_mono();
+		for (i = 0; i < TASKS / BATCH; i++) {
+			taskpool_spawn(tp, spawner, &num);
+			taskpool_run(tp);
+		}
+		sprintf(name, "nested spawn (%u threads)", threads);
+		report(name, start, TASKS);
+
+		start = time_mono();
+		for (i = 0; i < TASKS / YIELDS; i++)
+			taskpool_spawn(tp, yielder, NULL);
+		taskpool_run(tp);
+		sprintf(name, "yield (%u threads)", threads);
+		report(name, start, TASKS);
+
+		taskpool_free(tp);
+	}
+	return 0;
+}
@@ -0,0 +1,403 @@
+/* Licensed under LGPLv2.1+ - see LICENSE file for details */
+#include <ccan/taskpool/taskpool.h>
+#include <ccan/coroutine/coroutine.h>
+#include <ccan/lfstack/lfstack.h>
+#include <ccan/wsdeque/wsdeque.h>
+
+#include <assert.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/* Stacks kept by each worker, before going back to the shared pool. */
+#define SPARE_STACKS 16
+/* Busy workers check for ready file descriptors this often. */
+#define POLL_INTERVAL 64
+
+/* Lives in the metadata area of its own stack. */
+struct task {
+	struct coroutine_state cs;
+	void (*fn)(void *);
+	void *arg;
+	struct taskpool *tp;
+	/* While waiting on a file descriptor. */
+	struct lfstack_link waiting;
+	int fd;
+	short events, revents;
+	/* While spare. */
+	struct task *next_spare;
+};
+
+/* Why a task switched back to its worker. */
+enum task_state {
+	TASK_YIELDED,
+	TASK_WAITING,
+	TASK_DONE,
+};
+
+struct worker {
+	WSDEQUE(struct task) ready;
+	struct coroutine_state sched;
+	struct task *current;
+	enum task_state state;
+	/* A task which yielded, to go behind the next one we run. */
+	struct task *yielded;
+	struct task *spare;
+	unsigned int num_spare;
+	unsigned int ticks;
+	uint32_t seed;
+} __attribute__((aligned(WSDEQUE_CACHELINE)));
+
+struct taskpool {
+	unsigned int nthreads;
+	struct coroutine_stack_pool *stacks;
+	struct worker *workers;
+	/* Where the next task spawned from outside goes. */
+	unsigned int next_worker;
+	bool running;
+	/* Tasks spawned which haven't finished. */
+	size_t live __attribute__((aligned(WSDEQUE_CACHELINE)));
+	LFSTACK(struct task, waiting) waiting;
+	/* Only the worker which set this can use pfds and polled. */
+	bool polling;
+	struct pollfd *pfds;
+	struct task **polled;
+	size_t max_polled;
+};
+
+static unsigned int thread_num(void)
+{
+#if HAVE_OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+static struct worker *this_worker(struct taskpool *tp)
+{
+	unsigned int n = thread_num();
+
+	assert(n < tp->nthreads);
+	return &tp->workers[n];
+}
+
+struct taskpool *taskpool_new(unsigned int nthreads, size_t stacksize)
+{
+	struct taskpool *tp;
+	unsigned int i;
+
+	if (!nthreads) {
+#if HAVE_OPENMP
+		nthreads = omp_get_num_procs();
+#else
+		nthreads = 1;
+#endif
+	}
+	if (!stacksize)
+		stacksize = TASKPOOL_DEFAULT_STKSZ;
+
+	tp = calloc(1, sizeof(*tp));
+	if (!tp)
+		return NULL;
+	tp->nthreads = nthreads;
+	lfstack_init(&tp->waiting);
+
+	tp->stacks = coroutine_stack_pool_new(stacksize, sizeof(struct task), 0);
+	if (!tp->stacks) {
+		free(tp);
+		return NULL;
+	}
+	if (posix_memalign((void **)&tp->workers, WSDEQUE_CACHELINE,
+			   nthreads * sizeof(tp->workers[0])) != 0) {
+		coroutine_stack_pool_free(tp->stacks);
+		free(tp);
+		return NULL;
+	}
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &tp->workers[i];
+
+		if (!wsdeque_init(&w->ready)) {
+			while (i--)
+				wsdeque_free(&tp->workers[i].ready);
+			free(tp->workers);
+			coroutine_stack_pool_free(tp->stacks);
+			free(tp);
+			return NULL;
+		}
+		w->current = w->yielded = w->spare = NULL;
+		w->num_spare = w->ticks = 0;
+		w->seed = i + 1;
+	}
+	return tp;
+}
+
+static void task_release(struct task *t)
+{
+	struct coroutine_stack *stack;
+
+	stack = coroutine_stack_from_metadata(t, sizeof(*t));
+	coroutine_stack_release(stack, sizeof(*t));
+}
+
+void taskpool_free(struct taskpool *tp)
+{
+	unsigned int i;
+
+	assert(!tp->running);
+	for (i = 0; i < tp->nthreads; i++)
+		wsdeque_free(&tp->workers[i].ready);
+	/* This unmaps every task's stack, run or not. */
+	coroutine_stack_pool_free(tp->stacks);
+	free(tp->pfds);
+	free(tp->polled);
+	free(tp->workers);
+	free(tp);
+}
+
+/* Runs on the task's own stack. */
+static void task_main(void *arg)
+{
+	struct task *t = arg;
+	struct worker *w;
+
+	t->fn(t->arg);
+
+	/* We may have moved thread since we started. */
+	w = this_worker(t->tp);
+	w->state = TASK_DONE;
+	coroutine_jump(&w->sched);
+}
+
+bool taskpool_spawn_(struct taskpool *tp, void (*fn)(void *), void *arg)
+{
+	struct coroutine_stack *stack;
+	struct worker *w;
+	struct task *t;
+
+	if (tp->running) {
+		w = this_worker(tp);
+	} else {
+		w = &tp->workers[tp->next_worker++ % tp->nthreads];
+	}
+
+	if (w->spare) {
+		t = w->spare;
+		w->spare = t->next_spare;
+		w->num_spare--;
+		stack = coroutine_stack_from_metadata(t, sizeof(*t));
+	} else {
+		stack = coroutine_stack_pool_get(tp->stacks);
+		if (!stack)
+			return false;
+		t = coroutine_stack_to_metadata(stack, sizeof(*t));
+	}
+
+	t->fn = fn;
+	t->arg = arg;
+	t->tp = tp;
+	coroutine_init(&t->cs, task_main, t, stack);
+	/* Count it first: once pushed, it could be stolen and finished. */
+	__atomic_add_fetch(&tp->live, 1, __ATOMIC_RELAXED);
+	if (!wsdeque_push(&w->ready, t)) {
+		__atomic_sub_fetch(&tp->live, 1, __ATOMIC_RELAXED);
+		task_release(t);
+		return false;
+	}
+	return true;
+}
+
+/* Called from a task, to hand control back to its worker. */
+static void task_suspend(struct taskpool *tp, enum task_state state)
+{
+	struct worker *w = this_worker(tp);
+	struct task *t = w->current;
+
+	assert(t);
+	w->state = state;
+	coroutine_switch(&t->cs, &w->sched);
+}
+
+void taskpool_yield(struct taskpool *tp)
+{
+	task_suspend(tp, TASK_YIELDED);
+}
+
+short taskpool_wait_fd(struct taskpool *tp, int fd, short events)
+{
+	struct task *t = this_worker(tp)->current;
+
+	t->fd = fd;
+	t->events = events;
+	t->revents = 0;
+	task_suspend(tp, TASK_WAITING);
+	return t->revents;
+}
+
+static bool grow_polled(struct taskpool *tp)
+{
+	size_t max = tp->max_polled * 2 + 16;
+	struct pollfd *pfds;
+	struct task **polled;
+
+	pfds = realloc(tp->pfds, max * sizeof(*pfds));
+	if (!pfds)
+		return false;
+	tp->pfds = pfds;
+	polled = realloc(tp->polled, max * sizeof(*polled));
+	if (!polled)
+		return false;
+	tp->polled = polled;
+	tp->max_polled = max;
+	return true;
+}
+
+/* Poll the waiting tasks, moving ready ones onto @w's deque.  Only one
+ * worker polls at a time: the others have better things to do. */
+static void poll_waiting(struct taskpool *tp, struct worker *w, bool idle)
+{
+	struct lfstack_link *l;
+	struct task *t;
+	size_t i, n;
+
+	if (lfstack_empty(&tp->waiting))
+		return;
+	if (__atomic_exchange_n(&tp->polling, true, __ATOMIC_ACQUIRE))
+		return;
+
+	n = 0;
+	l = lfstack_pop_all(&tp->waiting);
+	while (l) {
+		t = lfstack_entry(&tp->waiting, l);
+		l = l->down;
+		if (n == tp->max_polled && !grow_polled(tp)) {
+			/* Leave it for next time. */
+			lfstack_push(&tp->waiting, t);
+			continue;
+		}
+		tp->pfds[n].fd = t->fd;
+		tp->pfds[n].events = t->events;
+		tp->pfds[n].revents = 0;
+		tp->polled[n++] = t;
+	}
+
+	/* Don't sleep for long: new tasks may turn up elsewhere. */
+	if (poll(tp->pfds, n, idle ? 1 : 0) < 0) {
+		for (i = 0; i < n; i++)
+			tp->pfds[i].revents = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		t = tp->polled[i];
+		if (tp->pfds[i].revents) {
+			t->revents = tp->pfds[i].revents;
+			if (wsdeque_push(&w->ready, t))
+				continue;
+		}
+		lfstack_push(&tp->waiting, t);
+	}
+	__atomic_store_n(&tp->polling, false, __ATOMIC_RELEASE);
+}
+
+/* Try everyone else's deque once, starting somewhere random. */
+static struct task *steal(struct taskpool *tp, struct worker *w)
+{
+	unsigned int i, start;
+	struct task *t;
+
+	if (tp->nthreads == 1)
+		return NULL;
+
+	/* xorshift32 */
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 17;
+	w->seed ^= w->seed << 5;
+	start = w->seed % tp->nthreads;
+	for (i = 0; i < tp->nthreads; i++) {
+		struct worker *victim = &tp->workers[(start + i) % tp->nthreads];
+
+		if (victim == w)
+			continue;
+		t = wsdeque_steal(&victim->ready);
+		if (t)
+			return t;
+	}
+	return NULL;
+}
+
+static void run_task(struct taskpool *tp, struct worker *w, struct task *t)
+{
+	w->current = t;
+	coroutine_switch(&w->sched, &t->cs);
+	w->current = NULL;
+
+	switch (w->state) {
+	case TASK_YIELDED:
+		w->yielded = t;
+		break;
+	case TASK_WAITING:
+		lfstack_push(&tp->waiting, t);
+		break;
+	case TASK_DONE:
+		if (w->num_spare < SPARE_STACKS) {
+			t->next_spare = w->spare;
+			w->spare = t;
+			w->num_spare++;
+		} else {
+			task_release(t);
+		}
+		__atomic_sub_fetch(&tp->live, 1, __ATOMIC_RELEASE);
+		break;
+	}
+}
+
+static void worker_loop(struct taskpool *tp, struct worker *w)
+{
+	struct task *t;
+
+	while (__atomic_load_n(&tp->live, __ATOMIC_ACQUIRE)) {
+		t = wsdeque_pop(&w->ready);
+		/* A task which yielded goes behind the next one, where others
+		 * can steal it; if there's nothing else, it runs again. */
+		if (w->yielded) {
+			if (!t) {
+				t = w->yielded;
+				w->yielded = NULL;
+			} else if (wsdeque_push(&w->ready, w->yielded)) {
+				w->yielded = NULL;
+			}
+		}
+		if (!t)
+			t = steal(tp, w);
+
+		if (!t) {
+			poll_waiting(tp, w, true);
+			t = wsdeque_pop(&w->ready);
+			if (!t) {
+				sched_yield();
+				continue;
+			}
+		} else if (++w->ticks % POLL_INTERVAL == 0) {
+			poll_waiting(tp, w, false);
+		}
+		run_task(tp, w, t);
+	}
+}
+
+void taskpool_run(struct taskpool *tp)
+{
+	tp->running = true;
+#if HAVE_OPENMP
+#pragma omp parallel num_threads(tp->nthreads)
+#endif
+	{
+		/* We may get fewer threads than we asked for: the others'
+		 * tasks will be stolen. */
+		worker_loop(tp, this_worker(tp));
+	}
+	tp->running = false;
+}
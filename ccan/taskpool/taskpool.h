@@ -0,0 +1,137 @@
+/* Licensed under LGPLv2.1+ - see LICENSE file for details */
+#ifndef CCAN_TASKPOOL_H
+#define CCAN_TASKPOOL_H
+#include "config.h"
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ccan/typesafe_cb/typesafe_cb.h>
+
+/**
+ * struct taskpool - a pool of worker threads running tasks
+ *
+ * Opaque: created by taskpool_new().
+ */
+struct taskpool;
+
+/**
+ * TASKPOOL_DEFAULT_STKSZ - stack size used if none is given
+ */
+#define TASKPOOL_DEFAULT_STKSZ	(64 * 1024)
+
+/**
+ * taskpool_new - create a pool of worker threads
+ * @nthreads: number of worker threads, or 0 for one per processor.
+ * @stacksize: stack size for each task, or 0 for TASKPOOL_DEFAULT_STKSZ.
+ *
+ * Returns NULL if out of memory.  Nothing runs until taskpool_run().
+ *
+ * Example:
+ *	struct taskpool *tp = taskpool_new(0, 0);
+ *	if (!tp)
+ *		abort();
+ */
+struct taskpool *taskpool_new(unsigned int nthreads, size_t stacksize);
+
+/**
+ * taskpool_free - free a pool
+ * @tp: the pool, which must not be running.
+ *
+ * Any tasks which were spawned but never run are discarded.
+ *
+ * Example:
+ *	taskpool_free(tp);
+ */
+void taskpool_free(struct taskpool *tp);
+
+/**
+ * taskpool_spawn - create a new task
+ * @tp: the pool
+ * @fn: the function to run in the task
+ * @arg: argument to @fn
+ *
+ * The task runs @fn(@arg) on its own stack, on whichever worker gets
+ * to it first.  It may be called before taskpool_run(), or from within
+ * a task; a new task goes on the spawning worker's own deque, for other
+ * workers to steal if they're idle.  It may not be called from any
+ * other thread while the pool is running.
+ *
+ * Returns false if out of memory.
+ *
+ * Example:
+ *	static void count(unsigned int *counter)
+ *	{
+ *		__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+ *	}
+ *	...
+ *	static unsigned int counter;
+ *	if (!taskpool_spawn(tp, count, &counter))
+ *		abort();
+ */
+#define taskpool_spawn(tp, fn, arg)					\
+	taskpool_spawn_((tp), typesafe_cb(void, void *, (fn), (arg)), (arg))
+bool taskpool_spawn_(struct taskpool *tp, void (*fn)(void *), void *arg);
+
+/**
+ * taskpool_run - run tasks until there are none left
+ * @tp: the pool
+ *
+ * This starts the worker threads (using OpenMP, if available; otherwise
+ * the calling thread runs everything), and returns once every task has
+ * finished, including any they spawned.
+ *
+ * Example:
+ *	taskpool_run(tp);
+ */
+void taskpool_run(struct taskpool *tp);
+
+/**
+ * taskpool_yield - let other tasks run
+ * @tp: the pool
+ *
+ * Called from within a task, this puts it back on its worker's deque
+ * behind the next task, and returns when it's been scheduled again
+ * (possibly on another thread).
+ */
+void taskpool_yield(struct taskpool *tp);
+
+/**
+ * taskpool_wait_fd - wait for a file descriptor to be ready
+ * @tp: the pool
+ * @fd: the file descriptor
+ * @events: the poll() events to wait for (eg. POLLIN, POLLOUT).
+ *
+ * Called from within a task, this suspends it until @fd is ready, while
+ * its worker runs other tasks.  Workers with nothing else to do poll()
+ * the waiting descriptors; busy ones also check every so often.
+ *
+ * Returns the poll() revents for @fd, which may include POLLERR,
+ * POLLHUP or POLLNVAL.
+ *
+ * Example:
+ *	struct conn {
+ *		struct taskpool *tp;
+ *		int fd;
+ *	};
+ *
+ *	static void echo(struct conn *c)
+ *	{
+ *		char buf[100];
+ *		ssize_t len;
+ *
+ *		while (taskpool_wait_fd(c->tp, c->fd, POLLIN) & POLLIN) {
+ *			len = read(c->fd, buf, sizeof(buf));
+ *			if (len <= 0)
+ *				break;
+ *			taskpool_wait_fd(c->tp, c->fd, POLLOUT);
+ *			if (write(c->fd, buf, len) != len)
+ *				break;
+ *		}
+ *		close(c->fd);
+ *	}
+ */
+short taskpool_wait_fd(struct taskpool *tp, int fd, short events);
+
+#endif /* CCAN_TASKPOOL_H */
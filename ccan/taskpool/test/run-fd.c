@@ -0,0 +1,68 @@
+#include <ccan/taskpool/taskpool.h>
+/* Include the C files directly. */
+#include <ccan/taskpool/taskpool.c>
+#include <ccan/tap/tap.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct taskpool *tp;
+static int fds[2];
+static char buf[100];
+static short revents[2];
+static unsigned int others;
+
+static void reader(void *unused)
+{
+	ssize_t len;
+
+	revents[0] = taskpool_wait_fd(tp, fds[0], POLLIN);
+	len = read(fds[0], buf, sizeof(buf) - 1);
+	if (len > 0)
+		buf[len] = '\0';
+	/* Now the writer has closed it. */
+	revents[1] = taskpool_wait_fd(tp, fds[0], POLLIN);
+	close(fds[0]);
+}
+
+static void writer(void *unused)
+{
+	unsigned int i;
+
+	/* The reader doesn't hold up anyone else. */
+	for (i = 0; i < 1000; i++)
+		taskpool_yield(tp);
+	if (write(fds[1], "hello", 5) != 5)
+		abort();
+	taskpool_yield(tp);
+	close(fds[1]);
+}
+
+static void other(void *unused)
+{
+	__atomic_add_fetch(&others, 1, __ATOMIC_RELAXED);
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	/* This is how many tests you plan to run */
+	plan_tests(7);
+
+	ok1(pipe(fds) == 0);
+	tp = taskpool_new(2, 0);
+	ok1(taskpool_spawn(tp, writer, NULL));
+	ok1(taskpool_spawn(tp, reader, NULL));
+	for (i = 0; i < 100; i++)
+		taskpool_spawn(tp, other, NULL);
+	taskpool_run(tp);
+
+	ok1(others == 100);
+	ok1(strcmp(buf, "hello") == 0);
+	ok1(revents[0] & POLLIN);
+	ok1(revents[1] & POLLHUP);
+	taskpool_free(tp);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
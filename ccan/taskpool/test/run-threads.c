@@ -0,0 +1,77 @@
+#include <ccan/taskpool/taskpool.h>
+/* Include the C files directly. */
+#include <ccan/taskpool/taskpool.c>
+#include <ccan/tap/tap.h>
+
+#define NUM_THREADS 8
+#define NUM 20000
+
+static struct taskpool *tp;
+
+struct leaf {
+	unsigned int runs;
+};
+
+static struct leaf leaves[NUM];
+
+struct range {
+	unsigned int from, to;
+	bool done;
+};
+
+/* Fork-join over the leaves: each half is a task, which may be stolen
+ * and may move thread when it yields. */
+static void visit(struct range *r)
+{
+	struct range lo, hi;
+	unsigned int i;
+
+	if (r->to - r->from <= 16) {
+		for (i = r->from; i < r->to; i++) {
+			__atomic_add_fetch(&leaves[i].runs, 1,
+					   __ATOMIC_RELAXED);
+			if (i % 4 == 0)
+				taskpool_yield(tp);
+		}
+	} else {
+		lo.from = r->from;
+		lo.to = hi.from = (r->from + r->to) / 2;
+		hi.to = r->to;
+		lo.done = hi.done = false;
+		if (!taskpool_spawn(tp, visit, &hi))
+			abort();
+		visit(&lo);
+		while (!__atomic_load_n(&hi.done, __ATOMIC_ACQUIRE))
+			taskpool_yield(tp);
+	}
+	__atomic_store_n(&r->done, true, __ATOMIC_RELEASE);
+}
+
+int main(void)
+{
+	struct range all = { 0, NUM, false };
+	unsigned int i, round;
+	bool ok;
+
+	/* This is how many tests you plan to run */
+	plan_tests(5);
+
+	tp = taskpool_new(NUM_THREADS, 16384);
+	ok1(tp);
+	for (round = 0; round < 2; round++) {
+		all.done = false;
+		ok1(taskpool_spawn(tp, visit, &all));
+		taskpool_run(tp);
+	}
+	ok1(all.done);
+
+	ok = true;
+	for (i = 0; i < NUM; i++)
+		if (leaves[i].runs != 2)
+			ok = false;
+	ok1(ok);
+	taskpool_free(tp);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,76 @@
+#include <ccan/taskpool/taskpool.h>
+/* Include the C files directly. */
+#include <ccan/taskpool/taskpool.c>
+#include <ccan/tap/tap.h>
+#include <string.h>
+
+static struct taskpool *tp;
+static char order[100];
+static unsigned int num_order;
+
+struct step {
+	char name;
+	unsigned int yields;
+};
+
+static void stepper(struct step *s)
+{
+	unsigned int i;
+
+	order[num_order++] = s->name;
+	for (i = 0; i < s->yields; i++) {
+		taskpool_yield(tp);
+		order[num_order++] = s->name;
+	}
+}
+
+static unsigned int spawned;
+
+static void spawner(unsigned int *depth)
+{
+	static unsigned int depths[20];
+
+	spawned++;
+	if (*depth) {
+		depths[*depth - 1] = *depth - 1;
+		taskpool_spawn(tp, spawner, &depths[*depth - 1]);
+		taskpool_spawn(tp, spawner, &depths[*depth - 1]);
+	}
+}
+
+int main(void)
+{
+	struct step a = { 'a', 2 }, b = { 'b', 0 }, c = { 'c', 1 };
+	unsigned int depth = 10;
+
+	/* This is how many tests you plan to run */
+	plan_tests(10);
+
+	tp = taskpool_new(1, 0);
+	ok1(tp);
+
+	/* Nothing to do. */
+	taskpool_run(tp);
+	ok1(num_order == 0);
+
+	/* The newest task runs first, and a task which yields goes behind
+	 * the next. */
+	ok1(taskpool_spawn(tp, stepper, &a));
+	ok1(taskpool_spawn(tp, stepper, &b));
+	ok1(taskpool_spawn(tp, stepper, &c));
+	taskpool_run(tp);
+	order[num_order] = '\0';
+	ok1(strcmp(order, "cbcaaa") == 0);
+
+	/* Tasks can spawn tasks, and stacks are reused. */
+	ok1(taskpool_spawn(tp, spawner, &depth));
+	taskpool_run(tp);
+	ok1(spawned == (1 << 11) - 1);
+	ok1(tp->workers[0].num_spare > 0
+	    && tp->workers[0].num_spare <= SPARE_STACKS);
+	ok1(tp->live == 0);
+	taskpool_free(tp);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -0,0 +1,93 @@
+/* Writes a feed of items of the given size in megabytes (500 by default),
+ * then times reading it with callbacks which only count what they see, and
+ * loading it into a tree and freeing it again.
+ *
+ * The tree takes several times the size of the document in memory. */
+#include <ccan/ttxml/ttxml.h>
+#include <ccan/time/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct counts {
+	size_t tags, attrs, text;
+};
+
+static int count_open(void *arg, const char *name, size_t len,
+		      const XmlAttr *attr, int nattr)
+{
+	struct counts *c = arg;
+
+	c->tags++;
+	c->attrs += nattr;
+	return 0;
+}
+
+static int count_text(void *arg, const char *text, size_t len)
+{
+	struct counts *c = arg;
+
+	c->text += len;
+	return 0;
+}
+
+static void report(const char *what, struct timemono start, size_t bytes)
+{
+	struct timerel diff = timemono_since(start);
+
+	printf("%-16s %10llu usec (%.0f MB/s)\n", what,
+	       (unsigned long long)time_to_usec(diff),
+	       bytes / (time_to_nsec(diff) / 1000.0));
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = argc > 2 ? argv[2] : "/tmp/ttxml-speed.xml";
+	size_t size = (argc > 1 ? atol(argv[1]) : 500) << 20, bytes = 0;
+	XmlHandler h = { count_open, NULL, count_text };
+	struct timemono start;
+	struct counts c;
+	XmlNode *xml;
+	unsigned long i;
+	FILE *f;
+
+	f = fopen(file, "w");
+	if (!f) {
+		perror(file);
+		return 1;
+	}
+	bytes += fprintf(f, "<?xml version=\"1.0\"?>\n<feed title=\"speed\">\n");
+	for (i = 0; bytes < size; i++)
+		bytes += fprintf(f, "  <item id=\"%lu\" type='%s' updated=2024-01-%02lu>\n"
+				 "    <title>Item number %lu</title>\n"
+				 "    <link href=\"http://example.com/items/%lu\"/>\n"
+				 "    <description>A description of item %lu, long"
+				 " enough to be typical of a feed, with some\n"
+				 "      words on a second line.</description>\n"
+				 "  </item>\n",
+				 i, i % 3 ? "article" : "video", i % 28 + 1,
+				 i, i, i);
+	bytes += fprintf(f, "</feed>\n");
+	fclose(f);
+	printf("%lu items, %zu bytes\n", i, bytes);
+
+	memset(&c, 0, sizeof(c));
+	start = time_mono();
+	if (xml_sax_load(file, &h, &c) != 0)
+		return 1;
+	report("xml_sax_load", start, bytes);
+	printf("%zu tags, %zu attributes, %zu bytes of text\n",
+	       c.tags, c.attrs, c.text);
+
+	start = time_mono();
+	xml = xml_load(file);
+	if (!xml)
+		return 1;
+	report("xml_load", start, bytes);
+	start = time_mono();
+	xml_free(xml);
+	report("xml_free", start, bytes);
+
+	remove(file);
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include <ccan/ttxml/ttxml.h>
+/* Include the C files directly. */
+
+#define BUFFER 40	/* use a stupidly small buffer to stomp out bugs */
+
+#include <ccan/ttxml/ttxml.c>
+#include <ccan/tap/tap.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+
+static const char *files[] = {
+	"./test/test.xml1", "./test/test.xml2",
+	"./test/test.xml3", "./test/test.xml4",
+};
+
+/* Write out a tree, so two of them can be compared */
+static void dump(char *out, XmlNode *x, int depth)
+{
+	int i;
+
+	for(; x; x = x->next)
+	{
+		sprintf(out + strlen(out), "%d[%s]", depth, x->name ? x->name : "");
+		for(i=0; i<x->nattrib*2; i++)
+			sprintf(out + strlen(out), "{%s}", x->attrib[i] ? x->attrib[i] : "-");
+		dump(out, x->child, depth + 1);
+	}
+}
+
+static int same_tree(XmlNode *a, XmlNode *b)
+{
+	char da[4096] = "", db[4096] = "";
+
+	dump(da, a, 0);
+	dump(db, b, 0);
+	return !strcmp(da, db);
+}
+
+/* Write out the callbacks */
+static char events[4096];
+
+static int ev_open(void *arg, const char *name, size_t len, const XmlAttr *attr, int nattr)
+{
+	int i;
+
+	sprintf(events + strlen(events), "<%.*s", (int)len, name);
+	for(i=0; i<nattr; i++)
+	{
+		sprintf(events + strlen(events), " %.*s", (int)attr[i].namelen, attr[i].name);
+		if(attr[i].value)
+			sprintf(events + strlen(events), "=%.*s", (int)attr[i].valuelen, attr[i].value);
+	}
+	strcat(events, ">");
+	return arg && len == 4 && !memcmp(name, "stop", 4) ? 7 : 0;
+}
+
+static int ev_close(void *arg, const char *name, size_t len)
+{
+	sprintf(events + strlen(events), "</%.*s>", (int)len, name);
+	return 0;
+}
+
+static int ev_text(void *arg, const char *text, size_t len)
+{
+	sprintf(events + strlen(events), "[%.*s]", (int)len, text);
+	return 0;
+}
+
+static const XmlHandler ev = { ev_open, ev_close, ev_text };
+
+/* Parse another document from inside a callback */
+static int nested_ok;
+static int nested_open(void *arg, const char *name, size_t len, const XmlAttr *attr, int nattr)
+{
+	XmlNode *x = xml_load_buffer("<inner a=1/>", 12);
+
+	if(x && !strcmp(x->name, "inner") && !strcmp(xml_attr(x, "a"), "1"))
+		nested_ok++;
+	if(x)xml_free(x);
+	return 0;
+}
+
+static char *slurp(const char *filename, size_t *len)
+{
+	FILE *f = fopen(filename, "rb");
+	char *buf = malloc(4096);
+
+	*len = fread(buf, 1, 4096, f);
+	fclose(f);
+	/* exactly the size of the document, so reading past it is caught */
+	return realloc(buf, *len ? *len : 1);
+}
+
+int main(void)
+{
+	static const XmlHandler nested = { nested_open, NULL, NULL };
+	const char *doc;
+	char fifo[64];
+	XmlNode *x, *y;
+	unsigned int i;
+	size_t len;
+	char *buf;
+	pid_t pid;
+	int fd;
+
+	/* This is how many tests you plan to run */
+	plan_tests(17);
+
+	/* The same trees from files and from memory. */
+	for(i=0; i<sizeof(files)/sizeof(files[0]); i++)
+	{
+		buf = slurp(files[i], &len);
+		x = xml_load(files[i]);
+		y = xml_load_buffer(buf, len);
+		ok(x && y && same_tree(x, y), "%s", files[i]);
+		xml_free(x);
+		xml_free(y);
+		free(buf);
+	}
+
+	/* Callbacks see what the tree would hold, and every tag closes. */
+	doc = "<a x=\"q \\\"u\\\" e\" y z='' w=-5>  some text\n <b/><c>more</c> <d>";
+	ok1(xml_sax_buffer(doc, strlen(doc), &ev, NULL) == 0);
+	ok1(!strcmp(events, "<a x=q \\\"u\\\" e y z= w=-5>[some text]<b></b><c>[more]</c><d></d></a>"));
+	x = xml_load_buffer(doc, strlen(doc));
+	ok1(x && !strcmp(xml_attr(x, "w"), "-5") && !xml_attr(x, "y") && !xml_attr(x, "z"));
+	ok1(!strcmp(x->child->attrib[0], "some text"));
+	xml_free(x);
+
+	/* A close at the top ends the document, whatever follows. */
+	events[0] = 0;
+	doc = "<a></wrong> text </a> <b/>";
+	ok1(xml_sax_buffer(doc, strlen(doc), &ev, NULL) == 0);
+	ok1(!strcmp(events, "<a></a>[text]"));
+
+	/* A callback can stop the parse. */
+	events[0] = 0;
+	doc = "<go><stop/><never/></go>";
+	ok1(xml_sax_buffer(doc, strlen(doc), &ev, events) == 7);
+	ok1(!strcmp(events, "<go><stop>"));
+
+	/* Nothing is shared between parses. */
+	doc = "<o/><o><o/></o>";
+	ok1(xml_sax_buffer(doc, strlen(doc), &nested, NULL) == 0 && nested_ok == 3);
+
+	/* Empty documents, and missing files. */
+	ok1(xml_load_buffer("", 0) == NULL);
+	ok1(xml_sax_load("does not exist", &ev, NULL) == -1);
+
+	/* Files which can't be mapped are read. */
+	sprintf(fifo, "/tmp/ttxml-run-buffer.%d", (int)getpid());
+	ok1(mkfifo(fifo, 0600) == 0);
+	pid = fork();
+	if(!pid)
+	{
+		buf = slurp("./test/test.xml1", &len);
+		fd = open(fifo, O_WRONLY);
+		_exit(write(fd, buf, len) != (ssize_t)len);
+	}
+	x = xml_load(fifo);
+	y = xml_load("./test/test.xml1");
+	ok1(x && y && same_tree(x, y));
+	xml_free(x);
+	xml_free(y);
+	waitpid(pid, NULL, 0);
+	unlink(fifo);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
@@ -3,389 +3,476 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "ttxml.h"
 
+/* Files which can't be mapped (pipes, empty files) are read in chunks of this
+ * size instead. */
 #ifndef BUFFER
 #define BUFFER 3264
 #endif
 
 
-#define XML_LETTER	1
-#define XML_NUMBER	2
-#define XML_SPACE	4
-#define XML_SLASH	8
-#define XML_OPEN	16
-#define XML_EQUALS	32
-#define XML_CLOSE	64
-#define XML_QUOTE	128
-#define XML_OTHER	256
-
-#define XML_ALL 0xFFFFFFFF
-
+/* The whole document is in memory, so the parser works on a pointer into
+ * it and scans for the next interesting byte with memchr() where it can.
+ * All of its state lives in here, so several documents can be parsed at
+ * once, or one from inside the callbacks of another. */
+typedef struct XMLNAME
+{
+	const char * name;
+	size_t len;
+} XMLNAME;
 
 typedef struct XMLBUF
 {
-	FILE * fptr;
-	char * buf;
-	int len;
-	int read_index;
-	int eof;
-	int error;
+	const char * p;
+	const char * end;
+	const XmlHandler * h;
+	void * arg;
+	XmlAttr * attr;		/* of the tag being read */
+	int attr_size;
+	XMLNAME * open;		/* the tags we are inside */
+	int depth;
+	int open_size;
 } XMLBUF;
 
-
-/* Allocate a new XmlNode */
-static XmlNode* xml_new(char * name)
+/* A document in memory, either mapped or read. */
+typedef struct XMLMAP
 {
-	XmlNode * ret = malloc(sizeof(XmlNode));
-	if(!ret)return NULL;
+	char * buf;
+	size_t len;
+	int mapped;
+} XMLMAP;
 
-	ret->attrib = NULL;
-	ret->nattrib = 0;
-	ret->child = ret->next = NULL;
 
-	ret->name = name;
-	return ret;
+static int is_space(char item)
+{
+	return item == 0x20 || item == '\t' || item == 0x0D || item == 0x0A;
 }
 
-/* free a previously allocated XmlNode */
-void xml_free(XmlNode *target)
+/* Ends a tag name or an unquoted attribute value */
+static int ends_name(char item)
 {
-	int i;
-	for(i=0; i<target->nattrib*2; i++)
-		if(target->attrib[i])
-			free(target->attrib[i]);
-
-	if(target->attrib)free(target->attrib);
-	if(target->child)xml_free(target->child);
-	if(target->next)xml_free(target->next);
-	free(target->name);
-	free(target);
+	return is_space(item) || item == '/' || item == '>';
 }
 
-/* Raise flags if we have a character of special meaning.
- * This is where I've hidden the switch statements :-p
- */
-static int is_special(char item)
+/* Grow an array so that it holds at least n items */
+static int xml_grow(void *arrp, int *size, int n, size_t item)
 {
-	if((item >= 'a' && item <= 'z') || (item >= 'A' && item <='Z'))
-		return XML_LETTER;
-	if( item >= '0' && item <='9' )
-		return XML_NUMBER;
-	if( item == 0x20 || item == '\t' ||	item == 0x0D || item == 0x0A )
-		return XML_SPACE;
-	if( item == '/' )
-		return XML_SLASH;
-	if( item == '<' )
-		return XML_OPEN;
-	if( item == '=' )
-		return XML_EQUALS;
-	if( item == '>' )
-		return XML_CLOSE;
-	if( item == '"' || item == '\'' )
-		return XML_QUOTE;
-	return 128;
+	void *tmp;
+	int want = *size ? *size : 8;
+
+	if(n <= *size)return 0;
+	while(want < n)
+		want *= 2;
+	tmp = realloc(*(void **)arrp, want * item);
+	if(!tmp)return -1;
+	*(void **)arrp = tmp;
+	*size = want;
+	return 0;
 }
 
-/* Refresh the buffer, if possible */
-static void xml_read_file(XMLBUF *xml)
+/* The closing quote, ignoring any escaped with a backslash */
+static const char *xml_quote_end(const char *p, const char *end, char quote)
 {
-	int size;
-	
-	if(xml->eof)return;
-	  
-	size = fread( xml->buf,	1, xml->len, xml->fptr);
-	if( size != xml->len )
+	const char *q, *b;
+
+	while( (q = memchr(p, quote, end - p)) )
 	{
-		xml->len = size;
-		xml->buf[size]=0;
-		xml->eof = 1;
+		for(b = q; b > p && b[-1] == '\\'; b--);
+		if( !((q - b) & 1) )
+			return q;
+		p = q + 1;
 	}
+	return end;
 }
 
+/* this reads attributes from tags, of the form...
+ *
+ * <tag attr1="some arguments" attr2=argument>
+ *
+ * It is aware of quotes, and will allow anything inside quoted arguments.
+ * Returns the number of attributes, or -1 if out of memory.
+ */
+static int xml_read_attr(XMLBUF *xml)
+{
+	const char *p = xml->p, *end = xml->end;
+	XmlAttr *a;
+	int n = 0;
 
-static void xml_end_file(XMLBUF *xml)
+	// how does this tag finish?
+	while( p < end && *p != '>' && *p != '/' )
+	{
+		if( xml_grow(&xml->attr, &xml->attr_size, n + 1, sizeof(XmlAttr)) )
+			return -1;
+		a = &xml->attr[n++];
+
+		a->name = p;
+		while( p < end && *p != '=' && !ends_name(*p) )
+			p++;
+		a->namelen = p - a->name;
+		a->value = NULL;
+		a->valuelen = 0;
+		if( p < end && *p == '=' )
+		{
+			p++;
+			if( p < end && (*p == '"' || *p == '\'') )
+			{
+				a->value = p + 1;
+				p = xml_quote_end(p + 1, end, *p);
+				a->valuelen = p - a->value;
+				if(p < end)p++;
+			}
+			else
+			{
+				a->value = p;
+				while( p < end && !ends_name(*p) )
+					p++;
+				a->valuelen = p - a->value;
+			}
+		}
+		while( p < end && is_space(*p) )
+			p++;
+	}
+	xml->p = p;
+	return n;
+}
+
+static int xml_open(XMLBUF *xml, const char *name, size_t len, int nattr)
 {
-	xml->len = 0;
-	xml->eof = 1;
-	xml->read_index = 0 ;
-	xml->error = 1;
+	if( xml_grow(&xml->open, &xml->open_size, xml->depth + 1, sizeof(XMLNAME)) )
+		return -1;
+	xml->open[xml->depth].name = name;
+	xml->open[xml->depth].len = len;
+	xml->depth++;
+	if(xml->h->open)
+		return xml->h->open(xml->arg, name, len, xml->attr, nattr);
+	return 0;
 }
 
-/* All reading of the XML buffer done through these two functions */
-/*** read a byte without advancing the offset */
-static char xml_peek(XMLBUF *xml)
+static int xml_close(XMLBUF *xml)
 {
-	return xml->buf[xml->read_index];
+	XMLNAME *tag = &xml->open[--xml->depth];
+
+	if(xml->h->close)
+		return xml->h->close(xml->arg, tag->name, tag->len);
+	return 0;
 }
 
-/*** read a byte and advance the offset */
-static char xml_read_byte(XMLBUF *xml)
+/* The big decision maker, is it a tag, or text.
+ *
+ * Whitespace either side of text is dropped, and whitespace alone is not
+ * text at all. A closing tag closes whatever tag is open, whatever its name,
+ * and at the top level it ends the document. Tags still open at the end are
+ * closed.
+ */
+static int xml_parse(XMLBUF *xml)
 {
-	char ret = xml_peek(xml);
-	xml->read_index++;
-	if(xml->read_index >= xml->len)
+	const char *end = xml->end, *s, *e;
+	int ret, nattr;
+
+	for(;;)
 	{
-		if(xml->eof)
+		while( xml->p < end && is_space(*xml->p) )
+			xml->p++;	// skip whitespace
+		if(xml->p >= end)break;
+
+		if(*xml->p != '<')	// text
 		{
-		  xml->read_index = xml->len;
-		  return ret;
+			s = xml->p;
+			e = memchr(s, '<', end - s);
+			xml->p = e ? e : end;
+			for(e = xml->p; is_space(e[-1]); e--);
+			if( xml->h->text && (ret = xml->h->text(xml->arg, s, e - s)) )
+				return ret;
+			continue;
 		}
-		xml->read_index = 0 ;
-		xml_read_file(xml);
+
+		if( ++xml->p < end && *xml->p == '/' )	// parents close tag
+		{
+			if(!xml->depth)return 0;
+			e = memchr(xml->p, '>', end - xml->p);
+			xml->p = e ? e + 1 : end;
+			if( (ret = xml_close(xml)) )
+				return ret;
+			continue;
+		}
+
+		// read the tag name
+		s = xml->p;
+		while( xml->p < end && !ends_name(*xml->p) )
+			xml->p++;
+		e = xml->p;
+		while( xml->p < end && is_space(*xml->p) )
+			xml->p++;	// skip any whitespace
+		nattr = xml_read_attr(xml);
+		if(nattr < 0)return -1;
+		if( (ret = xml_open(xml, s, e - s, nattr)) )
+			return ret;
+
+		// how does this tag finish?
+		if( xml->p < end && *xml->p == '>' )	// child-nodes ahead
+		{
+			xml->p++;
+			continue;
+		}
+		// self closing tag, or the end of the document
+		xml->p += end - xml->p < 2 ? end - xml->p : 2;
+		if( (ret = xml_close(xml)) )
+			return ret;
 	}
-	return ret;
-}
 
+	while(xml->depth)
+		if( (ret = xml_close(xml)) )
+			return ret;
+	return 0;
+}
 
-/* skip over bytes matching the is_special mask */
-static void xml_skip( XMLBUF *xml, int mask)
+int xml_sax_buffer(const char *buf, size_t len, const XmlHandler *h, void *arg)
 {
-	while( is_special(xml_peek(xml)) & mask && !(xml->eof && xml->read_index >= xml->len) )
-		xml_read_byte(xml);
+	XMLBUF xml;
+	int ret;
+
+	memset(&xml, 0, sizeof(xml));
+	xml.p = buf;
+	xml.end = buf + len;
+	xml.h = h;
+	xml.arg = arg;
+	ret = xml_parse(&xml);
+	free(xml.attr);
+	free(xml.open);
+	return ret;
 }
 
 
-/* character matching tests for the feed functions */
-static char quotechar = 0;
-static int test_quote(const char x)
+/* Map the file if we can, or read it all in */
+static int xml_map(XMLMAP *map, const char *filename)
 {
-	static int escaped=0;
-	if( escaped || '\\' == x )
+	FILE *fptr;
+	struct stat st;
+	size_t size = BUFFER, n;
+	char *tmp;
+
+	fptr = fopen(filename, "rb");
+	if(!fptr)
+		return -1;
+
+	map->mapped = 0;
+	if( fstat(fileno(fptr), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 )
 	{
-		escaped = !escaped;
-		return 1;
+		map->buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fptr), 0);
+		if(map->buf != MAP_FAILED)
+		{
+			madvise(map->buf, st.st_size, MADV_SEQUENTIAL);
+			map->len = st.st_size;
+			map->mapped = 1;
+			fclose(fptr);
+			return 0;
+		}
 	}
-	if( x != quotechar )
-		return 1;
+
+	map->buf = NULL;
+	map->len = 0;
+	do {
+		if(map->len == size)
+			size *= 2;
+		tmp = realloc(map->buf, size);
+		if(!tmp)goto xml_map_fail;
+		map->buf = tmp;
+		n = fread(map->buf + map->len, 1, size - map->len, fptr);
+		map->len += n;
+	} while(map->len == size);
+	if(ferror(fptr))goto xml_map_fail;
+	fclose(fptr);
 	return 0;
+
+xml_map_fail:
+	free(map->buf);
+	fclose(fptr);
+	return -1;
 }
 
-static int feed_mask = 0;
-static int test_mask(const char x)
+static void xml_unmap(XMLMAP *map)
 {
-	return !(is_special(x) & feed_mask);
+	if(map->mapped)
+		munmap(map->buf, map->len);
+	else
+		free(map->buf);
 }
 
-/*
- * char* xml_feed(x, test)
- *
- * Reads as many contiguous chars that pass test() into a newly allocated
- * string.
- *
- * Instead of calling xml_read_byte and flogging realloc() for each byte,
- * it checks the buffer itself.
-*/
-static char* xml_feed( XMLBUF *xml, int (*test)(char) )
+int xml_sax_load(const char *filename, const XmlHandler *h, void *arg)
 {
-	int offset = xml->read_index;
-	int delta;
-	char *ret = NULL;
-	char *tmp = NULL;
-	int size = 0;
-
-	/* perform first and N middle realloc()'s */
-	while( test(xml->buf[offset]) )
-	{
-		offset ++;
+	XMLMAP map;
+	int ret;
 
-		if(offset >= xml->len)
-		{
-			delta = offset - xml->read_index;
-			tmp = realloc(ret, size + delta + 1);
-			if(!tmp)goto xml_feed_malloc;
-			ret = tmp;
-			memcpy(ret+size, xml->buf + xml->read_index, delta);
-			size += delta;
-			ret[size]=0;
-			if(xml->eof)return ret;
-			xml_read_file(xml);
-			xml->read_index = 0;
-			offset = 0;
-		}
-	}
-	/* perform final realloc() if needed */
-	if(offset > xml->read_index)
-	{
-		delta = offset - xml->read_index;
-		tmp = realloc(ret, size + delta + 1);
-		if(!tmp)goto xml_feed_malloc;
-		ret = tmp;
-		memcpy(ret+size, xml->buf + xml->read_index, delta);
-		xml->read_index = offset;
-		size += delta;
-		ret[size]=0;
-	}
+	if(xml_map(&map, filename))
+		return -1;
+	ret = xml_sax_buffer(map.buf, map.len, h, arg);
+	xml_unmap(&map);
 	return ret;
-xml_feed_malloc:
-	free(ret);
-	xml_end_file(xml);
-	return 0;
 }
 
-/* this reads attributes from tags, of the form...
- *
- * <tag attr1="some arguments" attr2=argument>
- *
- * It is aware of quotes, and will allow anything inside quoted arguments
- */
-static void xml_read_attr(struct XMLBUF *xml, XmlNode *node)
+
+/* Building the tree is just another user of the callbacks.
+ * this is where the next node goes, up is where to go back to once the
+ * current tag closes. */
+typedef struct XMLTREE
 {
-	int n=0;
-	char **tmp;
+	XmlNode * root;
+	XmlNode ** this;
+	XmlNode *** up;
+	int depth;
+	int up_size;
+} XMLTREE;
 
-	// how does this tag finish?
-	while(xml->len)
+/* Allocate a new XmlNode */
+static XmlNode* xml_new(char * name)
+{
+	XmlNode * ret = malloc(sizeof(XmlNode));
+	if(!ret)return NULL;
+
+	ret->attrib = NULL;
+	ret->nattrib = 0;
+	ret->child = ret->next = NULL;
+
+	ret->name = name;
+	return ret;
+}
+
+/* free a previously allocated XmlNode */
+void xml_free(XmlNode *target)
+{
+	int i;
+	XmlNode *next;
+
+	while(target)
 	{
-		if( is_special(xml_peek(xml)) & (XML_CLOSE | XML_SLASH) )
-			return;
-
-		n = ++node->nattrib;
-		tmp = realloc(node->attrib, n * 2 * sizeof(char*) );
-		if(!tmp)goto xml_read_attr_malloc;
-		node->attrib = tmp;
-		node->attrib[--n*2+1] = 0;
-		
-		feed_mask = XML_EQUALS | XML_SPACE | XML_CLOSE | XML_SLASH;
-		node->attrib[n*2] = xml_feed(xml, test_mask );
-		if( xml_peek(xml) == '=' )
-		{
-			xml_read_byte(xml);
-			if( is_special(xml_peek(xml)) & XML_QUOTE )
-			{
-				quotechar = xml_read_byte(xml);
-				node->attrib[n*2+1] = xml_feed(xml, test_quote);
-				xml_read_byte(xml);
-			}
-			else
-			{
-				feed_mask = XML_SPACE | XML_CLOSE | XML_SLASH;
-				node->attrib[n*2+1] = xml_feed(xml, test_mask);
-			}
-		}
-		xml_skip(xml, XML_SPACE);
+		for(i=0; i<target->nattrib*2; i++)
+			if(target->attrib[i])
+				free(target->attrib[i]);
+
+		if(target->attrib)free(target->attrib);
+		if(target->child)xml_free(target->child);
+		next = target->next;
+		free(target->name);
+		free(target);
+		target = next;
 	}
-	return;
-xml_read_attr_malloc:
-	xml_end_file(xml);
 }
 
-/* The big decision maker, is it a regular node, or a text node.
- * If it's a node, it will check if it should have children, and if so
- * will recurse over them.
- * Text nodes don't have children, so no recursing.
- */
-static XmlNode* xml_parse(struct XMLBUF *xml)
+/* A copy of a piece of the document; empty pieces are NULL */
+static int xml_dup(char **ret, const char *s, size_t len)
 {
-	int toff;
-	char **tmp;
-	char *stmp;
-	XmlNode **this, *ret = NULL;
+	*ret = NULL;
+	if(!s || !len)return 0;
+	*ret = malloc(len + 1);
+	if(!*ret)return -1;
+	memcpy(*ret, s, len);
+	(*ret)[len] = 0;
+	return 0;
+}
 
-	this = &ret;
+static XmlNode* xml_tree_add(XMLTREE *tree, char *name, int nattrib)
+{
+	XmlNode *node = xml_new(name);
 
-	xml_skip(xml, XML_SPACE);	// skip whitespace
-	while( (xml->read_index < xml->len) || !xml->eof )
+	if(!node)
 	{
-		switch(is_special(xml_peek(xml)))
-		{
-			case XML_OPEN:
-				xml_read_byte(xml);
-				if(xml_peek(xml) == '/')
-					return ret;		// parents close tag
-				// read the tag name
-				feed_mask = XML_SPACE | XML_SLASH | XML_CLOSE;
-				*this = xml_new( xml_feed(xml, test_mask));
-				if(xml->error)goto xml_parse_malloc;
-				xml_skip(xml, XML_SPACE);	// skip any whitespace
-
-				xml_read_attr(xml, *this);	// read attributes
-
-				// how does this tag finish?
-				switch(is_special(xml_peek(xml)))
-				{
-					case XML_CLOSE:		// child-nodes ahead
-						xml_read_byte(xml);
-						(*this)->child = xml_parse(xml);
-						xml_skip(xml, XML_ALL ^ XML_CLOSE);
-						xml_read_byte(xml);
-						break;
-					case XML_SLASH:		// self closing tag
-						xml_read_byte(xml);
-						xml_read_byte(xml);
-						break;
-				}
-				break;
-
-			default:	// text node
-				*this = xml_new(0);
-				xml_skip(xml, XML_SPACE);	// skip any whitespace
-				feed_mask = XML_OPEN;
-				(*this)->nattrib=1;
-				tmp = malloc(sizeof(char*)*2);
-				if(!tmp)goto xml_parse_malloc;
-				(*this)->attrib = tmp;
-				(*this)->attrib[1] = NULL;
-				stmp = (*this)->attrib[0] = xml_feed(xml, test_mask);
-
-				/* trim the whitespace off the end of text nodes,
-				 * by overwriting the spaces will null termination. */
-				toff = strlen(stmp)-1;
-				while( ( is_special(stmp[toff]) & XML_SPACE ) )
-				{
-					stmp[toff] = 0;
-					toff --;
-				}
-
-				break;
-		}
-		this = &(*this)->next;
-		xml_skip(xml, XML_SPACE);	// skip whitespace
+		free(name);
+		return NULL;
 	}
+	*tree->this = node;
+	tree->this = &node->next;
+	if(nattrib)
+	{
+		node->attrib = calloc(nattrib * 2, sizeof(char*));
+		if(!node->attrib)return NULL;
+		node->nattrib = nattrib;
+	}
+	return node;
+}
 
-	return ret;
-xml_parse_malloc:
-	xml_end_file(xml);
-	if(ret)xml_free(ret);
+static int xml_tree_open(void *arg, const char *name, size_t len, const XmlAttr *attr, int nattr)
+{
+	XMLTREE *tree = arg;
+	XmlNode *node;
+	char *tmp;
+	int i;
+
+	if( xml_grow(&tree->up, &tree->up_size, tree->depth + 1, sizeof(XmlNode**)) )
+		return -1;
+	if( xml_dup(&tmp, name, len) || !(node = xml_tree_add(tree, tmp, nattr)) )
+		return -1;
+	for(i=0; i<nattr; i++)
+		if( xml_dup(&node->attrib[i*2], attr[i].name, attr[i].namelen)
+		    || xml_dup(&node->attrib[i*2+1], attr[i].value, attr[i].valuelen) )
+			return -1;
+	tree->up[tree->depth++] = tree->this;
+	tree->this = &node->child;
 	return 0;
 }
 
-
-/* bootstrap the structures for xml_parse() to be able to get started */
-XmlNode* xml_load(const char * filename)
+static int xml_tree_close(void *arg, const char *name, size_t len)
 {
-	struct XMLBUF xml;
-	XmlNode *ret = NULL;
+	XMLTREE *tree = arg;
 
-//	printf("xml_load(\"%s\");\n", filename);
+	tree->this = tree->up[--tree->depth];
+	return 0;
+}
 
-	xml.error = 0;
-	xml.eof = 0;
-	xml.read_index = 0;
-	xml.fptr = fopen(filename, "rb");
-	if(!xml.fptr)
-		return NULL;
+/* If it's a text node, then name is NULL and attrib[0] is the text */
+static int xml_tree_text(void *arg, const char *text, size_t len)
+{
+	XMLTREE *tree = arg;
+	XmlNode *node;
+	char *tmp;
+
+	if( xml_dup(&tmp, text, len) )
+		return -1;
+	node = xml_tree_add(tree, NULL, 1);
+	if(!node)
+	{
+		free(tmp);
+		return -1;
+	}
+	node->attrib[0] = tmp;
+	return 0;
+}
 
-	xml.buf = malloc(BUFFER+1);
-	if(!xml.buf)
-		goto xml_load_fail_malloc_buf;
-	xml.buf[BUFFER]=0;
-	xml.len = BUFFER;
-	
-	xml_read_file(&xml);
+static const XmlHandler xml_tree_handler = {
+	xml_tree_open,
+	xml_tree_close,
+	xml_tree_text,
+};
 
-	ret = xml_parse(&xml);
+XmlNode* xml_load_buffer(const char *buf, size_t len)
+{
+	XMLTREE tree;
 
-	if(xml.error)
+	memset(&tree, 0, sizeof(tree));
+	tree.this = &tree.root;
+	if( xml_sax_buffer(buf, len, &xml_tree_handler, &tree) )
 	{
-		xml_free(ret);
-		ret = NULL;
+		if(tree.root)xml_free(tree.root);
+		tree.root = NULL;
 	}
+	free(tree.up);
+	return tree.root;
+}
+
+/* bootstrap the structures for xml_parse() to be able to get started */
+XmlNode* xml_load(const char * filename)
+{
+	XMLMAP map;
+	XmlNode *ret;
 
-	free(xml.buf);
-xml_load_fail_malloc_buf:
-	fclose(xml.fptr);
+	if(xml_map(&map, filename))
+		return NULL;
+	ret = xml_load_buffer(map.buf, map.len);
+	xml_unmap(&map);
 	return ret;
 }
 
@@ -393,16 +480,14 @@ xml_load_fail_malloc_buf:
 XmlNode * xml_find(XmlNode *xml, const char *name)
 {
 	XmlNode * ret;
-	if(xml->name)if(!strcmp(xml->name, name))return xml;
-	if(xml->child)
+	for(; xml; xml = xml->next)
 	{
-		ret = xml_find(xml->child, name);
-		if(ret)return ret;
-	}
-	if(xml->next)
-	{
-		ret = xml_find(xml->next, name);
-		if(ret)return ret;
+		if(xml->name)if(!strcmp(xml->name, name))return xml;
+		if(xml->child)
+		{
+			ret = xml_find(xml->child, name);
+			if(ret)return ret;
+		}
 	}
 	return NULL;
 }
@@ -418,4 +503,3 @@ char* xml_attr(XmlNode *x, const char *name)
 	return 0;
 }
 
-
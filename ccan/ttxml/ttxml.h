@@ -1,6 +1,8 @@
 #ifndef CCAN_TTXML_H
 #define CCAN_TTXML_H
 
+#include <stddef.h>
+
 /**
  * ttxml - tiny XML library for parsing (trusted!) XML documents.
  *
@@ -45,13 +47,44 @@ typedef struct XmlNode {
  * Each pair of char* points to the attribute name & the attribute value,
  * if present.
  *
- * If it's a text node, then name = "text", and attrib[1] = the body of text.
- * This is the only case where there will be an attribute with a null name.
+ * If it's a text node, then name is NULL, and attrib[0] = the body of text.
+ * An attribute without a value (or with an empty one) has a NULL value.
  */
 
 XmlNode* xml_load(const char * filename);
+/* The same, from a document already in memory; it need not be 0 terminated */
+XmlNode* xml_load_buffer(const char *buf, size_t len);
 void xml_free(XmlNode *target);
 char* xml_attr(XmlNode *x, const char *name);
 XmlNode * xml_find(XmlNode *xml, const char *name);
 
+
+/* To read a document without building the tree, hand the parser some
+ * callbacks. They see the same document the tree would hold, as pointers
+ * into it with a length: nothing is 0 terminated or copied, so it is only
+ * valid until the callback returns. Text has the whitespace around it
+ * dropped, and every open is matched by a close, even if the document
+ * forgets to.
+ */
+typedef struct XmlAttr {
+	const char * name;
+	size_t namelen;
+	const char * value;	/* NULL if the attribute has no value */
+	size_t valuelen;
+} XmlAttr;
+
+/* Any of these may be NULL. Returning non-zero stops the parse. */
+typedef struct XmlHandler {
+	int (*open)(void *arg, const char *name, size_t len,
+		    const XmlAttr *attr, int nattr);
+	int (*close)(void *arg, const char *name, size_t len);
+	int (*text)(void *arg, const char *text, size_t len);
+} XmlHandler;
+
+/* These return 0 once the whole document has been read, -1 if it could not
+ * be read, or whatever a callback returned to stop it. The file is mapped
+ * rather than read where possible. */
+int xml_sax_load(const char *filename, const XmlHandler *h, void *arg);
+int xml_sax_buffer(const char *buf, size_t len, const XmlHandler *h, void *arg);
+
 #endif /* CCAN_TTXML_H */
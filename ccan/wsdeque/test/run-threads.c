@@ -0,0 +1,82 @@
+#include <ccan/wsdeque/wsdeque.h>
+/* Include the C files directly. */
+#include <ccan/wsdeque/wsdeque.c>
+#include <ccan/tap/tap.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define NUM 100000
+
+/* Only OpenMP gives us the threads to race. */
+#ifdef _OPENMP
+struct elem {
+	unsigned int taken;
+};
+
+static struct elem elems[NUM];
+
+/* Thread 0 owns the deque: it pushes every element, popping one every
+ * @every pushes.  The other threads steal until it has finished.  Every
+ * element must be taken exactly once. */
+static bool steal_race(unsigned int every)
+{
+	WSDEQUE(struct elem) d;
+	unsigned int done = 0;
+	bool ok = true;
+	int t, i;
+
+	memset(elems, 0, sizeof(elems));
+	if (!wsdeque_init(&d))
+		return false;
+
+#pragma omp parallel for num_threads(NUM_THREADS) reduction(&&:ok)
+	for (t = 0; t < NUM_THREADS; t++) {
+		struct elem *e;
+
+		if (t == 0) {
+			for (i = 0; i < NUM; i++) {
+				if (!wsdeque_push(&d, &elems[i]))
+					ok = false;
+				if (i % every == 0) {
+					e = wsdeque_pop(&d);
+					if (e)
+						__atomic_add_fetch(&e->taken, 1,
+							__ATOMIC_RELAXED);
+				}
+			}
+			while ((e = wsdeque_pop(&d)) != NULL)
+				__atomic_add_fetch(&e->taken, 1,
+						   __ATOMIC_RELAXED);
+			__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+		} else {
+			while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+				e = wsdeque_steal(&d);
+				if (e)
+					__atomic_add_fetch(&e->taken, 1,
+							   __ATOMIC_RELAXED);
+			}
+		}
+	}
+	wsdeque_free(&d);
+
+	for (i = 0; i < NUM; i++)
+		if (elems[i].taken != 1)
+			ok = false;
+	return ok;
+}
+#endif /* _OPENMP */
+
+int main(void)
+{
+	plan_tests(3);
+
+#ifdef _OPENMP
+	ok1(steal_race(1));
+	ok1(steal_race(3));
+	ok1(steal_race(1000));
+#else
+	skip(3, "not compiled with OpenMP");
+#endif
+
+	return exit_status();
+}
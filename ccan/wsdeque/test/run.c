@@ -0,0 +1,56 @@
+#include <ccan/wsdeque/wsdeque.h>
+/* Include the C files directly. */
+#include <ccan/wsdeque/wsdeque.c>
+#include <ccan/tap/tap.h>
+
+#define NUM 1000
+
+struct elem {
+	int id;
+};
+
+int main(void)
+{
+	WSDEQUE(struct elem) d;
+	struct elem e[NUM];
+	int i;
+
+	/* This is how many tests you plan to run */
+	plan_tests(15);
+
+	for (i = 0; i < NUM; i++)
+		e[i].id = i;
+
+	ok1(wsdeque_init(&d));
+	ok1(wsdeque_size(&d) == 0);
+	ok1(wsdeque_pop(&d) == NULL);
+	ok1(wsdeque_steal(&d) == NULL);
+
+	/* The owner sees a stack... */
+	ok1(wsdeque_push(&d, &e[0]));
+	ok1(wsdeque_push(&d, &e[1]));
+	ok1(wsdeque_size(&d) == 2);
+	ok1(wsdeque_pop(&d) == &e[1]);
+	ok1(wsdeque_pop(&d) == &e[0]);
+	ok1(wsdeque_pop(&d) == NULL);
+
+	/* ...and thieves see a queue, across growing. */
+	for (i = 0; i < NUM; i++)
+		if (!wsdeque_push(&d, &e[i]))
+			break;
+	ok1(i == NUM);
+	ok1(wsdeque_size(&d) == NUM);
+	for (i = 0; i < NUM / 2; i++)
+		if (wsdeque_steal(&d) != &e[i])
+			break;
+	ok1(i == NUM / 2);
+	for (i = NUM - 1; i >= NUM / 2; i--)
+		if (wsdeque_pop(&d) != &e[i])
+			break;
+	ok1(i == NUM / 2 - 1);
+	ok1(wsdeque_steal(&d) == NULL);
+	wsdeque_free(&d);
+
+	/* This exits depending on whether all tests passed */
+	return exit_status();
+}
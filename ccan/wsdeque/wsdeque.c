@@ -0,0 +1,126 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#include <ccan/wsdeque/wsdeque.h>
+#include <stdlib.h>
+
+/*
+ * This follows "Correct and Efficient Work-Stealing for Weak Memory
+ * Models" (Le, Pop, Cohen and Zappa Nardelli, PPoPP 2013), which gives
+ * the C11 orderings for the deque of "Dynamic Circular Work-Stealing
+ * Deque" (Chase and Lev, SPAA 2005).
+ */
+#define WSDEQUE_MIN_SIZE 64
+
+static struct wsdeque_array_ *new_array(int64_t size)
+{
+	struct wsdeque_array_ *a;
+
+	a = malloc(sizeof(*a) + size * sizeof(a->elems[0]));
+	if (a) {
+		a->mask = size - 1;
+		a->prev = NULL;
+	}
+	return a;
+}
+
+bool wsdeque_init_(struct wsdeque_ *d)
+{
+	d->top = d->bottom = 0;
+	d->array = new_array(WSDEQUE_MIN_SIZE);
+	return d->array != NULL;
+}
+
+void wsdeque_free_(struct wsdeque_ *d)
+{
+	struct wsdeque_array_ *a, *prev;
+
+	for (a = d->array; a; a = prev) {
+		prev = a->prev;
+		free(a);
+	}
+	d->array = NULL;
+}
+
+/* Only the owner writes to the array, and only it replaces it. */
+static struct wsdeque_array_ *grow(struct wsdeque_ *d,
+				   struct wsdeque_array_ *a,
+				   int64_t t, int64_t b)
+{
+	struct wsdeque_array_ *bigger = new_array(2 * (a->mask + 1));
+	int64_t i;
+
+	if (!bigger)
+		return NULL;
+	for (i = t; i < b; i++)
+		bigger->elems[i & bigger->mask] = a->elems[i & a->mask];
+	bigger->prev = a;
+	__atomic_store_n(&d->array, bigger, __ATOMIC_RELEASE);
+	return bigger;
+}
+
+bool wsdeque_push_(struct wsdeque_ *d, void *e)
+{
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	struct wsdeque_array_ *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+
+	if (b - t > a->mask) {
+		a = grow(d, a, t, b);
+		if (!a)
+			return false;
+	}
+	__atomic_store_n(&a->elems[b & a->mask], e, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+void *wsdeque_pop_(struct wsdeque_ *d)
+{
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	struct wsdeque_array_ *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+	int64_t t;
+	void *e;
+
+	/* Claim the bottom element before looking at what thieves did. */
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if (t > b) {
+		/* Empty. */
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	e = __atomic_load_n(&a->elems[b & a->mask], __ATOMIC_RELAXED);
+	if (t == b) {
+		/* The last one: race thieves for it. */
+		if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+						 __ATOMIC_SEQ_CST,
+						 __ATOMIC_RELAXED))
+			e = NULL;
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return e;
+}
+
+void *wsdeque_steal_(struct wsdeque_ *d)
+{
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	int64_t b;
+	struct wsdeque_array_ *a;
+	void *e;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b)
+		return NULL;
+
+	/* The C11 paper uses consume here. */
+	a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+	e = __atomic_load_n(&a->elems[t & a->mask], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+					 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	return e;
+}
@@ -0,0 +1,163 @@
+/* Licensed under BSD-MIT - see LICENSE file for details */
+#ifndef CCAN_WSDEQUE_H
+#define CCAN_WSDEQUE_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ccan/tcon/tcon.h>
+
+/* The owner's end and the thieves' end are kept this far apart, so the
+ * owner doesn't share a cache line with them. */
+#define WSDEQUE_CACHELINE 64
+
+/**
+ * struct wsdeque_array_ - the circular array behind a deque (internal type)
+ * @mask: number of slots, minus one.
+ * @prev: the array this one replaced, kept until wsdeque_free().
+ * @elems: the slots.
+ */
+struct wsdeque_array_ {
+	int64_t mask;
+	struct wsdeque_array_ *prev;
+	void *elems[];
+};
+
+/**
+ * struct wsdeque_ - a work-stealing deque (internal type)
+ * @top: position of the oldest element, where thieves take from.
+ * @bottom: position after the newest element, where the owner works.
+ * @array: the current slots.
+ */
+struct wsdeque_ {
+	int64_t top __attribute__((aligned(WSDEQUE_CACHELINE)));
+	int64_t bottom __attribute__((aligned(WSDEQUE_CACHELINE)));
+	struct wsdeque_array_ *array;
+} __attribute__((aligned(WSDEQUE_CACHELINE)));
+
+/**
+ * WSDEQUE - declare a work-stealing deque
+ * @type: the type of elements in the deque
+ *
+ * The WSDEQUE macro declares a wsdeque, the Chase-Lev deque of pointers
+ * to @type for scheduling work between threads.  One thread owns it, and
+ * pushes and pops at one end like a stack; any other thread may steal
+ * the oldest element from the other end.  Neither end takes a lock, and
+ * the owner only needs a compare and swap when it's down to the last
+ * element.
+ *
+ * The deque grows as needed.  Arrays it has outgrown are kept until
+ * wsdeque_free(), since a thief may still be reading from one.
+ *
+ * Example:
+ *	struct job {
+ *		int id;
+ *	};
+ *	struct worker {
+ *		WSDEQUE(struct job) jobs;
+ *	};
+ */
+#define WSDEQUE(etype)							\
+	TCON_WRAP(struct wsdeque_, etype *canary)
+
+/**
+ * wsdeque_init - initialize a deque
+ * @d: the wsdeque
+ *
+ * Returns false if out of memory.
+ *
+ * Example:
+ *	struct job {
+ *		int id;
+ *	};
+ *	WSDEQUE(struct job) *dp = malloc(sizeof(*dp));
+ *	if (!wsdeque_init(dp))
+ *		abort();
+ */
+#define wsdeque_init(d_) \
+	wsdeque_init_(tcon_unwrap(d_))
+bool wsdeque_init_(struct wsdeque_ *d);
+
+/**
+ * wsdeque_free - free a deque
+ * @d: the wsdeque
+ *
+ * This does not free the elements.  No other thread may be using the
+ * deque.
+ *
+ * Example:
+ *	wsdeque_free(dp);
+ */
+#define wsdeque_free(d_) \
+	wsdeque_free_(tcon_unwrap(d_))
+void wsdeque_free_(struct wsdeque_ *d);
+
+/**
+ * wsdeque_push - add an element at the owner's end
+ * @d: the wsdeque
+ * @e: the element (not NULL)
+ *
+ * Only the owner may call this.  Returns false if the deque needed to
+ * grow and we ran out of memory.
+ *
+ * Example:
+ *	struct job j;
+ *	if (!wsdeque_push(dp, &j))
+ *		abort();
+ */
+#define wsdeque_push(d_, e_) \
+	wsdeque_push_(tcon_unwrap(tcon_check((d_), canary, (e_))), (e_))
+bool wsdeque_push_(struct wsdeque_ *d, void *e);
+
+/**
+ * wsdeque_pop - remove the newest element
+ * @d: the wsdeque
+ *
+ * Only the owner may call this.  Returns NULL if the deque is empty
+ * (including if a thief just took the last element).
+ *
+ * Example:
+ *	struct job *next;
+ *	while ((next = wsdeque_pop(dp)) != NULL)
+ *		printf("Job %i\n", next->id);
+ */
+#define wsdeque_pop(d_) \
+	tcon_cast((d_), canary, wsdeque_pop_(tcon_unwrap(d_)))
+void *wsdeque_pop_(struct wsdeque_ *d);
+
+/**
+ * wsdeque_steal - remove the oldest element
+ * @d: the wsdeque
+ *
+ * Any thread may call this.  Returns NULL if the deque is empty, or if
+ * another thread took the element first: a thief should generally move
+ * on to another deque rather than retry.
+ *
+ * Example:
+ *	struct job *stolen = wsdeque_steal(dp);
+ *	if (stolen)
+ *		printf("Stole job %i\n", stolen->id);
+ */
+#define wsdeque_steal(d_) \
+	tcon_cast((d_), canary, wsdeque_steal_(tcon_unwrap(d_)))
+void *wsdeque_steal_(struct wsdeque_ *d);
+
+/**
+ * wsdeque_size - roughly how many elements are in a deque?
+ * @d: the wsdeque
+ *
+ * With other threads using the deque, this may be out of date as soon
+ * as it returns.
+ */
+#define wsdeque_size(d_) \
+	wsdeque_size_(tcon_unwrap(d_))
+static inline size_t wsdeque_size_(const struct wsdeque_ *d)
+{
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	return b > t ? b - t : 0;
+}
+
+#endif /* CCAN_WSDEQUE_H */
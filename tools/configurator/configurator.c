@@ -380,6 +380,17 @@ static const struct test base_tests[] = {
 	  "	extern void *__start_mysec[], *__stop_mysec[];\n"
 	  "	return __stop_mysec - __start_mysec;\n"
 	  "}\n" },
+	{ "HAVE_SENDMMSG", "sendmmsg() and recvmmsg() in <sys/socket.h>",
+	  "DEFINES_FUNC", NULL, NULL,
+	  "#ifndef _GNU_SOURCE\n"
+	  "#define _GNU_SOURCE\n"
+	  "#endif\n"
+	  "#include <sys/socket.h>\n"
+	  "static int func(int fd, struct mmsghdr *msgs) {\n"
+	  "	if (sendmmsg(fd, msgs, 2, 0) < 0)\n"
+	  "		return -1;\n"
+	  "	return recvmmsg(fd, msgs, 2, MSG_WAITFORONE, 0);\n"
+	  "}\n" },
 	{ "HAVE_STACK_GROWS_UPWARDS", "stack grows upwards",
 	  "DEFINES_EVERYTHING|EXECUTE", NULL, NULL,
 	  "#include <stddef.h>\n"